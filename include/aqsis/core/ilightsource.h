@@ -16,6 +16,7 @@
 #include <aqsis/aqsis.h>
 
 #include <aqsis/core/interfacefwd.h>
+#include <aqsis/math/vector3d.h>
 
 namespace Aqsis {
 
@@ -47,6 +48,12 @@ public:
 	 * \param pPs the point being lit.
 	 */
 	virtual	void	Evaluate( IqShaderData* pPs, IqShaderData* pNs, IqSurface* pSurface ) = 0;
+	/** Determine whether the lightsource can affect a region of space.
+	 * \param vecMin Minimum corner of the region, in "current" space.
+	 * \param vecMax Maximum corner of the region, in "current" space.
+	 * \return false if the lightsource is known not to reach the region.
+	 */
+	virtual	bool	Influences( const CqVector3D& vecMin, const CqVector3D& vecMax ) = 0;
 	/** Get a pointer to the attributes associated with this lightsource.
 	 * \return a CqAttributes pointer.
 	 */
@@ -82,6 +82,31 @@ class CqGridDiff
 		template<typename T>
 		T diffV(const T* data, TqInt u, TqInt v) const;
 
+		/** \brief Compute the u-direction first differences for a whole grid row.
+		 *
+		 * The results are the same as calling diffU() for each point in the
+		 * row, but the stencil is chosen once per row rather than per point,
+		 * leaving simple loops over the interior of the row.
+		 *
+		 * \param data - grid holding the data
+		 * \param v - v index of the row
+		 * \param result - output array of length uRes()
+		 */
+		template<typename T>
+		void diffURow(const T* data, TqInt v, T* result) const;
+
+		/** \brief Compute the v-direction first differences for a whole grid row.
+		 *
+		 * \see diffURow
+		 */
+		template<typename T>
+		void diffVRow(const T* data, TqInt v, T* result) const;
+
+		/// Get the u-resolution of the grid.
+		TqInt uRes() const;
+		/// Get the v-resolution of the grid.
+		TqInt vRes() const;
+
 	private:
 		template<typename T>
 		static T diff(const T* data, bool useCentred, TqInt stride,
@@ -154,6 +179,89 @@ inline T CqGridDiff::diffV(const T* data, TqInt u, TqInt v) const
 				m_uRes, v, m_vRes);
 }
 
+template<typename T>
+void CqGridDiff::diffURow(const T* data, TqInt v, T* result) const
+{
+	assert(v >= 0 && v < m_vRes);
+	const TqInt n = m_uRes;
+	if(m_uDiffZero || n < 2)
+	{
+		for(TqInt u = 0; u < n; ++u)
+			result[u] = T(0.0f);
+		return;
+	}
+	const T* row = data + v*n;
+	// The stencils here are the same as those in diff().
+	if(m_useCentred && n > 2)
+	{
+		result[0] = -1.5*row[0] + 2*row[1] - 0.5*row[2];
+		for(TqInt u = 1; u < n-1; ++u)
+			result[u] = 0.5*(row[u+1] - row[u-1]);
+		result[n-1] = 1.5*row[n-1] - 2*row[n-2] + 0.5*row[n-3];
+	}
+	else
+	{
+		for(TqInt u = 0; u < n-1; ++u)
+			result[u] = 0.5*(row[u+1] - row[u]);
+		result[n-1] = 0.5*(row[n-1] - row[n-2]);
+	}
+}
+
+template<typename T>
+void CqGridDiff::diffVRow(const T* data, TqInt v, T* result) const
+{
+	assert(v >= 0 && v < m_vRes);
+	const TqInt n = m_uRes;
+	if(m_vDiffZero || m_vRes < 2)
+	{
+		for(TqInt u = 0; u < n; ++u)
+			result[u] = T(0.0f);
+		return;
+	}
+	const T* row = data + v*n;
+	if(m_useCentred && m_vRes > 2)
+	{
+		if(v == 0)
+		{
+			for(TqInt u = 0; u < n; ++u)
+				result[u] = -1.5*row[u] + 2*row[u+n] - 0.5*row[u+2*n];
+		}
+		else if(v == m_vRes-1)
+		{
+			for(TqInt u = 0; u < n; ++u)
+				result[u] = 1.5*row[u] - 2*row[u-n] + 0.5*row[u-2*n];
+		}
+		else
+		{
+			for(TqInt u = 0; u < n; ++u)
+				result[u] = 0.5*(row[u+n] - row[u-n]);
+		}
+	}
+	else
+	{
+		if(v == m_vRes-1)
+		{
+			for(TqInt u = 0; u < n; ++u)
+				result[u] = 0.5*(row[u] - row[u-n]);
+		}
+		else
+		{
+			for(TqInt u = 0; u < n; ++u)
+				result[u] = 0.5*(row[u+n] - row[u]);
+		}
+	}
+}
+
+inline TqInt CqGridDiff::uRes() const
+{
+	return m_uRes;
+}
+
+inline TqInt CqGridDiff::vRes() const
+{
+	return m_vRes;
+}
+
 /** Compute the first difference on a grid; general strided version
  *
  * \param data - array of values from which to compute the differences
@@ -78,6 +78,15 @@ class AQSIS_MATH_SHARE CqNoise
 		static	CqColor	CGNoise4( const CqVector3D& v, TqFloat t );
 		static	CqColor	CGPNoise4( const CqVector3D& v, TqFloat t, const CqVector3D& pv, TqFloat pt );
 
+		// Versions of the 3D noise functions which evaluate noise at count
+		// points in one call.  These give the same results as the single point
+		// versions but are considerably faster for whole shading grids.
+
+		static	void	FGNoise3( const CqVector3D* v, TqFloat* result, TqInt count );
+		static	void	FGPNoise3( const CqVector3D* v, const CqVector3D& pv, TqFloat* result, TqInt count );
+		static	void	PGNoise3( const CqVector3D* v, CqVector3D* result, TqInt count );
+		static	void	PGPNoise3( const CqVector3D* v, const CqVector3D& pv, CqVector3D* result, TqInt count );
+
 };
 
 //-----------------------------------------------------------------------
@@ -64,7 +64,24 @@ class AQSIS_MATH_SHARE CqNoise1234
 		static TqFloat pnoise( TqFloat x, TqFloat y, TqFloat z, TqFloat w,
 		                                    TqInt px, TqInt py, TqInt pz, TqInt pw );
 
+		/** 3D float Perlin noise and periodic noise for arrays of points.
+		 *
+		 * These give the same results as calling the single point versions
+		 * for each of the count points in turn, but work on several points
+		 * at once so that the compiler can vectorise most of the work.
+		 */
+		static void noise( const TqFloat* x, const TqFloat* y, const TqFloat* z,
+		                   TqFloat* result, TqInt count );
+		static void pnoise( const TqFloat* x, const TqFloat* y, const TqFloat* z,
+		                    TqInt px, TqInt py, TqInt pz, TqFloat* result, TqInt count );
+
 	private:
+		/// Number of points handled together by the array versions.
+		static const TqInt blockSize = 8;
+		static void noiseBlock( const TqFloat* x, const TqFloat* y, const TqFloat* z,
+		                        bool periodic, TqInt px, TqInt py, TqInt pz,
+		                        TqFloat* result, TqInt count );
+
 		static unsigned char perm[];
 		static TqFloat  grad( TqInt hash, TqFloat x );
 		static TqFloat  grad( TqInt hash, TqFloat x, TqFloat y );
@@ -187,6 +187,21 @@ AQSIS_SHADERVM_SHARE boost::shared_ptr<IqShader> createShaderVM(IqRenderer* rend
  */
 AQSIS_SHADERVM_SHARE void shutdownShaderVM();
 
+/** \brief Turn profiling of shader execution on or off.
+ *
+ * While profiling is on, the time spent in each instruction of every shader
+ * is recorded, along with the number of grid points it ran on.  Turning
+ * profiling on discards any results gathered so far.
+ */
+AQSIS_SHADERVM_SHARE void setShaderProfiling(bool enabled);
+
+/** \brief Print the shader profile gathered since profiling was turned on.
+ *
+ * The results are printed as tables of the shaders, source lines and opcodes
+ * ranked by the time spent in them.
+ */
+AQSIS_SHADERVM_SHARE void printShaderProfile(std::ostream& out);
+
 //@}
 
 } // namespace Aqsis
@@ -50,7 +50,10 @@ class AQSIS_SLCOMP_SHARE IqCodeGen
 //-----------------------------------------------------------------------
 /// Version number for the virtual machine stack code produced by the
 /// CqCodeGenVM code generator.
-#define AQSIS_SLX_VERSION 2
+#define AQSIS_SLX_VERSION 3
+/// Oldest version of the stack code which the virtual machine can still load.
+/// Version 2 code only lacks the source line markers used for profiling.
+#define AQSIS_SLX_OLDEST_VERSION 2
 
 /** \brief Compiler backend to output VM code.
  */
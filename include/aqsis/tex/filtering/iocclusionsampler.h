@@ -66,6 +66,24 @@ class AQSIS_TEX_SHARE IqOcclusionSampler
 				const CqVector3D& normal, const CqShadowSampleOptions& sampleOpts,
 				TqFloat* outSamps) const = 0;
 
+		/** \brief Sample the occlusion over all the regions in a grid.
+		 *
+		 * Batching the lookups for a whole grid lets implementations share
+		 * work between neighbouring points, for instance by rejecting
+		 * directions which can't contribute to any point in the grid.  The
+		 * default implementation calls sample() for each point.
+		 *
+		 * \param regions - array of numPoints regions to sample over
+		 * \param normals - array of numPoints surface normals
+		 * \param numPoints - number of points in the grid
+		 * \param sampleOpts - options to the sampler, used for all points.
+		 * \param outSamps - the outSamps samples for each point will be
+		 *                   placed here, one after the other.
+		 */
+		virtual void sampleGrid(const Sq3DSamplePllgram* regions,
+				const CqVector3D* normals, TqInt numPoints,
+				const CqShadowSampleOptions& sampleOpts, TqFloat* outSamps) const;
+
 		/** \brief Get the default sample options for this texture.
 		 *
 		 * The default implementation returns texture sample options
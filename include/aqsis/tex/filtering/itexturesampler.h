@@ -51,6 +51,46 @@ class IqTiledTexInputFile;
 class IqMultiTexInputFile;
 class CqTexFileHeader;
 
+//------------------------------------------------------------------------------
+/** \brief Sample regions and varying options for a grid of texture lookups.
+ *
+ * Each quantity is held in a separate array with one entry per sample point,
+ * matching the layout of varying data in the shading system.  The sample
+ * region for point i is the parallelogram with center (cs[i], ct[i]) and
+ * sides (s1s[i], s1t[i]) and (s2s[i], s2t[i]); see SqSamplePllgram.
+ *
+ * The arrays of varying options may be null, in which case the value from
+ * the uniform sample options is used for every point.
+ */
+struct SqSampleGrid
+{
+	/// Number of sample points.
+	TqInt numPoints;
+	/// Parallelogram centers.
+	const TqFloat* cs;
+	const TqFloat* ct;
+	/// First sides of the parallelograms.
+	const TqFloat* s1s;
+	const TqFloat* s1t;
+	/// Second sides of the parallelograms.
+	const TqFloat* s2s;
+	const TqFloat* s2t;
+	/// Varying blur in the s and t directions, or null.
+	const TqFloat* sBlur;
+	const TqFloat* tBlur;
+	/// Varying start channel, or null.
+	const TqFloat* startChannel;
+
+	/// Construct a grid with all array pointers null.
+	SqSampleGrid(TqInt numPoints = 0);
+
+	/// Get the sample region for a point.
+	SqSamplePllgram pllgram(TqInt i) const;
+	/// Set the varying options for a point in opts.
+	void varyingOptions(TqInt i, CqTextureSampleOptions& opts) const;
+};
+
+
 //------------------------------------------------------------------------------
 /** \brief An interface for sampling texture buffers.
  *
@@ -91,6 +131,21 @@ class AQSIS_TEX_SHARE IqTextureSampler
 		virtual void sample(const SqSamplePllgram& samplePllgram,
 				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const = 0;
 
+		/** \brief Filter the texture over all the regions in a grid.
+		 *
+		 * Batching the lookups for a whole grid lets implementations share
+		 * the setup work between points and visit the texture data in a
+		 * cache friendly order.  The default implementation calls sample()
+		 * for each point in turn.
+		 *
+		 * \param grid - sample regions and varying options for each point.
+		 * \param sampleOpts - options shared by all points.
+		 * \param outSamps - results for point i are placed at
+		 *                   outSamps[i*sampleOpts.numChannels()].
+		 */
+		virtual void sampleGrid(const SqSampleGrid& grid,
+				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const;
+
 		/** \brief Get the default sample options for this texture.
 		 *
 		 * The default implementation returns texture sample options
@@ -125,6 +180,40 @@ class AQSIS_TEX_SHARE IqTextureSampler
 		virtual ~IqTextureSampler() {}
 };
 
+
+//==============================================================================
+// Implementation details
+//==============================================================================
+// SqSampleGrid implementation
+inline SqSampleGrid::SqSampleGrid(TqInt numPoints)
+	: numPoints(numPoints),
+	cs(0),
+	ct(0),
+	s1s(0),
+	s1t(0),
+	s2s(0),
+	s2t(0),
+	sBlur(0),
+	tBlur(0),
+	startChannel(0)
+{ }
+
+inline SqSamplePllgram SqSampleGrid::pllgram(TqInt i) const
+{
+	return SqSamplePllgram(CqVector2D(cs[i], ct[i]), CqVector2D(s1s[i], s1t[i]),
+			CqVector2D(s2s[i], s2t[i]));
+}
+
+inline void SqSampleGrid::varyingOptions(TqInt i, CqTextureSampleOptions& opts) const
+{
+	if(sBlur)
+		opts.setSBlur(sBlur[i]);
+	if(tBlur)
+		opts.setTBlur(tBlur[i]);
+	if(startChannel)
+		opts.setStartChannel(static_cast<TqInt>(startChannel[i]));
+}
+
 } // namespace Aqsis
 
 #endif // ITEXTURESAMPLER_H_INCLUDED
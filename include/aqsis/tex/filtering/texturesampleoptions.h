@@ -67,6 +67,7 @@ enum EqTextureFilter
 	TextureFilter_Box,		///< box filtering
 	TextureFilter_Gaussian, ///< gaussian filter (via EWA)
 	TextureFilter_None,		///< no filtering; nearest-neighbour reconstruction.
+	TextureFilter_Bilinear,	///< gaussian, with bilinear lookups for small footprints.
 	TextureFilter_Unknown	///< Unknown filter type.
 };
 
@@ -74,6 +75,7 @@ AQSIS_ENUM_INFO_BEGIN(EqTextureFilter, TextureFilter_Unknown)
 	"box",
 	"gaussian",
 	"none",
+	"bilinear",
 	"unknown"
 AQSIS_ENUM_INFO_END
 
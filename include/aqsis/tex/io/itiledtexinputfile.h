@@ -172,6 +172,14 @@ class AQSIS_TEX_SHARE IqTiledTexInputFile
 		 */
 		static boost::shared_ptr<IqTiledTexInputFile> openAny(const boostfs::path& fileName);
 
+		/** \brief Get the number of bytes of tile data read by the calling thread.
+		 *
+		 * This is a running total over all tiled files, so the texture I/O
+		 * done for a piece of work may be found from the difference in the
+		 * total before and after.
+		 */
+		static TqUlong threadBytesRead();
+
 	protected:
 		/** \brief Low-level readTile() function to be overridden by child classes
 		 *
@@ -189,6 +197,10 @@ class AQSIS_TEX_SHARE IqTiledTexInputFile
 		 */
 		virtual void readTileImpl(TqUint8* buffer, TqInt tileX, TqInt tileY,
 				TqInt subImageIdx, const SqTileInfo tileSize) const = 0;
+
+	private:
+		/// Add to the total returned by threadBytesRead()
+		static void addThreadBytesRead(TqUlong bytes);
 };
 
 
@@ -211,6 +223,8 @@ void IqTiledTexInputFile::readTile(ArrayT& buffer, TqInt tileX, TqInt tileY,
 	assert(subImageIdx < numSubImages());
 	buffer.resize(tInfo.width, tInfo.height, header().channelList());
 	readTileImpl(buffer.rawData(), tileX, tileY, subImageIdx, tInfo);
+	addThreadBytesRead(static_cast<TqUlong>(tInfo.width)*tInfo.height
+			*header().channelList().bytesPerPixel());
 }
 
 } // namespace Aqsis
@@ -20,7 +20,8 @@
 
 /** \file
 		\brief A simple, efficient object pool based on code from Stroustrups
-		"The C++ Programming Language - Third Edition"
+		"The C++ Programming Language - Third Edition", extended with per-thread
+		free lists so that it can be used from several threads at once.
 */
 
 //? Is .h included already?
@@ -29,10 +30,103 @@
 
 #include	<aqsis/aqsis.h>
 
+#include	<algorithm>
+#include	<vector>
+
+#include	<boost/thread/mutex.hpp>
+
 namespace Aqsis {
 
+//------------------------------------------------------------------------------
+/** \brief Base class allowing all object pools to be managed together.
+ */
+class CqObjectPoolBase
+{
+	public:
+		/** \brief Return the elements cached by the calling thread to their pools.
+		 *
+		 * This should be called when a thread has finished a unit of work (eg,
+		 * a bucket), so that the elements it freed can be reused by other
+		 * threads.  The memory itself is kept by the pools for reuse.
+		 */
+		static void releaseThreadCaches()
+		{
+			boost::mutex::scoped_lock lock(registryMutex());
+			std::vector<CqObjectPoolBase*>& pools = registry();
+			for(std::vector<CqObjectPoolBase*>::iterator i = pools.begin(); i != pools.end(); ++i)
+				(*i)->releaseThreadCache();
+		}
+
+		/** \brief Free the memory of every pool with no elements in use.
+		 *
+		 * This releases the calling thread's cached elements first.  It
+		 * should be called at a coarse point where the pooled objects are
+		 * expected to be gone (eg, when a frame has been rendered), since
+		 * the memory has to be allocated again if the pools are used later.
+		 */
+		static void releaseUnusedMemory()
+		{
+			boost::mutex::scoped_lock lock(registryMutex());
+			std::vector<CqObjectPoolBase*>& pools = registry();
+			for(std::vector<CqObjectPoolBase*>::iterator i = pools.begin(); i != pools.end(); ++i)
+			{
+				(*i)->releaseThreadCache();
+				(*i)->releaseIfUnused();
+			}
+		}
+
+	protected:
+		CqObjectPoolBase()
+		{
+			boost::mutex::scoped_lock lock(registryMutex());
+			registry().push_back(this);
+		}
+		virtual ~CqObjectPoolBase()
+		{
+			boost::mutex::scoped_lock lock(registryMutex());
+			std::vector<CqObjectPoolBase*>& pools = registry();
+			pools.erase(std::remove(pools.begin(), pools.end(), this), pools.end());
+		}
+
+		/// Return the calling thread's cached elements to the pool.
+		virtual void releaseThreadCache() = 0;
+		/// Free the pool's chunks if all its elements are back in the depot.
+		virtual void releaseIfUnused() = 0;
+
+	private:
+		static std::vector<CqObjectPoolBase*>& registry()
+		{
+			static std::vector<CqObjectPoolBase*> pools;
+			return pools;
+		}
+		static boost::mutex& registryMutex()
+		{
+			static boost::mutex mutex;
+			return mutex;
+		}
+};
+
+
+//------------------------------------------------------------------------------
+/** \brief Pool allocator for objects of a single type.
+ *
+ * Elements are carved out of chunks of CS kB.  Each thread allocates from and
+ * frees to its own list of free elements without locking.  When a thread runs
+ * out, it takes a batch of elements from a shared depot (or allocates a new
+ * chunk), and when its list grows too long it returns a batch to the depot,
+ * so the lock is only taken once per batch.
+ *
+ * A thread which is finished with the pool for a while should call
+ * CqObjectPoolBase::releaseThreadCaches().  Chunks are kept from one bucket
+ * to the next rather than allocated afresh each time, and are only freed by
+ * CqObjectPoolBase::releaseUnusedMemory() once every element is back in the
+ * depot, or when the pool is destroyed.
+ *
+ * Each thread may only have one pool of a given type active at a time, which
+ * is the case for the usual static pool per class.
+ */
 template <class T, TqInt CS=8>
-class /*AQSIS_UTIL_SHARE*/ CqObjectPool
+class /*AQSIS_UTIL_SHARE*/ CqObjectPool : public CqObjectPoolBase
 {
 		struct SqLink
 		{
@@ -44,10 +138,51 @@ class /*AQSIS_UTIL_SHARE*/ CqObjectPool
 			SqChunk* m_next;
 			char m_mem[size];
 		};
+		/// A linked list of free elements.
+		struct SqFreeList
+		{
+			SqLink* m_head;
+			TqInt m_count;
+			SqFreeList() : m_head(0), m_count(0) {}
+		};
+		/// The free elements held by a single thread.
+		struct SqThreadCache : SqFreeList
+		{
+			CqObjectPool* m_pool;
+			SqThreadCache() : m_pool(0) {}
+			~SqThreadCache()
+			{
+				if(m_pool)
+					m_pool->flush(*this);
+			}
+		};
+
 		SqChunk* m_chunks;
 
 		const unsigned int m_esize;
-		SqLink* m_head;
+		/// Number of elements in a chunk, and in a batch moved to or from the depot.
+		const TqInt m_batchSize;
+		/// Batches of free elements shared between threads.
+		std::vector<SqFreeList> m_depot;
+		/// Number of elements in the depot.
+		TqInt m_depotCount;
+		/// Total number of elements in all chunks.
+		TqInt m_numElems;
+		boost::mutex m_mutex;
+
+		static SqThreadCache& threadCache()
+		{
+			static thread_local SqThreadCache cache;
+			return cache;
+		}
+
+		/// Make this the pool that the thread's cache belongs to.
+		void bind(SqThreadCache& cache)
+		{
+			if(cache.m_pool)
+				cache.m_pool->flush(cache);
+			cache.m_pool = this;
+		}
 
 		void grow()	// Allocate new 'chunk', organize it as a linked list of elements of size 'm_esize'
 		{
@@ -55,24 +190,65 @@ class /*AQSIS_UTIL_SHARE*/ CqObjectPool
 			n->m_next = m_chunks;
 			m_chunks = n;
 
-			const int nelem = SqChunk::size/m_esize;
+			const int nelem = m_batchSize;
 			char* start = n->m_mem;
 			char* last = &start[(nelem-1)*m_esize];
 			for (char* p = start; p<last; p+=m_esize)	// assume sizeof(SqLink)<=m_esize
 				reinterpret_cast<SqLink*>(p)->m_next = reinterpret_cast<SqLink*>(p+m_esize);
 			reinterpret_cast<SqLink*>(last)->m_next = 0;
-			m_head = reinterpret_cast<SqLink*>(start);
+			SqFreeList batch;
+			batch.m_head = reinterpret_cast<SqLink*>(start);
+			batch.m_count = nelem;
+			m_depot.push_back(batch);
+			m_depotCount += nelem;
+			m_numElems += nelem;
 		}
 
-	public:
-		CqObjectPool()
-				: m_esize(sizeof(T)<sizeof(SqLink*)?sizeof(SqLink*):sizeof(T))
+		/// Fill an empty thread cache with a batch from the depot.
+		void refill(SqThreadCache& cache)
 		{
-			m_head = 0;
-			m_chunks = 0;
+			boost::mutex::scoped_lock lock(m_mutex);
+			if(m_depot.empty())
+				grow();
+			SqFreeList& batch = m_depot.back();
+			cache.m_head = batch.m_head;
+			cache.m_count = batch.m_count;
+			m_depotCount -= batch.m_count;
+			m_depot.pop_back();
 		}
 
-		~CqObjectPool() // free all chunks
+		/// Move a batch of elements from a thread cache to the depot.
+		void spill(SqThreadCache& cache)
+		{
+			SqFreeList batch;
+			batch.m_head = cache.m_head;
+			batch.m_count = m_batchSize;
+			SqLink* last = cache.m_head;
+			for(TqInt i = 1; i < m_batchSize; ++i)
+				last = last->m_next;
+			cache.m_head = last->m_next;
+			cache.m_count -= m_batchSize;
+			last->m_next = 0;
+
+			boost::mutex::scoped_lock lock(m_mutex);
+			m_depot.push_back(batch);
+			m_depotCount += batch.m_count;
+		}
+
+		/// Move all elements from a thread cache to the depot.
+		void flush(SqThreadCache& cache)
+		{
+			if(cache.m_head)
+			{
+				boost::mutex::scoped_lock lock(m_mutex);
+				m_depot.push_back(cache);
+				m_depotCount += cache.m_count;
+			}
+			cache.m_head = 0;
+			cache.m_count = 0;
+		}
+
+		void freeChunks()
 		{
 			SqChunk* n = m_chunks;
 			while(n)
@@ -81,6 +257,47 @@ class /*AQSIS_UTIL_SHARE*/ CqObjectPool
 				n = n->m_next;
 				delete(p);
 			}
+			m_chunks = 0;
+			m_depot.clear();
+			m_depotCount = 0;
+			m_numElems = 0;
+		}
+
+	protected:
+		virtual void releaseThreadCache()
+		{
+			SqThreadCache& cache = threadCache();
+			if(cache.m_pool == this)
+				flush(cache);
+		}
+		virtual void releaseIfUnused()
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+			if(m_depotCount == m_numElems)
+				freeChunks();
+		}
+
+	public:
+		CqObjectPool()
+				: m_chunks(0),
+				m_esize(sizeof(T)<sizeof(SqLink*)?sizeof(SqLink*):sizeof(T)),
+				m_batchSize(SqChunk::size/m_esize),
+				m_depot(),
+				m_depotCount(0),
+				m_numElems(0),
+				m_mutex()
+		{ }
+
+		~CqObjectPool() // free all chunks
+		{
+			SqThreadCache& cache = threadCache();
+			if(cache.m_pool == this)
+			{
+				cache.m_head = 0;
+				cache.m_count = 0;
+				cache.m_pool = 0;
+			}
+			freeChunks();
 		}
 
 		// The following is a workaround for a bug which arises when using
@@ -107,18 +324,29 @@ class /*AQSIS_UTIL_SHARE*/ CqObjectPool
 #		endif
 		void* alloc()
 		{
-			if (m_head==0)
-				grow();
-			SqLink* p = m_head;
-			m_head = p->m_next;
+			SqThreadCache& cache = threadCache();
+			if (cache.m_pool != this)
+				bind(cache);
+			if (cache.m_head==0)
+				refill(cache);
+			SqLink* p = cache.m_head;
+			cache.m_head = p->m_next;
+			--cache.m_count;
 			return(p);
 		}
 
 		void free(void* b)
 		{
+			SqThreadCache& cache = threadCache();
+			if (cache.m_pool != this)
+				bind(cache);
 			SqLink* p = static_cast<SqLink*>(b);
-			p->m_next = m_head;
-			m_head = p;
+			p->m_next = cache.m_head;
+			cache.m_head = p;
+			// Keep one batch in hand when returning the rest, so that
+			// alternating allocs and frees don't bounce on the depot.
+			if (++cache.m_count >= 2*m_batchSize)
+				spill(cache);
 		}
 
 };
@@ -40,6 +40,7 @@
 #include <vector>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 #include <boost/timer/timer.hpp>
 
 namespace Aqsis {
@@ -54,6 +55,9 @@ namespace Aqsis {
  * Support for other types of statistics is easily possible (such as miniumum
  * and maximum times out of the samples, or even an entire histogram) but these
  * should only be added if needed in the future.
+ *
+ * Times are measured as wall clock time in seconds; the process CPU time
+ * would include the work of every other thread running at the same time.
  */
 class CqTimer
 {
@@ -71,6 +75,8 @@ class CqTimer
 		double averageTime() const;
 		/// Return total number of timing samples recorded.
 		long numSamples() const;
+		/// Add the total time and samples of another timer to this one.
+		CqTimer& operator+=(const CqTimer& other);
 
 	private:
 		double m_totalTime;    ///< total time
@@ -86,6 +92,11 @@ class CqTimer
  * of the timer classes.  Dumping the timer results to a stream in text format
  * is supported via the printTimes() function.
  *
+ * Each thread gets its own copy of every timer, so timers may be started and
+ * stopped from many threads at once without locking.  printTimes() reports
+ * the sum over all threads, so should be called while no other thread is
+ * using the set.  Each thread is expected to use a single timer set.
+ *
  * EnumClassT is a "class enum" specifying enum label identifiers for the
  * individual timers held by CqTimerSet:
  *
@@ -107,9 +118,12 @@ class CqTimerSet
 		// Set up EnumClassT::size timers.
 		CqTimerSet();
 
-		/// Get a timer by name, or create a new one if it doesn't exist.
+		/// Get the calling thread's timer by name.
 		CqTimer& getTimer(typename EnumClassT::Enum id);
 
+		/// Get the sum of a timer over all threads.
+		CqTimer totalTimer(typename EnumClassT::Enum id) const;
+
 		/// Dump timing results to the given stream
 		void printTimes(std::ostream& ostr) const;
 
@@ -118,8 +132,13 @@ class CqTimerSet
 		static std::string timeToString(double time);
 
 		struct SqTimeSort;
-		typedef std::vector<boost::shared_ptr<CqTimer> > TqTimerVec;
-		TqTimerVec m_timers;
+		typedef std::vector<CqTimer> TqTimerVec;
+		/// Get the timers belonging to the calling thread.
+		TqTimerVec& threadTimers();
+
+		/// Timers for each thread which has used the set.
+		std::vector<boost::shared_ptr<TqTimerVec> > m_threadTimers;
+		mutable boost::mutex m_mutex;
 };
 
 
@@ -165,7 +184,7 @@ inline void CqTimer::start()
 
 inline void CqTimer::stop()
 {
-	m_totalTime += m_timer.elapsed().user;
+	m_totalTime += m_timer.elapsed().wall*1e-9;
 	++m_numSamples;
 }
 
@@ -187,21 +206,56 @@ inline long CqTimer::numSamples() const
 	return m_numSamples;
 }
 
+inline CqTimer& CqTimer::operator+=(const CqTimer& other)
+{
+	m_totalTime += other.m_totalTime;
+	m_numSamples += other.m_numSamples;
+	return *this;
+}
+
 
 //------------------------------------------------------------------------------
 // CqTimerSet implementation
 template<typename EnumClassT>
 inline CqTimerSet<EnumClassT>::CqTimerSet()
-	: m_timers(EnumClassT::size)
+	: m_threadTimers(),
+	m_mutex()
+{ }
+
+template<typename EnumClassT>
+inline CqTimer& CqTimerSet<EnumClassT>::getTimer(typename EnumClassT::Enum id)
 {
-	for(int i = 0; i < EnumClassT::size; ++i)
-		m_timers[i].reset(new CqTimer());
+	return threadTimers()[id];
 }
 
 template<typename EnumClassT>
-inline CqTimer& CqTimerSet<EnumClassT>::getTimer(typename EnumClassT::Enum id)
+typename CqTimerSet<EnumClassT>::TqTimerVec& CqTimerSet<EnumClassT>::threadTimers()
 {
-	return *m_timers[id];
+	struct SqCache
+	{
+		const CqTimerSet* set;
+		TqTimerVec* timers;
+	};
+	static thread_local SqCache cache = {0, 0};
+	if(cache.set != this)
+	{
+		boost::shared_ptr<TqTimerVec> timers(new TqTimerVec(EnumClassT::size));
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_threadTimers.push_back(timers);
+		cache.set = this;
+		cache.timers = timers.get();
+	}
+	return *cache.timers;
+}
+
+template<typename EnumClassT>
+CqTimer CqTimerSet<EnumClassT>::totalTimer(typename EnumClassT::Enum id) const
+{
+	CqTimer total;
+	boost::mutex::scoped_lock lock(m_mutex);
+	for(int t = 0, numThreads = m_threadTimers.size(); t < numThreads; ++t)
+		total += (*m_threadTimers[t])[id];
+	return total;
 }
 
 /// Functor for sorting times in decreasing order.
@@ -225,12 +279,18 @@ void CqTimerSet<EnumClassT>::printTimes(std::ostream& ostr) const
 	ostr << "Timings" << tStr << "\n";
 	ostr << std::setw(65) << std::setfill('-') << "-\n";
 
+	// Add up the timers from each thread
+	TqTimerVec totals;
+	totals.reserve(EnumClassT::size);
+	for(int i = 0; i < EnumClassT::size; ++i)
+		totals.push_back(totalTimer(static_cast<typename EnumClassT::Enum>(i)));
+
 	// Sort the timers first
 	std::vector<std::pair<typename EnumClassT::Enum, const CqTimer*> > sorted;
-	for(int i = 0, end = m_timers.size(); i < end; ++i)
+	for(int i = 0; i < EnumClassT::size; ++i)
 	{
 		sorted.push_back(std::make_pair(
-			static_cast<typename EnumClassT::Enum>(i), m_timers[i].get()));
+			static_cast<typename EnumClassT::Enum>(i), &totals[i]));
 	}
 	std::sort(sorted.begin(), sorted.end(), SqTimeSort());
 
@@ -35,6 +35,7 @@
 #include	<boost/filesystem/fstream.hpp>
 
 #include	"imagebuffer.h"
+#include	"imagepixel.h"
 #include	"lights.h"
 #include	"renderer.h"
 #include	"patch.h"
@@ -99,6 +100,12 @@ namespace Aqsis {
 static RtBoolean ProcessPrimitiveVariables(CqSurface * pSurface,
 										   const Ri::ParamList& pList);
 RtVoid	CreateGPrim( const boost::shared_ptr<CqSurface>& pSurface );
+static bool isMultipass();
+static bool subdivisionMeshKey( CqTessellationKey& key,
+		const Ri::IntArray& nvertices, const Ri::IntArray& vertices,
+		const Ri::TokenArray& tags, const Ri::IntArray& nargs,
+		const Ri::IntArray& intargs, const Ri::FloatArray& floatargs,
+		const Ri::ParamList& pList, const CqMatrix& matOtoW );
 
 
 //------------------------------------------------------------------------------
@@ -657,6 +664,9 @@ RtVoid RiCxxCore::WorldBegin()
 	QGetRenderContext()->initialiseCropWindow();
 	QGetRenderContext()->pImage()->SetImage();
 
+	const TqInt* tessCacheLimit = QGetRenderContext()->poptCurrent()->GetIntegerOption( "limits", "tessellationcache" );
+	QGetRenderContext()->tessellationCache().beginWorld( tessCacheLimit ? tessCacheLimit[ 0 ] : 0 );
+
 	CqRandom().Reseed('a'+'q'+'s'+'i'+'s');
 }
 
@@ -685,6 +695,11 @@ RtVoid RiCxxCore::WorldEnd()
 	if(QGetRenderContext()->pRaytracer())
 		QGetRenderContext()->pRaytracer()->Finalise();
 
+	// Profile shader execution if asked to.
+	const TqInt* poptShaderProfile = QGetRenderContext() ->poptCurrent()->GetIntegerOption( "statistics", "shaderprofile" );
+	bool profileShaders = poptShaderProfile != 0 && poptShaderProfile[ 0 ] != 0;
+	setShaderProfiling( profileShaders );
+
 	// Render the world
 	try
 	{
@@ -718,6 +733,17 @@ RtVoid RiCxxCore::WorldEnd()
 
 		// ..and print the statistics.
 		QGetRenderContext() ->Stats().PrintStats( verbosity );
+		if ( profileShaders )
+			printShaderProfile( std::cout );
+
+		// Write the machine readable report if one has been asked for.
+		const CqString* poptStatsFile = QGetRenderContext() ->poptCurrent()->GetStringOption( "statistics", "filename" );
+		if ( poptStatsFile != 0 && !poptStatsFile[ 0 ].empty() )
+		{
+			if ( !QGetRenderContext() ->Stats().WriteStatsFile( poptStatsFile[ 0 ] ) )
+				Aqsis::log() << error << "Could not write statistics to \""
+					<< poptStatsFile[ 0 ] << "\"" << std::endl;
+		}
 	}
 
 	QGetRenderContext()->SetWorldBegin(false);
@@ -963,6 +989,9 @@ RtVoid RiCxxCore::Display(RtConstToken name, RtConstToken type, RtConstToken mod
 		dataSize += 1;
 		index += strlen( RI_Z );
 	}
+	bool isCostChannel = false;
+	for ( TqInt i = 0; i < Cost_Last; ++i )
+		isCostChannel |= strcmp( mode, costChannelNames[ i ] ) == 0;
 
 	// Special case test.
 	if(strncmp(&mode[index], "depth", strlen("depth") ) == 0 )
@@ -971,6 +1000,12 @@ RtVoid RiCxxCore::Display(RtConstToken name, RtConstToken type, RtConstToken mod
 		/// \todo This shouldn't be a constant.
 		dataOffset = 6;
 	}
+	// The render costs are recorded for each pixel by the bucket processor
+	// rather than being stored with the samples.
+	else if( isCostChannel )
+	{
+		dataSize = 1;
+	}
 	// If none of the standard "rgbaz" strings match, then it is an alternative 'arbitrary output variable'
 	else if( eValue == 0 )
 	{
@@ -3321,18 +3356,44 @@ RtVoid RiCxxCore::SubdivisionMesh(RtConstToken scheme, const IntArray& nvertices
 			QGetRenderContext() ->matVSpaceToSpace( "object", "world", NULL, pPointsClass->pTransform().get(), time, matVOtoW );
 			pPointsClass->Transform( matOtoW, matNOtoW, matVOtoW);
 
-			boost::shared_ptr<CqSubdivision2> pSubd2( new CqSubdivision2( pPointsClass ) );
-			pSubd2->Prepare( cVerts );
+			// Static meshes in a sequence may be able to reuse the topology
+			// built and refined in a previous frame.
+			CqTessellationCache& tessCache = QGetRenderContext()->tessellationCache();
+			CqTessellationKey tessKey;
+			bool useTessCache = tessCache.isEnabled()
+				&& !QGetRenderContext()->pconCurrent()->fMotionBlock()
+				&& !isMultipass()
+				&& subdivisionMeshKey( tessKey, nvertices, vertices, tags, nargs,
+						intargs, floatargs, pList, matOtoW );
+
+			boost::shared_ptr<CqSubdivision2> pSubd2;
+			if ( useTessCache )
+				pSubd2 = tessCache.fetch( tessKey );
+			bool finalised = true;
+			if ( pSubd2 )
+			{
+				// Pick up the attributes and transform of the current gprim.
+				pSubd2->pPoints()->SetSurfaceParameters( *pPointsClass );
+			}
+			else
+			{
+				pSubd2.reset( new CqSubdivision2( pPointsClass ) );
+				pSubd2->Prepare( cVerts );
+
+				RtInt	iP = 0;
+				for ( face = 0; face < nfaces; ++face )
+				{
+					pSubd2->AddFacet( nvertices[face], const_cast<TqInt*>(&vertices[iP]), iP );
+					iP += nvertices[ face ];
+				}
+				finalised = pSubd2->Finalise();
+				if ( finalised && useTessCache )
+					tessCache.store( tessKey, pSubd2 );
+			}
 
 			boost::shared_ptr<CqSurfaceSubdivisionMesh> pMesh( new CqSurfaceSubdivisionMesh(pSubd2, nfaces ) );
 
-			RtInt	iP = 0;
-			for ( face = 0; face < nfaces; ++face )
-			{
-				pSubd2->AddFacet( nvertices[face], const_cast<TqInt*>(&vertices[iP]), iP );
-				iP += nvertices[ face ];
-			}
-			if ( pSubd2->Finalise() )
+			if ( finalised )
 			{
 				// Process tags.
 				TqInt argcIndex = 0;
@@ -3798,6 +3859,77 @@ static RtBoolean ProcessPrimitiveVariables(CqSurface * pSurface,
 }
 
 
+//----------------------------------------------------------------------
+// isMultipass
+// Determine whether gprims are being stored for multipass rendering.
+static bool isMultipass()
+{
+	const TqInt* pMultipass = QGetRenderContext()->poptCurrent()->GetIntegerOption("Render", "multipass");
+	return ( pMultipass && pMultipass[0] );
+}
+
+
+//----------------------------------------------------------------------
+// subdivisionMeshKey
+// Build the tessellation cache key for an RiSubdivisionMesh call.
+// return	:	false if the mesh has data which can't be compared between
+//				frames, true otherwise.
+static bool subdivisionMeshKey( CqTessellationKey& key,
+		const Ri::IntArray& nvertices, const Ri::IntArray& vertices,
+		const Ri::TokenArray& tags, const Ri::IntArray& nargs,
+		const Ri::IntArray& intargs, const Ri::FloatArray& floatargs,
+		const Ri::ParamList& pList, const CqMatrix& matOtoW )
+{
+	key.addString( "catmull-clark" );
+	key.add( nvertices.size() );
+	key.add( nvertices.begin(), nvertices.size() );
+	key.add( vertices.size() );
+	key.add( vertices.begin(), vertices.size() );
+	key.add( tags.size() );
+	for ( TqUint i = 0; i < tags.size(); ++i )
+		key.addString( tags[i] );
+	key.add( nargs.size() );
+	key.add( nargs.begin(), nargs.size() );
+	key.add( intargs.size() );
+	key.add( intargs.begin(), intargs.size() );
+	key.add( floatargs.size() );
+	key.add( floatargs.begin(), floatargs.size() );
+
+	key.add( pList.size() );
+	for ( TqUint i = 0; i < pList.size(); ++i )
+	{
+		const Ri::Param& param = pList[i];
+		key.addString( param.name() );
+		key.add( param.spec().iclass );
+		key.add( param.spec().type );
+		key.add( param.spec().arraySize );
+		key.add( param.size() );
+		switch ( param.spec().storageType() )
+		{
+			case Ri::TypeSpec::Float:
+				key.add( param.floatData().begin(), param.size() );
+				break;
+			case Ri::TypeSpec::Integer:
+				key.add( param.intData().begin(), param.size() );
+				break;
+			case Ri::TypeSpec::String:
+			{
+				Ri::StringArray strings = param.stringData();
+				for ( TqUint j = 0; j < strings.size(); ++j )
+					key.addString( strings[j] );
+				break;
+			}
+			default:
+				// Pointers don't necessarily refer to the same data next frame.
+				return ( false );
+		}
+	}
+
+	key.addMatrix( matOtoW );
+	return ( true );
+}
+
+
 //----------------------------------------------------------------------
 // CreateGPrin
 // Create and register a GPrim according to the current attributes/transform
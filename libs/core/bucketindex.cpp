@@ -0,0 +1,257 @@
+// Aqsis
+// Copyright (C) 1997 - 2002, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ * \brief Screen space index of gprims waiting to be rendered.
+ */
+
+#include "bucketindex.h"
+
+#include <aqsis/math/math.h>
+#include "bucket.h"
+#include "surface.h"
+
+namespace Aqsis {
+
+namespace {
+
+/// Count the set bits in a tile mask.
+TqInt bitCount(TqUint mask)
+{
+	TqInt count = 0;
+	for(; mask; mask &= mask - 1)
+		++count;
+	return count;
+}
+
+} // anonymous namespace
+
+CqBucketSurfaceIndex::CqBucketSurfaceIndex()
+	: m_bucketRegion(),
+	m_xTiles(0),
+	m_yTiles(0),
+	m_tiles(),
+	m_records(),
+	m_residentMemory(0),
+	m_peakMemory(0),
+	m_mutex()
+{ }
+
+void CqBucketSurfaceIndex::setBucketRegion(const CqRegion& bucketRegion)
+{
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		if(!m_tiles.empty()
+			&& bucketRegion.xMin() == m_bucketRegion.xMin()
+			&& bucketRegion.yMin() == m_bucketRegion.yMin()
+			&& bucketRegion.xMax() == m_bucketRegion.xMax()
+			&& bucketRegion.yMax() == m_bucketRegion.yMax())
+			return;
+		m_bucketRegion = bucketRegion;
+		m_xTiles = (bucketRegion.width() + tileSize - 1)/tileSize;
+		m_yTiles = (bucketRegion.height() + tileSize - 1)/tileSize;
+		std::vector<SqTile>(m_xTiles*m_yTiles).swap(m_tiles);
+	}
+	clear();
+}
+
+void CqBucketSurfaceIndex::clear()
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	CqRegion allBuckets(m_bucketRegion.xMin(), m_bucketRegion.yMin(),
+			m_bucketRegion.xMax() - 1, m_bucketRegion.yMax() - 1);
+	for(TqInt ty = 0; ty < m_yTiles; ++ty)
+	{
+		for(TqInt tx = 0; tx < m_xTiles; ++tx)
+		{
+			SqTile& tile = m_tiles[tileIndex(tx, ty)];
+			std::vector<TqRecordPtr>().swap(tile.records);
+			// Tiles on the right and bottom edges may be only partially
+			// covered by the bucket region.
+			tile.validMask = tileMask(tx, ty, allBuckets);
+			tile.finishedMask = 0;
+		}
+	}
+	m_records.clear();
+	m_residentMemory = 0;
+	m_peakMemory = 0;
+}
+
+bool CqBucketSurfaceIndex::insert(const boost::shared_ptr<CqSurface>& surface,
+		const CqRegion& buckets)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	if(m_records.find(surface.get()) != m_records.end())
+		return true;
+	CqRegion tiles = tileRange(buckets);
+	// Count the unfinished buckets which the surface overlaps.  If there
+	// aren't any, nothing will ever render the surface so it can be dropped
+	// straight away.
+	TqInt pendingBuckets = 0;
+	for(TqInt ty = tiles.yMin(); ty <= tiles.yMax(); ++ty)
+	{
+		for(TqInt tx = tiles.xMin(); tx <= tiles.xMax(); ++tx)
+		{
+			const SqTile& tile = m_tiles[tileIndex(tx, ty)];
+			pendingBuckets += bitCount(tileMask(tx, ty, buckets)
+					& tile.validMask & ~tile.finishedMask);
+		}
+	}
+	if(pendingBuckets == 0)
+		return false;
+
+	TqRecordPtr record(new SqRecord());
+	record->surface = surface;
+	record->buckets = buckets;
+	record->pendingBuckets = pendingBuckets;
+	record->memory = surface->MemoryUsage();
+	for(TqInt ty = tiles.yMin(); ty <= tiles.yMax(); ++ty)
+	{
+		for(TqInt tx = tiles.xMin(); tx <= tiles.xMax(); ++tx)
+		{
+			SqTile& tile = m_tiles[tileIndex(tx, ty)];
+			// Don't bother with tiles where the covered buckets are done.
+			if(tileMask(tx, ty, buckets) & tile.validMask & ~tile.finishedMask)
+				tile.records.push_back(record);
+		}
+	}
+	m_records[surface.get()] = record;
+	m_residentMemory += record->memory;
+	m_peakMemory = max(m_peakMemory, m_residentMemory);
+	return true;
+}
+
+TqInt CqBucketSurfaceIndex::fillBucket(CqBucket& bucket)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	TqInt x = bucket.getCol();
+	TqInt y = bucket.getRow();
+	SqTile& tile = m_tiles[tileIndex((x - m_bucketRegion.xMin())/tileSize,
+			(y - m_bucketRegion.yMin())/tileSize)];
+	TqInt numAdded = 0;
+	// Pull out the surfaces which overlap the bucket, dropping any released
+	// ones along the way.  Order within the tile doesn't matter since the
+	// bucket keeps its surfaces depth sorted.
+	std::vector<TqRecordPtr>& records = tile.records;
+	for(std::vector<TqRecordPtr>::size_type i = 0; i < records.size();)
+	{
+		const SqRecord& record = *records[i];
+		if(!record.surface)
+		{
+			std::swap(records[i], records.back());
+			records.pop_back();
+			continue;
+		}
+		const CqRegion& b = record.buckets;
+		if(x >= b.xMin() && x <= b.xMax() && y >= b.yMin() && y <= b.yMax())
+		{
+			bucket.AddGPrim(record.surface);
+			++numAdded;
+		}
+		++i;
+	}
+	return numAdded;
+}
+
+void CqBucketSurfaceIndex::surfaceConsumed(const CqSurface* surface)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	// The record stays in the tiles until they're next scanned, but without
+	// the surface it only costs a few bytes.
+	std::map<const CqSurface*, TqRecordPtr>::iterator i = m_records.find(surface);
+	if(i != m_records.end())
+	{
+		release(*i->second);
+		m_records.erase(i);
+	}
+}
+
+void CqBucketSurfaceIndex::bucketFinished(const CqBucket& bucket)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	TqInt x = bucket.getCol();
+	TqInt y = bucket.getRow();
+	TqInt tx = (x - m_bucketRegion.xMin())/tileSize;
+	TqInt ty = (y - m_bucketRegion.yMin())/tileSize;
+	SqTile& tile = m_tiles[tileIndex(tx, ty)];
+	tile.finishedMask |= tileMask(tx, ty, CqRegion(x, y, x, y));
+
+	std::vector<TqRecordPtr>& records = tile.records;
+	for(std::vector<TqRecordPtr>::size_type i = 0; i < records.size();)
+	{
+		SqRecord& record = *records[i];
+		const CqRegion& b = record.buckets;
+		if(record.surface
+			&& x >= b.xMin() && x <= b.xMax() && y >= b.yMin() && y <= b.yMax()
+			&& --record.pendingBuckets <= 0)
+		{
+			// This was the last bucket which could have used the surface.
+			m_records.erase(record.surface.get());
+			release(record);
+		}
+		if(!record.surface)
+		{
+			std::swap(records[i], records.back());
+			records.pop_back();
+		}
+		else
+			++i;
+	}
+	if(tile.finishedMask == tile.validMask)
+		std::vector<TqRecordPtr>().swap(records);
+}
+
+TqInt CqBucketSurfaceIndex::tileIndex(TqInt tx, TqInt ty) const
+{
+	assert(tx >= 0 && tx < m_xTiles && ty >= 0 && ty < m_yTiles);
+	return ty*m_xTiles + tx;
+}
+
+CqRegion CqBucketSurfaceIndex::tileRange(const CqRegion& buckets) const
+{
+	return CqRegion(
+		clamp((buckets.xMin() - m_bucketRegion.xMin())/tileSize, 0, m_xTiles-1),
+		clamp((buckets.yMin() - m_bucketRegion.yMin())/tileSize, 0, m_yTiles-1),
+		clamp((buckets.xMax() - m_bucketRegion.xMin())/tileSize, 0, m_xTiles-1),
+		clamp((buckets.yMax() - m_bucketRegion.yMin())/tileSize, 0, m_yTiles-1));
+}
+
+TqUint CqBucketSurfaceIndex::tileMask(TqInt tx, TqInt ty,
+		const CqRegion& buckets) const
+{
+	TqInt x0 = m_bucketRegion.xMin() + tx*tileSize;
+	TqInt y0 = m_bucketRegion.yMin() + ty*tileSize;
+	TqInt xMin = max(buckets.xMin(), x0) - x0;
+	TqInt yMin = max(buckets.yMin(), y0) - y0;
+	TqInt xMax = min(buckets.xMax(), x0 + tileSize - 1) - x0;
+	TqInt yMax = min(buckets.yMax(), y0 + tileSize - 1) - y0;
+	TqUint mask = 0;
+	for(TqInt y = yMin; y <= yMax; ++y)
+		for(TqInt x = xMin; x <= xMax; ++x)
+			mask |= 1u << (y*tileSize + x);
+	return mask;
+}
+
+void CqBucketSurfaceIndex::release(SqRecord& record)
+{
+	m_residentMemory -= record.memory;
+	record.surface.reset();
+}
+
+} // namespace Aqsis
@@ -0,0 +1,186 @@
+// Aqsis
+// Copyright (C) 1997 - 2002, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ * \brief Screen space index of gprims waiting to be rendered.
+ */
+
+#ifndef BUCKETINDEX_H_INCLUDED
+#define BUCKETINDEX_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <map>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <aqsis/math/region.h>
+
+namespace Aqsis {
+
+class CqBucket;
+class CqSurface;
+
+/** \brief A two-level screen space index of the gprims waiting for buckets.
+ *
+ * The bucket grid is divided into square tiles of tileSize x tileSize
+ * buckets.  A surface is inserted once into each tile which its bucket range
+ * overlaps, along with the range itself.  When a bucket is about to be
+ * rendered, it pulls every surface overlapping it out of the containing tile
+ * and into its own depth-sorted heap, which forms the second level of the
+ * index.
+ *
+ * This means a surface only needs to be bounded once when it's posted; it
+ * doesn't need to be pushed from bucket to bucket when it turns out to be
+ * occluded.  Instead the index keeps a count of the unfinished buckets which
+ * each surface overlaps.  The surface is released as soon as a bucket dices,
+ * splits or discards it (see CqSurface::MarkConsumed()), or as soon as the
+ * last bucket it overlaps is finished, whichever comes first.
+ *
+ * The index also keeps an estimate of the memory held by the surfaces it's
+ * holding on to, so that the bucket order can be adjusted when geometry
+ * memory gets too high.
+ *
+ * Surfaces are inserted and consumed from the bucket processing threads
+ * while the main thread fills and finishes buckets, so all the methods lock
+ * the index.
+ */
+class CqBucketSurfaceIndex
+{
+	public:
+		/// Width and height of a tile, measured in buckets.
+		static const TqInt tileSize = 4;
+
+		CqBucketSurfaceIndex();
+
+		/** \brief Set up the tiles to cover the given region of buckets.
+		 *
+		 * The index is only cleared if the region is different to the
+		 * current one, since the image buffer is set up more than once per
+		 * frame.
+		 *
+		 * \param bucketRegion - the region of non-cropped buckets; the maximum
+		 *                       is one greater than the last bucket index.
+		 */
+		void setBucketRegion(const CqRegion& bucketRegion);
+		/// Remove all surfaces from the index and mark all buckets unfinished.
+		void clear();
+
+		/** \brief Insert a surface into the index.
+		 *
+		 * \param surface - surface to insert
+		 * \param buckets - range of buckets overlapped by the surface.  The
+		 *                  range is inclusive, unlike CqRegion's usual
+		 *                  convention.
+		 * \return false if all the buckets in the range are already finished,
+		 *         in which case the surface isn't inserted.
+		 */
+		bool insert(const boost::shared_ptr<CqSurface>& surface,
+				const CqRegion& buckets);
+		/** \brief Move all unconsumed surfaces which overlap a bucket into it.
+		 *
+		 * \return the number of surfaces added to the bucket.
+		 */
+		TqInt fillBucket(CqBucket& bucket);
+		/** \brief Release a surface which has been diced, split or discarded.
+		 *
+		 * The surface should already be marked using
+		 * CqSurface::MarkConsumed().
+		 */
+		void surfaceConsumed(const CqSurface* surface);
+		/** \brief Notify the index that a bucket has been rendered.
+		 *
+		 * Any surfaces for which this was the last unfinished bucket are
+		 * released.
+		 */
+		void bucketFinished(const CqBucket& bucket);
+
+		/// Estimated memory held by the surfaces in the index, in bytes.
+		TqUlong residentMemory() const;
+		/// Peak value of residentMemory() since the last clear().
+		TqUlong peakMemory() const;
+
+	private:
+		/// Bookkeeping shared between all the tiles holding a surface.
+		struct SqRecord
+		{
+			/// The surface; null once it's been consumed or released.
+			boost::shared_ptr<CqSurface> surface;
+			/// Inclusive range of buckets overlapped by the surface.
+			CqRegion buckets;
+			/// Number of unfinished buckets in the range.
+			TqInt pendingBuckets;
+			/// Estimated memory held by the surface.
+			TqUlong memory;
+		};
+		typedef boost::shared_ptr<SqRecord> TqRecordPtr;
+
+		struct SqTile
+		{
+			std::vector<TqRecordPtr> records;
+			/// Bitmask of the buckets in the tile which are inside the region
+			TqUint validMask;
+			/// Bitmask of the buckets in the tile which have been finished.
+			TqUint finishedMask;
+			SqTile() : records(), validMask(0), finishedMask(0) {}
+		};
+
+		/// Get the index of the tile containing the bucket at column x, row y
+		TqInt tileIndex(TqInt x, TqInt y) const;
+		/// Get the inclusive range of tiles covering an inclusive bucket range
+		CqRegion tileRange(const CqRegion& buckets) const;
+		/// Get the mask of buckets in tile (tx,ty) overlapped by a bucket range
+		TqUint tileMask(TqInt tx, TqInt ty, const CqRegion& buckets) const;
+		/// Drop the index's reference to a surface.
+		void release(SqRecord& record);
+
+		CqRegion m_bucketRegion;
+		TqInt m_xTiles;
+		TqInt m_yTiles;
+		std::vector<SqTile> m_tiles;
+		/// Live records, for finding the record of a consumed surface.
+		std::map<const CqSurface*, TqRecordPtr> m_records;
+		TqUlong m_residentMemory;
+		TqUlong m_peakMemory;
+		/// Protects all of the above.
+		mutable boost::mutex m_mutex;
+};
+
+
+//==============================================================================
+// Implementation details
+//==============================================================================
+
+inline TqUlong CqBucketSurfaceIndex::residentMemory() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_residentMemory;
+}
+
+inline TqUlong CqBucketSurfaceIndex::peakMemory() const
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_peakMemory;
+}
+
+} // namespace Aqsis
+
+#endif // BUCKETINDEX_H_INCLUDED
@@ -18,9 +18,14 @@
 
 #include	"bucketprocessor.h"
 
+#include	<algorithm>
+#include	<atomic>
+#include	<cfloat>
 #include	<valarray>
 
 #include	<aqsis/math/math.h>
+#include	<aqsis/util/pool.h>
+#include	<aqsis/tex/io/itiledtexinputfile.h>
 #include	"bucket.h"
 #include	"imagebuffer.h"
 #include	<aqsis/util/timer.h>
@@ -28,6 +33,37 @@
 
 namespace Aqsis {
 
+/** Get the running totals of the calling thread's counters which are reported
+ * for each bucket.
+ */
+static SqBucketStats threadBucketCounters()
+{
+	SqBucketStats counters;
+	for(TqInt i = CqStats::GRD_shd_size_4; i <= CqStats::GRD_shd_size_g256; ++i)
+		counters.grids += CqStats::threadI(i);
+	counters.micropolygons = CqStats::threadI(CqStats::MPG_allocated);
+	counters.samples = CqStats::threadI(CqStats::SPL_count);
+	counters.sampleHits = CqStats::threadI(CqStats::SPL_hits);
+	counters.textureBytes = IqTiledTexInputFile::threadBytesRead();
+	return counters;
+}
+
+/** Determine whether any display has asked for one of the render cost
+ * channels.
+ */
+static bool displaysNeedCosts()
+{
+	for(TqInt i = 0; i < Cost_Last; ++i)
+	{
+		if(QGetRenderContext()->pDDmanager()->fDisplayNeeds(costChannelNames[i]))
+			return true;
+	}
+	return false;
+}
+
+/// Source of serial numbers for the grids counted in the pixel costs.
+static std::atomic<TqUlong> g_costGridSerial(0);
+
 CqBucketProcessor::CqBucketProcessor(CqImageBuffer& imageBuf,
                                      const SqOptionCache& optCache)
 	: m_bucket(0),
@@ -46,7 +82,11 @@ CqBucketProcessor::CqBucketProcessor(CqImageBuffer& imageBuf,
 	m_SampleRegion(),
 	m_DisplayRegion(),
 	m_hasValidSamples(false),
-	m_channelBuffer()
+	m_channelBuffer(),
+	m_bucketStats(),
+	m_recordCosts(displaysNeedCosts()),
+	m_costGrid(0),
+	m_costGridSerial(0)
 {
 	setupCacheInformation();
 }
@@ -76,6 +116,11 @@ void CqBucketProcessor::setBucket(CqBucket* bucket)
 	m_hasValidSamples = false;
 }
 
+const SqBucketStats& CqBucketProcessor::bucketStats() const
+{
+	return m_bucketStats;
+}
+
 const CqBucket* CqBucketProcessor::getBucket() const
 {
 	return m_bucket;
@@ -210,6 +255,19 @@ void CqBucketProcessor::process()
 	if (!m_bucket)
 		return;
 
+	// The bucket is processed entirely by this thread, so the work done for
+	// it is the change in the thread's counters.
+	CqTimer bucketTimer;
+	bucketTimer.start();
+	const SqBucketStats startCounters = threadBucketCounters();
+	// Pick up the gprims, grids and micropolygons held by other threads for
+	// the peak counters, which only look at this thread while it renders.
+	CqStats::syncPeaks();
+	m_bucketStats = SqBucketStats();
+	m_bucketStats.col = m_bucket->getCol();
+	m_bucketStats.row = m_bucket->getRow();
+	m_bucketStats.peakMemory = m_imageBuf.geometryMemory();
+
 	{
 		AQSIS_TIME_SCOPE(Render_MPGs);
 		RenderWaitingMPs();
@@ -221,21 +279,39 @@ void CqBucketProcessor::process()
 	while ( m_bucket->hasPendingSurfaces() )
 	{
 		boost::shared_ptr<CqSurface> surface = m_bucket->pTopSurface();
-		if (surface)
+		// Advance to next surface
+		m_bucket->popSurface();
+		// Skip surfaces which another bucket has already diced or split.
+		if (surface && !surface->fConsumed())
 		{
-			// Advance to next surface
-			m_bucket->popSurface();
+			++m_bucketStats.gprims;
 			RenderSurface( surface );
 			{
 				AQSIS_TIME_SCOPE(Render_MPGs);
 				RenderWaitingMPs();
 			}
+			// Splitting can post new surfaces, so sample the memory after
+			// each one rather than only when the bucket is finished.
+			m_bucketStats.peakMemory = std::max(m_bucketStats.peakMemory,
+					m_imageBuf.geometryMemory());
 		}
 	}
 	{
 		AQSIS_TIME_SCOPE(Render_MPGs);
 		RenderWaitingMPs();
 	}
+
+	// Hand the micropolygons freed by this thread back to the shared pools.
+	CqObjectPoolBase::releaseThreadCaches();
+
+	const SqBucketStats endCounters = threadBucketCounters();
+	m_bucketStats.grids = endCounters.grids - startCounters.grids;
+	m_bucketStats.micropolygons = endCounters.micropolygons - startCounters.micropolygons;
+	m_bucketStats.samples = endCounters.samples - startCounters.samples;
+	m_bucketStats.sampleHits = endCounters.sampleHits - startCounters.sampleHits;
+	m_bucketStats.textureBytes = endCounters.textureBytes - startCounters.textureBytes;
+	bucketTimer.stop();
+	m_bucketStats.time = bucketTimer.totalTime();
 }
 
 void CqBucketProcessor::postProcess()
@@ -247,6 +323,8 @@ void CqBucketProcessor::postProcess()
 	// micropolygons rendered to that pixel.
 	{
 		AQSIS_TIME_SCOPE(Combine_samples);
+		if(QGetRenderContext()->pDDmanager()->fDisplayNeedsDeepData())
+			CollectDeepFragments();
 		CombineElements();
 	}
 
@@ -374,6 +452,67 @@ void CqBucketProcessor::CombineElements()
 	}
 }
 
+void CqBucketProcessor::CollectDeepFragments()
+{
+	TqInt fragSize = SqImageSample::sampleSize;
+	m_deepBuffer.clear(DisplayRegion().width(), DisplayRegion().height(), fragSize);
+	if(!m_hasValidSamples)
+	{
+		for(TqInt i = 0, end = DisplayRegion().area(); i < end; ++i)
+			m_deepBuffer.endPixel();
+		return;
+	}
+
+	std::vector<TqFloat>& frags = m_pixelFragments;
+	for(TqInt y = DisplayRegion().yMin(); y < DisplayRegion().yMax(); ++y)
+	{
+		for(TqInt x = DisplayRegion().xMin(); x < DisplayRegion().xMax(); ++x)
+		{
+			CqImagePixelPtr* pie;
+			ImageElement(x, y, pie);
+			CqImagePixel& pixel = **pie;
+			TqInt numSamples = pixel.numSamples();
+			TqFloat weight = 1.0f/numSamples;
+
+			frags.clear();
+			for(TqInt s = 0; s < numSamples; ++s)
+			{
+				SqSampleData& sample = pixel.SampleData(s);
+				const SqImageSample& occlHit = sample.occludingHit;
+				bool occluded = occlHit.flags & SqImageSample::Flag_Valid;
+				TqFloat occlDepth = occluded ? pixel.sampleHitData(occlHit)[Sample_Depth] : FLT_MAX;
+				// The occluding hit isn't placed in the hit list until the
+				// samples are combined, so add it first.
+				TqInt numHits = sample.data.size();
+				for(TqInt h = occluded ? -1 : 0; h < numHits; ++h)
+				{
+					const SqImageSample& hit = h < 0 ? occlHit : sample.data[h];
+					const TqFloat* hitData = pixel.sampleHitData(hit);
+					if(h >= 0 && hitData[Sample_Depth] > occlDepth)
+						continue;
+					TqInt start = frags.size();
+					frags.insert(frags.end(), hitData, hitData + fragSize);
+					TqFloat* frag = &frags[start];
+					// Matte surfaces hold out anything behind them, but don't
+					// contribute any colour.
+					if(hit.flags & SqImageSample::Flag_Matte)
+						frag[Sample_Red] = frag[Sample_Green] = frag[Sample_Blue] = 0;
+					frag[Sample_Alpha] = (frag[Sample_ORed] + frag[Sample_OGreen]
+							+ frag[Sample_OBlue]) / 3;
+					frag[Sample_Coverage] = 1;
+					for(TqInt i = 0; i < fragSize; ++i)
+					{
+						if(i != Sample_Depth)
+							frag[i] *= weight;
+					}
+				}
+			}
+
+			m_deepBuffer.addPixel(frags);
+		}
+	}
+}
+
 //----------------------------------------------------------------------
 /** Filter the samples in this bucket according to type and filter widths.
  */
@@ -396,6 +535,13 @@ void CqBucketProcessor::FilterBucket()
 	std::map<std::string, CqRenderer::SqOutputDataEntry>::iterator aov_end = outputMap.end();
 	for(; aov_i != aov_end; ++aov_i)
 		channelMap[m_channelBuffer.addChannel(aov_i->first, aov_i->second.m_NumSamples)] = aov_i->second;
+	// The render costs are summed over each pixel rather than filtered, so
+	// they're filled in separately.
+	if(m_recordCosts)
+	{
+		for(TqInt i = 0; i < Cost_Last; ++i)
+			m_channelBuffer.addChannel(costChannelNames[i], 1);
+	}
 
 	TqInt depthIndex = m_channelBuffer.getChannelIndex("z");
 
@@ -706,6 +852,22 @@ void CqBucketProcessor::FilterBucket()
 		}
 	}
 
+	if(m_recordCosts)
+	{
+		TqInt costIndices[Cost_Last];
+		for(TqInt c = 0; c < Cost_Last; ++c)
+			costIndices[c] = m_channelBuffer.getChannelIndex(costChannelNames[c]);
+		for ( y = 0; y < endy; y++ )
+		{
+			for ( x = 0; x < endx; x++ )
+			{
+				ImageElement( DisplayRegion().xMin() + x, DisplayRegion().yMin() + y, pie );
+				for(TqInt c = 0; c < Cost_Last; ++c)
+					m_channelBuffer(x, y, costIndices[c])[0] = (*pie)->cost(static_cast<EqCostChannel>(c));
+			}
+		}
+	}
+
 	endy = DisplayRegion().height();
 	endx = DisplayRegion().width();
 
@@ -931,6 +1093,9 @@ void CqBucketProcessor::RenderWaitingMPs()
 		RenderMicroPoly( mp );
 	}
 	m_bucket->micropolygons().clear();
+	// The grids may be freed now, so don't mistake a new grid at the same
+	// address for the last one.
+	m_costGrid = 0;
 
 	m_OcclusionTree.updateTree();
 }
@@ -957,6 +1122,10 @@ void CqBucketProcessor::RenderSurface( boost::shared_ptr<CqSurface>& surface )
 		}
 	}
 
+	// From here on the surface will be diced, split or discarded, so no other
+	// bucket needs to see it.
+	m_imageBuf.ConsumeSurface(surface);
+
 	// If the epsilon check has deemed this surface to be undiceable, don't bother asking.
 	bool fDiceable = false;
 	{
@@ -989,11 +1158,13 @@ void CqBucketProcessor::RenderSurface( boost::shared_ptr<CqSurface>& surface )
 				// extra scaling due to projection, we use the z coordinate at
 				// the centre of the object's bounding box.
 				//
-				// TODO: It's not nice recomputing the bound here.  Perhaps it
-				// would be better to cache it (along with the cached raster
-				// bound?)
+				// The cached raster bound holds camera space z values, so
+				// use that rather than recomputing the bound where possible.
 				CqBound bound;
-				surface->Bound(&bound);
+				if(surface->fCachedBound())
+					bound = surface->GetCachedRasterBound();
+				else
+					surface->Bound(&bound);
 				TqFloat midz = 0.5f*(bound.vecMin().z() + bound.vecMax().z());
 				xscale /= midz;
 				yscale /= midz;
@@ -1026,7 +1197,18 @@ void CqBucketProcessor::RenderSurface( boost::shared_ptr<CqSurface>& surface )
 			ADDREF( pGrid );
 			// Only shade in all cases since the Displacement could be called in the shadow map creation too.
 			// \note Timings for shading are broken down into component parts within this function.
-			pGrid->Shade();
+			if ( m_recordCosts )
+			{
+				CqTimer shadingTimer;
+				shadingTimer.start();
+				TqUlong textureStart = IqTiledTexInputFile::threadBytesRead();
+				pGrid->Shade();
+				shadingTimer.stop();
+				pGrid->SetRenderCosts( shadingTimer.totalTime(),
+						IqTiledTexInputFile::threadBytesRead() - textureStart );
+			}
+			else
+				pGrid->Shade();
 			pGrid->TransferOutputVariables();
 
 			if ( pGrid->vfCulled() == false )
@@ -1088,6 +1270,49 @@ void CqBucketProcessor::RenderMicroPoly( CqMicroPolygon* pMP )
 		RenderMPG_MBOrDof( pMP, IsMoving, UsingDof );
 	else
 		RenderMPG_Static( pMP );
+
+	if(m_recordCosts)
+		AddMicroPolyCosts( pMP );
+}
+
+void CqBucketProcessor::AddMicroPolyCosts( CqMicroPolygon* pMPG )
+{
+	const CqMicroPolyGridBase* grid = pMPG->pGrid();
+	if(grid != m_costGrid)
+	{
+		m_costGrid = grid;
+		m_costGridSerial = ++g_costGridSerial;
+	}
+	const SqGridInfo& gridInfo = grid->GetCachedGridInfo();
+
+	// Share the costs evenly between all the pixels touched by the bound,
+	// including those outside this bucket, so that micropolygons crossing
+	// bucket boundaries aren't counted more than once.
+	const CqBound& bound = pMPG->GetBound();
+	TqInt sX = lfloor( bound.vecMin().x() );
+	TqInt sY = lfloor( bound.vecMin().y() );
+	TqInt eX = max<TqInt>( lceil( bound.vecMax().x() ), sX + 1 );
+	TqInt eY = max<TqInt>( lceil( bound.vecMax().y() ), sY + 1 );
+	TqFloat numPixels = static_cast<TqFloat>( ( eX - sX ) * ( eY - sY ) );
+	TqFloat shadingCost = gridInfo.shadingCost / numPixels;
+	TqFloat textureCost = gridInfo.textureCost / numPixels;
+
+	sX = max<TqInt>( sX, SampleRegion().xMin() );
+	sY = max<TqInt>( sY, SampleRegion().yMin() );
+	eX = min<TqInt>( eX, SampleRegion().xMax() );
+	eY = min<TqInt>( eY, SampleRegion().yMax() );
+	for( TqInt iY = sY; iY < eY; ++iY )
+	{
+		for( TqInt iX = sX; iX < eX; ++iX )
+		{
+			CqImagePixelPtr* pie;
+			ImageElement( iX, iY, pie );
+			CqImagePixel& pixel = **pie;
+			pixel.addCost( Cost_Shading, shadingCost );
+			pixel.addCost( Cost_Texture, textureCost );
+			pixel.addGridCost( m_costGridSerial );
+		}
+	}
 }
 
 
@@ -1160,6 +1385,9 @@ void CqBucketProcessor::RenderMPG_Static( CqMicroPolygon* pMPG)
 			int end_m = ( iX == ( eX - 1 ) ) ? em : iXSamples;
 			int index_start = n*iXSamples + start_m;
 
+			if(m_recordCosts)
+				(*pie2)->addCost( Cost_Samples, ( end_n - n ) * ( end_m - start_m ) );
+
 			for ( ; n < end_n; n++ )
 			{
 				int index = index_start;
@@ -1373,6 +1601,8 @@ void CqBucketProcessor::RenderMPG_MBOrDof( CqMicroPolygon* pMPG, bool IsMoving,
 						// may have times within the current mb bounding box.
 						index = indexT0;
 					}
+					if(m_recordCosts)
+						(*pie2)->addCost( Cost_Samples, UsingDof ? 1 : max<TqInt>( 1, indexT1 - indexT0 ) );
 					// loop over potential samples
 					do
 					{
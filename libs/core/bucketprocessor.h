@@ -32,15 +32,18 @@
 
 #include	"bucket.h"
 #include	"channelbuffer.h"
+#include	"deepbuffer.h"
 #include	"imagepixel.h"
 #include	"isampler.h"
 #include	"occlusion.h"
 #include	"optioncache.h"
+#include	"stats.h"
 
 
 namespace Aqsis {
 
 class CqSampleIterator;
+class CqMicroPolyGridBase;
 class CqRenderer;
 class CqImageBuffer;
 
@@ -84,6 +87,13 @@ class CqBucketProcessor
 		//-------------- Reorganise -------------------------
 		
 		CqChannelBuffer& getChannelBuffer();
+		/** Get the surface fragments for the display region.  These are only
+		 *  collected when a deep display has been requested.
+		 */
+		const CqDeepBuffer& getDeepBuffer() const;
+		/** Get the statistics gathered while processing the bucket.
+		 */
+		const SqBucketStats& bucketStats() const;
 
 		const SqOptionCache& optCache() const;
 
@@ -105,6 +115,11 @@ class CqBucketProcessor
 		void	InitialiseFilterValues();
 		void	CalculateDofBounds();
 		void	CombineElements();
+		/** Collect the depth sorted surface fragments at each pixel of the
+		 *  display region into m_deepBuffer.  This must happen before the
+		 *  samples are combined, since combining overwrites the hit data.
+		 */
+		void	CollectDeepFragments();
 		void	FilterBucket();
 		void	ExposeBucket();
 
@@ -136,6 +151,10 @@ class CqBucketProcessor
 		void	StoreSample(CqMicroPolygon* pMPG, CqImagePixel* pie2, TqInt index,
 							TqFloat D, const CqVector2D& uv);
 		void	StoreExtraData( CqMicroPolygon* pMPG, TqFloat* hitData);
+		/** Share the shading and texture costs of a micropolygon between the
+		 * pixels covered by its bound, and count its grid in them.
+		 */
+		void	AddMicroPolyCosts( CqMicroPolygon* pMPG );
 		const CqBound& DofSubBound(TqInt index) const;
 
 		void setupCacheInformation();
@@ -177,8 +196,21 @@ class CqBucketProcessor
 		bool	m_hasValidSamples;
 
 		CqChannelBuffer	m_channelBuffer;
+		CqDeepBuffer	m_deepBuffer;
+		/// Scratch space for the unsorted fragments of a pixel.
+		std::vector<TqFloat>	m_pixelFragments;
 
 		boost::array<CqRegion, SqBucketCacheSegment::last> m_cacheRegions;
+
+		/// Statistics for the current bucket.
+		SqBucketStats	m_bucketStats;
+
+		/// Whether a display needs the render cost channels.
+		bool	m_recordCosts;
+		/// Grid of the last micropolygon whose costs were recorded.
+		const CqMicroPolyGridBase*	m_costGrid;
+		/// Serial number identifying m_costGrid in the pixel costs.
+		TqUlong	m_costGridSerial;
 };
 
 
@@ -278,6 +310,11 @@ inline CqChannelBuffer& CqBucketProcessor::getChannelBuffer()
 	return m_channelBuffer;
 }
 
+inline const CqDeepBuffer& CqBucketProcessor::getDeepBuffer() const
+{
+	return m_deepBuffer;
+}
+
 inline const CqBound& CqBucketProcessor::DofSubBound(TqInt index) const
 {
 	assert(index < m_NumDofBounds);
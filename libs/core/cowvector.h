@@ -0,0 +1,121 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+/** \file
+		\brief Declares a copy-on-write vector for primitive variable storage.
+*/
+
+//? Is cowvector.h included already?
+#ifndef COWVECTOR_H_INCLUDED
+#define COWVECTOR_H_INCLUDED 1
+
+#include <aqsis/aqsis.h>
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+namespace Aqsis {
+
+//----------------------------------------------------------------------
+/** \class CqCowVector
+ * Reference counted vector which copies its storage only when modified.
+ *
+ * Copying a CqCowVector just shares the underlying storage, so cloning a
+ * primitive variable when a surface is split is cheap.  Any non-const access
+ * first makes sure the storage isn't shared with any other vector, so values
+ * which splitting doesn't change (uniform and constant values, for example)
+ * are never duplicated.
+ *
+ * Pointers and references obtained through non-const access are only valid
+ * until the vector is next copied; writing through them after that would
+ * modify the shared copy.
+ */
+
+template <class T>
+class CqCowVector
+{
+	public:
+		CqCowVector()
+			: m_data()
+		{}
+		explicit CqCowVector( TqUint size )
+			: m_data( new std::vector<T>( size ) )
+		{}
+
+		/** Get the number of elements.
+		 */
+		TqUint size() const
+		{
+			return ( m_data ? m_data->size() : 0 );
+		}
+		/** Resize the vector, copying the storage first if it's shared.
+		 *
+		 * Resizing to the current size leaves shared storage alone.
+		 */
+		void resize( TqUint size )
+		{
+			if ( size == this->size() )
+				return;
+			makeUnique();
+			m_data->resize( size );
+		}
+		/** Remove all elements, releasing this vector's share of the storage.
+		 */
+		void clear()
+		{
+			m_data.reset();
+		}
+		/** Determine whether the storage is shared with another vector.
+		 */
+		bool isShared() const
+		{
+			return ( m_data && !m_data.unique() );
+		}
+
+		const T& operator[]( TqUint index ) const
+		{
+			return ( ( *m_data ) [ index ] );
+		}
+		/** Get a modifiable element, copying the storage first if it's shared.
+		 */
+		T& operator[]( TqUint index )
+		{
+			makeUnique();
+			return ( ( *m_data ) [ index ] );
+		}
+
+	private:
+		/** Make sure this vector holds the only reference to the storage.
+		 */
+		void makeUnique()
+		{
+			if ( !m_data )
+				m_data.reset( new std::vector<T>() );
+			else if ( !m_data.unique() )
+				m_data.reset( new std::vector<T>( *m_data ) );
+		}
+
+		boost::shared_ptr<std::vector<T> >	m_data;	///< Shared storage, null when empty.
+};
+
+} // namespace Aqsis
+
+#endif	// !COWVECTOR_H_INCLUDED
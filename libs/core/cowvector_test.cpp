@@ -0,0 +1,184 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file Unit tests for the copy-on-write primitive variable storage.
+ */
+
+#include "cowvector.h"
+#include "parameters.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+#include <boost/scoped_ptr.hpp>
+
+BOOST_AUTO_TEST_SUITE(cowvector_tests)
+
+using namespace Aqsis;
+
+namespace {
+
+typedef CqCowVector<TqFloat> FloatVec;
+
+/// Make a vector holding 0, 1, ..., size-1.
+FloatVec makeRamp(TqUint size)
+{
+	FloatVec v(size);
+	for(TqUint i = 0; i < size; ++i)
+		v[i] = i;
+	return v;
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqCowVector_empty_test)
+{
+	FloatVec v;
+	BOOST_CHECK_EQUAL(v.size(), 0U);
+	BOOST_CHECK(!v.isShared());
+	FloatVec w(v);
+	BOOST_CHECK(!v.isShared());
+	BOOST_CHECK(!w.isShared());
+
+	v.resize(3);
+	BOOST_CHECK_EQUAL(v.size(), 3U);
+	BOOST_CHECK_EQUAL(w.size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(CqCowVector_copy_shares_test)
+{
+	FloatVec v = makeRamp(4);
+	BOOST_CHECK(!v.isShared());
+	FloatVec w(v);
+	BOOST_CHECK(v.isShared());
+	BOOST_CHECK(w.isShared());
+
+	// Const access must leave the storage shared.
+	const FloatVec& cw = w;
+	BOOST_CHECK_EQUAL(cw[2], 2.0f);
+	BOOST_CHECK(w.isShared());
+
+	// Resizing to the current size doesn't count as a modification.
+	w.resize(4);
+	BOOST_CHECK(w.isShared());
+}
+
+BOOST_AUTO_TEST_CASE(CqCowVector_write_copies_test)
+{
+	FloatVec v = makeRamp(4);
+	FloatVec w(v);
+	w[1] = 10;
+	BOOST_CHECK(!v.isShared());
+	BOOST_CHECK(!w.isShared());
+	BOOST_CHECK_EQUAL(v[1], 1.0f);
+	BOOST_CHECK_EQUAL(w[1], 10.0f);
+	for(TqUint i = 0; i < 4; ++i)
+	{
+		if(i != 1)
+			BOOST_CHECK_EQUAL(w[i], v[i]);
+	}
+
+	// Once unique, writes go straight to the storage.
+	const TqFloat* p = &w[0];
+	w[3] = 30;
+	BOOST_CHECK_EQUAL(&w[0], p);
+}
+
+BOOST_AUTO_TEST_CASE(CqCowVector_resize_copies_test)
+{
+	FloatVec v = makeRamp(4);
+	FloatVec w(v);
+	w.resize(2);
+	BOOST_CHECK_EQUAL(v.size(), 4U);
+	BOOST_CHECK_EQUAL(w.size(), 2U);
+	BOOST_CHECK_EQUAL(v[3], 3.0f);
+	BOOST_CHECK_EQUAL(w[1], 1.0f);
+}
+
+BOOST_AUTO_TEST_CASE(CqCowVector_clear_releases_test)
+{
+	FloatVec v = makeRamp(4);
+	FloatVec w(v);
+	FloatVec x(v);
+	x.clear();
+	BOOST_CHECK_EQUAL(x.size(), 0U);
+	BOOST_CHECK(v.isShared());
+	w.clear();
+	BOOST_CHECK(!v.isShared());
+	BOOST_CHECK_EQUAL(v.size(), 4U);
+	BOOST_CHECK_EQUAL(v[3], 3.0f);
+}
+
+BOOST_AUTO_TEST_CASE(CqCowVector_assign_test)
+{
+	FloatVec v = makeRamp(3);
+	FloatVec w = makeRamp(5);
+	w = v;
+	BOOST_CHECK(v.isShared());
+	BOOST_CHECK_EQUAL(w.size(), 3U);
+	v[0] = -1;
+	BOOST_CHECK_EQUAL(w[0], 0.0f);
+	BOOST_CHECK_EQUAL(v[0], -1.0f);
+}
+
+BOOST_AUTO_TEST_CASE(CqParameterTypedVarying_subdivide_shares_test)
+{
+	typedef CqParameterTypedVarying<TqFloat, type_float, TqFloat> FloatParam;
+	FloatParam parent("a");
+	parent.SetSize(4);
+	for(TqInt i = 0; i < 4; ++i)
+		parent.pValue(i)[0] = i;
+	// A split gprim starts with a copy sharing the parent's values.
+	boost::scoped_ptr<FloatParam> copy(static_cast<FloatParam*>(parent.Clone()));
+	const FloatParam& cparent = parent;
+	const FloatParam& ccopy = *copy;
+	BOOST_CHECK_EQUAL(ccopy.pValue(0), cparent.pValue(0));
+
+	FloatParam result1("a");
+	FloatParam result2("a");
+	parent.Subdivide(&result1, &result2, true);
+	// Reading the parent while subdividing must not unshare its values.
+	BOOST_CHECK_EQUAL(ccopy.pValue(0), cparent.pValue(0));
+	BOOST_CHECK_EQUAL(result1.pValue(1)[0], 0.5f);
+	BOOST_CHECK_EQUAL(result2.pValue(1)[0], 1.0f);
+}
+
+BOOST_AUTO_TEST_CASE(CqParameterTypedVaryingArray_subdivide_shares_test)
+{
+	typedef CqParameterTypedVaryingArray<TqFloat, type_float, TqFloat> FloatArrayParam;
+	FloatArrayParam parent("a", 2);
+	parent.SetSize(4);
+	for(TqInt i = 0; i < 4; ++i)
+	{
+		parent.pValue(i)[0] = i;
+		parent.pValue(i)[1] = 10*i;
+	}
+	boost::scoped_ptr<FloatArrayParam> copy(static_cast<FloatArrayParam*>(parent.Clone()));
+	const FloatArrayParam& cparent = parent;
+	const FloatArrayParam& ccopy = *copy;
+	BOOST_CHECK_EQUAL(ccopy.pValue(0), cparent.pValue(0));
+
+	FloatArrayParam result1("a", 2);
+	FloatArrayParam result2("a", 2);
+	parent.Subdivide(&result1, &result2, false);
+	BOOST_CHECK_EQUAL(ccopy.pValue(0), cparent.pValue(0));
+	BOOST_CHECK_EQUAL(result1.pValue(2)[1], 10.0f);
+	BOOST_CHECK_EQUAL(result2.pValue(2)[1], 20.0f);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -30,8 +30,11 @@
 #include	"winsock2.h"
 #endif
 
+#include	<algorithm>
+#include	<cmath>
 #include	<cstring>
 
+#include	<boost/bind.hpp>
 #include	<boost/static_assert.hpp>
 #include	<boost/format.hpp>
 
@@ -43,6 +46,7 @@
 #include	<aqsis/ri/ndspy.h>
 #include	<aqsis/version.h>
 #include	"debugdd.h"
+#include	"deepfile.h"
 #include	<aqsis/math/random.h>
 
 namespace Aqsis {
@@ -68,8 +72,7 @@ TqInt CqDDManager::AddDisplay( const TqChar* name, const TqChar* type, const TqC
 	/// \todo The shared_ptr should be declared before the if-else block and initialized inside,
 	// then the last 2 lines in the if-else blocks should follow afterward. I couldn't figure out
 	// how to declare the boost pointer separately from its initialization.
-	//if (std::string(type) == "dsm")
-	if (false)  // Removed until DSM is integrated after aqsis-1.4
+	if (std::string(type) == "deep" || std::string(type) == "dsm")
 	{
 		boost::shared_ptr<CqDisplayRequest> req(new CqDeepDisplayRequest(false, name, type, mode, CqString::hash( mode ), modeID,
 		                                        dataOffset,	dataSize, 0.0f, 255.0f, 0.0f, 0.0f, 0.0f, false, false));
@@ -131,11 +134,18 @@ TqInt CqDDManager::OpenDisplays(TqInt width, TqInt height)
 		m_MemberData.m_strDelayCloseMethod = "DspyImageDelayClose";
 		dspNo++;
 	}
+#ifdef	ENABLE_THREADING
+	m_queue.start();
+#endif
+	// Without threading support the queue is never started, so the display
+	// jobs run directly in the rendering thread.
 	return ( 0 );
 }
 
 TqInt CqDDManager::CloseDisplays()
 {
+	// Make sure all the data has reached the displays before closing them.
+	m_queue.finish();
 	// Now go over any requested displays launching the clients.
 	std::vector< boost::shared_ptr<CqDisplayRequest> >::iterator i;
 	for (i = m_displayRequests.begin(); i!= m_displayRequests.end(); ++i)
@@ -164,12 +174,43 @@ TqInt CqDDManager::DisplayBucket( const CqRegion& DRegion, const IqChannelBuffer
 	std::vector< boost::shared_ptr<CqDisplayRequest> >::iterator i;
 	for ( i = m_displayRequests.begin(); i != m_displayRequests.end(); ++i )
 	{
-		(*i)->DisplayBucket(DRegion, pBuffer);
+		(*i)->DisplayBucket(DRegion, pBuffer, m_queue);
 	}
 	return ( 0 );
 
 }
 
+TqInt CqDDManager::DisplayDeepBucket( const CqRegion& DRegion, const IqDeepBuffer* pBuffer )
+{
+	if ( (pBuffer->width() == 0) || (pBuffer->height() == 0) )
+		return(0);
+
+	// If completely outside the crop rectangle, don't bother sending.
+	if( DRegion.xMax() <= QGetRenderContext()->cropWindowXMin() ||
+		DRegion.yMax() <= QGetRenderContext()->cropWindowYMin() ||
+		DRegion.xMin() > QGetRenderContext()->cropWindowXMax() ||
+		DRegion.yMin() > QGetRenderContext()->cropWindowYMax() )
+		return(0);
+
+	std::vector< boost::shared_ptr<CqDisplayRequest> >::iterator i;
+	for ( i = m_displayRequests.begin(); i != m_displayRequests.end(); ++i )
+	{
+		(*i)->DisplayDeepBucket(DRegion, pBuffer, m_queue);
+	}
+	return ( 0 );
+}
+
+bool CqDDManager::fDisplayNeedsDeepData()
+{
+	std::vector< boost::shared_ptr<CqDisplayRequest> >::iterator i;
+	for (i = m_displayRequests.begin(); i!= m_displayRequests.end(); ++i)
+	{
+		if ( (*i)->NeedsDeepData() )
+			return true;
+	}
+	return ( false );
+}
+
 bool CqDDManager::fDisplayNeeds( const TqChar* var )
 {
 	static TqUlong rgb = CqString::hash( "rgb" );
@@ -420,8 +461,7 @@ void CqDisplayRequest::LoadDisplayLibrary( SqDDMemberData& ddMemberData, CqSimpl
 	}
 
 	// Nullified the data part
-	m_DataRow = 0;
-	m_DataBucket = 0;
+	m_dataRows.clear();
 
 	if ( NULL != m_OpenMethod )
 	{
@@ -645,16 +685,7 @@ void CqDisplayRequest::CloseDisplayLibrary()
 	else if ( NULL != m_CloseMethod )
 		(*m_CloseMethod)(m_imageHandle);
 
-	if (m_DataBucket != 0)
-	{
-		delete [] m_DataBucket;
-		m_DataBucket = 0;
-	}
-	if (m_DataRow != 0)
-	{
-		delete [] m_DataRow;
-		m_DataRow = 0;
-	}
+	m_dataRows.clear();
 
 	// Empty out the display request data
 	m_CloseMethod = NULL;
@@ -981,7 +1012,7 @@ void CqDisplayRequest::PrepareSystemParameters()
 	m_customParams.push_back(parameter);
 }
 
-void CqDisplayRequest::DisplayBucket( const CqRegion& DRegion, const IqChannelBuffer* pBuffer )
+void CqDisplayRequest::DisplayBucket( const CqRegion& DRegion, const IqChannelBuffer* pBuffer, CqDisplayQueue& queue )
 {
 	// If the display is not validated, don't send it data.
 	// Or if a DspyImageData function was not found for
@@ -993,45 +1024,61 @@ void CqDisplayRequest::DisplayBucket( const CqRegion& DRegion, const IqChannelBu
 	TqInt	ymin = DRegion.yMin();
 	TqInt	xmaxplus1 = DRegion.xMax();
 	TqInt	ymaxplus1 = DRegion.yMax();
-	PtDspyError err;
 
 	// Dispatch to display sub-type methods
-	// Copy relevant data from the bucket and store locally,
-	// while quantizing and/or compressing
-	FormatBucketForDisplay( DRegion, pBuffer );
-	// Now that the bucket data has been constructed, send it to the display
-	// either lines by lines or bucket by bucket.
-	// Check if the display needs scanlines, and if so, accumulate bucket data
-	// until a scanline is complete. Send to display when complete.
+	// Copy relevant data from the bucket, while quantizing and/or
+	// compressing.  If the display needs scanlines, the data goes straight
+	// into its place in a row of buckets, otherwise into a buffer of its own.
 	if (m_flags.flags & PkDspyFlagsWantsScanLineOrder)
 	{
-		if (CollapseBucketsToScanlines( DRegion ))
+		SqBucketRow& row = m_dataRows[ymin];
+		if (!row.data)
+		{
+			row.ymaxplus1 = ymaxplus1;
+			row.xmin = xmin;
+			row.data.reset(new unsigned char[m_elementSize * m_width * (ymaxplus1 - ymin)]);
+		}
+		FormatBucketForDisplay( DRegion, pBuffer, &row.data[m_elementSize * xmin], m_elementSize * m_width );
+		row.xmin = min(row.xmin, xmin);
+		row.filled += min(xmaxplus1, m_width) - xmin;
+		// Send complete rows to the display, stopping at the first row which
+		// is still waiting for buckets.
+		while (!m_dataRows.empty() && RowComplete(m_dataRows.begin()->second))
 		{
-			// Filled a scan line: time to send complete rows to display
-			SendToDisplay(ymin, ymaxplus1);
+			std::map<TqInt, SqBucketRow>::iterator first = m_dataRows.begin();
+			Aqsis::log() << debug << "filled a scanline" << std::endl;
+			queue.push(boost::bind(&CqDisplayRequest::SendToDisplay, this,
+						0, m_width, first->first, first->second.ymaxplus1,
+						first->second.data));
+			m_dataRows.erase(first);
 		}
 	}
 	else
 	{
 		// Send the bucket information as they come in
-		err = (m_DataMethod)(m_imageHandle, xmin, xmaxplus1, ymin, ymaxplus1, m_elementSize, m_DataBucket);
+		boost::shared_array<unsigned char> data(
+				new unsigned char[m_elementSize * (xmaxplus1 - xmin) * (ymaxplus1 - ymin)]);
+		FormatBucketForDisplay( DRegion, pBuffer, data.get(), m_elementSize * (xmaxplus1 - xmin) );
+		queue.push(boost::bind(&CqDisplayRequest::SendToDisplay, this,
+					xmin, xmaxplus1, ymin, ymaxplus1, data));
 	}
+}
 
+bool CqDisplayRequest::RowComplete(const SqBucketRow& row) const
+{
+	// Buckets entirely outside the crop window are never sent, so a row
+	// starts with the bucket containing the left edge of the crop window.
+	return row.xmin <= QGetRenderContext()->cropWindowXMin()
+		&& row.filled >= m_width - row.xmin;
 }
 
-void CqDisplayRequest::FormatBucketForDisplay( const CqRegion& DRegion, const IqChannelBuffer* pBuffer )
+void CqDisplayRequest::FormatBucketForDisplay( const CqRegion& DRegion, const IqChannelBuffer* pBuffer,
+		unsigned char* pData, TqInt rowStride )
 {
 	static CqRandom random( 61 );
 
-	if (m_DataBucket == 0)
-		m_DataBucket = new unsigned char[m_elementSize * static_cast<int>(DRegion.area())];
-	if ((m_flags.flags & PkDspyFlagsWantsScanLineOrder) && m_DataRow == 0)
-	{
-		m_DataRow = new unsigned char[m_elementSize * m_width * m_height];
-	}
-
 	// Fill in the bucket data for each channel in each element, honoring the requested order and formats.
-	unsigned char* pdata = m_DataBucket;
+	unsigned char* pdata = pData;
 
 	std::vector<std::pair<TqInt, TqInt> > offsets;
 	std::vector<PtDspyDevFormat>::iterator iformat;
@@ -1045,6 +1092,7 @@ void CqDisplayRequest::FormatBucketForDisplay( const CqRegion& DRegion, const Iq
 
 	for ( TqInt y = 0, endy = pBuffer->height(); y < endy; ++y )
 	{
+		pdata = pData + y * rowStride;
 		for ( TqInt x = 0, endx = pBuffer->width(); x < endx; ++x )
 		{
 			double s = random.RandomFloat();
@@ -1117,66 +1165,135 @@ void CqDisplayRequest::FormatBucketForDisplay( const CqRegion& DRegion, const Iq
 	}
 }
 
-
-void CqDeepDisplayRequest::FormatBucketForDisplay( const CqRegion& DRegion, const IqChannelBuffer* pBuffer )
+void CqDisplayRequest::SendToDisplay( TqInt xmin, TqInt xmaxplus1, TqInt ymin, TqInt ymaxplus1,
+		boost::shared_array<unsigned char> data )
 {
+	if (m_flags.flags & PkDspyFlagsWantsScanLineOrder)
+	{
+		// send to the display one line at a time
+		unsigned char* pdata = data.get();
+		for (TqInt y = ymin; y < ymaxplus1; y++)
+		{
+			(m_DataMethod)(m_imageHandle, xmin, xmaxplus1, y, y+1, m_elementSize, pdata);
+			pdata += m_elementSize * (xmaxplus1 - xmin);
+		}
+	}
+	else
+	{
+		(m_DataMethod)(m_imageHandle, xmin, xmaxplus1, ymin, ymaxplus1, m_elementSize, data.get());
+	}
+}
 
+void CqDisplayRequest::DisplayDeepBucket( const CqRegion& /*DRegion*/, const IqDeepBuffer* /*pBuffer*/, CqDisplayQueue& /*queue*/ )
+{ }
+
+bool CqDisplayRequest::NeedsDeepData() const
+{
+	return false;
 }
 
-//-----------------------------------------------------------------------------
-// Return true if a scanline of buckets has been accumulated, false otherwise.
-//-----------------------------------------------------------------------------
-bool CqDisplayRequest::CollapseBucketsToScanlines( const CqRegion& DRegion )
+
+namespace {
+
+/// Find a custom display parameter of the given type by name.
+const UserParameter* findParameter( const std::vector<UserParameter>& params,
+		const char* name, char vtype )
 {
+	for (std::vector<UserParameter>::const_iterator i = params.begin(); i != params.end(); ++i)
+	{
+		if (i->name && i->vtype == vtype && i->vcount > 0 && std::strcmp(i->name, name) == 0)
+			return &*i;
+	}
+	return 0;
+}
 
-	unsigned char* pdata = m_DataBucket;
-	TqInt	xmin = DRegion.xMin();
-	TqInt	ymin = DRegion.yMin();
-	TqInt	xmaxplus1 = DRegion.xMax();
-	TqInt	ymaxplus1 = DRegion.yMax();
-	TqInt x, y;
+} // unnamed namespace
 
-	for (y = ymin; y < ymaxplus1; y++)
+void CqDeepDisplayRequest::LoadDisplayLibrary( SqDDMemberData& /*ddMemberData*/, CqSimplePlugin& /*dspyPlugin*/, TqInt /*dspNo*/, TqInt width, TqInt height )
+{
+	m_width = width;
+	m_height = height;
+
+	if (const UserParameter* param = findParameter(m_customParams, "mergetolerance", 'f'))
+		m_mergeTolerance = std::max(0.0f, static_cast<const RtFloat*>(param->value)[0]);
+	if (const UserParameter* param = findParameter(m_customParams, "compression", 's'))
+		m_compress = std::strcmp(static_cast<char**>(param->value)[0], "none") != 0;
+
+	// Build the list of channels written for each fragment.
+	std::vector<std::string> channelNames;
+	const char* standardNames[] = {"Z", "R", "G", "B", "AR", "AG", "AB", "A"};
+	const TqInt standardOffsets[] = {Sample_Depth, Sample_Red, Sample_Green, Sample_Blue,
+		Sample_ORed, Sample_OGreen, Sample_OBlue, Sample_Alpha};
+	m_channelOffsets.assign(standardOffsets, standardOffsets + 8);
+	channelNames.assign(standardNames, standardNames + 8);
+	std::map<std::string, CqRenderer::SqOutputDataEntry>& outputMap = QGetRenderContext()->GetMapOfOutputDataEntries();
+	for (std::map<std::string, CqRenderer::SqOutputDataEntry>::iterator aov = outputMap.begin();
+			aov != outputMap.end(); ++aov)
 	{
-		for (x = xmin; x < xmaxplus1; x++)
+		for (TqInt i = 0; i < aov->second.m_NumSamples; ++i)
 		{
-			memcpy(&(m_DataRow[m_width * m_elementSize * (y - ymin) + m_elementSize * x]), pdata, m_elementSize);
-			pdata += m_elementSize;
+			m_channelOffsets.push_back(aov->second.m_Offset + i);
+			channelNames.push_back(boost::str(boost::format("%s.%d") % aov->first % i));
 		}
 	}
 
-	if (xmaxplus1 >= m_width)
+	m_file.reset(new std::ofstream(m_name.c_str(), std::ios::out | std::ios::binary));
+	if (!*m_file)
 	{
-		// Filled a scan line
-		Aqsis::log() << debug << "filled a scanline" << std::endl;
-		return true;
+		Aqsis::log() << error << "Could not open deep display file \"" << m_name << "\"" << std::endl;
+		m_file.reset();
+		m_valid = false;
+		return;
 	}
-	return false;
+
+	std::vector<unsigned char> header;
+	encodeDeepHeader(m_width, m_height, QGetRenderContext()->cropWindowXMin(),
+			QGetRenderContext()->cropWindowYMin(), channelNames, m_compress, header);
+	m_file->write(reinterpret_cast<const char*>(&header[0]), header.size());
+
+	m_valid = true;
+	m_isLoaded = true;
 }
 
-bool CqDeepDisplayRequest::CollapseBucketsToScanlines( const CqRegion& DRegion )
+void CqDeepDisplayRequest::CloseDisplayLibrary()
 {
-	return false;
+	if (m_file)
+	{
+		m_file->close();
+		if (!*m_file)
+			Aqsis::log() << error << "Error writing deep display file \"" << m_name << "\"" << std::endl;
+	}
+	m_file.reset();
+	m_valid = false;
 }
 
-void CqDisplayRequest::SendToDisplay(TqInt ymin, TqInt ymaxplus1)
+void CqDeepDisplayRequest::DisplayBucket( const CqRegion& /*DRegion*/, const IqChannelBuffer* /*pBuffer*/, CqDisplayQueue& /*queue*/ )
+{ }
+
+void CqDeepDisplayRequest::DisplayDeepBucket( const CqRegion& DRegion, const IqDeepBuffer* pBuffer, CqDisplayQueue& queue )
 {
-	//Aqsis::log() << debug << "CqDisplayRequest::SendToDisplay()" << std::endl;
-	TqInt y;
-	PtDspyError err;
-	unsigned char* pdata = m_DataRow;
+	if ( !m_valid || !m_file )
+		return;
 
-	// send to the display one line at a time
-	for (y = ymin; y < ymaxplus1; y++)
+	boost::shared_ptr<std::vector<unsigned char> > chunk(new std::vector<unsigned char>());
+	if (!encodeDeepChunk(DRegion, *pBuffer, m_channelOffsets, m_mergeTolerance,
+				m_compress, *chunk))
 	{
-		err = (m_DataMethod)(m_imageHandle, 0, m_width, y, y+1, m_elementSize, pdata);
-		pdata += m_elementSize * m_width;
+		Aqsis::log() << error << "Could not compress deep data for \"" << m_name << "\"" << std::endl;
+		return;
 	}
+	queue.push(boost::bind(&CqDeepDisplayRequest::WriteChunk, this, chunk));
 }
 
-void CqDeepDisplayRequest::SendToDisplay(TqInt ymin, TqInt ymaxplus1)
+bool CqDeepDisplayRequest::NeedsDeepData() const
 {
+	return m_valid;
+}
 
+void CqDeepDisplayRequest::WriteChunk( boost::shared_ptr<std::vector<unsigned char> > chunk )
+{
+	if (m_file)
+		m_file->write(reinterpret_cast<const char*>(&(*chunk)[0]), chunk->size());
 }
 
 bool CqDisplayRequest::ThisDisplayNeeds( const TqUlong& htoken, const TqUlong& rgb, const TqUlong& rgba,
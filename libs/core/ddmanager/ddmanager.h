@@ -27,11 +27,17 @@
 #ifndef ___ddmanager_Loaded___
 #define ___ddmanager_Loaded___
 
+#include	<fstream>
+#include	<map>
 #include	<vector>
 
+#include	<boost/shared_array.hpp>
+#include	<boost/shared_ptr.hpp>
+
 #include	<aqsis/aqsis.h>
 #include	<aqsis/math/matrix.h>
 #include	<aqsis/ri/ri.h>
+#include	"displayqueue.h"
 #include	"iddmanager.h"
 #include	<aqsis/util/plugins.h>
 #define		DSPY_INTERNAL
@@ -115,8 +121,8 @@ class CqDisplayRequest : public IqDisplayRequest
 		 */
 		virtual	void ThisDisplayUses( TqInt& Uses );
 
-		void LoadDisplayLibrary( SqDDMemberData& ddMemberData, CqSimplePlugin& dspyPlugin, TqInt dspNo, TqInt width, TqInt height );
-		void CloseDisplayLibrary();
+		virtual void LoadDisplayLibrary( SqDDMemberData& ddMemberData, CqSimplePlugin& dspyPlugin, TqInt dspNo, TqInt width, TqInt height );
+		virtual void CloseDisplayLibrary();
 		void ConstructStringsParameter(const char* name, const char** strings, TqInt count, UserParameter& parameter);
 		void ConstructIntsParameter(const char* name, const TqInt* ints, TqInt count, UserParameter& parameter);
 		void ConstructFloatsParameter(const char* name, const TqFloat* floats, TqInt count, UserParameter& parameter);
@@ -124,11 +130,18 @@ class CqDisplayRequest : public IqDisplayRequest
 		void PrepareCustomParameters( std::map<std::string, void*>& mapParams );
 		void PrepareSystemParameters();
 
-		/* Prepare a bucket for display, then send to the display device.
-		 * We implement the standard functionality, but allow child classes
-		 * to override.
+		/* Prepare a bucket for display, then queue it to be sent to the
+		 * display device.  We implement the standard functionality, but allow
+		 * child classes to override.
+		 */
+		virtual void DisplayBucket( const CqRegion& DRegion, const IqChannelBuffer* pBuffer, CqDisplayQueue& queue );
+		/* Queue the surface fragments of a bucket to be written out.  Only
+		 * deep displays make use of these, so the default does nothing.
+		 */
+		virtual void DisplayDeepBucket( const CqRegion& DRegion, const IqDeepBuffer* pBuffer, CqDisplayQueue& queue );
+		/* Query if this display needs the surface fragments of each bucket.
 		 */
-		virtual void DisplayBucket( const CqRegion& DRegion, const IqChannelBuffer* pBuffer);
+		virtual bool NeedsDeepData() const;
 
 		//----------------------------------------------
 		// Pure virtual functions
@@ -138,17 +151,16 @@ class CqDisplayRequest : public IqDisplayRequest
 		virtual const std::string& 	name() const;
 		virtual bool isLoaded() const;
 		/* Does quantization, or in the case of DSM does the compression.
+		 * The rows of formatted data are placed rowStride bytes apart
+		 * starting at pData.
 		 */
-		virtual void FormatBucketForDisplay( const CqRegion& DRegion, const IqChannelBuffer* pBuffer);
-		/* Collapses a row of buckets into a scanline by copying the
-		 * quantized data into a format readable by the display.
-		 * Used when the display wants scanline order.
-		 * Return true if a full row is ready, false otherwise.
+		virtual void FormatBucketForDisplay( const CqRegion& DRegion, const IqChannelBuffer* pBuffer,
+		                                     unsigned char* pData, TqInt rowStride );
+		/* Sends formatted data for a region to the display.  This is called
+		 * from the display queue's output thread when threading is enabled.
 		 */
-		virtual bool CollapseBucketsToScanlines(const CqRegion& DRegion);
-		/* Sends the data to the display.
-		*/
-		virtual void SendToDisplay(TqInt ymin, TqInt ymaxplus1);
+		virtual void SendToDisplay( TqInt xmin, TqInt xmaxplus1, TqInt ymin, TqInt ymaxplus1,
+		                            boost::shared_array<unsigned char> data );
 
 	protected:
 		bool			m_valid;
@@ -182,19 +194,57 @@ class CqDisplayRequest : public IqDisplayRequest
 		DspyImageDelayCloseMethod	m_DelayCloseMethod;
 		bool			m_isLoaded;
 
-		/// \todo Some of the instance data from SqDisplayRequest
-		//  should be split out into a new structure,
-		//  SqFormattedBucketData.
-		//  Specifically, the stuff which deals with holding the data
-		//  which has been copied out of the bucket and quantized:
-		unsigned char  *m_DataRow;    // A row of bucket's data
-		unsigned char  *m_DataBucket; // A bucket's data
+		/// A row of buckets, for displays which want scanline order.
+		struct SqBucketRow
+		{
+			SqBucketRow() : ymaxplus1(0), xmin(0), filled(0), data() {}
+			TqInt ymaxplus1;
+			/// Leftmost pixel and number of pixel columns received so far.
+			TqInt xmin;
+			TqInt filled;
+			boost::shared_array<unsigned char> data;
+		};
+		/** \brief Rows of buckets waiting to be sent, keyed by their first scanline.
+		 *
+		 * Buckets don't always finish in row order, for instance when the
+		 * image buffer finishes a tile early to free geometry, so a row is
+		 * only sent once it and all the rows above it are complete.
+		 */
+		std::map<TqInt, SqBucketRow> m_dataRows;
+		/// Check whether all the buckets in a row have been received.
+		bool RowComplete(const SqBucketRow& row) const;
 
 };
 
 //---------------------------------------------------------------------
 /** \class CqDeepDisplayRequest
- * Class representing a DSM display request
+ * Class representing a deep display request.
+ *
+ * Rather than sending filtered pixels to a display driver, a deep display
+ * writes the depth sorted list of surface fragments at each pixel to a file.
+ * Each fragment holds the depth, colour, opacity, alpha and any AOVs, weighted
+ * by the pixel coverage of the fragment.  Fragments closer together than the
+ * "mergetolerance" display parameter (relative to their depth) are merged,
+ * and the fragment data is compressed with zlib unless the "compression"
+ * parameter is "none".
+ *
+ * The file starts with the header
+ * \verbatim
+ *   char[8]  "AQDEEP01"
+ *   int32    width, height, xorigin, yorigin
+ *   int32    numChannels
+ *   int32    compression (0 = none, 1 = zip)
+ *   char[]   numChannels null terminated channel names
+ * \endverbatim
+ * followed by one chunk per bucket,
+ * \verbatim
+ *   int32    xmin, xmaxplus1, ymin, ymaxplus1
+ *   uint32   raw size, stored size
+ *   char[]   stored data
+ * \endverbatim
+ * The (decompressed) data for a chunk is an int32 fragment count for each
+ * pixel in raster order, followed by the fragments of all the pixels, with
+ * numChannels floats per fragment.  All values are in native byte order.
  */
 class CqDeepDisplayRequest : virtual public CqDisplayRequest
 {
@@ -208,25 +258,37 @@ class CqDeepDisplayRequest : virtual public CqDisplayRequest
 		                     TqFloat quantizeMinVal, TqFloat quantizeMaxVal, TqFloat quantizeDitherVal, bool quantizeSpecified, bool quantizeDitherSpecified) :
 				CqDisplayRequest(valid, name, type, mode, modeHash,
 				                 modeID, dataOffset, dataSize, quantizeZeroVal, quantizeOneVal,
-				                 quantizeMinVal, quantizeMaxVal, quantizeDitherVal, quantizeSpecified, quantizeDitherSpecified)
+				                 quantizeMinVal, quantizeMaxVal, quantizeDitherVal, quantizeSpecified, quantizeDitherSpecified),
+				m_mergeTolerance(0),
+				m_compress(true)
 		{}
 
-		/* Does quantization, or in the case of DSM does the compression.
+		/* Open the output file rather than a display driver.
 		 */
-		virtual void FormatBucketForDisplay( const CqRegion& DRegion, const IqChannelBuffer* pBuffer);
-		/* Collapses a row of buckets into a scanline by copying the
-		 * quantized data into a format readable by the display.
-		 * Used when the display wants scanline order.
-		 * Return true if a full row is ready, false otherwise.
+		virtual void LoadDisplayLibrary( SqDDMemberData& ddMemberData, CqSimplePlugin& dspyPlugin, TqInt dspNo, TqInt width, TqInt height );
+		virtual void CloseDisplayLibrary();
+		/* Deep displays ignore the filtered pixels.
 		 */
-		virtual bool CollapseBucketsToScanlines(const CqRegion& DRegion );
-		/*
-		 * Sends the data to the display.
+		virtual void DisplayBucket( const CqRegion& DRegion, const IqChannelBuffer* pBuffer, CqDisplayQueue& queue );
+		/* Merge and compress the fragments of a bucket, and queue the
+		 * result to be written to the file.
 		 */
-		virtual void SendToDisplay(TqInt ymin, TqInt ymaxplus1);
+		virtual void DisplayDeepBucket( const CqRegion& DRegion, const IqDeepBuffer* pBuffer, CqDisplayQueue& queue );
+		virtual bool NeedsDeepData() const;
 
 	private:
-
+		/* Write a chunk of data to the file.  This is called from the display
+		 * queue's output thread when threading is enabled.
+		 */
+		void WriteChunk( boost::shared_ptr<std::vector<unsigned char> > chunk );
+
+		/// Relative depth difference under which fragments are merged.
+		TqFloat			m_mergeTolerance;
+		/// Whether to compress the fragment data.
+		bool			m_compress;
+		/// Offsets of the written channels in the fragment data.
+		std::vector<TqInt>	m_channelOffsets;
+		boost::shared_ptr<std::ofstream>	m_file;
 };
 
 //---------------------------------------------------------------------
@@ -237,7 +299,7 @@ class CqDeepDisplayRequest : virtual public CqDisplayRequest
 class CqDDManager : public IqDDManager
 {
 	public:
-		CqDDManager() : m_Uses(0)
+		CqDDManager() : m_Uses(0), m_queue(32)
 		{}
 		virtual ~CqDDManager()
 		{}
@@ -261,6 +323,8 @@ class CqDDManager : public IqDDManager
 		virtual	TqInt	OpenDisplays(TqInt width, TqInt height);
 		virtual	TqInt	CloseDisplays();
 		virtual	TqInt	DisplayBucket( const CqRegion& DRegion, const IqChannelBuffer* pBucket );
+		virtual	TqInt	DisplayDeepBucket( const CqRegion& DRegion, const IqDeepBuffer* pBuffer );
+		virtual	bool	fDisplayNeedsDeepData();
 		virtual	bool	fDisplayNeeds( const TqChar* var );
 		virtual	TqInt	Uses();
 
@@ -270,6 +334,9 @@ class CqDDManager : public IqDDManager
 		static SqDDMemberData m_MemberData;
 		CqSimplePlugin m_DspyPlugin;
 		TqInt 	m_Uses;
+		/// Queue of data waiting to be sent to the displays, only started
+		/// when built with ENABLE_THREADING.
+		CqDisplayQueue m_queue;
 };
 
 
@@ -0,0 +1,145 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+/** \file
+		\brief Implements encoding of deep display buckets in the AQDEEP01 file
+		format.
+*/
+
+#include	"deepfile.h"
+
+#include	<cmath>
+#include	<cstring>
+
+#include	<zlib.h>
+
+#include	<aqsis/math/region.h>
+#include	"imagepixel.h"
+
+namespace Aqsis {
+
+namespace {
+
+/// Append the bytes of plain values to a buffer.
+template<typename T>
+void appendBytes( std::vector<unsigned char>& buf, const T* values, TqInt count )
+{
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(values);
+	buf.insert(buf.end(), bytes, bytes + count*sizeof(T));
+}
+
+} // unnamed namespace
+
+void encodeDeepHeader( TqInt width, TqInt height, TqInt xOrigin, TqInt yOrigin,
+		const std::vector<std::string>& channelNames, bool compress,
+		std::vector<unsigned char>& header )
+{
+	appendBytes(header, "AQDEEP01", 8);
+	TqInt32 ints[] = {
+		width, height, xOrigin, yOrigin,
+		static_cast<TqInt32>(channelNames.size()),
+		compress ? 1 : 0
+	};
+	appendBytes(header, ints, 6);
+	for (std::vector<std::string>::const_iterator name = channelNames.begin();
+			name != channelNames.end(); ++name)
+		appendBytes(header, name->c_str(), name->size() + 1);
+}
+
+bool encodeDeepChunk( const CqRegion& region, const IqDeepBuffer& buffer,
+		const std::vector<TqInt>& channelOffsets, TqFloat mergeTolerance,
+		bool compress, std::vector<unsigned char>& chunk )
+{
+	TqInt fragSize = buffer.fragmentSize();
+	TqInt numChannels = channelOffsets.size();
+	TqInt numPixels = buffer.width() * buffer.height();
+
+	// Merge the fragments of each pixel and gather the output channels.
+	std::vector<TqInt32> counts;
+	counts.reserve(numPixels);
+	std::vector<TqFloat> outFrags;
+	std::vector<TqFloat> merged(fragSize);
+	for (TqInt y = 0; y < buffer.height(); ++y)
+	{
+		for (TqInt x = 0; x < buffer.width(); ++x)
+		{
+			TqInt count = 0;
+			const TqFloat* frags = buffer.fragments(x, y, count);
+			TqInt numOut = 0;
+			for (TqInt f = 0; f < count; )
+			{
+				const TqFloat* front = frags + f*fragSize;
+				merged.assign(front, front + fragSize);
+				// Fragments are sorted, so all those within the tolerance
+				// of the front one follow it directly.  The values are
+				// already weighted by coverage, so merging is just a sum.
+				TqFloat maxDepth = front[Sample_Depth]
+					+ mergeTolerance*std::fabs(front[Sample_Depth]);
+				for (++f; f < count && mergeTolerance > 0
+						&& frags[f*fragSize + Sample_Depth] <= maxDepth; ++f)
+				{
+					const TqFloat* frag = frags + f*fragSize;
+					for (TqInt i = 0; i < fragSize; ++i)
+					{
+						if (i != Sample_Depth)
+							merged[i] += frag[i];
+					}
+				}
+				for (TqInt c = 0; c < numChannels; ++c)
+					outFrags.push_back(merged[channelOffsets[c]]);
+				++numOut;
+			}
+			counts.push_back(numOut);
+		}
+	}
+
+	std::vector<unsigned char> raw;
+	raw.reserve(counts.size()*sizeof(TqInt32) + outFrags.size()*sizeof(TqFloat));
+	if (!counts.empty())
+		appendBytes(raw, &counts[0], counts.size());
+	if (!outFrags.empty())
+		appendBytes(raw, &outFrags[0], outFrags.size());
+
+	TqInt32 bounds[] = {region.xMin(), region.xMax(), region.yMin(), region.yMax()};
+	appendBytes(chunk, bounds, 4);
+	TqUint32 rawSize = raw.size();
+	if (compress)
+	{
+		uLongf storedSize = compressBound(rawSize);
+		TqInt sizesStart = chunk.size();
+		TqInt dataStart = sizesStart + 2*sizeof(TqUint32);
+		chunk.resize(dataStart + storedSize);
+		if (compress2(&chunk[dataStart], &storedSize, raw.empty() ? 0 : &raw[0],
+					rawSize, Z_DEFAULT_COMPRESSION) != Z_OK)
+			return false;
+		chunk.resize(dataStart + storedSize);
+		TqUint32 sizes[] = {rawSize, static_cast<TqUint32>(storedSize)};
+		std::memcpy(&chunk[sizesStart], sizes, sizeof(sizes));
+	}
+	else
+	{
+		TqUint32 sizes[] = {rawSize, rawSize};
+		appendBytes(chunk, sizes, 2);
+		chunk.insert(chunk.end(), raw.begin(), raw.end());
+	}
+	return true;
+}
+
+} // namespace Aqsis
@@ -0,0 +1,74 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+/** \file
+		\brief Declares functions which encode the fragments of deep display
+		buckets in the AQDEEP01 file format.
+*/
+
+//? Is deepfile.h included already?
+#ifndef DEEPFILE_H_INCLUDED
+#define DEEPFILE_H_INCLUDED 1
+
+#include	<aqsis/aqsis.h>
+
+#include	<string>
+#include	<vector>
+
+#include	"iddmanager.h"
+
+namespace Aqsis {
+
+class CqRegion;
+
+/** Encode the header of a deep display file.  See CqDeepDisplayRequest for
+ *  a description of the format.
+ *
+ * \param width, height - size of the full image.
+ * \param xOrigin, yOrigin - position of the crop window in the image.
+ * \param channelNames - names of the channels stored for each fragment.
+ * \param compress - whether the fragment data of each chunk is compressed.
+ * \param header - the encoded header is appended to this buffer.
+ */
+void encodeDeepHeader( TqInt width, TqInt height, TqInt xOrigin, TqInt yOrigin,
+		const std::vector<std::string>& channelNames, bool compress,
+		std::vector<unsigned char>& header );
+
+/** Merge the fragments of a bucket and encode them as a file chunk.
+ *
+ * Neighbouring fragments of a pixel whose depth is within mergeTolerance
+ * (relative to the depth of the front one) are summed into a single fragment.
+ *
+ * \param region - region of the image covered by the bucket.
+ * \param buffer - depth sorted fragments of each pixel in the bucket.
+ * \param channelOffsets - offsets in each fragment of the channels to store.
+ * \param mergeTolerance - relative depth under which fragments are merged.
+ * \param compress - whether to compress the fragment data with zlib.
+ * \param chunk - the encoded chunk is appended to this buffer.
+ *
+ * \return false if the data couldn't be compressed.
+ */
+bool encodeDeepChunk( const CqRegion& region, const IqDeepBuffer& buffer,
+		const std::vector<TqInt>& channelOffsets, TqFloat mergeTolerance,
+		bool compress, std::vector<unsigned char>& chunk );
+
+} // namespace Aqsis
+
+#endif	// !DEEPFILE_H_INCLUDED
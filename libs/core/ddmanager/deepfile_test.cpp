@@ -0,0 +1,187 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file Unit tests for encoding deep display data in the AQDEEP01 format.
+ */
+
+#include "deepfile.h"
+
+#include <cstring>
+
+#include <zlib.h>
+
+#include <aqsis/math/region.h>
+#include "deepbuffer.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(deepfile_tests)
+
+using namespace Aqsis;
+
+namespace {
+
+const TqInt fragSize = Sample_Alpha + 1;
+
+/// Read plain values from an encoded buffer, advancing the position.
+template<typename T>
+T readValue(const std::vector<unsigned char>& buf, TqInt& pos)
+{
+	T value;
+	BOOST_REQUIRE(pos + sizeof(T) <= buf.size());
+	std::memcpy(&value, &buf[pos], sizeof(T));
+	pos += sizeof(T);
+	return value;
+}
+
+/// Decoded form of a chunk.
+struct SqChunk
+{
+	TqInt32 bounds[4];
+	std::vector<TqInt32> counts;
+	std::vector<TqFloat> frags;
+};
+
+SqChunk decodeChunk(const std::vector<unsigned char>& chunk, TqInt numPixels,
+		bool compressed)
+{
+	SqChunk result;
+	TqInt pos = 0;
+	for(TqInt i = 0; i < 4; ++i)
+		result.bounds[i] = readValue<TqInt32>(chunk, pos);
+	TqUint32 rawSize = readValue<TqUint32>(chunk, pos);
+	TqUint32 storedSize = readValue<TqUint32>(chunk, pos);
+	BOOST_REQUIRE_EQUAL(pos + storedSize, chunk.size());
+	std::vector<unsigned char> raw(rawSize);
+	if(compressed)
+	{
+		uLongf size = rawSize;
+		BOOST_REQUIRE_EQUAL(uncompress(&raw[0], &size, &chunk[pos], storedSize), Z_OK);
+		BOOST_REQUIRE_EQUAL(size, rawSize);
+	}
+	else
+	{
+		BOOST_REQUIRE_EQUAL(rawSize, storedSize);
+		raw.assign(chunk.begin() + pos, chunk.end());
+	}
+	pos = 0;
+	for(TqInt i = 0; i < numPixels; ++i)
+		result.counts.push_back(readValue<TqInt32>(raw, pos));
+	while(pos < static_cast<TqInt>(raw.size()))
+		result.frags.push_back(readValue<TqFloat>(raw, pos));
+	return result;
+}
+
+/// Fill a 2x1 buffer: two fragments close together and one further back
+/// in the first pixel, nothing in the second.
+void fillBuffer(CqDeepBuffer& buf)
+{
+	buf.clear(2, 1, fragSize);
+	std::vector<TqFloat> frags(3*fragSize, 0);
+	TqFloat depths[] = {1, 1.001f, 2};
+	for(TqInt i = 0; i < 3; ++i)
+	{
+		frags[i*fragSize + Sample_Depth] = depths[i];
+		frags[i*fragSize + Sample_Red] = 0.25f;
+		frags[i*fragSize + Sample_Alpha] = 0.5f;
+	}
+	buf.addPixel(frags);
+	buf.endPixel();
+}
+
+std::vector<TqInt> depthRedAlpha()
+{
+	std::vector<TqInt> offsets;
+	offsets.push_back(Sample_Depth);
+	offsets.push_back(Sample_Red);
+	offsets.push_back(Sample_Alpha);
+	return offsets;
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(encodeDeepHeader_test)
+{
+	std::vector<std::string> names;
+	names.push_back("Z");
+	names.push_back("R");
+	std::vector<unsigned char> header;
+	encodeDeepHeader(640, 480, 16, 32, names, true, header);
+
+	BOOST_REQUIRE(header.size() >= 8);
+	BOOST_CHECK(std::memcmp(&header[0], "AQDEEP01", 8) == 0);
+	TqInt pos = 8;
+	BOOST_CHECK_EQUAL(readValue<TqInt32>(header, pos), 640);
+	BOOST_CHECK_EQUAL(readValue<TqInt32>(header, pos), 480);
+	BOOST_CHECK_EQUAL(readValue<TqInt32>(header, pos), 16);
+	BOOST_CHECK_EQUAL(readValue<TqInt32>(header, pos), 32);
+	BOOST_CHECK_EQUAL(readValue<TqInt32>(header, pos), 2);
+	BOOST_CHECK_EQUAL(readValue<TqInt32>(header, pos), 1);
+	BOOST_CHECK_EQUAL(std::string(header.begin() + pos, header.end()),
+			std::string("Z\0R\0", 4));
+}
+
+BOOST_AUTO_TEST_CASE(encodeDeepChunk_uncompressed_test)
+{
+	CqDeepBuffer buf;
+	fillBuffer(buf);
+	std::vector<unsigned char> chunk;
+	BOOST_REQUIRE(encodeDeepChunk(CqRegion(10, 20, 12, 21), buf,
+				depthRedAlpha(), 0, false, chunk));
+
+	SqChunk decoded = decodeChunk(chunk, 2, false);
+	BOOST_CHECK_EQUAL(decoded.bounds[0], 10);
+	BOOST_CHECK_EQUAL(decoded.bounds[1], 12);
+	BOOST_CHECK_EQUAL(decoded.bounds[2], 20);
+	BOOST_CHECK_EQUAL(decoded.bounds[3], 21);
+	BOOST_REQUIRE_EQUAL(decoded.counts.size(), 2U);
+	BOOST_CHECK_EQUAL(decoded.counts[0], 3);
+	BOOST_CHECK_EQUAL(decoded.counts[1], 0);
+	// Without a merge tolerance, every fragment is kept.
+	BOOST_REQUIRE_EQUAL(decoded.frags.size(), 9U);
+	BOOST_CHECK_EQUAL(decoded.frags[0], 1);
+	BOOST_CHECK_EQUAL(decoded.frags[1], 0.25f);
+	BOOST_CHECK_EQUAL(decoded.frags[2], 0.5f);
+	BOOST_CHECK_EQUAL(decoded.frags[6], 2);
+}
+
+BOOST_AUTO_TEST_CASE(encodeDeepChunk_merge_compressed_test)
+{
+	CqDeepBuffer buf;
+	fillBuffer(buf);
+	std::vector<unsigned char> chunk;
+	BOOST_REQUIRE(encodeDeepChunk(CqRegion(0, 0, 2, 1), buf,
+				depthRedAlpha(), 0.01f, true, chunk));
+
+	// The first two fragments are merged, keeping the front depth and
+	// summing the rest.
+	SqChunk decoded = decodeChunk(chunk, 2, true);
+	BOOST_REQUIRE_EQUAL(decoded.counts.size(), 2U);
+	BOOST_CHECK_EQUAL(decoded.counts[0], 2);
+	BOOST_CHECK_EQUAL(decoded.counts[1], 0);
+	BOOST_REQUIRE_EQUAL(decoded.frags.size(), 6U);
+	BOOST_CHECK_EQUAL(decoded.frags[0], 1);
+	BOOST_CHECK_CLOSE(decoded.frags[1], 0.5f, 1e-4f);
+	BOOST_CHECK_CLOSE(decoded.frags[2], 1.0f, 1e-4f);
+	BOOST_CHECK_EQUAL(decoded.frags[3], 2);
+	BOOST_CHECK_CLOSE(decoded.frags[4], 0.25f, 1e-4f);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
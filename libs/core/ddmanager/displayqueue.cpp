@@ -0,0 +1,101 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+/** \file
+		\brief Implements a queue for sending data to display drivers from a
+		separate thread.
+*/
+
+#include	"displayqueue.h"
+
+#include	<boost/bind.hpp>
+
+namespace Aqsis {
+
+CqDisplayQueue::CqDisplayQueue( TqInt maxJobs )
+	: m_jobs(),
+	m_maxJobs( maxJobs ),
+	m_finishing( false ),
+	m_mutex(),
+	m_jobsAvailable(),
+	m_spaceAvailable(),
+	m_thread()
+{}
+
+CqDisplayQueue::~CqDisplayQueue()
+{
+	finish();
+}
+
+void CqDisplayQueue::start()
+{
+	if ( m_thread )
+		return;
+	m_finishing = false;
+	m_thread.reset( new boost::thread( boost::bind( &CqDisplayQueue::run, this ) ) );
+}
+
+void CqDisplayQueue::push( const TqJob& job )
+{
+	if ( !m_thread )
+	{
+		job();
+		return;
+	}
+	boost::mutex::scoped_lock lock( m_mutex );
+	while ( static_cast<TqInt>( m_jobs.size() ) >= m_maxJobs )
+		m_spaceAvailable.wait( lock );
+	m_jobs.push_back( job );
+	m_jobsAvailable.notify_one();
+}
+
+void CqDisplayQueue::finish()
+{
+	if ( !m_thread )
+		return;
+	{
+		boost::mutex::scoped_lock lock( m_mutex );
+		m_finishing = true;
+		m_jobsAvailable.notify_one();
+	}
+	m_thread->join();
+	m_thread.reset();
+}
+
+void CqDisplayQueue::run()
+{
+	while ( true )
+	{
+		TqJob job;
+		{
+			boost::mutex::scoped_lock lock( m_mutex );
+			while ( m_jobs.empty() && !m_finishing )
+				m_jobsAvailable.wait( lock );
+			if ( m_jobs.empty() )
+				return;
+			job.swap( m_jobs.front() );
+			m_jobs.pop_front();
+			m_spaceAvailable.notify_one();
+		}
+		job();
+	}
+}
+
+} // namespace Aqsis
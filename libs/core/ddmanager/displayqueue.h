@@ -0,0 +1,97 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+/** \file
+		\brief Declares a queue for sending data to display drivers from a
+		separate thread.
+*/
+
+//? Is displayqueue.h included already?
+#ifndef DISPLAYQUEUE_H_INCLUDED
+#define DISPLAYQUEUE_H_INCLUDED 1
+
+#include	<aqsis/aqsis.h>
+
+#include	<deque>
+
+#include	<boost/function.hpp>
+#include	<boost/scoped_ptr.hpp>
+#include	<boost/thread/condition.hpp>
+#include	<boost/thread/mutex.hpp>
+#include	<boost/thread/thread.hpp>
+#include	<boost/utility.hpp>
+
+namespace Aqsis {
+
+//----------------------------------------------------------------------
+/** \class CqDisplayQueue
+ * Bounded queue of display driver calls, run in order on an output thread.
+ *
+ * Display drivers may be slow to accept data, for instance when they
+ * compress the image or send it over a socket.  Queueing the calls lets
+ * the renderer carry on with the next bucket while the output thread feeds
+ * the drivers.  When the queue is full, push() blocks until there is room,
+ * so the amount of pending image data is bounded.
+ *
+ * All jobs run on the one output thread in the order they were pushed, so
+ * drivers see their data in the same order as when called directly.
+ */
+
+class CqDisplayQueue : boost::noncopyable
+{
+	public:
+		typedef boost::function0<void> TqJob;
+
+		/** Construct a queue which holds at most maxJobs pending jobs.
+		 */
+		CqDisplayQueue( TqInt maxJobs );
+		/** Run any remaining jobs and stop the output thread.
+		 */
+		~CqDisplayQueue();
+
+		/** Start the output thread.
+		 */
+		void start();
+		/** Add a job to the queue.
+		 *
+		 * If the output thread isn't running, the job is run immediately.
+		 */
+		void push( const TqJob& job );
+		/** Wait for all queued jobs to complete and stop the output thread.
+		 */
+		void finish();
+
+	private:
+		/** Main loop of the output thread.
+		 */
+		void run();
+
+		std::deque<TqJob>	m_jobs;		///< Pending jobs, oldest first.
+		TqInt	m_maxJobs;		///< Maximum number of pending jobs.
+		bool	m_finishing;		///< True when the output thread should exit once the queue is empty.
+		boost::mutex	m_mutex;		///< Mutex protecting m_jobs and m_finishing.
+		boost::condition	m_jobsAvailable;	///< Signalled when a job is pushed, or on finish().
+		boost::condition	m_spaceAvailable;	///< Signalled when a job is taken from the queue.
+		boost::scoped_ptr<boost::thread>	m_thread;	///< The output thread, or null if not started.
+};
+
+} // namespace Aqsis
+
+#endif	// !DISPLAYQUEUE_H_INCLUDED
@@ -0,0 +1,183 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file Unit tests for the display output queue.
+ */
+
+#include "displayqueue.h"
+
+#include <vector>
+
+#include <boost/bind.hpp>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(displayqueue_tests)
+
+using namespace Aqsis;
+
+namespace {
+
+/// Records the order in which jobs run.
+struct SqJobLog
+{
+	std::vector<TqInt> order;
+	boost::mutex mutex;
+
+	void run(TqInt id)
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		order.push_back(id);
+	}
+};
+
+/// Blocks the output thread until released.
+struct SqGate
+{
+	bool open;
+	boost::mutex mutex;
+	boost::condition opened;
+
+	SqGate() : open(false) {}
+	void wait()
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		while(!open)
+			opened.wait(lock);
+	}
+	void release()
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		open = true;
+		opened.notify_all();
+	}
+};
+
+/// Pushes a range of logging jobs, counting how many pushes returned.
+struct SqPusher
+{
+	CqDisplayQueue* queue;
+	SqJobLog* log;
+	TqInt begin;
+	TqInt end;
+	TqInt pushed;
+	boost::mutex mutex;
+
+	void operator()()
+	{
+		for(TqInt i = begin; i < end; ++i)
+		{
+			queue->push(boost::bind(&SqJobLog::run, log, i));
+			boost::mutex::scoped_lock lock(mutex);
+			++pushed;
+		}
+	}
+	TqInt numPushed()
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		return pushed;
+	}
+};
+
+void checkInOrder(const std::vector<TqInt>& order, TqInt numJobs)
+{
+	BOOST_REQUIRE_EQUAL(static_cast<TqInt>(order.size()), numJobs);
+	for(TqInt i = 0; i < numJobs; ++i)
+		BOOST_CHECK_EQUAL(order[i], i);
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqDisplayQueue_unstarted_runs_immediately_test)
+{
+	SqJobLog log;
+	CqDisplayQueue queue(2);
+	queue.push(boost::bind(&SqJobLog::run, &log, 0));
+	BOOST_REQUIRE_EQUAL(log.order.size(), 1U);
+	queue.push(boost::bind(&SqJobLog::run, &log, 1));
+	checkInOrder(log.order, 2);
+}
+
+BOOST_AUTO_TEST_CASE(CqDisplayQueue_order_test)
+{
+	const TqInt numJobs = 1000;
+	SqJobLog log;
+	CqDisplayQueue queue(4);
+	queue.start();
+	for(TqInt i = 0; i < numJobs; ++i)
+		queue.push(boost::bind(&SqJobLog::run, &log, i));
+	queue.finish();
+	checkInOrder(log.order, numJobs);
+
+	// The queue can be restarted, and jobs pushed after finish() run
+	// immediately.
+	log.order.clear();
+	queue.push(boost::bind(&SqJobLog::run, &log, 0));
+	queue.start();
+	queue.push(boost::bind(&SqJobLog::run, &log, 1));
+	queue.finish();
+	checkInOrder(log.order, 2);
+}
+
+BOOST_AUTO_TEST_CASE(CqDisplayQueue_bounded_test)
+{
+	const TqInt maxJobs = 2;
+	const TqInt numJobs = 6;
+	SqJobLog log;
+	SqGate gate;
+	CqDisplayQueue queue(maxJobs);
+	queue.start();
+	// Hold up the output thread in the first job.
+	queue.push(boost::bind(&SqGate::wait, &gate));
+
+	SqPusher pusher;
+	pusher.queue = &queue;
+	pusher.log = &log;
+	pusher.begin = 0;
+	pusher.end = numJobs;
+	pusher.pushed = 0;
+	boost::thread pushThread(boost::ref(pusher));
+	boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+	// At most maxJobs jobs fit behind the blocked one; the gate job itself
+	// may or may not have left the queue yet.
+	BOOST_CHECK_LE(pusher.numPushed(), maxJobs);
+	BOOST_CHECK(log.order.empty());
+
+	gate.release();
+	pushThread.join();
+	BOOST_CHECK_EQUAL(pusher.numPushed(), numJobs);
+	queue.finish();
+	checkInOrder(log.order, numJobs);
+}
+
+BOOST_AUTO_TEST_CASE(CqDisplayQueue_destructor_finishes_test)
+{
+	const TqInt numJobs = 10;
+	SqJobLog log;
+	{
+		CqDisplayQueue queue(3);
+		queue.start();
+		for(TqInt i = 0; i < numJobs; ++i)
+			queue.push(boost::bind(&SqJobLog::run, &log, i));
+	}
+	checkInOrder(log.order, numJobs);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -57,6 +57,30 @@ class IqChannelBuffer
 };
 
 
+/** \brief Depth-sorted lists of surface fragments for a 2D region of pixels.
+ *
+ * Each fragment is an array of fragmentSize() floats, laid out as the sample
+ * hit data (see EqSampleIndices), with any AOVs following.  All values apart
+ * from the depth are weighted by the fraction of the pixel covered by the
+ * fragment, which is also stored as the fragment coverage.
+ */
+class IqDeepBuffer
+{
+	public:
+		virtual ~IqDeepBuffer() {}
+
+		virtual TqInt width() const = 0;
+		virtual TqInt height() const = 0;
+		/// Get the number of floats in each fragment.
+		virtual TqInt fragmentSize() const = 0;
+		/** Get the fragments for a pixel, sorted front to back.
+		 *
+		 * \param count - returns the number of fragments for the pixel.
+		 */
+		virtual const TqFloat* fragments(TqInt x, TqInt y, TqInt& count) const = 0;
+};
+
+
 class IqDisplayRequest
 {
 	public:
@@ -97,6 +121,13 @@ public:
 	/** Display a bucket.
 	 */
 	virtual	TqInt	DisplayBucket( const CqRegion& DRegion, const IqChannelBuffer* pBuffer ) = 0;
+	/** Display the surface fragments of a bucket to any deep displays.
+	 */
+	virtual	TqInt	DisplayDeepBucket( const CqRegion& DRegion, const IqDeepBuffer* pBuffer ) = 0;
+	/** Determine if any of the displays need the surface fragments of each
+	 *  bucket, rather than just the filtered pixels.
+	 */
+	virtual bool	fDisplayNeedsDeepData() = 0;
 	/** Determine if any of the displays need the named shader variable.
 	 */
 	virtual bool	fDisplayNeeds( const TqChar* var) = 0;
@@ -1,15 +1,25 @@
 set(ddmanager_srcs
 	ddmanager.cpp
 	debugdd.cpp
+	deepfile.cpp
+	displayqueue.cpp
 )
 make_absolute(ddmanager_srcs ${ddmanager_SOURCE_DIR})
 
 set(ddmanager_hdrs
 	ddmanager.h
 	debugdd.h
+	deepfile.h
+	displayqueue.h
 	iddmanager.h
 )
 make_absolute(ddmanager_hdrs ${ddmanager_SOURCE_DIR})
 
 include_directories(${ddmanager_SOURCE_DIR})
 
+set(ddmanager_test_srcs
+	deepfile_test.cpp
+	displayqueue_test.cpp
+)
+make_absolute(ddmanager_test_srcs ${ddmanager_SOURCE_DIR})
+
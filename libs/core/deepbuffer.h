@@ -0,0 +1,170 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+
+/** \file
+		\brief Declares a class to hold the surface fragments for a 2D region
+		of pixels.
+*/
+
+//? Is deepbuffer.h included already?
+#ifndef DEEPBUFFER_H_INCLUDED
+#define DEEPBUFFER_H_INCLUDED 1
+
+#include <aqsis/aqsis.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "iddmanager.h"
+#include "imagepixel.h"
+
+namespace Aqsis {
+
+//-----------------------------------------------------------------------
+/** \class CqDeepBuffer
+ * Class to store the depth-sorted fragments for each pixel of a region.
+ *
+ * The fragments are stored contiguously in raster order, so the buffer is
+ * filled a pixel at a time with addFragment() and endPixel().
+ */
+
+class CqDeepBuffer : public IqDeepBuffer
+{
+	public:
+		CqDeepBuffer();
+		virtual ~CqDeepBuffer() {}
+
+		/** Empty the buffer, ready to be filled with fragments for a new region.
+		 */
+		void clear(TqInt width, TqInt height, TqInt fragmentSize);
+		/** Add a fragment to the current pixel.  Fragments should be added
+		 *  front to back.
+		 */
+		void addFragment(const TqFloat* fragment);
+		/** Finish the current pixel and move on to the next one.
+		 */
+		void endPixel();
+		/** Add all the fragments of a pixel, in any order, and move on to the
+		 *  next pixel.  The fragments are sorted front to back.
+		 *
+		 * \param frags - fragmentSize() floats for each fragment.
+		 */
+		void addPixel(const std::vector<TqFloat>& frags);
+
+		// Overridden from IqDeepBuffer
+		virtual TqInt width() const;
+		virtual TqInt height() const;
+		virtual TqInt fragmentSize() const;
+		virtual const TqFloat* fragments(TqInt x, TqInt y, TqInt& count) const;
+
+	private:
+		TqInt	m_width;
+		TqInt	m_height;
+		TqInt	m_fragmentSize;
+		/// Index of the first fragment of each pixel, plus one past the end.
+		std::vector<TqInt>	m_pixelStarts;
+		/// Fragment data for all pixels.
+		std::vector<TqFloat>	m_data;
+		/// Scratch space for sorting fragments by depth.
+		std::vector<std::pair<TqFloat, TqInt> >	m_order;
+};
+
+
+//==============================================================================
+// Implementation details
+//==============================================================================
+
+inline CqDeepBuffer::CqDeepBuffer()
+	: m_width(0),
+	m_height(0),
+	m_fragmentSize(0),
+	m_pixelStarts(1, 0),
+	m_data(),
+	m_order()
+{ }
+
+inline void CqDeepBuffer::clear(TqInt width, TqInt height, TqInt fragmentSize)
+{
+	m_width = width;
+	m_height = height;
+	m_fragmentSize = fragmentSize;
+	m_pixelStarts.assign(1, 0);
+	m_pixelStarts.reserve(width*height + 1);
+	m_data.clear();
+}
+
+inline void CqDeepBuffer::addFragment(const TqFloat* fragment)
+{
+	m_data.insert(m_data.end(), fragment, fragment + m_fragmentSize);
+}
+
+inline void CqDeepBuffer::endPixel()
+{
+	assert(static_cast<TqInt>(m_pixelStarts.size()) <= m_width*m_height);
+	m_pixelStarts.push_back(m_data.size()/m_fragmentSize);
+}
+
+inline void CqDeepBuffer::addPixel(const std::vector<TqFloat>& frags)
+{
+	TqInt numFrags = frags.size()/m_fragmentSize;
+	m_order.resize(numFrags);
+	for(TqInt i = 0; i < numFrags; ++i)
+		m_order[i] = std::make_pair(frags[i*m_fragmentSize + Sample_Depth], i*m_fragmentSize);
+	std::sort(m_order.begin(), m_order.end());
+	for(TqInt i = 0; i < numFrags; ++i)
+		addFragment(&frags[m_order[i].second]);
+	endPixel();
+}
+
+inline TqInt CqDeepBuffer::width() const
+{
+	return m_width;
+}
+
+inline TqInt CqDeepBuffer::height() const
+{
+	return m_height;
+}
+
+inline TqInt CqDeepBuffer::fragmentSize() const
+{
+	return m_fragmentSize;
+}
+
+inline const TqFloat* CqDeepBuffer::fragments(TqInt x, TqInt y, TqInt& count) const
+{
+	assert(x >= 0 && x < m_width);
+	assert(y >= 0 && y < m_height);
+	TqInt pixel = y*m_width + x;
+	assert(pixel + 1 < static_cast<TqInt>(m_pixelStarts.size()));
+	TqInt start = m_pixelStarts[pixel];
+	count = m_pixelStarts[pixel+1] - start;
+	if(count == 0)
+		return 0;
+	return &m_data[start*m_fragmentSize];
+}
+
+//-----------------------------------------------------------------------
+
+} // namespace Aqsis
+
+#endif	// !DEEPBUFFER_H_INCLUDED
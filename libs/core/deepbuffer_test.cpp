@@ -0,0 +1,96 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file Unit tests for collecting the surface fragments of a region.
+ */
+
+#include "deepbuffer.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(deepbuffer_tests)
+
+using namespace Aqsis;
+
+namespace {
+
+const TqInt fragSize = Sample_Alpha + 1;
+
+/// Append a fragment with the given depth and red value to a pixel.
+void addFrag(std::vector<TqFloat>& frags, TqFloat depth, TqFloat red)
+{
+	TqInt start = frags.size();
+	frags.resize(start + fragSize, 0);
+	frags[start + Sample_Depth] = depth;
+	frags[start + Sample_Red] = red;
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqDeepBuffer_addPixel_sorts_test)
+{
+	CqDeepBuffer buf;
+	buf.clear(2, 2, fragSize);
+
+	std::vector<TqFloat> frags;
+	addFrag(frags, 3, 0.3f);
+	addFrag(frags, 1, 0.1f);
+	addFrag(frags, 2, 0.2f);
+	buf.addPixel(frags);
+	// Pixels with no fragments
+	buf.addPixel(std::vector<TqFloat>());
+	buf.endPixel();
+	frags.clear();
+	addFrag(frags, 5, 0.5f);
+	buf.addPixel(frags);
+
+	TqInt count = -1;
+	const TqFloat* f = buf.fragments(0, 0, count);
+	BOOST_REQUIRE_EQUAL(count, 3);
+	for(TqInt i = 0; i < count; ++i)
+	{
+		BOOST_CHECK_EQUAL(f[i*fragSize + Sample_Depth], i + 1);
+		BOOST_CHECK_CLOSE(f[i*fragSize + Sample_Red], 0.1f*(i + 1), 1e-4f);
+	}
+	BOOST_CHECK(buf.fragments(1, 0, count) == 0);
+	BOOST_CHECK_EQUAL(count, 0);
+	BOOST_CHECK(buf.fragments(0, 1, count) == 0);
+	BOOST_CHECK_EQUAL(count, 0);
+	f = buf.fragments(1, 1, count);
+	BOOST_REQUIRE_EQUAL(count, 1);
+	BOOST_CHECK_EQUAL(f[Sample_Depth], 5);
+}
+
+BOOST_AUTO_TEST_CASE(CqDeepBuffer_clear_test)
+{
+	CqDeepBuffer buf;
+	buf.clear(1, 1, fragSize);
+	std::vector<TqFloat> frags;
+	addFrag(frags, 1, 1);
+	buf.addPixel(frags);
+
+	buf.clear(1, 1, fragSize);
+	buf.endPixel();
+	TqInt count = -1;
+	BOOST_CHECK(buf.fragments(0, 0, count) == 0);
+	BOOST_CHECK_EQUAL(count, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
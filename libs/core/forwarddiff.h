@@ -70,7 +70,7 @@ class CqForwardDiffBezier
 		 * Applies PRECALCULATED matrix to the four bezier control points to calculate
 		 * the FORWARD-DIFFERENCE increments matrix (FD).
 		 */
-		void CalcForwardDiff( T& A, T& B, T& C, T& D )
+		void CalcForwardDiff( const T& A, const T& B, const T& C, const T& D )
 		{
 			f = A;                             // STORE THE START VALUE
 			df = static_cast<T>( A * M20 + B * M21 + C * M22 + D * M23 ); // CALC CHANGE IN START
@@ -94,7 +94,7 @@ void cubicCurveNatSubdiv(
 	CqParameter* pResult2
 )
 {
-	CqParameterTyped<T, SLT>* pTParam = static_cast<CqParameterTyped<T, SLT>*>( pParam );
+	const CqParameterTyped<T, SLT>* pTParam = static_cast<const CqParameterTyped<T, SLT>*>( pParam );
 	CqParameterTyped<T, SLT>* pTResult1 = static_cast<CqParameterTyped<T, SLT>*>( pResult1 );
 	CqParameterTyped<T, SLT>* pTResult2 = static_cast<CqParameterTyped<T, SLT>*>( pResult2 );
 
@@ -163,7 +163,7 @@ void cubicCurveVaryingNatSubdiv(
 	CqParameter* pResult2
 )
 {
-	CqParameterTyped<T, SLT>* pTParam = static_cast<CqParameterTyped<T, SLT>*>( pParam );
+	const CqParameterTyped<T, SLT>* pTParam = static_cast<const CqParameterTyped<T, SLT>*>( pParam );
 	CqParameterTyped<T, SLT>* pTResult1 = static_cast<CqParameterTyped<T, SLT>*>( pResult1 );
 	CqParameterTyped<T, SLT>* pTResult2 = static_cast<CqParameterTyped<T, SLT>*>( pResult2 );
 
@@ -232,7 +232,7 @@ TqInt CqCubicCurveSegment::Split( std::vector<boost::shared_ptr<CqSurface> >& aS
 				TqInt cPatches = SplitToPatch( aSplits );
 				STATS_INC( GEO_crv_splits );
 				STATS_INC( GEO_crv_patch );
-				STATS_SETI( GEO_crv_patch_created, STATS_GETI( GEO_crv_patch_created ) + cPatches );
+				STATS_ADDI( GEO_crv_patch_created, cPatches );
 
 				return cPatches;
 			}
@@ -242,7 +242,7 @@ TqInt CqCubicCurveSegment::Split( std::vector<boost::shared_ptr<CqSurface> >& aS
 				TqInt cCurves = SplitToCurves( aSplits );
 				STATS_INC( GEO_crv_splits );
 				STATS_INC( GEO_crv_crv );
-				STATS_SETI( GEO_crv_crv_created, STATS_GETI( GEO_crv_crv_created ) + cCurves );
+				STATS_ADDI( GEO_crv_crv_created, cCurves );
 
 				return cCurves;
 			}
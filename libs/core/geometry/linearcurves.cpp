@@ -73,7 +73,7 @@ void linCurveNatSubdiv(CqParameter* pParam,
 		CqParameter* pResult1,
 		CqParameter* pResult2)
 {
-	CqParameterTyped<T, SLT>* pTParam = static_cast<CqParameterTyped<T, SLT>*>( pParam );
+	const CqParameterTyped<T, SLT>* pTParam = static_cast<const CqParameterTyped<T, SLT>*>( pParam );
 	CqParameterTyped<T, SLT>* pTResult1 = static_cast<CqParameterTyped<T, SLT>*>( pResult1 );
 	CqParameterTyped<T, SLT>* pTResult2 = static_cast<CqParameterTyped<T, SLT>*>( pResult2 );
 
@@ -142,7 +142,7 @@ TqInt CqLinearCurveSegment::Split( std::vector<boost::shared_ptr<CqSurface> >& a
 				TqInt cPatches = SplitToPatch( aSplits );
 				STATS_INC( GEO_crv_splits );
 				STATS_INC( GEO_crv_patch );
-				STATS_SETI( GEO_crv_patch_created, STATS_GETI( GEO_crv_patch_created ) + cPatches );
+				STATS_ADDI( GEO_crv_patch_created, cPatches );
 
 				return cPatches;
 			}
@@ -153,7 +153,7 @@ TqInt CqLinearCurveSegment::Split( std::vector<boost::shared_ptr<CqSurface> >& a
 				TqInt cCurves = SplitToCurves( aSplits );
 				STATS_INC( GEO_crv_splits );
 				STATS_INC( GEO_crv_crv );
-				STATS_SETI( GEO_crv_crv_created, STATS_GETI( GEO_crv_crv_created ) + cCurves );
+				STATS_ADDI( GEO_crv_crv_created, cCurves );
 
 				return cCurves;
 			}
@@ -90,7 +90,7 @@ void bicubicPatchNatSubdiv(CqParameter* pParam, CqParameter* pResult1,
 {
 	TqInt iu, iv;
 
-	CqParameterTyped<T, SLT>* pTParam = static_cast<CqParameterTyped<T, SLT>*>( pParam );
+	const CqParameterTyped<T, SLT>* pTParam = static_cast<const CqParameterTyped<T, SLT>*>( pParam );
 	CqParameterTyped<T, SLT>* pTResult1 = static_cast<CqParameterTyped<T, SLT>*>( pResult1 );
 	CqParameterTyped<T, SLT>* pTResult2 = static_cast<CqParameterTyped<T, SLT>*>( pResult2 );
 	if ( u )
@@ -206,7 +206,7 @@ template <class T, class SLT>
 void bicubicPatchNatDice(TqFloat uSize, TqFloat vSize, CqParameter* pParam,
 		IqShaderData* pData)
 {
-	CqParameterTyped<T, SLT>* pTParam = static_cast<CqParameterTyped<T, SLT>*>(pParam);
+	const CqParameterTyped<T, SLT>* pTParam = static_cast<const CqParameterTyped<T, SLT>*>(pParam);
 	CqForwardDiffBezier<T> vFD0( 1.0f / vSize );
 	CqForwardDiffBezier<T> vFD1( 1.0f / vSize );
 	CqForwardDiffBezier<T> vFD2( 1.0f / vSize );
@@ -242,8 +242,214 @@ void bicubicPatchNatDice(TqFloat uSize, TqFloat vSize, CqParameter* pParam,
 	}
 }
 
+/** \brief Evaluate the Bernstein basis functions of degree 1 or 3 and their
+ * derivatives at each dice point along an edge.
+ *
+ * The degree+1 values for each dice point are stored contiguously, so a
+ * whole row of a grid can be evaluated without recomputing the basis.
+ */
+void bernsteinBasisRows(TqInt degree, TqInt diceSize, std::vector<TqFloat>& basis,
+		std::vector<TqFloat>& dBasis)
+{
+	const TqInt order = degree + 1;
+	basis.resize((diceSize + 1)*order);
+	dBasis.resize((diceSize + 1)*order);
+	for(TqInt i = 0; i <= diceSize; ++i)
+	{
+		TqFloat t = static_cast<TqFloat>(i)/diceSize;
+		TqFloat s = 1 - t;
+		TqFloat* b = &basis[i*order];
+		TqFloat* db = &dBasis[i*order];
+		if(degree == 1)
+		{
+			b[0] = s;
+			b[1] = t;
+			db[0] = -1;
+			db[1] = 1;
+		}
+		else
+		{
+			b[0] = s*s*s;
+			b[1] = 3*t*s*s;
+			b[2] = 3*t*t*s;
+			b[3] = t*t*t;
+			db[0] = -3*s*s;
+			db[1] = 3*s*s - 6*t*s;
+			db[2] = 6*t*s - 3*t*t;
+			db[3] = 3*t*t;
+		}
+	}
+}
+
+/** \brief Dice P for a bilinear or bicubic Bezier patch, producing the
+ * geometric normals and surface derivatives analytically at the same time.
+ *
+ * The control points are collapsed in v once per grid row, after which each
+ * grid point only needs a single row of basis functions in u.  Ng is left
+ * for CqMicroPolyGrid::CalcNormals() when the patch has degenerate regions,
+ * since the finite difference fallbacks there are more robust.
+ *
+ * \return The standard variables which were filled in on the grid.
+ */
+TqInt dicePatchGeometry(CqSurface& surface, TqInt degree, TqInt uDiceSize,
+		TqInt vDiceSize, CqMicroPolyGrid* pGrid)
+{
+	const CqParameterTyped<CqVector4D, CqVector3D>* pP = surface.P();
+	if(!pP || !pGrid->pVar(EnvVars_P))
+		return 0;
+	TqInt lUses = surface.Uses();
+	TqInt lDone = 0;
+
+	CqVector3D* pointGrid = 0;
+	pGrid->pVar(EnvVars_P)->GetPointPtr(pointGrid);
+	CqVector3D* normalGrid = 0;
+	if(USES(lUses, EnvVars_Ng) && pGrid->pVar(EnvVars_Ng))
+		pGrid->pVar(EnvVars_Ng)->GetNormalPtr(normalGrid);
+
+	// dPdu and dPdv are derivatives with respect to the u and v primitive
+	// variables, which only cover part of the patch parameter range once the
+	// patch has been split.
+	CqVector3D* dPduGrid = 0;
+	CqVector3D* dPdvGrid = 0;
+	TqFloat invURange = 0;
+	TqFloat invVRange = 0;
+	const CqParameterTyped<TqFloat, TqFloat>* pu = surface.u();
+	const CqParameterTyped<TqFloat, TqFloat>* pv = surface.v();
+	if(pu && pv)
+	{
+		TqFloat uRange = pu->pValue(1)[0] - pu->pValue(0)[0];
+		TqFloat vRange = pv->pValue(2)[0] - pv->pValue(0)[0];
+		if(uRange != 0 && vRange != 0)
+		{
+			invURange = 1/uRange;
+			invVRange = 1/vRange;
+			if(USES(lUses, EnvVars_dPdu) && pGrid->pVar(EnvVars_dPdu))
+				pGrid->pVar(EnvVars_dPdu)->GetVectorPtr(dPduGrid);
+			if(USES(lUses, EnvVars_dPdv) && pGrid->pVar(EnvVars_dPdv))
+				pGrid->pVar(EnvVars_dPdv)->GetVectorPtr(dPdvGrid);
+		}
+	}
+
+	// Rational patches are interpolated in homogeneous space and projected
+	// afterwards, so the weights are kept separately and the derivatives
+	// come from the quotient rule.
+	const TqInt order = degree + 1;
+	CqVector3D cp[16];
+	TqFloat cpw[16];
+	for(TqInt i = 0; i < order*order; ++i)
+	{
+		const CqVector4D& Pw = pP->pValue(i)[0];
+		cp[i] = CqVector3D(Pw.x(), Pw.y(), Pw.z());
+		cpw[i] = Pw.h();
+	}
+	const CqVector3D P00 = vectorCast<CqVector3D>(pP->pValue(0)[0]);
+	const CqVector3D P11 = vectorCast<CqVector3D>(pP->pValue(order*order-1)[0]);
+
+	// See CqMicroPolyGrid::CalcNormals() for the orientation convention and
+	// the degeneracy tolerance.  Bezier patches interpolate their corners, so
+	// the diagonal is known before dicing.
+	bool CSO = surface.pTransform()->GetHandedness(surface.pTransform()->Time(0));
+	bool O = surface.pAttributes()->GetIntegerAttribute("System", "Orientation")[0] != 0;
+	bool flipNormals = O ^ CSO;
+	const TqFloat eps = 100*FLT_EPSILON;
+	const TqFloat epsNlen2 = (P00 - P11).Magnitude2()
+		* (P00 - P11).Magnitude2() * eps*eps;
+	bool degenerate = false;
+
+	std::vector<TqFloat> uBasis, duBasis, vBasis, dvBasis;
+	bernsteinBasisRows(degree, uDiceSize, uBasis, duBasis);
+	bernsteinBasisRows(degree, vDiceSize, vBasis, dvBasis);
+
+	CqVector3D row[4];
+	CqVector3D dRow[4];
+	TqFloat wRow[4];
+	TqFloat dwRow[4];
+	for(TqInt iv = 0, igrid = 0; iv <= vDiceSize; ++iv)
+	{
+		// Collapse the control points in v to a single curve in u, along
+		// with its derivative in v.
+		const TqFloat* bv = &vBasis[iv*order];
+		const TqFloat* dbv = &dvBasis[iv*order];
+		for(TqInt i = 0; i < order; ++i)
+		{
+			row[i] = CqVector3D(0, 0, 0);
+			dRow[i] = CqVector3D(0, 0, 0);
+			wRow[i] = 0;
+			dwRow[i] = 0;
+			for(TqInt j = 0; j < order; ++j)
+			{
+				row[i] += bv[j]*cp[j*order + i];
+				dRow[i] += dbv[j]*cp[j*order + i];
+				wRow[i] += bv[j]*cpw[j*order + i];
+				dwRow[i] += dbv[j]*cpw[j*order + i];
+			}
+		}
+
+		for(TqInt iu = 0; iu <= uDiceSize; ++iu, ++igrid)
+		{
+			const TqFloat* bu = &uBasis[iu*order];
+			const TqFloat* dbu = &duBasis[iu*order];
+			CqVector3D P(0, 0, 0);
+			CqVector3D dP_u(0, 0, 0);
+			CqVector3D dP_v(0, 0, 0);
+			TqFloat w = 0;
+			TqFloat dw_u = 0;
+			TqFloat dw_v = 0;
+			for(TqInt i = 0; i < order; ++i)
+			{
+				P += bu[i]*row[i];
+				dP_u += dbu[i]*row[i];
+				dP_v += bu[i]*dRow[i];
+				w += bu[i]*wRow[i];
+				dw_u += dbu[i]*wRow[i];
+				dw_v += bu[i]*dwRow[i];
+			}
+			if(w != 1)
+			{
+				// d(Pw/w) = (dPw - P dw)/w
+				TqFloat wInv = 1/w;
+				P *= wInv;
+				dP_u = (dP_u - dw_u*P)*wInv;
+				dP_v = (dP_v - dw_v*P)*wInv;
+			}
+			pointGrid[igrid] = P;
+			if(dPduGrid)
+				dPduGrid[igrid] = dP_u*invURange;
+			if(dPdvGrid)
+				dPdvGrid[igrid] = dP_v*invVRange;
+			if(normalGrid && !degenerate)
+			{
+				CqVector3D N = dP_u % dP_v;
+				if(N.Magnitude2() <= epsNlen2)
+					degenerate = true;
+				if(flipNormals)
+					N = -N;
+				N.Unit();
+				normalGrid[igrid] = N;
+			}
+		}
+	}
+
+	DONE(lDone, EnvVars_P);
+	if(normalGrid && !degenerate)
+		DONE(lDone, EnvVars_Ng);
+	if(dPduGrid || dPdvGrid)
+	{
+		DONE(lDone, EnvVars_dPdu);
+		DONE(lDone, EnvVars_dPdv);
+	}
+	return lDone;
+}
+
 } // unnamed namespace
 
+/** Dice P, Ng and the surface derivatives in a single pass.
+ */
+TqInt CqSurfacePatchBicubic::DiceAll(CqMicroPolyGrid* pGrid)
+{
+	return dicePatchGeometry(*this, 3, m_uDiceSize, m_vDiceSize, pGrid);
+}
+
 /** Dice the patch into a mesh of micropolygons.
  */
 void CqSurfacePatchBicubic::NaturalDice(CqParameter* pParam, TqInt uDiceSize,
@@ -828,6 +1034,13 @@ TqInt CqSurfacePatchBilinear::Split( std::vector<boost::shared_ptr<CqSurface> >&
 	}
 }
 
+/** Dice P, Ng and the surface derivatives in a single pass.
+ */
+TqInt CqSurfacePatchBilinear::DiceAll(CqMicroPolyGrid* pGrid)
+{
+	return dicePatchGeometry(*this, 1, m_uDiceSize, m_vDiceSize, pGrid);
+}
+
 void CqSurfacePatchBilinear::PostDice(CqMicroPolyGrid * pGrid)
 {
 	if(m_fHasPhantomFourthVertex)
@@ -104,6 +104,7 @@ class CqSurfacePatchBicubic : public CqSurface
 			return ( cVarying() );
 		}
 
+		virtual TqInt DiceAll( CqMicroPolyGrid* pGrid );
 		virtual void NaturalDice( CqParameter* pParameter, TqInt uDiceSize, TqInt vDiceSize, IqShaderData* pData );
 		virtual	TqInt PreSubdivide( std::vector<boost::shared_ptr<CqSurface> >& aSplits, bool u );
 		virtual void NaturalSubdivide( CqParameter* pParam, CqParameter* pParam1, CqParameter* pParam2, bool u );
@@ -177,6 +178,7 @@ class CqSurfacePatchBilinear : public CqSurface
 
 		virtual	TqInt	Split( std::vector<boost::shared_ptr<CqSurface> >& aSplits );
 		virtual	TqInt	PreSubdivide( std::vector<boost::shared_ptr<CqSurface> >& aSplits, bool u );
+		virtual TqInt	DiceAll( CqMicroPolyGrid* pGrid );
 		virtual void	PostDice(CqMicroPolyGrid * pGrid);
 
 	protected:
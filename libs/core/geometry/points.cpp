@@ -272,7 +272,7 @@ void pointsNaturalDice(CqParameter* pParam, const std::vector<TqInt>& paramIdx,
 		return;
 	}
 
-	CqParameterTyped<T, SLT>* pTParam = static_cast<CqParameterTyped<T, SLT>*>(pParam);
+	const CqParameterTyped<T, SLT>* pTParam = static_cast<const CqParameterTyped<T, SLT>*>(pParam);
 	const T* src = pTParam->pValue();
 	for(TqInt j = 0, arraySize = pTParam->Count(); j < arraySize; j++)
 	{
@@ -143,6 +143,21 @@ void CqSurface::AdjustBoundForTransformationMotion( CqBound* B ) const
 }
 
 
+//---------------------------------------------------------------------
+/** Estimate the memory held by the surface, dominated by the primitive
+ * variables for most GPrims.
+ */
+
+TqUlong CqSurface::MemoryUsage() const
+{
+	TqUlong memory = sizeof( *this );
+	for ( std::vector<CqParameter*>::const_iterator iUP = m_aUserParams.begin();
+			iUP != m_aUserParams.end(); ++iUP )
+		memory += ( *iUP ) ->MemoryUsage();
+	return ( memory );
+}
+
+
 //---------------------------------------------------------------------
 /** Default constructor
  */
@@ -159,6 +174,7 @@ CqSurface::CqSurface()
 	m_SplitDir(SplitDir_U),
 	m_CachedBound(false),
 	m_Bound(),
+	m_fConsumed(false),
 	m_pCSGNode()
 {
 	// Set a refernce with the current attributes.
@@ -189,9 +205,7 @@ CqSurface::CqSurface()
 
 	STATS_INC( GPR_allocated );
 	STATS_INC( GPR_current );
-	TqInt cGprim = STATS_GETI( GPR_current );
-	TqInt cPeak = STATS_GETI( GPR_peak );
-	STATS_SETI( GPR_peak, cGprim > cPeak ? cGprim : cPeak );
+	STATS_PEAK( GPR_peak, GPR_current );
 }
 
 
@@ -301,7 +315,7 @@ template <class T, class SLT>
 void surfaceNaturalSubdivide(CqParameter* pParam, CqParameter* pResult1,
 		CqParameter* pResult2, bool u )
 {
-	CqParameterTyped<T, SLT>* pTParam = static_cast<CqParameterTyped<T, SLT>*>( pParam );
+	const CqParameterTyped<T, SLT>* pTParam = static_cast<const CqParameterTyped<T, SLT>*>( pParam );
 	CqParameterTyped<T, SLT>* pTResult1 = static_cast<CqParameterTyped<T, SLT>*>( pResult1 );
 	CqParameterTyped<T, SLT>* pTResult2 = static_cast<CqParameterTyped<T, SLT>*>( pResult2 );
 
@@ -366,7 +380,7 @@ template <class T, class SLT>
 void surfaceNaturalDice(TqFloat uSize, TqFloat vSize, CqParameter* pParam,
 		IqShaderData* pData)
 {
-	CqParameterTyped<T, SLT>* pTParam = static_cast<CqParameterTyped<T, SLT>*>(pParam);
+	const CqParameterTyped<T, SLT>* pTParam = static_cast<const CqParameterTyped<T, SLT>*>(pParam);
 	TqInt iv, iu;
 	for ( iv = 0; iv <= vSize; iv++ )
 	{
@@ -504,6 +518,9 @@ CqMicroPolyGridBase* CqSurface::Dice()
 	if ( isDONE( lDone, EnvVars_Ng ) )
 		pGrid->SetbGeometricNormals( true );
 
+	if ( isDONE( lDone, EnvVars_dPdu ) && isDONE( lDone, EnvVars_dPdv ) )
+		pGrid->SetbSurfaceDerivatives( true );
+
 	// Now we need to dice the user specified parameters as appropriate.
 	std::vector<CqParameter*>::iterator iUP;
 	std::vector<CqParameter*>::iterator end = m_aUserParams.end();
@@ -217,7 +217,28 @@ class CqSurface : public IqSurface, private boost::noncopyable, public boost::en
 		{
 			return ( m_CachedBound );
 		}
+		/** Mark this GPrim as diced, split or discarded, so that other buckets
+		 * overlapping it know not to process it again.
+		 */
+		void	MarkConsumed()
+		{
+			m_fConsumed = true;
+		}
+		/** Determine whether this GPrim has already been diced, split or discarded.
+		 */
+		bool	fConsumed() const
+		{
+			return ( m_fConsumed );
+		}
 		void	AdjustBoundForTransformationMotion( CqBound* B ) const;
+		/** Get an estimate of the memory held by this GPrim.
+		 *
+		 * This is used to decide when to release geometry more aggressively,
+		 * so only needs to be roughly right.
+		 *
+		 * \return Size in bytes of the GPrim and its primitive variables.
+		 */
+		virtual	TqUlong	MemoryUsage() const;
 
 		boost::shared_ptr<CqCSGTreeNode>& pCSGNode()
 		{
@@ -607,6 +628,7 @@ class CqSurface : public IqSurface, private boost::noncopyable, public boost::en
 		EqSplitDir	m_SplitDir;			///< The direction to split this GPrim to achieve best results.
 		bool	m_CachedBound;		///< Whether or not the bound has been cached
 		CqBound	m_Bound;			///< The cached object bound
+		bool	m_fConsumed;		///< Whether or not this GPrim has been diced, split or discarded
 		boost::shared_ptr<CqCSGTreeNode>	m_pCSGNode;		///< Pointer to the 'primitive' CSG node this surface belongs to, NULL if not part of a solid.
 }
 ;
@@ -769,6 +791,14 @@ class CqDeformingSurface : public CqSurface, public CqMotionSpec<boost::shared_p
 				GetMotionObject( Time( i ) ) ->Discard();
 		}
 
+		virtual	TqUlong	MemoryUsage() const
+		{
+			TqUlong memory = sizeof( *this );
+			for ( TqInt i = 0; i < cTimes(); i++ )
+				memory += GetMotionObject( Time( i ) ) ->MemoryUsage();
+			return ( memory );
+		}
+
 		virtual	TqUint	cUniform() const
 		{
 			return ( GetMotionObject( Time( 0 ) ) ->cUniform() );
@@ -29,6 +29,7 @@
 #include    <windows.h>
 #endif
 #include	<math.h>
+#include	<algorithm>
 
 #include	<aqsis/math/math.h>
 #include	"stats.h"
@@ -225,6 +226,9 @@ void	CqImageBuffer::SetImage()
 
 	m_CurrentBucketCol = m_bucketRegion.xMin();
 	m_CurrentBucketRow = m_bucketRegion.yMin();
+	m_nextScanlineBucket = 0;
+
+	m_surfaceIndex.setBucketRegion( m_bucketRegion );
 }
 
 
@@ -396,6 +400,37 @@ void CqImageBuffer::PostSurface( const boost::shared_ptr<CqSurface>& pSurface )
 		return ;
 	}
 
+	CqRegion buckets = BucketRange( Bound, *pSurface );
+
+	// The index refuses surfaces which only touch buckets that have already
+	// been processed.
+	if ( !m_surfaceIndex.insert( pSurface, buckets ) )
+		return;
+
+	// Buckets being rendered have already collected their surfaces from the
+	// index, so surfaces generated during rendering (by splitting) need to be
+	// handed to them directly.
+	boost::mutex::scoped_lock lock( m_activeBucketsMutex );
+	for ( std::vector<CqBucket*>::const_iterator i = m_activeBuckets.begin(),
+			end = m_activeBuckets.end(); i != end; ++i )
+	{
+		CqBucket& bucket = **i;
+		if ( bucket.getCol() >= buckets.xMin() && bucket.getCol() <= buckets.xMax() &&
+		     bucket.getRow() >= buckets.yMin() && bucket.getRow() <= buckets.yMax() )
+			bucket.AddGPrim( pSurface );
+	}
+}
+
+
+//----------------------------------------------------------------------
+/** Compute the range of buckets touched by a surface.
+ * \param Bound The bound of the surface, as adjusted by CullSurface().
+ * \param surface The surface being bucketed.
+ * \return The range of buckets, inclusive of the maximum row and column.
+ */
+
+CqRegion CqImageBuffer::BucketRange( const CqBound& Bound, const CqSurface& surface ) const
+{
 	// If the primitive has been marked as undiceable by the eyeplane check, then we cannot get a valid
 	// bucket index from it as the projection of the bound would cross the camera plane and therefore give a false
 	// result, so just put it back in the current bucket for further splitting.
@@ -403,7 +438,7 @@ void CqImageBuffer::PostSurface( const boost::shared_ptr<CqSurface>& pSurface )
 	TqInt YMinb = 0;
 	TqInt XMaxb = 0;
 	TqInt YMaxb = 0;
-	if (! pSurface->IsUndiceable() )
+	if (! surface.IsUndiceable() )
 	{
 		XMinb = static_cast<TqInt>( Bound.vecMin().x() ) / m_optCache.xBucketSize;
 		YMinb = static_cast<TqInt>( Bound.vecMin().y() ) / m_optCache.yBucketSize;
@@ -414,75 +449,27 @@ void CqImageBuffer::PostSurface( const boost::shared_ptr<CqSurface>& pSurface )
 	YMinb = clamp( YMinb, m_bucketRegion.yMin(), m_bucketRegion.yMax()-1 );
 	XMaxb = clamp( XMaxb, m_bucketRegion.xMin(), m_bucketRegion.xMax()-1 );
 	YMaxb = clamp( YMaxb, m_bucketRegion.yMin(), m_bucketRegion.yMax()-1 );
-
-	// Sanity check we are not putting into a bucket that has already been processed.
-	CqBucket* bucket = &Bucket( XMinb, YMinb );
-	if ( bucket->IsProcessed() )
-	{
-		// Scan over the buckets that the bound touches, looking for the first one that isn't processed.
-		TqInt yb = YMinb;
-		TqInt xb = XMinb + 1;
-		bool done = false;
-		while(!done && yb <= YMaxb)
-		{
-			while(!done && xb <= XMaxb)
-			{
-				CqBucket& availBucket = Bucket(xb, yb);
-				if(!availBucket.IsProcessed())
-				{
-					availBucket.AddGPrim(pSurface);
-					done = true;
-				}
-				++xb;
-			}
-			xb = XMinb;
-			++yb;
-		}
-	}
-	else
-	{
-		bucket->AddGPrim( pSurface );
-	}
+	return CqRegion( XMinb, YMinb, XMaxb, YMaxb );
 }
 
 
 void CqImageBuffer::RepostSurface(const CqBucket& oldBucket,
                                   const boost::shared_ptr<CqSurface>& surface)
 {
-	const CqBound rasterBound = surface->GetCachedRasterBound();
-
-	bool wasPosted = false;
 	// Surface is behind everying in this bucket but it may be visible in other
-	// buckets it overlaps.
-	//
-	// First look in bucket to the right
+	// buckets it overlaps.  Those buckets will pick it up from the surface
+	// index, so there's nothing to move around here.
+#ifdef DEBUG
+	const CqRegion buckets = BucketRange(surface->GetCachedRasterBound(), *surface);
+	bool wasPosted = buckets.yMax() > oldBucket.getRow()
+		|| (buckets.yMax() == oldBucket.getRow() && buckets.xMax() > oldBucket.getCol());
 	TqInt nextBucketX = oldBucket.getCol() + 1;
 	TqInt nextBucketY = oldBucket.getRow();
-	TqInt xpos = oldBucket.getXPosition() + oldBucket.getXSize();
-	if ( nextBucketX < m_bucketRegion.xMax() && rasterBound.vecMax().x() >= xpos )
-	{
-		Bucket( nextBucketX, nextBucketY ).AddGPrim( surface );
-		wasPosted = true;
-	}
-	else
+	if(nextBucketX > buckets.xMax())
 	{
-		// next row
+		nextBucketX = buckets.xMin();
 		++nextBucketY;
-		// find bucket containing left side of bound
-		nextBucketX = max<TqInt>(m_bucketRegion.xMin(),
-				lfloor(rasterBound.vecMin().x())/m_optCache.xBucketSize);
-		TqInt ypos = oldBucket.getYPosition() + oldBucket.getYSize();
-
-		if ( ( nextBucketX < m_bucketRegion.xMax() ) &&
-			( nextBucketY  < m_bucketRegion.yMax() ) &&
-			( rasterBound.vecMax().y() >= ypos ) )
-		{
-			Bucket( nextBucketX, nextBucketY ).AddGPrim( surface );
-			wasPosted = true;
-		}
 	}
-
-#ifdef DEBUG
 	// Print info about reposting.  This is protected by DEBUG so that scenes
 	// with huge amounts of occlusion won't silently be causing *heaps* of
 	// logging traffic.
@@ -506,6 +493,13 @@ void CqImageBuffer::RepostSurface(const CqBucket& oldBucket,
 #endif
 }
 
+
+void CqImageBuffer::ConsumeSurface( const boost::shared_ptr<CqSurface>& surface )
+{
+	surface->MarkConsumed();
+	m_surfaceIndex.surfaceConsumed( surface.get() );
+}
+
 //----------------------------------------------------------------------
 /** Add a new micro polygon to the list of waiting ones.
  * \param pmpgNew Pointer to a CqMicroPolygon derived class.
@@ -631,6 +625,15 @@ void CqImageBuffer::RenderImage()
 			bucketmodulo = m_cXBuckets;
 	}
 
+	// Once the surfaces waiting for buckets hold more than this, buckets are
+	// chosen to release geometry rather than to follow the bucket order.
+	m_geometryMemoryLimit = 0;
+	if ( const TqInt* poptGeomMem = QGetRenderContext() ->poptCurrent()->GetIntegerOption( "limits", "geometrymemory" ) )
+	{
+		if ( poptGeomMem[ 0 ] > 0 )
+			m_geometryMemoryLimit = static_cast<TqUlong>( poptGeomMem[ 0 ] ) * 1024;
+	}
+
 	// Render the surface at the front of the list.
 	RtProgressFunc pProgressHandler = NULL;
 	pProgressHandler = QGetRenderContext()->pProgressHandler();
@@ -684,6 +687,12 @@ void CqImageBuffer::RenderImage()
 
 #ifdef		ENABLE_THREADING
 	numConcurrentBuckets = MULTIPROCESSING_NBUCKETS;
+	if(const TqInt* threads = QGetRenderContext()->poptCurrent()->
+			GetIntegerOption("limits", "threads"))
+	{
+		if(threads[0] > 0)
+			numConcurrentBuckets = threads[0];
+	}
 #endif
 
 	for(int i = 0; i < numConcurrentBuckets; ++i)
@@ -703,6 +712,11 @@ void CqImageBuffer::RenderImage()
 			sampler = &gridSampler;
 	}
 
+	// Only keep per-bucket statistics if a report has been asked for.
+	const CqString* statsFile = QGetRenderContext()->poptCurrent()->
+		GetStringOption("statistics", "filename");
+	bool collectBucketStats = statsFile && !statsFile[0].empty();
+
 	// Iterate over all buckets...
 	bool pendingBuckets = true;
 	while ( pendingBuckets && !m_fQuit )
@@ -712,6 +726,12 @@ void CqImageBuffer::RenderImage()
 
 		for (int i = 0; pendingBuckets && i < numConcurrentBuckets; ++i)
 		{
+			// Collect the surfaces touching the bucket from the index.
+			m_surfaceIndex.fillBucket(CurrentBucket());
+			{
+				boost::mutex::scoped_lock lock(m_activeBucketsMutex);
+				m_activeBuckets.push_back(&CurrentBucket());
+			}
 			bucketProcessors[i]->setBucket(&CurrentBucket());
 
 			// Prepare the bucket processor
@@ -744,7 +764,17 @@ void CqImageBuffer::RenderImage()
 				const CqBucket* bucket = bucketProcessors[i]->getBucket();
 				if (bucket)
 				{
+					if (collectBucketStats)
+					{
+						QGetRenderContext()->Stats().AddBucketStats(bucketProcessors[i]->bucketStats());
+					}
 					QGetRenderContext() ->pDDmanager() ->DisplayBucket( bucketProcessors[i]->DisplayRegion(), &(bucketProcessors[i]->getChannelBuffer()) );
+					if ( QGetRenderContext() ->pDDmanager() ->fDisplayNeedsDeepData() )
+						QGetRenderContext() ->pDDmanager() ->DisplayDeepBucket( bucketProcessors[i]->DisplayRegion(), &(bucketProcessors[i]->getDeepBuffer()) );
+					m_surfaceIndex.bucketFinished(*bucket);
+					boost::mutex::scoped_lock lock(m_activeBucketsMutex);
+					m_activeBuckets.erase(std::find(m_activeBuckets.begin(),
+								m_activeBuckets.end(), bucket));
 				}
 			}
 			bucketProcessors[i]->reset();
@@ -764,6 +794,21 @@ void CqImageBuffer::RenderImage()
 		}
 	}
 
+	STATS_SETI( GPR_mem_peak, static_cast<TqInt>( m_surfaceIndex.peakMemory() / 1024 ) );
+	// The bucket threads have finished, so bring the main thread's peak
+	// counters up to date with what they created and freed.
+	CqStats::syncPeaks();
+
+	// Release anything left over, for instance if the render was stopped early.
+	m_surfaceIndex.clear();
+	{
+		boost::mutex::scoped_lock lock(m_activeBucketsMutex);
+		m_activeBuckets.clear();
+	}
+	// With the frame finished the micropolygons are all gone, so hand the
+	// pooled memory back rather than holding it until the next frame.
+	CqObjectPoolBase::releaseUnusedMemory();
+
 	// Pass >100 through to progress to allow it to indicate completion.
 	if ( pProgressHandler )
 	{
@@ -786,20 +831,39 @@ void CqImageBuffer::Quit()
 
   Computes the next bucket based on the "render" "bucketorder" given.
 
+  If the surfaces waiting to be rendered hold more memory than the
+  "limits" "geometrymemory" option allows, the remaining buckets in the
+  current tile of the surface index are finished first.  Surfaces are
+  released when the last bucket they touch is done, so this frees compact
+  groups of surfaces rather than leaving a whole row of buckets half done.
+  Buckets then finish out of row order; displays which want scanlines hold
+  rows back until the rows above them are complete.
+
   \return True if there is still an unprocessed bucket left, otherwise False.
  */
 bool CqImageBuffer::NextBucket(EqBucketOrder order)
 {
-	// only deal with horizontal bucket orders for now.
-	m_CurrentBucketCol++;
+	if( m_geometryMemoryLimit > 0
+		&& m_surfaceIndex.residentMemory() > m_geometryMemoryLimit
+		&& NextBucketInTile() )
+		return true;
 
-	if( m_CurrentBucketCol >= m_bucketRegion.xMax() )
+	// only deal with horizontal bucket orders for now.  Buckets before
+	// m_nextScanlineBucket have all been started, but some after it may
+	// have been started out of order.
+	const TqInt width = m_bucketRegion.width();
+	for( ; m_nextScanlineBucket < m_bucketRegion.area(); ++m_nextScanlineBucket )
 	{
-		m_CurrentBucketCol = m_bucketRegion.xMin();
-		m_CurrentBucketRow++;
-		if( m_CurrentBucketRow >= m_bucketRegion.yMax() )
-			return false;
+		TqInt col = m_bucketRegion.xMin() + m_nextScanlineBucket % width;
+		TqInt row = m_bucketRegion.yMin() + m_nextScanlineBucket / width;
+		if( !BucketStarted(col, row) )
+		{
+			m_CurrentBucketCol = col;
+			m_CurrentBucketRow = row;
+			return true;
+		}
 	}
+	return false;
 
 	// General bucket orders are not ready for prime time.
 	// WARNING: The code below needs to be adjusted to deal with m_bucketRegion
@@ -956,7 +1020,39 @@ bool CqImageBuffer::NextBucket(EqBucketOrder order)
 		break;
 	}
 #endif
-	return( true );
+}
+
+bool CqImageBuffer::NextBucketInTile()
+{
+	const TqInt tileSize = CqBucketSurfaceIndex::tileSize;
+	TqInt tileCol = m_bucketRegion.xMin()
+		+ (m_CurrentBucketCol - m_bucketRegion.xMin())/tileSize*tileSize;
+	TqInt tileRow = m_bucketRegion.yMin()
+		+ (m_CurrentBucketRow - m_bucketRegion.yMin())/tileSize*tileSize;
+	TqInt colEnd = min(tileCol + tileSize, m_bucketRegion.xMax());
+	TqInt rowEnd = min(tileRow + tileSize, m_bucketRegion.yMax());
+	for( TqInt row = tileRow; row < rowEnd; ++row )
+	{
+		for( TqInt col = tileCol; col < colEnd; ++col )
+		{
+			if( !BucketStarted(col, row) )
+			{
+				m_CurrentBucketCol = col;
+				m_CurrentBucketRow = row;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+bool CqImageBuffer::BucketStarted(TqInt x, TqInt y) const
+{
+	const CqBucket* bucket = &m_Buckets[y][x];
+	boost::mutex::scoped_lock lock(m_activeBucketsMutex);
+	return bucket->IsProcessed()
+		|| std::find(m_activeBuckets.begin(), m_activeBuckets.end(), bucket)
+			!= m_activeBuckets.end();
 }
 
 //---------------------------------------------------------------------
@@ -32,9 +32,12 @@
 
 #include	<vector>
 
+#include	<boost/thread/mutex.hpp>
+
 #include	"surface.h"
 #include	<aqsis/math/vector2d.h>
 #include   	"bucket.h"
+#include	"bucketindex.h"
 #include	"mpdump.h"
 #include	"optioncache.h"
 
@@ -67,8 +70,9 @@ enum EqBucketOrder {
   can be added to the buffer. This is done by calling PostSurface() for each gprim.
   (note: before calling this method the gprim has to be transformed into camera space!)
   All the gprims that can be culled at this point (i.e. CullSurface() returns true) 
-  won't be stored inside the buffer. If a gprim can't be culled it is assigned to
-  the first bucket that touches its bound.
+  won't be stored inside the buffer. If a gprim can't be culled it is inserted
+  into a screen space index (CqBucketSurfaceIndex), from which each bucket
+  collects the gprims touching it just before it is rendered.
  
   Once all the gprims are posted to the buffer the image can be rendered by calling
   RenderImage(). Now all buckets will be processed one after another. 
@@ -84,7 +88,9 @@ class CqImageBuffer
 				m_cXBuckets( 0 ),
 				m_cYBuckets( 0 ),
 				m_CurrentBucketCol( 0 ),
-				m_CurrentBucketRow( 0 )
+				m_CurrentBucketRow( 0 ),
+				m_nextScanlineBucket( 0 ),
+				m_geometryMemoryLimit( 0 )
 		{}
 		~CqImageBuffer();
 
@@ -92,16 +98,25 @@ class CqImageBuffer
 		void PostSurface( const boost::shared_ptr<CqSurface>& pSurface );
 		/** \brief Repost a previously posted surface into the next unfinished bucket.
 		 *
-		 * The surface is reposted it to the next unfinished bucket within the
-		 * surface's bound, skipping the old bucket.  Using this function is
-		 * relevant when the surface is culled in the current bucket for
-		 * reasons such as occlusion culling.
+		 * The surface remains in the surface index until it's consumed, so
+		 * the next unfinished bucket within the surface's bound will pick it
+		 * up without any further work.  Using this function is relevant when
+		 * the surface is culled in the current bucket for reasons such as
+		 * occlusion culling.
 		 *
 		 * \param oldBucket - previous bucket holding the surface.
 		 * \param surface - surface to repost
 		 */
 		void RepostSurface( const CqBucket& oldBucket,
 		                    const boost::shared_ptr<CqSurface>& surface );
+		/** \brief Mark a posted surface as diced, split or discarded.
+		 *
+		 * This stops any other buckets overlapping the surface from
+		 * processing it again, and allows the surface index to release it.
+		 *
+		 * \param surface - surface which has been consumed.
+		 */
+		void ConsumeSurface( const boost::shared_ptr<CqSurface>& surface );
 		void RenderImage();
 
 		void SetImage();
@@ -121,6 +136,11 @@ class CqImageBuffer
 		 *  \param neighbours - A reference to the array to be filled.
 		 */
 		void	axialNeighbours(CqBucket const& bucket, std::vector<CqBucket*>& neighbours);
+		/// Memory used by the posted surfaces waiting for buckets, in bytes.
+		TqUlong	geometryMemory() const
+		{
+			return m_surfaceIndex.residentMemory();
+		}
 
 	private:
 		/// Get a pointer to the bucket at position x,y in the grid.
@@ -141,19 +161,36 @@ class CqImageBuffer
 		TqInt	m_cYBuckets;		///< Integer vertical bucket count.
 
 		std::vector<std::vector<CqBucket> >	m_Buckets; ///< Array of bucket storage classes (row/col)
+		CqBucketSurfaceIndex	m_surfaceIndex;	///< Index of posted surfaces waiting for buckets.
+		std::vector<CqBucket*>	m_activeBuckets;	///< Buckets currently being rendered.
+		/// Protects m_activeBuckets, which PostSurface() reads from the bucket threads.
+		mutable boost::mutex	m_activeBucketsMutex;
 		TqInt	m_CurrentBucketCol;	///< Column index of the bucket currently being processed.
 		TqInt	m_CurrentBucketRow;	///< Row index of the bucket currently being processed.
+		TqInt	m_nextScanlineBucket;	///< Scanline index of the first bucket which might not be started.
+		TqUlong	m_geometryMemoryLimit;	///< Geometry memory above which buckets are chosen to free memory, or 0.
 
 #if ENABLE_MPDUMP
 		CqMPDump	m_mpdump;
 #endif
 
 		bool	CullSurface( CqBound& Bound, const boost::shared_ptr<CqSurface>& pSurface );
+		/** Get the inclusive range of buckets touched by a surface, given its
+		 * bound as computed by CullSurface().
+		 */
+		CqRegion	BucketRange( const CqBound& Bound, const CqSurface& surface ) const;
 		void	DeleteImage();
 
 		/** Move to the next bucket to process.
 		 */
 		bool NextBucket(EqBucketOrder order);
+		/** Move to the next unstarted bucket in the tile of the surface index
+		 * containing the current bucket.
+		 */
+		bool NextBucketInTile();
+		/** Determine whether a bucket has been rendered or is being rendered.
+		 */
+		bool BucketStarted(TqInt x, TqInt y) const;
 
 		/** Get a pointer to the current bucket
 		 */
@@ -40,6 +40,13 @@ namespace Aqsis {
 
 TqInt SqImageSample::sampleSize(9);
 
+const char* const costChannelNames[Cost_Last] = {
+	"_cost_shading",
+	"_cost_samples",
+	"_cost_gprims",
+	"_cost_texture"
+};
+
 //----------------------------------------------------------------------
 /** Constructor
  */
@@ -51,11 +58,14 @@ CqImagePixel::CqImagePixel(TqInt xSamples, TqInt ySamples)
 		m_hitSamples(),
 		m_DofOffsetIndices(new TqInt[xSamples*ySamples]),
 		m_refCount(0),
-		m_hasValidSamples(false)
+		m_hasValidSamples(false),
+		m_costs(),
+		m_lastCostGrid(0)
 {
 	assert(xSamples > 0);
 	assert(ySamples > 0);
 
+	m_costs.fill(0);
 	TqInt nSamples = numSamples();
 	// Allocate sample storage for all the occluding hits.
 	TqInt sampSize = SqImageSample::sampleSize;
@@ -73,6 +83,8 @@ void CqImagePixel::swap(CqImagePixel& other)
 	m_samples.swap(other.m_samples);
 	m_DofOffsetIndices.swap(other.m_DofOffsetIndices);
 	m_hasValidSamples = other.m_hasValidSamples;
+	m_costs.swap(other.m_costs);
+	std::swap(m_lastCostGrid, other.m_lastCostGrid);
 }
 
 void CqImagePixel::setupGridPattern(CqVector2D& offset, TqFloat opentime,
@@ -108,6 +120,8 @@ void CqImagePixel::clear()
 	TqInt sampSize = SqImageSample::sampleSize;
 	m_hitSamples.resize(nSamples*sampSize);
 	m_hasValidSamples = false;
+	m_costs.fill(0);
+	m_lastCostGrid = 0;
 	for(TqInt i = 0; i < nSamples; ++i)
 	{
 		if(!m_samples[i].data.empty())
@@ -31,6 +31,7 @@
 #include	<vector>
 #include	<cfloat> // for FLT_MAX
 
+#include	<boost/array.hpp>
 #include	<boost/intrusive_ptr.hpp>
 #include	<boost/scoped_array.hpp>
 #include	<boost/noncopyable.hpp>
@@ -60,6 +61,23 @@ enum EqSampleIndices
     Sample_Alpha = 8,
 };
 
+/** \brief Measures of the work done to render a pixel.
+ *
+ * These are recorded for each pixel when a display asks for one of the
+ * "_cost_*" channels, to show which parts of the image are expensive.
+ */
+enum EqCostChannel
+{
+    Cost_Shading = 0,	///< Time spent shading the micropolygons, in seconds.
+    Cost_Samples,		///< Number of samples tested against micropolygons.
+    Cost_Gprims,		///< Number of grids with micropolygons over the pixel.
+    Cost_Texture,		///< Texture data read while shading, in bytes.
+    Cost_Last
+};
+
+/// Display channel names for the entries of EqCostChannel.
+extern const char* const costChannelNames[Cost_Last];
+
 
 /** \brief Holder for data from a hit of a micropoly against a sample point.
  *
@@ -293,6 +311,17 @@ class CqImagePixel : private boost::noncopyable
 		/// Check if the pixel has any valid samples.
 		bool hasValidSamples();
 
+		/// Add to the render cost recorded for the pixel.
+		void addCost(EqCostChannel channel, TqFloat cost);
+		/// Get the render cost recorded for the pixel.
+		TqFloat cost(EqCostChannel channel) const;
+		/** \brief Count a grid towards the Cost_Gprims cost of the pixel.
+		 *
+		 * Grids are identified by a serial number, and each is only counted
+		 * once however many of its micropolygons cover the pixel.
+		 */
+		void addGridCost(TqUlong gridSerial);
+
 		/** \brief Fill in the sample data using the given distribution object.
 		 *  Initialise the camera sample information for this pixel, including
 		 *  position, depth of field data, motion time and level of detail values.
@@ -324,6 +353,10 @@ class CqImagePixel : private boost::noncopyable
 		int m_refCount;
 		/// A flag to indicate successful sample hits in this pixel.
 		bool m_hasValidSamples;
+		/// Render costs recorded for the pixel, indexed by EqCostChannel.
+		boost::array<TqFloat, Cost_Last> m_costs;
+		/// Serial number of the last grid counted in the Cost_Gprims cost.
+		TqUlong m_lastCostGrid;
 }; 
 
 /// Intrusive reference counted pointer to a pixel class.
@@ -511,6 +544,25 @@ inline bool CqImagePixel::hasValidSamples()
 	return m_hasValidSamples;
 }
 
+inline void CqImagePixel::addCost(EqCostChannel channel, TqFloat cost)
+{
+	m_costs[channel] += cost;
+}
+
+inline TqFloat CqImagePixel::cost(EqCostChannel channel) const
+{
+	return m_costs[channel];
+}
+
+inline void CqImagePixel::addGridCost(TqUlong gridSerial)
+{
+	if(gridSerial != m_lastCostGrid)
+	{
+		m_lastCostGrid = gridSerial;
+		m_costs[Cost_Gprims] += 1;
+	}
+}
+
 //------------------------------------------------------------------------------
 // CqPixelPool implementation
 inline CqPixelPool::CqPixelPool(TqInt xSamples, TqInt ySamples)
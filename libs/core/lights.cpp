@@ -27,6 +27,8 @@
 #include	"lights.h"
 #include	<aqsis/util/file.h>
 #include	"renderer.h"
+#include	"bound.h"
+#include	"stats.h"
 
 namespace Aqsis {
 
@@ -57,6 +59,34 @@ CqLightsource::~CqLightsource()
 }
 
 
+//---------------------------------------------------------------------
+/** Test the "light" "influencebound" attribute against a region of space.
+ * The bound is specified in the coordinate system which was active when the
+ * light was declared.
+ */
+
+bool CqLightsource::Influences( const CqVector3D& vecMin, const CqVector3D& vecMax )
+{
+	const TqFloat* influenceBound = m_pAttributes->GetFloatAttribute( "light", "influencebound" );
+	if ( influenceBound && m_pShader )
+	{
+		CqMatrix mat;
+		QGetRenderContext() ->matSpaceToSpace( "shader", "current", m_pShader->getTransform(), NULL, QGetRenderContextI()->Time(), mat );
+		CqBound bound( influenceBound );
+		bound.Transform( mat );
+		if ( vecMin.x() > bound.vecMax().x() || vecMax.x() < bound.vecMin().x() ||
+		     vecMin.y() > bound.vecMax().y() || vecMax.y() < bound.vecMin().y() ||
+		     vecMin.z() > bound.vecMax().z() || vecMax.z() < bound.vecMin().z() )
+		{
+			STATS_INC( LGT_culled );
+			return ( false );
+		}
+	}
+	STATS_INC( LGT_evaluated );
+	return ( true );
+}
+
+
 //---------------------------------------------------------------------
 /** Initialise the environment for the specified grid size.
  * \param iGridRes Integer grid resolution.
@@ -93,6 +93,11 @@ class CqLightsource : public IqLightsource, public boost::enable_shared_from_thi
 			m_pShaderExecEnv->SetCurrentSurface(pSurface);
 			m_pShader->Evaluate( m_pShaderExecEnv.get() );
 		}
+		/** Determine whether the lightsource can affect a region of space.
+		 * Lights with no "light" "influencebound" attribute are assumed to
+		 * reach everywhere.
+		 */
+		virtual bool	Influences( const CqVector3D& vecMin, const CqVector3D& vecMax );
 		/** Get a pointer to the attributes state associated with this GPrim.
 		 * \return A pointer to a CqAttributes class.
 		 */
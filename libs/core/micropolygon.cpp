@@ -63,6 +63,18 @@ void CqMicroPolyGridBase::CacheGridInfo(const boost::shared_ptr<const CqSurface>
 
 	m_CurrentGridInfo.lodBounds
 		= attrs.GetFloatAttribute("System", "LevelOfDetailBounds");
+
+	m_CurrentGridInfo.shadingCost = 0;
+	m_CurrentGridInfo.textureCost = 0;
+}
+
+void CqMicroPolyGridBase::SetRenderCosts( TqFloat shadingTime, TqFloat textureBytes )
+{
+	TqUint numMPGs = numMicroPolygons( uGridRes(), vGridRes() );
+	if ( numMPGs == 0 )
+		return;
+	m_CurrentGridInfo.shadingCost = shadingTime / numMPGs;
+	m_CurrentGridInfo.textureCost = textureBytes / numMPGs;
 }
 
 
@@ -73,14 +85,13 @@ void CqMicroPolyGridBase::CacheGridInfo(const boost::shared_ptr<const CqSurface>
 CqMicroPolyGrid::CqMicroPolyGrid() : CqMicroPolyGridBase(),
 		m_bShadingNormals( false ),
 		m_bGeometricNormals( false ), 
+		m_bSurfaceDerivatives( false ),
 		m_pShaderExecEnv(IqShaderExecEnv::create(QGetRenderContextI()))
 {
 	STATS_INC( GRD_allocated );
 	STATS_INC( GRD_current );
 	STATS_INC( GRD_allocated );
-	TqInt cGRD = STATS_GETI( GRD_current );
-	TqInt cPeak = STATS_GETI( GRD_peak );
-	STATS_SETI( GRD_peak, cGRD > cPeak ? cGRD : cPeak );
+	STATS_PEAK( GRD_peak, GRD_current );
 }
 
 
@@ -403,8 +414,8 @@ void CqMicroPolyGrid::Shade( bool canCullGrid )
 			break;
 	}
 
-	// Calculate surface derivatives if necessary.
-	if ( USES( lUses, EnvVars_dPdu ) || USES( lUses, EnvVars_dPdv ) )
+	// Calculate surface derivatives if necessary and not specified by the surface.
+	if ( !bSurfaceDerivatives() && ( USES( lUses, EnvVars_dPdu ) || USES( lUses, EnvVars_dPdv ) ) )
 		CalcSurfaceDerivatives();
 
 	// Initialize surface color Ci to black
@@ -864,11 +875,9 @@ void CqMicroPolyGrid::Split( long xmin, long xmax, long ymin, long ymax )
 			area *= 0.5f;
 			area = fabs(area);
 
-			STATS_SETF( MPG_average_area, STATS_GETF( MPG_average_area ) + area );
-			if( area < STATS_GETF( MPG_min_area ) )
-				STATS_SETF( MPG_min_area, area );
-			if( area > STATS_GETF( MPG_max_area ) )
-				STATS_SETF( MPG_max_area, area );
+			STATS_ADDF( MPG_average_area, area );
+			STATS_MINF( MPG_min_area, area );
+			STATS_MAXF( MPG_max_area, area );
 
 		//	smallArea = std::min(smallArea, area);
 		//	bigArea = std::max(bigArea, area);
@@ -935,6 +944,18 @@ void CqMotionMicroPolyGrid::TransferOutputVariables()
 }
 
 
+//---------------------------------------------------------------------
+/** Record the render costs against the primary grid, which is the one
+ * referenced by the micropolygons.
+ */
+
+void CqMotionMicroPolyGrid::SetRenderCosts( TqFloat shadingTime, TqFloat textureBytes )
+{
+	CqMicroPolyGrid * pGrid = static_cast<CqMicroPolyGrid*>( GetMotionObject( Time( 0 ) ) );
+	pGrid->SetRenderCosts( shadingTime, textureBytes );
+}
+
+
 //---------------------------------------------------------------------
 /** Split the micropolygrid into individual MPGs,
  * \param xmin Integer minimum extend of the image part being rendered, takes into account buckets and clipping.
@@ -1164,9 +1185,7 @@ CqMicroPolygon::CqMicroPolygon(CqMicroPolyGridBase* pGrid, TqInt Index ) : m_pGr
 {
 	STATS_INC( MPG_allocated );
 	STATS_INC( MPG_current );
-	TqInt cMPG = STATS_GETI( MPG_current );
-	TqInt cPeak = STATS_GETI( MPG_peak );
-	STATS_SETI( MPG_peak, cMPG > cPeak ? cMPG : cPeak );
+	STATS_PEAK( MPG_peak, MPG_current );
 	ADDREF(pGrid);
 }
 
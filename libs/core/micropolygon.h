@@ -60,6 +60,10 @@ struct SqGridInfo
 	TqUchar matteFlag;
 	bool usesDataMap;
 	bool useSmoothShading;
+	/// Shading time per micropolygon, in seconds.
+	TqFloat shadingCost;
+	/// Texture data read while shading per micropolygon, in bytes.
+	TqFloat textureCost;
 };
 
 
@@ -194,6 +198,13 @@ class CqMicroPolyGridBase : public CqRefCount
 		{
 			return m_CurrentGridInfo;
 		}
+		/** Record the cost of shading the grid, to be shared out between
+		 * its micropolygons.
+		 *
+		 * \param shadingTime - time taken to shade the grid in seconds.
+		 * \param textureBytes - texture data read while shading the grid.
+		 */
+		virtual void SetRenderCosts( TqFloat shadingTime, TqFloat textureBytes );
 
 	protected:
 		bool m_fCulled; ///< Boolean indicating the entire grid is culled.
@@ -257,6 +268,13 @@ class CqMicroPolyGrid : public CqMicroPolyGridBase
 		{
 			m_bGeometricNormals = f;
 		}
+		/** Set the surface derivatives flag, indicating this grid has dPdu and dPdv already specified.
+		 * \param f The new state of the flag.
+		 */
+		void	SetbSurfaceDerivatives( bool f )
+		{
+			m_bSurfaceDerivatives = f;
+		}
 		/** Query whether shading (N) normals have been filled in by the surface at dice time.
 		 */
 		bool bShadingNormals() const
@@ -270,6 +288,13 @@ class CqMicroPolyGrid : public CqMicroPolyGridBase
 			return ( m_bGeometricNormals );
 		}
 
+		/** Query whether surface derivatives (dPdu and dPdv) have been filled in by the surface at dice time.
+		 */
+		bool bSurfaceDerivatives() const
+		{
+			return ( m_bSurfaceDerivatives );
+		}
+
 		/** Get a reference to the bitvector representing the culled status of each u-poly in this grid.
 		 */
 		CqBitVector& CulledPolys()
@@ -382,6 +407,7 @@ class CqMicroPolyGrid : public CqMicroPolyGridBase
 	private:
 		bool	m_bShadingNormals;		///< Flag indicating shading normals have been filled in and don't need to be calculated during shading.
 		bool	m_bGeometricNormals;	///< Flag indicating geometric normals have been filled in and don't need to be calculated during shading.
+		bool	m_bSurfaceDerivatives;	///< Flag indicating dPdu and dPdv have been filled in and don't need to be calculated during shading.
 		boost::shared_ptr<CqSurface> m_pSurface;	///< Pointer to the surface for this grid.
 		boost::shared_ptr<CqCSGTreeNode> m_pCSGNode;	///< Pointer to the CSG tree node this grid belongs to, NULL if not part of a solid.
 		CqBitVector	m_CulledPolys;		///< Bitvector indicating whether the individual micro polygons are culled.
@@ -410,6 +436,7 @@ class CqMotionMicroPolyGrid : public CqMicroPolyGridBase, public CqMotionSpec<Cq
 		virtual	void	Split( long xmin, long xmax, long ymin, long ymax );
 		virtual	void	Shade( bool canCullGrid = true );
 		virtual	void	TransferOutputVariables();
+		virtual void	SetRenderCosts( TqFloat shadingTime, TqFloat textureBytes );
 		
 		/**
 		* \todo Review: Unused parameter all
@@ -51,10 +51,7 @@ CqParameter::CqParameter( const char* strName, TqInt Count ) :
 
 	STATS_INC( PRM_created );
 	STATS_INC( PRM_current );
-	TqInt cPRM = STATS_GETI( PRM_current );
-	TqInt cPeak = STATS_GETI( PRM_peak );
-
-	STATS_SETI( PRM_peak, cPRM > cPeak ? cPRM : cPeak );
+	STATS_PEAK( PRM_peak, PRM_current );
 	m_hash = CqString::hash(strName);
 }
 
@@ -70,10 +67,7 @@ CqParameter::CqParameter( const CqParameter& From ) :
 	//	QGetRenderContext() ->Stats().IncParametersAllocated();
 	STATS_INC( PRM_created );
 	STATS_INC( PRM_current );
-	TqInt cPRM = STATS_GETI( PRM_current );
-	TqInt cPeak = STATS_GETI( PRM_peak );
-
-	STATS_SETI( PRM_peak, cPRM > cPeak ? cPRM : cPeak );
+	STATS_PEAK( PRM_peak, PRM_current );
 }
 
 CqParameter::~CqParameter()
@@ -39,6 +39,7 @@
 #include	<aqsis/shadervm/ishaderdata.h>
 #include	<aqsis/core/iparameter.h>
 #include	"bilinear.h"
+#include	"cowvector.h"
 #include	<aqsis/riutil/primvartoken.h>
 #include	<aqsis/math/vectorcast.h>
 
@@ -103,6 +104,10 @@ class CqParameter : public IqParameter
 		{
 			return Count();
 		}
+		/** Pure virtual, get an estimate of the memory held by the values.
+		 * \return Size of the value storage in bytes.
+		 */
+		virtual	TqUlong	MemoryUsage() const = 0;
 		/** Pure virtual, clear value contents.
 		 */
 		virtual	void	Clear() = 0;
@@ -211,6 +216,11 @@ class CqParameterTyped : public CqParameter
 			*pValue( idxTarget ) = *pFromTyped->pValue( idxSource );
 		}
 
+		virtual	TqUlong	MemoryUsage() const
+		{
+			return static_cast<TqUlong>( this->Size() ) * this->Count() * sizeof( T );
+		}
+
 	protected:
 };
 
@@ -276,6 +286,9 @@ class CqParameterTypedVarying : public CqParameterTyped<T, SLT>
 
 			CqParameterTypedVarying<T, I, SLT>* pTResult1 = static_cast<CqParameterTypedVarying<T, I, SLT>*>( pResult1 );
 			CqParameterTypedVarying<T, I, SLT>* pTResult2 = static_cast<CqParameterTypedVarying<T, I, SLT>*>( pResult2 );
+			// Read the values through a const reference, since the non-const
+			// accessors would copy storage shared with other parameters.
+			const CqParameterTypedVarying<T, I, SLT>& self = *this;
 			pTResult1->SetSize( 4 );
 			pTResult2->SetSize( 4 );
 			// Check if a valid 4 point quad, do nothing if not.
@@ -283,17 +296,17 @@ class CqParameterTypedVarying : public CqParameterTyped<T, SLT>
 			{
 				if ( u )
 				{
-					pTResult2->pValue( 1 ) [ 0 ] = pValue( 1 ) [ 0 ];
-					pTResult2->pValue( 3 ) [ 0 ] = pValue( 3 ) [ 0 ];
-					pTResult1->pValue( 1 ) [ 0 ] = pTResult2->pValue( 0 ) [ 0 ] = static_cast<T>( ( pValue( 0 ) [ 0 ] + pValue( 1 ) [ 0 ] ) * 0.5 );
-					pTResult1->pValue( 3 ) [ 0 ] = pTResult2->pValue( 2 ) [ 0 ] = static_cast<T>( ( pValue( 2 ) [ 0 ] + pValue( 3 ) [ 0 ] ) * 0.5 );
+					pTResult2->pValue( 1 ) [ 0 ] = self.pValue( 1 ) [ 0 ];
+					pTResult2->pValue( 3 ) [ 0 ] = self.pValue( 3 ) [ 0 ];
+					pTResult1->pValue( 1 ) [ 0 ] = pTResult2->pValue( 0 ) [ 0 ] = static_cast<T>( ( self.pValue( 0 ) [ 0 ] + self.pValue( 1 ) [ 0 ] ) * 0.5 );
+					pTResult1->pValue( 3 ) [ 0 ] = pTResult2->pValue( 2 ) [ 0 ] = static_cast<T>( ( self.pValue( 2 ) [ 0 ] + self.pValue( 3 ) [ 0 ] ) * 0.5 );
 				}
 				else
 				{
-					pTResult2->pValue( 2 ) [ 0 ] = pValue( 2 ) [ 0 ];
-					pTResult2->pValue( 3 ) [ 0 ] = pValue( 3 ) [ 0 ];
-					pTResult1->pValue( 2 ) [ 0 ] = pTResult2->pValue( 0 ) [ 0 ] = static_cast<T>( ( pValue( 0 ) [ 0 ] + pValue( 2 ) [ 0 ] ) * 0.5 );
-					pTResult1->pValue( 3 ) [ 0 ] = pTResult2->pValue( 1 ) [ 0 ] = static_cast<T>( ( pValue( 1 ) [ 0 ] + pValue( 3 ) [ 0 ] ) * 0.5 );
+					pTResult2->pValue( 2 ) [ 0 ] = self.pValue( 2 ) [ 0 ];
+					pTResult2->pValue( 3 ) [ 0 ] = self.pValue( 3 ) [ 0 ];
+					pTResult1->pValue( 2 ) [ 0 ] = pTResult2->pValue( 0 ) [ 0 ] = static_cast<T>( ( self.pValue( 0 ) [ 0 ] + self.pValue( 2 ) [ 0 ] ) * 0.5 );
+					pTResult1->pValue( 3 ) [ 0 ] = pTResult2->pValue( 1 ) [ 0 ] = static_cast<T>( ( self.pValue( 1 ) [ 0 ] + self.pValue( 3 ) [ 0 ] ) * 0.5 );
 				}
 			}
 		}
@@ -334,15 +347,8 @@ class CqParameterTypedVarying : public CqParameterTyped<T, SLT>
 		 */
 		CqParameterTypedVarying<T, I, SLT>& operator=( const CqParameterTypedVarying<T, I, SLT>& From )
 		{
-
-			TqInt size = From.m_aValues.size();
-
-			m_aValues.resize( size );
-
-			for ( TqUint j = 0; j < (TqUint) size; j++ )
-			{
-				m_aValues[ j ] = From.m_aValues[ j ];
-			}
+			// Share the values until one of the parameters is modified.
+			m_aValues = From.m_aValues;
 			return ( *this );
 		}
 
@@ -356,7 +362,7 @@ class CqParameterTypedVarying : public CqParameterTyped<T, SLT>
 		}
 
 	private:
-		std::vector<T>	m_aValues;		///< Vector of values, one per varying index.
+		CqCowVector<T>	m_aValues;		///< Vector of values, one per varying index.
 }
 ;
 
@@ -431,8 +437,9 @@ class CqParameterTypedUniform : public CqParameterTyped<T, SLT>
 			// has been split into isngle patches, or the polymesh has been split into polys.
 			TqUint i;
 			TqUint size = max<TqInt>(u*v, pResult->Size());
+			const T& value = static_cast<const CqParameterTypedUniform<T, I, SLT>&>( *this ).pValue( 0 )[ 0 ];
 			for ( i = 0; i < size; i++ )
-				pResult->SetValue( paramToShaderType<SLT,T>(m_aValues[0]), i );
+				pResult->SetValue( paramToShaderType<SLT,T>(value), i );
 		}
 
 		virtual	void	CopyToShaderVariable( IqShaderData* pResult ) const
@@ -482,11 +489,7 @@ class CqParameterTypedUniform : public CqParameterTyped<T, SLT>
 		 */
 		CqParameterTypedUniform<T, I, SLT>& operator=( const CqParameterTypedUniform<T, I, SLT>& From )
 		{
-			m_aValues.resize( From.m_aValues.size() );
-			for ( TqUint j = 0; j < m_aValues.size(); j++ )
-			{
-				m_aValues[ j ] = From.m_aValues[ j ];
-			}
+			m_aValues = From.m_aValues;
 			return ( *this );
 		}
 
@@ -499,7 +502,7 @@ class CqParameterTypedUniform : public CqParameterTyped<T, SLT>
 			return ( new CqParameterTypedUniform<T, I, SLT>( strName, Count ) );
 		}
 	private:
-		std::vector<T>	m_aValues;		///< Vector of values, one per uniform index.
+		CqCowVector<T>	m_aValues;		///< Vector of values, one per uniform index.
 }
 ;
 
@@ -847,6 +850,7 @@ class CqParameterTypedVaryingArray : public CqParameterTyped<T, SLT>
 
 			CqParameterTypedVaryingArray<T, I, SLT>* pTResult1 = static_cast<CqParameterTypedVaryingArray<T, I, SLT>*>( pResult1 );
 			CqParameterTypedVaryingArray<T, I, SLT>* pTResult2 = static_cast<CqParameterTypedVaryingArray<T, I, SLT>*>( pResult2 );
+			const CqParameterTypedVaryingArray<T, I, SLT>& self = *this;
 			pTResult1->SetSize( 4 );
 			pTResult2->SetSize( 4 );
 			// Check if a valid 4 point quad, do nothing if not.
@@ -857,10 +861,10 @@ class CqParameterTypedVaryingArray : public CqParameterTyped<T, SLT>
 					TqInt index;
 					for( index = this->Count()-1; index >= 0; index-- )
 					{
-						pTResult2->pValue( 1 ) [ index ] = pValue( 1 ) [ index ];
-						pTResult2->pValue( 3 ) [ index ] = pValue( 3 ) [ index ];
-						pTResult1->pValue( 1 ) [ index ] = pTResult2->pValue( 0 ) [ index ] = static_cast<T>( ( pValue( 0 ) [ index ] + pValue( 1 ) [ index ] ) * 0.5 );
-						pTResult1->pValue( 3 ) [ index ] = pTResult2->pValue( 2 ) [ index ] = static_cast<T>( ( pValue( 2 ) [ index ] + pValue( 3 ) [ index ] ) * 0.5 );
+						pTResult2->pValue( 1 ) [ index ] = self.pValue( 1 ) [ index ];
+						pTResult2->pValue( 3 ) [ index ] = self.pValue( 3 ) [ index ];
+						pTResult1->pValue( 1 ) [ index ] = pTResult2->pValue( 0 ) [ index ] = static_cast<T>( ( self.pValue( 0 ) [ index ] + self.pValue( 1 ) [ index ] ) * 0.5 );
+						pTResult1->pValue( 3 ) [ index ] = pTResult2->pValue( 2 ) [ index ] = static_cast<T>( ( self.pValue( 2 ) [ index ] + self.pValue( 3 ) [ index ] ) * 0.5 );
 					}
 				}
 				else
@@ -868,10 +872,10 @@ class CqParameterTypedVaryingArray : public CqParameterTyped<T, SLT>
 					TqInt index;
 					for( index = this->Count()-1; index >= 0; index-- )
 					{
-						pTResult2->pValue( 2 ) [ index ] = pValue( 2 ) [ index ];
-						pTResult2->pValue( 3 ) [ index ] = pValue( 3 ) [ index ];
-						pTResult1->pValue( 2 ) [ index ] = pTResult2->pValue( 0 ) [ index ] = static_cast<T>( ( pValue( 0 ) [ index ] + pValue( 2 ) [ index ] ) * 0.5 );
-						pTResult1->pValue( 3 ) [ index ] = pTResult2->pValue( 1 ) [ index ] = static_cast<T>( ( pValue( 1 ) [ index ] + pValue( 3 ) [ index ] ) * 0.5 );
+						pTResult2->pValue( 2 ) [ index ] = self.pValue( 2 ) [ index ];
+						pTResult2->pValue( 3 ) [ index ] = self.pValue( 3 ) [ index ];
+						pTResult1->pValue( 2 ) [ index ] = pTResult2->pValue( 0 ) [ index ] = static_cast<T>( ( self.pValue( 0 ) [ index ] + self.pValue( 2 ) [ index ] ) * 0.5 );
+						pTResult1->pValue( 3 ) [ index ] = pTResult2->pValue( 1 ) [ index ] = static_cast<T>( ( self.pValue( 1 ) [ index ] + self.pValue( 3 ) [ index ] ) * 0.5 );
 					}
 				}
 			}
@@ -920,7 +924,7 @@ class CqParameterTypedVaryingArray : public CqParameterTyped<T, SLT>
 		CqParameterTypedVaryingArray<T, I, SLT>& operator=( const CqParameterTypedVaryingArray<T, I, SLT>& From )
 		{
 			m_size = From.m_size;
-			m_aValues.assign(From.m_aValues.begin(), From.m_aValues.end());
+			m_aValues = From.m_aValues;
 			return ( *this );
 		}
 
@@ -935,7 +939,7 @@ class CqParameterTypedVaryingArray : public CqParameterTyped<T, SLT>
 
 	private:
 		TqInt m_size;  ///< number of values stored ( == m_aValues.size()/m_Count )
-		std::vector<T>	m_aValues;		///< Array of varying values.
+		CqCowVector<T>	m_aValues;		///< Array of varying values.
 }
 ;
 
@@ -955,13 +959,9 @@ class CqParameterTypedUniformArray : public CqParameterTyped<T, SLT>
 			m_aValues.resize( Count );
 		}
 		CqParameterTypedUniformArray( const CqParameterTypedUniformArray<T, I, SLT>& From ) :
-				CqParameterTyped<T, SLT>( From )
-		{
-			m_aValues.resize( From.m_Count );
-			TqUint i;
-			for ( i = 0; i < (TqUint)From.m_Count; i++ )
-				m_aValues[ i ] = From.m_aValues[ i ];
-		}
+				CqParameterTyped<T, SLT>( From ),
+				m_aValues( From.m_aValues )
+		{}
 		virtual	~CqParameterTypedUniformArray()
 	{}
 
@@ -1001,9 +1001,10 @@ class CqParameterTypedUniformArray : public CqParameterTyped<T, SLT>
 			TqUint i; 
 			TqInt  j;
 			TqUint size = max<TqInt>(u*v, pResult->Size());
+			const CqParameterTypedUniformArray<T, I, SLT>& self = *this;
 			for ( i = 0; i < size; ++i )
 				for( j = 0; j < this->ArrayLength(); ++j )
-					pResult->ArrayEntry(j)->SetValue( paramToShaderType<SLT,T>(pValue( 0 ) [ j ]), i );
+					pResult->ArrayEntry(j)->SetValue( paramToShaderType<SLT,T>(self.pValue( 0 ) [ j ]), i );
 		}
 		virtual	void	CopyToShaderVariable( IqShaderData* pResult ) const
 		{
@@ -1027,8 +1028,9 @@ class CqParameterTypedUniformArray : public CqParameterTyped<T, SLT>
 			// initialised to the correct size prior to calling.
 			TqUint i;
 			TqUint size = max<TqInt>(u*v, pResult->Size());
+			const CqParameterTypedUniformArray<T, I, SLT>& self = *this;
 			for ( i = 0; i < size; i++ )
-				pResult->ArrayEntry(ArrayIndex)->SetValue( paramToShaderType<SLT,T>(pValue( 0 ) [ ArrayIndex ]), i );
+				pResult->ArrayEntry(ArrayIndex)->SetValue( paramToShaderType<SLT,T>(self.pValue( 0 ) [ ArrayIndex ]), i );
 		}
 
 		// Overridden from CqParameterTyped<T>
@@ -1057,10 +1059,7 @@ class CqParameterTypedUniformArray : public CqParameterTyped<T, SLT>
 		 */
 		CqParameterTypedUniformArray<T, I, SLT>& operator=( const CqParameterTypedUniformArray<T, I, SLT>& From )
 		{
-			m_aValues.resize( From.m_aValues.size() );
-			TqInt i2 = 0;
-			for (typename  std::vector<T>::iterator i = From.m_aValues.begin(); i != From.m_aValues.end(); i++, i2++ )
-				m_aValues[ i2 ] = ( *i );
+			m_aValues = From.m_aValues;
 			return ( *this );
 		}
 
@@ -1073,7 +1072,7 @@ class CqParameterTypedUniformArray : public CqParameterTyped<T, SLT>
 			return ( new CqParameterTypedUniformArray<T, I, SLT>( strName, Count ) );
 		}
 	private:
-		std::vector<T>	m_aValues;	///< Array of uniform values.
+		CqCowVector<T>	m_aValues;	///< Array of uniform values.
 }
 ;
 
@@ -1092,13 +1091,9 @@ class CqParameterTypedConstantArray : public CqParameterTyped<T, SLT>
 			m_aValues.resize( Count );
 		}
 		CqParameterTypedConstantArray( const CqParameterTypedConstantArray<T, I, SLT>& From ) :
-				CqParameterTyped<T, SLT>( From )
-		{
-			m_aValues.resize( From.m_Count );
-			TqInt i;
-			for ( i = 0; i < From.m_Count; i++ )
-				m_aValues[ i ] = From.m_aValues[ i ];
-		}
+				CqParameterTyped<T, SLT>( From ),
+				m_aValues( From.m_aValues )
+		{}
 		virtual	~CqParameterTypedConstantArray()
 	{}
 
@@ -1138,9 +1133,10 @@ class CqParameterTypedConstantArray : public CqParameterTyped<T, SLT>
 			TqUint i; 
 			TqInt  j;
 			TqUint size = max<TqInt>(u*v, pResult->Size());
+			const CqParameterTypedConstantArray<T, I, SLT>& self = *this;
 			for ( i = 0; i < size; ++i )
 				for( j = 0; j < this->Count(); ++j )
-					pResult->ArrayEntry(j)->SetValue( paramToShaderType<SLT,T>(pValue( 0 ) [ j ]), i );
+					pResult->ArrayEntry(j)->SetValue( paramToShaderType<SLT,T>(self.pValue( 0 ) [ j ]), i );
 		}
 		virtual	void	CopyToShaderVariable( IqShaderData* pResult ) const
 		{
@@ -1164,8 +1160,9 @@ class CqParameterTypedConstantArray : public CqParameterTyped<T, SLT>
 			// initialised to the correct size prior to calling.
 			TqUint i;
 			TqUint size = max<TqInt>(u*v, pResult->Size());
+			const CqParameterTypedConstantArray<T, I, SLT>& self = *this;
 			for ( i = 0; i < size; i++ )
-				pResult->ArrayEntry(ArrayIndex)->SetValue( paramToShaderType<SLT,T>(pValue( 0 ) [ ArrayIndex ]), i );
+				pResult->ArrayEntry(ArrayIndex)->SetValue( paramToShaderType<SLT,T>(self.pValue( 0 ) [ ArrayIndex ]), i );
 		}
 
 		// Overridden from CqParameterTyped<T>
@@ -1194,10 +1191,7 @@ class CqParameterTypedConstantArray : public CqParameterTyped<T, SLT>
 		 */
 		CqParameterTypedConstantArray<T, I, SLT>& operator=( const CqParameterTypedUniformArray<T, I, SLT>& From )
 		{
-			m_aValues.resize( From.m_aValues.size() );
-			TqInt i2 = 0;
-			for ( typename std::vector<T>::iterator i = From.m_aValues.being(); i != From.m_aValues.end(); i++, i2++ )
-				m_aValues[ i2 ] = ( *i );
+			m_aValues = From.m_aValues;
 			return ( *this );
 		}
 
@@ -1210,7 +1204,7 @@ class CqParameterTypedConstantArray : public CqParameterTyped<T, SLT>
 			return ( new CqParameterTypedConstantArray<T, I, SLT>( strName, Count ) );
 		}
 	private:
-		std::vector<T>	m_aValues;	///< Array of uniform values.
+		CqCowVector<T>	m_aValues;	///< Array of uniform values.
 }
 ;
 
@@ -1389,6 +1383,7 @@ void CqParameterTypedVarying<T, I, SLT>::Dice( TqInt u, TqInt v, IqShaderData* p
 		
 
 	T res;
+	const CqParameterTypedVarying<T, I, SLT>& self = *this;
 
 	SLT* pResData;
 	pResult->GetValuePtr( pResData );
@@ -1407,10 +1402,10 @@ void CqParameterTypedVarying<T, I, SLT>::Dice( TqInt u, TqInt v, IqShaderData* p
 			TqInt iu;
 			for ( iu = 0; iu <= u; iu++ )
 			{
-				res = BilinearEvaluate<T>( pValue( 0 ) [ 0 ],
-				                           pValue( 1 ) [ 0 ],
-				                           pValue( 2 ) [ 0 ],
-				                           pValue( 3 ) [ 0 ],
+				res = BilinearEvaluate<T>( self.pValue( 0 ) [ 0 ],
+				                           self.pValue( 1 ) [ 0 ],
+				                           self.pValue( 2 ) [ 0 ],
+				                           self.pValue( 3 ) [ 0 ],
 				                           iu * diu, iv * div );
 				( *pResData++ ) = paramToShaderType<SLT,T>(res);
 			}
@@ -1419,7 +1414,7 @@ void CqParameterTypedVarying<T, I, SLT>::Dice( TqInt u, TqInt v, IqShaderData* p
 	else
 	{
 		TqInt iv;
-		res = pValue( 0 ) [ 0 ];
+		res = self.pValue( 0 ) [ 0 ];
 		for ( iv = 0; iv <= v; iv++ )
 		{
 			TqInt iu;
@@ -1461,6 +1456,7 @@ void CqParameterTypedVaryingArray<T, I, SLT>::Dice( TqInt u, TqInt v, IqShaderDa
 	assert( pResult->isArray() && pResult->ArrayLength() == this->ArrayLength() );
 
 	T res;
+	const CqParameterTypedVaryingArray<T, I, SLT>& self = *this;
 
 	std::vector<SLT*> pResData(this->Count());
 	
@@ -1483,10 +1479,10 @@ void CqParameterTypedVaryingArray<T, I, SLT>::Dice( TqInt u, TqInt v, IqShaderDa
 			{
 				for( arrayIndex = 0; arrayIndex < this->Count(); arrayIndex++ )
 				{
-					res = BilinearEvaluate<T>( pValue( 0 ) [ arrayIndex ],
-								   pValue( 1 ) [ arrayIndex ],
-								   pValue( 2 ) [ arrayIndex ],
-								   pValue( 3 ) [ arrayIndex ],
+					res = BilinearEvaluate<T>( self.pValue( 0 ) [ arrayIndex ],
+								   self.pValue( 1 ) [ arrayIndex ],
+								   self.pValue( 2 ) [ arrayIndex ],
+								   self.pValue( 3 ) [ arrayIndex ],
 								   iu * diu, iv * div );
 					( *(pResData[arrayIndex])++ ) = paramToShaderType<SLT,T>(res);
 				}
@@ -1529,6 +1525,7 @@ void CqParameterTypedVaryingArray<T, I, SLT>::DiceOne( TqInt u, TqInt v, IqShade
 	assert( this->Count() > ArrayIndex );
 
 	T res;
+	const CqParameterTypedVaryingArray<T, I, SLT>& self = *this;
 
 	SLT* pResData;
 	pResult->GetValuePtr( pResData );
@@ -1547,10 +1544,10 @@ void CqParameterTypedVaryingArray<T, I, SLT>::DiceOne( TqInt u, TqInt v, IqShade
 			TqInt iu;
 			for ( iu = 0; iu <= u; iu++ )
 			{
-				res = BilinearEvaluate<T>( pValue( 0 ) [ ArrayIndex ],
-				                           pValue( 1 ) [ ArrayIndex ],
-				                           pValue( 2 ) [ ArrayIndex ],
-				                           pValue( 3 ) [ ArrayIndex ],
+				res = BilinearEvaluate<T>( self.pValue( 0 ) [ ArrayIndex ],
+				                           self.pValue( 1 ) [ ArrayIndex ],
+				                           self.pValue( 2 ) [ ArrayIndex ],
+				                           self.pValue( 3 ) [ ArrayIndex ],
 				                           iu * diu, iv * div );
 				( *pResData++ ) = paramToShaderType<SLT,T>(res);
 			}
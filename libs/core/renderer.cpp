@@ -83,6 +83,7 @@ CqRenderer::CqRenderer()
 	m_InstancedShaders(),
 	m_lights(),
 	m_textureCache(),
+	m_tessellationCache(),
 	m_fSaveGPrims(false),
 	m_pTransCamera(new CqTransform()),
 	m_pTransDefObj(new CqTransform()),
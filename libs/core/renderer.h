@@ -49,6 +49,7 @@
 #include	"lights.h"
 
 #include	"clippingvolume.h"
+#include	"tessellationcache.h"
 
 namespace Aqsis {
 
@@ -203,6 +204,12 @@ class CqRenderer : public IqRenderer
 		}
 
 		virtual	IqTextureCache& textureCache();
+		/** Get the cache of subdivision topology kept between frames.
+		 */
+		CqTessellationCache& tessellationCache()
+		{
+			return ( m_tessellationCache );
+		}
 		virtual	IqTextureMapOld* GetEnvironmentMap( const CqString& strFileName );
 		virtual	IqTextureMapOld* GetOcclusionMap(const CqString& fileName);
 		virtual	IqTextureMapOld* GetLatLongMap( const CqString& strFileName );
@@ -543,6 +550,7 @@ class CqRenderer : public IqRenderer
 		TqLightMap m_lights;
 
 		boost::shared_ptr<IqTextureCache> m_textureCache; ///< Cache for aqsistex texture access.
+		CqTessellationCache	m_tessellationCache;	///< Subdivision topology kept between frames.
 		 
 
 		bool	m_fSaveGPrims;
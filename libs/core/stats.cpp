@@ -23,10 +23,18 @@
 
 #include "stats.h"
 
+#include <algorithm>
+#include <atomic>
 #include <iomanip>
 #include <iostream>
 #include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
 #include <string>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
 
 #include "attributes.h"
 #include "imagebuffer.h"
@@ -69,8 +77,282 @@ void gStats_setF( TqInt index, TqFloat value )
 {
 	CqStats::setF( index, value );
 }
-TqFloat	 CqStats::m_floatVars[ CqStats::_Last_float ];		///< Float variables
-TqInt	 CqStats::m_intVars[ CqStats::_Last_int ];			///< Int variables
+void gStats_addI( TqInt index, TqInt value )
+{
+	CqStats::addI( index, value );
+}
+void gStats_peakI( TqInt peakIndex, TqInt currentIndex )
+{
+	CqStats::peakI( peakIndex, currentIndex );
+}
+void gStats_addF( TqInt index, TqFloat value )
+{
+	CqStats::addF( index, value );
+}
+void gStats_minF( TqInt index, TqFloat value )
+{
+	CqStats::minF( index, value );
+}
+void gStats_maxF( TqInt index, TqFloat value )
+{
+	CqStats::maxF( index, value );
+}
+
+namespace {
+
+/// How the values of a variable held by different threads are combined.
+enum EqCombine
+{
+	Combine_sum,
+	Combine_min,
+	Combine_max
+};
+
+EqCombine intCombine( TqInt index )
+{
+	switch ( index )
+	{
+		case CqStats::GPR_peak:
+		case CqStats::GPR_mem_peak:
+		case CqStats::GRD_peak:
+		case CqStats::MPG_peak:
+		case CqStats::PRM_peak:
+			return Combine_max;
+		default:
+			return Combine_sum;
+	}
+}
+
+EqCombine floatCombine( TqInt index )
+{
+	switch ( index )
+	{
+		case CqStats::MPG_min_area:
+			return Combine_min;
+		case CqStats::MPG_max_area:
+			return Combine_max;
+		default:
+			return Combine_sum;
+	}
+}
+
+template<typename T>
+T combine( EqCombine how, T a, T b )
+{
+	switch ( how )
+	{
+		case Combine_min:
+			return std::min( a, b );
+		case Combine_max:
+			return std::max( a, b );
+		default:
+			return a + b;
+	}
+}
+
+/// The value which leaves anything it's combined with unchanged.
+template<typename T>
+T identity( EqCombine how )
+{
+	switch ( how )
+	{
+		case Combine_min:
+			return std::numeric_limits<T>::max();
+		case Combine_max:
+			return std::numeric_limits<T>::lowest();
+		default:
+			return 0;
+	}
+}
+
+/** A block of statistics variables.
+ *
+ * The variables are only ever written by a single thread at a time, so
+ * updates are a plain load and store; they're atomic only so that another
+ * thread may read them while collecting the totals.
+ */
+struct SqCounterBlock
+{
+	std::atomic<TqInt> intVars[ CqStats::_Last_int ];
+	std::atomic<TqFloat> floatVars[ CqStats::_Last_float ];
+
+	/// Reset every variable to its identity value.
+	void clear()
+	{
+		for ( TqInt i = CqStats::_First_int; i < CqStats::_Last_int; ++i )
+			intVars[ i ].store( identity<TqInt>( intCombine( i ) ), std::memory_order_relaxed );
+		for ( TqInt i = CqStats::_First_float; i < CqStats::_Last_float; ++i )
+			floatVars[ i ].store( identity<TqFloat>( floatCombine( i ) ), std::memory_order_relaxed );
+	}
+};
+
+/// Totals from the last reset, including the blocks of threads which have exited.
+SqCounterBlock g_totals;
+
+boost::mutex& registryMutex()
+{
+	static boost::mutex mutex;
+	return mutex;
+}
+
+/// Blocks of all threads which are still running.
+std::vector<SqCounterBlock*>& registry()
+{
+	static std::vector<SqCounterBlock*> blocks;
+	return blocks;
+}
+
+/// A thread's own statistics variables, folded into the totals at thread exit.
+struct SqThreadCounters : SqCounterBlock
+{
+	/** Contribution of everything but this thread to each integer, as of
+	 * the last call to CqStats::syncPeaks().  Only read by this thread.
+	 */
+	TqInt othersAtSync[ CqStats::_Last_int ];
+
+	SqThreadCounters()
+	{
+		clear();
+		std::fill( othersAtSync, othersAtSync + CqStats::_Last_int, 0 );
+		boost::mutex::scoped_lock lock( registryMutex() );
+		registry().push_back( this );
+	}
+	~SqThreadCounters()
+	{
+		boost::mutex::scoped_lock lock( registryMutex() );
+		for ( TqInt i = CqStats::_First_int; i < CqStats::_Last_int; ++i )
+			g_totals.intVars[ i ].store( combine( intCombine( i ),
+				g_totals.intVars[ i ].load( std::memory_order_relaxed ),
+				intVars[ i ].load( std::memory_order_relaxed ) ), std::memory_order_relaxed );
+		for ( TqInt i = CqStats::_First_float; i < CqStats::_Last_float; ++i )
+			g_totals.floatVars[ i ].store( combine( floatCombine( i ),
+				g_totals.floatVars[ i ].load( std::memory_order_relaxed ),
+				floatVars[ i ].load( std::memory_order_relaxed ) ), std::memory_order_relaxed );
+		std::vector<SqCounterBlock*>& blocks = registry();
+		blocks.erase( std::remove( blocks.begin(), blocks.end(), this ), blocks.end() );
+	}
+};
+
+SqThreadCounters& threadCounters()
+{
+	static thread_local SqThreadCounters counters;
+	return counters;
+}
+
+/// Update a variable owned by the calling thread.
+template<typename T>
+inline void update( std::atomic<T>& var, EqCombine how, T value )
+{
+	var.store( combine( how, var.load( std::memory_order_relaxed ), value ),
+			std::memory_order_relaxed );
+}
+
+} // unnamed namespace
+
+void CqStats::IncI( const TqInt index )
+{
+	update( threadCounters().intVars[ index ], Combine_sum, 1 );
+}
+
+void CqStats::DecI( const TqInt index )
+{
+	update( threadCounters().intVars[ index ], Combine_sum, -1 );
+}
+
+void CqStats::addI( const TqInt index, const TqInt value )
+{
+	update( threadCounters().intVars[ index ], Combine_sum, value );
+}
+
+void CqStats::peakI( const TqInt peakIndex, const TqInt currentIndex )
+{
+	SqThreadCounters& counters = threadCounters();
+	TqInt current = counters.othersAtSync[ currentIndex ]
+		+ counters.intVars[ currentIndex ].load( std::memory_order_relaxed );
+	update( counters.intVars[ peakIndex ], Combine_max, current );
+}
+
+void CqStats::syncPeaks()
+{
+	SqThreadCounters& counters = threadCounters();
+	boost::mutex::scoped_lock lock( registryMutex() );
+	std::vector<SqCounterBlock*>& blocks = registry();
+	for ( TqInt index = _First_int; index < _Last_int; ++index )
+	{
+		if ( intCombine( index ) != Combine_sum )
+			continue;
+		TqInt others = g_totals.intVars[ index ].load( std::memory_order_relaxed );
+		for ( std::vector<SqCounterBlock*>::iterator i = blocks.begin(); i != blocks.end(); ++i )
+		{
+			if ( *i != &counters )
+				others += ( *i )->intVars[ index ].load( std::memory_order_relaxed );
+		}
+		counters.othersAtSync[ index ] = others;
+	}
+}
+
+void CqStats::setI( const TqInt index, const TqInt value )
+{
+	boost::mutex::scoped_lock lock( registryMutex() );
+	g_totals.intVars[ index ].store( value, std::memory_order_relaxed );
+	TqInt id = identity<TqInt>( intCombine( index ) );
+	std::vector<SqCounterBlock*>& blocks = registry();
+	for ( std::vector<SqCounterBlock*>::iterator i = blocks.begin(); i != blocks.end(); ++i )
+		( *i )->intVars[ index ].store( id, std::memory_order_relaxed );
+}
+
+TqInt CqStats::getI( const TqInt index )
+{
+	boost::mutex::scoped_lock lock( registryMutex() );
+	EqCombine how = intCombine( index );
+	TqInt value = g_totals.intVars[ index ].load( std::memory_order_relaxed );
+	std::vector<SqCounterBlock*>& blocks = registry();
+	for ( std::vector<SqCounterBlock*>::iterator i = blocks.begin(); i != blocks.end(); ++i )
+		value = combine( how, value, ( *i )->intVars[ index ].load( std::memory_order_relaxed ) );
+	return value;
+}
+
+void CqStats::addF( const TqInt index, const TqFloat value )
+{
+	update( threadCounters().floatVars[ index ], Combine_sum, value );
+}
+
+void CqStats::minF( const TqInt index, const TqFloat value )
+{
+	update( threadCounters().floatVars[ index ], Combine_min, value );
+}
+
+void CqStats::maxF( const TqInt index, const TqFloat value )
+{
+	update( threadCounters().floatVars[ index ], Combine_max, value );
+}
+
+void CqStats::setF( const TqInt index, const TqFloat value )
+{
+	boost::mutex::scoped_lock lock( registryMutex() );
+	g_totals.floatVars[ index ].store( value, std::memory_order_relaxed );
+	TqFloat id = identity<TqFloat>( floatCombine( index ) );
+	std::vector<SqCounterBlock*>& blocks = registry();
+	for ( std::vector<SqCounterBlock*>::iterator i = blocks.begin(); i != blocks.end(); ++i )
+		( *i )->floatVars[ index ].store( id, std::memory_order_relaxed );
+}
+
+TqFloat CqStats::getF( const TqInt index )
+{
+	boost::mutex::scoped_lock lock( registryMutex() );
+	EqCombine how = floatCombine( index );
+	TqFloat value = g_totals.floatVars[ index ].load( std::memory_order_relaxed );
+	std::vector<SqCounterBlock*>& blocks = registry();
+	for ( std::vector<SqCounterBlock*>::iterator i = blocks.begin(); i != blocks.end(); ++i )
+		value = combine( how, value, ( *i )->floatVars[ index ].load( std::memory_order_relaxed ) );
+	return value;
+}
+
+TqInt CqStats::threadI( const TqInt index )
+{
+	return threadCounters().intVars[ index ].load( std::memory_order_relaxed );
+}
+
 /**
    Initialise every variable.
  
@@ -86,9 +368,9 @@ void CqStats::Initialise()
 	TqInt i;
 	m_Complete = 0.0f;
 	for (i = _First_int; i < _Last_int; i++)
-		m_intVars[i] = 0;
+		setI( i, 0 );
 	for (i = _First_float; i < _Last_float; i++)
-		m_floatVars[i] = 0.0f;
+		setF( i, 0.0f );
 	//	m_timeTotal = 0;
 	InitialiseFrame();
 }
@@ -106,6 +388,7 @@ void CqStats::InitialiseFrame()
 	m_cTextureMemory = 0;
 	memset( m_cTextureMisses, '\0', sizeof( m_cTextureMisses ) );
 	memset( m_cTextureHits, '\0', sizeof( m_cTextureHits ) );
+	m_bucketStats.clear();
 }
 //----------------------------------------------------------------------
 /** Output rendering stats if required.
@@ -156,7 +439,8 @@ void CqStats::PrintStats( TqInt level ) const
 		<< STATS_INT_GETI( GPR_allocated ) <<  " allocated\n\t"
 		<< STATS_INT_GETI( GPR_created_total ) <<  " used (" << _gpr_u_q << "%), " << STATS_INT_GETI( GPR_peak ) << " peak,\n\t"
 		<< STATS_INT_GETI( GPR_culled ) << " culled (" << _gpr_c_q << "%)\n\t"
-		<< STATS_INT_GETI( GPR_occlusion_culled ) << " occlusion culled (" << _gpr_oc_q << "%)\n" << std::endl;
+		<< STATS_INT_GETI( GPR_occlusion_culled ) << " occlusion culled (" << _gpr_oc_q << "%)\n\t"
+		<< STATS_INT_GETI( GPR_mem_peak ) << "K peak memory waiting for buckets\n" << std::endl;
 		/*
 			GPrim stats - End
 			-------------------------------------------------------------------
@@ -191,7 +475,10 @@ void CqStats::PrintStats( TqInt level ) const
 		<<					"\t" << STATS_INT_GETI( GEO_prc_split ) << " split (" << _geo_prc_s_q << "%)\n\t\t"
 		<<							STATS_INT_GETI( GEO_prc_created_dl ) << " dynamic load,\n\t\t"
 		<<							STATS_INT_GETI( GEO_prc_created_dra ) << " dynamic read archive,\n\t\t"
-		<<							STATS_INT_GETI( GEO_prc_created_prp ) << " run program\n\t\t"
+		<<							STATS_INT_GETI( GEO_prc_created_prp ) << " run program\n\t"
+		<< "Tessellation cache:\n"
+		<<					"\t\t" << STATS_INT_GETI( GEO_tsc_hits ) << " hits, "
+		<<							STATS_INT_GETI( GEO_tsc_misses ) << " misses\n"
 		<< std::endl;
 		/*
 			GPrim stats - End
@@ -298,6 +585,21 @@ void CqStats::PrintStats( TqInt level ) const
 			Grid stats - End
 			-------------------------------------------------------------------
 		*/
+		/*
+			-------------------------------------------------------------------
+			Light stats
+		*/
+		TqFloat _lgt_c_q = 0.0f;
+		if (STATS_INT_GETI( LGT_evaluated ) + STATS_INT_GETI( LGT_culled ))
+			_lgt_c_q = 100.0f * STATS_INT_GETI( LGT_culled ) / ( STATS_INT_GETI( LGT_evaluated ) + STATS_INT_GETI( LGT_culled ) );
+		MSG << "Lights:\n\t"
+		<< STATS_INT_GETI( LGT_evaluated ) << " evaluated, "
+		<< STATS_INT_GETI( LGT_culled ) << " culled by influence bound (" << _lgt_c_q << "%)\n"
+		<< std::endl;
+		/*
+			Light stats - End
+			-------------------------------------------------------------------
+		*/
 		/* MPGS */
 		/*
 			-------------------------------------------------------------------
@@ -569,5 +871,199 @@ void CqStats::PrintInfo() const
 	Aqsis::log() << info << "	PixelSamples: " << psX << " " << psY << std::endl;
 	Aqsis::log() << info << "	PixelFilter: \"" << fName << "\" " << fX << " " << fY << std::endl;
 }
+
+namespace {
+
+/// Names of the integer variables in the JSON report.
+const char* const g_intNames[] = {
+	"",
+	"GPR_allocated",
+	"GPR_created",
+	"GPR_created_total",
+	"GPR_current",
+	"GPR_peak",
+	"GPR_culled",
+	"GPR_occlusion_culled",
+	"GPR_mem_peak",
+	"GPR_nurbs",
+	"GPR_blobbies",
+	"GPR_poly",
+	"GPR_subdiv",
+	"GPR_crv",
+	"GPR_points",
+	"GPR_quad",
+	"GPR_patch",
+	"GEO_crv_splits",
+	"GEO_crv_crv",
+	"GEO_crv_patch",
+	"GEO_crv_crv_created",
+	"GEO_crv_patch_created",
+	"GEO_prc_created",
+	"GEO_prc_split",
+	"GEO_prc_created_dl",
+	"GEO_prc_created_dra",
+	"GEO_prc_created_prp",
+	"GEO_tsc_hits",
+	"GEO_tsc_misses",
+	"GRD_created",
+	"GRD_culled",
+	"GRD_current",
+	"GRD_peak",
+	"GRD_allocated",
+	"GRD_deallocated",
+	"GRD_size_4",
+	"GRD_size_8",
+	"GRD_size_16",
+	"GRD_size_32",
+	"GRD_size_64",
+	"GRD_size_128",
+	"GRD_size_256",
+	"GRD_size_g256",
+	"GRD_shd_size_4",
+	"GRD_shd_size_8",
+	"GRD_shd_size_16",
+	"GRD_shd_size_32",
+	"GRD_shd_size_64",
+	"GRD_shd_size_128",
+	"GRD_shd_size_256",
+	"GRD_shd_size_g256",
+	"LGT_evaluated",
+	"LGT_culled",
+	"MPG_allocated",
+	"MPG_deallocated",
+	"MPG_current",
+	"MPG_peak",
+	"MPG_culled",
+	"MPG_missed",
+	"MPG_trimmed",
+	"MPG_trimmedout",
+	"MPG_sample_coverage0_125",
+	"MPG_sample_coverage125_25",
+	"MPG_sample_coverage25_375",
+	"MPG_sample_coverage375_50",
+	"MPG_sample_coverage50_625",
+	"MPG_sample_coverage625_75",
+	"MPG_sample_coverage75_875",
+	"MPG_sample_coverage875_100",
+	"MPG_pushed_forward",
+	"MPG_pushed_down",
+	"MPG_pushed_far_down",
+	"SPL_count",
+	"SPL_bound_hits",
+	"SPL_hits",
+	"PRM_created",
+	"PRM_current",
+	"PRM_peak",
+};
+
+/// Names of the float variables in the JSON report.
+const char* const g_floatNames[] = {
+	"",
+	"MPG_average_area",
+	"MPG_min_area",
+	"MPG_max_area",
+};
+
+/// Write a string to a stream as a quoted JSON string.
+void writeJSONString( std::ostream& out, const std::string& str )
+{
+	out << '"';
+	for ( std::string::const_iterator c = str.begin(); c != str.end(); ++c )
+	{
+		switch ( *c )
+		{
+			case '"':
+				out << "\\\"";
+				break;
+			case '\\':
+				out << "\\\\";
+				break;
+			case '\n':
+				out << "\\n";
+				break;
+			default:
+				if ( static_cast<unsigned char>( *c ) < 0x20 )
+					out << "\\u" << std::hex << std::setw( 4 ) << std::setfill( '0' )
+						<< static_cast<TqInt>( *c ) << std::dec;
+				else
+					out << *c;
+				break;
+		}
+	}
+	out << '"';
+}
+
+} // unnamed namespace
+
+bool CqStats::WriteStatsFile( const std::string& fileName ) const
+{
+	static_assert( sizeof( g_intNames ) / sizeof( g_intNames[ 0 ] ) == _Last_int,
+			"g_intNames must name every integer variable" );
+	static_assert( sizeof( g_floatNames ) / sizeof( g_floatNames[ 0 ] ) == _Last_float,
+			"g_floatNames must name every float variable" );
+
+	std::ofstream out( fileName.c_str() );
+	if ( !out )
+		return false;
+	out.precision( 9 );
+
+	out << "{\n\t\"frame\": " << QGetRenderContext()->CurrentFrame() << ",\n";
+
+	out << "\t\"counters\": {";
+	for ( TqInt i = _First_int + 1; i < _Last_int; ++i )
+	{
+		out << ( i == _First_int + 1 ? "\n" : ",\n" ) << "\t\t";
+		writeJSONString( out, g_intNames[ i ] );
+		out << ": " << getI( i );
+	}
+	for ( TqInt i = _First_float + 1; i < _Last_float; ++i )
+	{
+		out << ",\n\t\t";
+		writeJSONString( out, g_floatNames[ i ] );
+		out << ": " << getF( i );
+	}
+	out << ",\n\t\t\"texture_memory\": " << m_cTextureMemory;
+	out << "\n\t},\n";
+
+	out << "\t\"timers\": {";
+#	ifdef USE_TIMERS
+	for ( TqInt i = 0; i < EqTimerStats::size; ++i )
+	{
+		EqTimerStats::Enum id = static_cast<EqTimerStats::Enum>( i );
+		CqTimer timer = g_timerSet.totalTimer( id );
+		std::ostringstream name;
+		name << id;
+		out << ( i == 0 ? "\n" : ",\n" ) << "\t\t";
+		writeJSONString( out, name.str() );
+		out << ": { \"time\": " << timer.totalTime()
+			<< ", \"count\": " << timer.numSamples() << " }";
+	}
+	out << "\n\t";
+#	endif // USE_TIMERS
+	out << "},\n";
+
+	out << "\t\"buckets\": [";
+	for ( std::vector<SqBucketStats>::const_iterator b = m_bucketStats.begin();
+			b != m_bucketStats.end(); ++b )
+	{
+		out << ( b == m_bucketStats.begin() ? "\n" : ",\n" )
+			<< "\t\t{ \"col\": " << b->col
+			<< ", \"row\": " << b->row
+			<< ", \"time\": " << b->time
+			<< ", \"gprims\": " << b->gprims
+			<< ", \"grids\": " << b->grids
+			<< ", \"micropolygons\": " << b->micropolygons
+			<< ", \"samples\": " << b->samples
+			<< ", \"sample_hits\": " << b->sampleHits
+			<< ", \"texture_bytes\": " << b->textureBytes
+			<< ", \"peak_memory\": " << b->peakMemory << " }";
+	}
+	if ( !m_bucketStats.empty() )
+		out << "\n\t";
+	out << "]\n}\n";
+
+	return out.good();
+}
+
 //---------------------------------------------------------------------
 } // namespace Aqsis
@@ -31,6 +31,8 @@
 
 #include <time.h>
 #include <iostream>
+#include <string>
+#include <vector>
 
 #include <aqsis/util/timer.h>
 #include <aqsis/ri/ri.h>
@@ -44,6 +46,11 @@ extern TqInt gStats_getI( TqInt index );
 extern void gStats_setI( TqInt index, TqInt value );
 extern TqFloat gStats_getF( TqInt index );
 extern void gStats_setF( TqInt index, TqFloat value );
+extern void gStats_addI( TqInt index, TqInt value );
+extern void gStats_peakI( TqInt peakIndex, TqInt currentIndex );
+extern void gStats_addF( TqInt index, TqFloat value );
+extern void gStats_minF( TqInt index, TqFloat value );
+extern void gStats_maxF( TqInt index, TqFloat value );
 
 #define STATS_INC( index )				gStats_IncI( CqStats::index )
 #define STATS_DEC( index )				gStats_DecI( CqStats::index )
@@ -51,6 +58,11 @@ extern void gStats_setF( TqInt index, TqFloat value );
 #define	STATS_SETI( index , value )		gStats_setI( CqStats::index , value )
 #define	STATS_GETF( index )				gStats_getF( CqStats::index )
 #define	STATS_SETF( index , value )		gStats_setF( CqStats::index , value )
+#define	STATS_ADDI( index , value )		gStats_addI( CqStats::index , value )
+#define	STATS_PEAK( peak , current )	gStats_peakI( CqStats::peak , CqStats::current )
+#define	STATS_ADDF( index , value )		gStats_addF( CqStats::index , value )
+#define	STATS_MINF( index , value )		gStats_minF( CqStats::index , value )
+#define	STATS_MAXF( index , value )		gStats_maxF( CqStats::index , value )
 
 
 //----------------------------------------------------------------------
@@ -156,6 +168,32 @@ extern CqTimerSet<EqTimerStats> g_timerSet;
 
 #endif // USE_TIMERS
 
+//----------------------------------------------------------------------
+/** \brief Statistics gathered while rendering a single bucket.
+ *
+ * These are collected for the report written to the file given by
+ * Option "statistics" "filename".
+ */
+struct SqBucketStats
+{
+	TqInt	col;			///< Bucket column.
+	TqInt	row;			///< Bucket row.
+	TqFloat	time;			///< Time taken to render the bucket, in seconds.
+	TqInt	gprims;			///< Number of gprims diced or split.
+	TqInt	grids;			///< Number of grids shaded.
+	TqInt	micropolygons;	///< Number of micropolygons created.
+	TqInt	samples;		///< Number of samples tested against micropolygons.
+	TqInt	sampleHits;		///< Number of samples hit by micropolygons.
+	TqUlong	textureBytes;	///< Texture tile data read from file, in bytes.
+	TqUlong	peakMemory;		///< Peak memory of the geometry waiting for buckets while the bucket rendered, in bytes.
+
+	SqBucketStats()
+		: col(0), row(0), time(0), gprims(0), grids(0), micropolygons(0),
+		samples(0), sampleHits(0), textureBytes(0), peakMemory(0)
+	{}
+};
+
+
 //----------------------------------------------------------------------
 /** \class CqStats
    \brief Class containing statistics information.
@@ -167,6 +205,16 @@ extern CqTimerSet<EqTimerStats> g_timerSet;
 	 IncXyz()-Method. To measure various times there are several pairs
 	 of StartXyzTimer() and StopXyZTimer() methods.
 	 The statistics for each frame can be printed with PrintStats().
+
+	 The integer and float variables are updated from all the bucket
+	 threads, so each thread accumulates into its own block of counters
+	 without locking.  A thread's block is folded into the shared totals
+	 when the thread exits, and getI()/getF() combine the totals with the
+	 blocks of any threads still running.  Each variable is combined by
+	 summing, except for peaks and minimum/maximum values which are
+	 combined by taking the extreme value.  setI()/setF() reset a variable
+	 in every block, so should only be used while no other thread is
+	 rendering.
  */
 
 class CqStats
@@ -197,40 +245,62 @@ class CqStats
 		}
 
 		//! Increase an integer specified by an EqIntIndex value by one
-		static void IncI( const TqInt index )
-		{
-			m_intVars[ index ]++;
-		}
+		static void IncI( const TqInt index );
 
 		//! Decrease an integer specified by an EqIntIndex value by one
-		static void DecI( const TqInt index )
-		{
-			m_intVars[ index ]--;
-		}
+		static void DecI( const TqInt index );
+
+		//! Add value to an integer specified by an EqIntIndex value
+		static void addI( const TqInt index, const TqInt value );
+
+		/** Update a peak counter from the corresponding current counter.
+		 *
+		 * This is called for every gprim, grid, micropolygon and parameter,
+		 * so it only reads the calling thread's own counters.  The current
+		 * value is taken as the contribution of the other threads recorded
+		 * by the last syncPeaks() in this thread, plus this thread's own.
+		 * Peaks are therefore approximate while several threads render:
+		 * anything other threads allocate or free after the sync is missed.
+		 * They are exact when rendering with a single thread.
+		 */
+		static void peakI( const TqInt peakIndex, const TqInt currentIndex );
+
+		/** Record the other threads' contribution to each current counter
+		 * for use by peakI() in the calling thread.
+		 *
+		 * This walks the blocks of all running threads under the same lock
+		 * as getI(), so should be called at coarse points such as the start
+		 * of each bucket.
+		 */
+		static void syncPeaks();
 
 		//! Set an integer specified by an EqIntIndex value to value
-		static void setI( const TqInt index, const TqInt value )
-		{
-			m_intVars[ index ] = value;
-		}
+		static void setI( const TqInt index, const TqInt value );
 
 		//! Get an integer specified by an EqIntIndex value
-		static TqInt getI( const TqInt index )
-		{
-			return m_intVars[ index ];
-		}
+		static TqInt getI( const TqInt index );
+
+		//! Add value to a float specified by an EqfloatIndex value
+		static void addF( const TqInt index, const TqFloat value );
+
+		//! Lower a float specified by an EqfloatIndex value to value if smaller
+		static void minF( const TqInt index, const TqFloat value );
+
+		//! Raise a float specified by an EqfloatIndex value to value if larger
+		static void maxF( const TqInt index, const TqFloat value );
 
 		//! Set a float specified by an EqfloatIndex value to value
-		static void setF( const TqInt index, const TqFloat value )
-		{
-			m_floatVars[ index ] = value;
-		}
+		static void setF( const TqInt index, const TqFloat value );
 
 		//! Get a float specified by an EqfloatIndex value
-		static TqFloat getF( const TqInt index )
-		{
-			return m_floatVars[ index ];
-		}
+		static TqFloat getF( const TqInt index );
+
+		/** Get the calling thread's own contribution to an integer.
+		 *
+		 * This is a running total for the thread, so the work done by a
+		 * thread between two points may be found from the difference.
+		 */
+		static TqInt threadI( const TqInt index );
 
 		/**
 			\param	value	This has to be a 32-bit integer!
@@ -287,6 +357,7 @@ class CqStats
 		       GPR_peak,
 		       GPR_culled,
 		       GPR_occlusion_culled,
+		       GPR_mem_peak,
 
 		       // GPrim types
 
@@ -317,6 +388,11 @@ class CqStats
 		       GEO_prc_created_dra,
 		       GEO_prc_created_prp,
 
+		       // Tessellation cache
+
+		       GEO_tsc_hits,
+		       GEO_tsc_misses,
+
 		       // Grid stats
 
 		       GRD_created,
@@ -346,6 +422,11 @@ class CqStats
 		       GRD_shd_size_256,
 		       GRD_shd_size_g256,
 
+		       // Light stats
+
+		       LGT_evaluated,
+		       LGT_culled,
+
 		       // MPG stats
 
 		       //(De)Allocs
@@ -418,20 +499,33 @@ class CqStats
 
 		//@}
 
+		/** Record the statistics for a finished bucket.
+		 */
+		void AddBucketStats( const SqBucketStats& stats )
+		{
+			m_bucketStats.push_back( stats );
+		}
+
 		void PrintStats( TqInt level ) const;
 		void PrintInfo() const;
+		/** Write the statistics for the frame to a file as JSON.
+		 *
+		 * The report contains every counter and timer, along with the
+		 * records added by AddBucketStats().
+		 *
+		 * \return false if the file couldn't be written.
+		 */
+		bool WriteStatsFile( const std::string& fileName ) const;
 
 	private:
 		std::ostream& TimeToString( std::ostream& os, TqFloat t, TqFloat tot ) const;
 
 		TqFloat	m_Complete;						///< Current percentage complete.
 
-		static TqFloat	 m_floatVars[ _Last_float ];		///< Float variables
-		static TqInt		m_intVars[ _Last_int ];			///< Int variables
-
 		TqInt m_cTextureMemory;     ///< Count of the memory used by texturemap.cpp
 		TqInt m_cTextureHits[ 2 ][ 5 ];     ///< Count of the hits encountered used by texturemap.cpp
 		TqInt m_cTextureMisses[ 5 ];     ///< Count of the hits encountered used by texturemap.cpp
+		std::vector<SqBucketStats> m_bucketStats;	///< Records of the buckets rendered in this frame.
 };
 
 
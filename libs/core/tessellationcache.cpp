@@ -0,0 +1,174 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+/** \file
+		\brief Implements a cache of refined subdivision topology which
+		persists between frames.
+*/
+
+#include	"tessellationcache.h"
+
+#include	"renderer.h"
+#include	"stats.h"
+#include	"subdivision2.h"
+
+namespace Aqsis {
+
+//---------------------------------------------------------------------
+// CqTessellationKey
+
+CqTessellationKey::CqTessellationKey()
+	: m_data(),
+	m_hash( 2166136261u )
+{}
+
+void CqTessellationKey::addMatrix( const CqMatrix& mat )
+{
+	// The elements of an identity matrix aren't necessarily filled in.
+	add( mat.fIdentity() );
+	if ( !mat.fIdentity() )
+		add( mat.pElements(), 16 );
+}
+
+void CqTessellationKey::append( const TqUchar* data, TqUint size )
+{
+	m_data.insert( m_data.end(), data, data + size );
+	// FNV-1a
+	for ( TqUint i = 0; i < size; ++i )
+		m_hash = ( m_hash ^ data[ i ] ) * 16777619u;
+}
+
+
+//---------------------------------------------------------------------
+// CqTessellationCache
+
+CqTessellationCache::CqTessellationCache()
+	: m_entries(),
+	m_memoryLimit( 0 ),
+	m_memory( 0 ),
+	m_world( 0 ),
+	m_matCtoW(),
+	m_matNCtoW(),
+	m_matVCtoW()
+{}
+
+void CqTessellationCache::beginWorld( TqInt memoryLimit )
+{
+	++m_world;
+	m_memoryLimit = memoryLimit > 0 ? static_cast<TqUlong>( memoryLimit ) * 1024 : 0;
+	if ( !isEnabled() )
+	{
+		clear();
+		return;
+	}
+
+	QGetRenderContext() ->matSpaceToSpace( "camera", "world", NULL, NULL, 0, m_matCtoW );
+	QGetRenderContext() ->matNSpaceToSpace( "camera", "world", NULL, NULL, 0, m_matNCtoW );
+	QGetRenderContext() ->matVSpaceToSpace( "camera", "world", NULL, NULL, 0, m_matVCtoW );
+
+	// Topologies grow as they're refined during rendering, so update the
+	// memory estimates before deciding what to keep.
+	m_memory = 0;
+	for ( TqEntryMap::iterator i = m_entries.begin(); i != m_entries.end(); ++i )
+	{
+		i->second.memory = memoryUsage( *i->second.topology );
+		m_memory += i->second.memory;
+	}
+	evict();
+}
+
+boost::shared_ptr<CqSubdivision2> CqTessellationCache::fetch( const CqTessellationKey& key )
+{
+	if ( isEnabled() )
+	{
+		std::pair<TqEntryMap::iterator, TqEntryMap::iterator> range = m_entries.equal_range( key.hash() );
+		for ( TqEntryMap::iterator i = range.first; i != range.second; ++i )
+		{
+			SqEntry& entry = i->second;
+			// A topology already used in this world belongs to another gprim.
+			if ( !( entry.key == key ) || entry.lastWorld == m_world )
+				continue;
+			entry.topology->pPoints()->Transform( entry.matCtoW, entry.matNCtoW, entry.matVCtoW );
+			entry.matCtoW = m_matCtoW;
+			entry.matNCtoW = m_matNCtoW;
+			entry.matVCtoW = m_matVCtoW;
+			entry.lastWorld = m_world;
+			STATS_INC( GEO_tsc_hits );
+			return ( entry.topology );
+		}
+	}
+	STATS_INC( GEO_tsc_misses );
+	return ( boost::shared_ptr<CqSubdivision2>() );
+}
+
+void CqTessellationCache::store( const CqTessellationKey& key,
+		const boost::shared_ptr<CqSubdivision2>& topology )
+{
+	if ( !isEnabled() )
+		return;
+	std::pair<TqEntryMap::iterator, TqEntryMap::iterator> range = m_entries.equal_range( key.hash() );
+	for ( TqEntryMap::iterator i = range.first; i != range.second; ++i )
+	{
+		// Keep the existing entry for duplicate gprims in a single world.
+		if ( i->second.key == key )
+			return;
+	}
+
+	SqEntry entry;
+	entry.key = key;
+	entry.topology = topology;
+	entry.matCtoW = m_matCtoW;
+	entry.matNCtoW = m_matNCtoW;
+	entry.matVCtoW = m_matVCtoW;
+	entry.lastWorld = m_world;
+	entry.memory = memoryUsage( *topology );
+	m_entries.insert( TqEntryMap::value_type( key.hash(), entry ) );
+	m_memory += entry.memory;
+	evict();
+}
+
+void CqTessellationCache::clear()
+{
+	m_entries.clear();
+	m_memory = 0;
+}
+
+void CqTessellationCache::evict()
+{
+	while ( m_memory > m_memoryLimit && !m_entries.empty() )
+	{
+		TqEntryMap::iterator oldest = m_entries.begin();
+		for ( TqEntryMap::iterator i = m_entries.begin(); i != m_entries.end(); ++i )
+		{
+			if ( i->second.lastWorld < oldest->second.lastWorld )
+				oldest = i;
+		}
+		m_memory -= oldest->second.memory;
+		m_entries.erase( oldest );
+	}
+}
+
+TqUlong CqTessellationCache::memoryUsage( const CqSubdivision2& topology )
+{
+	return ( topology.apLaths().size() * sizeof( CqLath )
+			+ topology.pPoints()->MemoryUsage() );
+}
+
+} // namespace Aqsis
@@ -0,0 +1,191 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+/** \file
+		\brief Declares a cache of refined subdivision topology which persists
+		between frames.
+*/
+
+//? Is tessellationcache.h included already?
+#ifndef TESSELLATIONCACHE_H_INCLUDED
+#define TESSELLATIONCACHE_H_INCLUDED 1
+
+#include <aqsis/aqsis.h>
+
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <aqsis/math/matrix.h>
+
+namespace Aqsis {
+
+class CqSubdivision2;
+
+//----------------------------------------------------------------------
+/** \class CqTessellationKey
+ * Identifies a gprim by the complete data it was created from.
+ *
+ * The key holds a copy of the data rather than just a hash of it, so that a
+ * cache hit is guaranteed to be the same gprim.
+ */
+
+class CqTessellationKey
+{
+	public:
+		CqTessellationKey();
+
+		/** Append an array of plain values to the key.
+		 */
+		template<typename T>
+		void add( const T* values, TqUint count )
+		{
+			append( reinterpret_cast<const TqUchar*>( values ), count*sizeof( T ) );
+		}
+		/** Append a single plain value to the key.
+		 */
+		template<typename T>
+		void add( const T& value )
+		{
+			add( &value, 1 );
+		}
+		/** Append a null terminated string to the key.
+		 */
+		void addString( const char* str )
+		{
+			append( reinterpret_cast<const TqUchar*>( str ), std::strlen( str ) + 1 );
+		}
+		/** Append a matrix to the key.
+		 */
+		void addMatrix( const CqMatrix& mat );
+
+		TqUlong hash() const
+		{
+			return ( m_hash );
+		}
+		bool operator==( const CqTessellationKey& other ) const
+		{
+			return ( m_hash == other.m_hash && m_data == other.m_data );
+		}
+
+	private:
+		void append( const TqUchar* data, TqUint size );
+
+		std::vector<TqUchar>	m_data;		///< Serialised gprim data.
+		TqUlong	m_hash;		///< Hash of m_data.
+};
+
+
+//----------------------------------------------------------------------
+/** \class CqTessellationCache
+ * Cache of refined subdivision topology which is kept between world blocks.
+ *
+ * Building the lath topology of a subdivision mesh and refining it during
+ * dicing is expensive, and for static geometry in an animated sequence the
+ * results are the same every frame.  The cache keeps hold of the topology
+ * along with all the refined vertices, so that the next frame can pick up
+ * where the last one left off.
+ *
+ * Subdivision is affine invariant, so refined vertices computed in the
+ * camera space of one frame are correct in any other space once the
+ * corresponding transformation is applied.  The cache moves the vertices of
+ * a topology back to world space when it's fetched, after which they are
+ * transformed into the new camera space along with everything else.
+ *
+ * The cache is only active when the "limits" "tessellationcache" option
+ * gives it some memory.  It is only usable for gprims which are posted
+ * directly into the pipeline (ie, not in multipass mode), and outside
+ * motion blocks.
+ */
+
+class CqTessellationCache
+{
+	public:
+		CqTessellationCache();
+
+		/** Prepare the cache for a new world block.
+		 *
+		 * Entries which don't fit in the memory limit are evicted, least
+		 * recently used first.
+		 *
+		 * \param memoryLimit - memory available to the cache in kB, 0 to
+		 *                      disable and empty the cache.
+		 */
+		void beginWorld( TqInt memoryLimit );
+		/** Determine whether gprims should be looked up in the cache.
+		 */
+		bool isEnabled() const
+		{
+			return ( m_memoryLimit > 0 );
+		}
+		/** Look up the topology for a subdivision mesh.
+		 *
+		 * Each topology can only be used once per world block.  The points of
+		 * a returned topology are in world space.
+		 *
+		 * \return The cached topology, or null if there isn't a usable one.
+		 */
+		boost::shared_ptr<CqSubdivision2> fetch( const CqTessellationKey& key );
+		/** Add a newly finalised topology to the cache.
+		 *
+		 * The points of the topology should be in world space and about to be
+		 * posted to the pipeline.
+		 */
+		void store( const CqTessellationKey& key,
+				const boost::shared_ptr<CqSubdivision2>& topology );
+		/** Remove all entries.
+		 */
+		void clear();
+
+	private:
+		struct SqEntry
+		{
+			CqTessellationKey	key;
+			boost::shared_ptr<CqSubdivision2>	topology;
+			/// Transformations from the camera space the topology was last used in back to world space.
+			CqMatrix	matCtoW;
+			CqMatrix	matNCtoW;
+			CqMatrix	matVCtoW;
+			/// World block in which the topology was last used.
+			TqInt	lastWorld;
+			/// Memory estimate at the time the entry was last checked.
+			TqUlong	memory;
+		};
+		typedef std::multimap<TqUlong, SqEntry> TqEntryMap;
+
+		/** Remove least recently used entries until the cache fits.
+		 */
+		void evict();
+		static TqUlong memoryUsage( const CqSubdivision2& topology );
+
+		TqEntryMap	m_entries;		///< Entries indexed by key hash.
+		TqUlong	m_memoryLimit;		///< Memory limit in bytes.
+		TqUlong	m_memory;		///< Estimated memory of all entries in bytes.
+		TqInt	m_world;		///< Counter identifying the current world block.
+		CqMatrix	m_matCtoW;		///< Camera to world transformation for this world block.
+		CqMatrix	m_matNCtoW;
+		CqMatrix	m_matVCtoW;
+};
+
+} // namespace Aqsis
+
+#endif	// !TESSELLATIONCACHE_H_INCLUDED
@@ -0,0 +1,238 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file Unit tests for the cache of subdivision topology kept between frames.
+ */
+
+#include "tessellationcache.h"
+
+#include <aqsis/ri/ri.h>
+
+#include "parameters.h"
+#include "polygon.h"
+#include "renderer.h"
+#include "subdivision2.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(tessellationcache_tests)
+
+using namespace Aqsis;
+
+namespace {
+
+inline char* tok(const char* str)
+{
+	return const_cast<char*>(str);
+}
+
+/// Begin a world block with the given cache limit and camera position.
+void beginWorld(TqInt cacheLimit, TqFloat cameraZ = 0)
+{
+	RiOption(tok("limits"), tok("tessellationcache"), &cacheLimit, RI_NULL);
+	RiFrameBegin(0);
+	// Render a tiny image to the internal debugging display, so that no
+	// display driver needs to be found.
+	RtString driver = tok("debugdd");
+	RiOption(tok("display"), tok("string debugdd"), &driver, RI_NULL);
+	RiFormat(4, 4, 1);
+	RiDisplay(tok("tessellationcache_test"), tok("debugdd"), tok("rgb"), RI_NULL);
+	RiTranslate(0, 0, cameraZ);
+	RiWorldBegin();
+}
+
+void endWorld()
+{
+	RiWorldEnd();
+	RiFrameEnd();
+}
+
+CqTessellationCache& cache()
+{
+	return QGetRenderContext()->tessellationCache();
+}
+
+const CqVector3D squareVerts[] = {
+	CqVector3D(0,0,1), CqVector3D(1,0,1), CqVector3D(1,1,1), CqVector3D(0,1,1)
+};
+
+/// Build the topology of a single square face, with points in world space.
+boost::shared_ptr<CqSubdivision2> makeSquare()
+{
+	boost::shared_ptr<CqPolygonPoints> points(new CqPolygonPoints(4, 1, 4));
+	CqHPointVertexParameter* P = new CqHPointVertexParameter("P", 1);
+	P->SetSize(4);
+	for(TqInt i = 0; i < 4; ++i)
+		P->pValue(i)[0] = vectorCast<CqVector4D>(squareVerts[i]);
+	points->AddPrimitiveVariable(P);
+
+	boost::shared_ptr<CqSubdivision2> topology(new CqSubdivision2(points));
+	topology->Prepare(4);
+	TqInt indices[] = {0, 1, 2, 3};
+	topology->AddFacet(4, indices, 0);
+	BOOST_REQUIRE(topology->Finalise());
+	return topology;
+}
+
+CqTessellationKey makeKey(TqInt id)
+{
+	CqTessellationKey key;
+	key.addString("catmull-clark");
+	key.add(id);
+	key.addMatrix(CqMatrix());
+	return key;
+}
+
+/// Move the points of a topology from world to camera space, as the
+/// pipeline does with posted surfaces.
+void worldToCamera(CqSubdivision2& topology)
+{
+	CqMatrix matWtoC, matNWtoC, matVWtoC;
+	CqRenderer* context = QGetRenderContext();
+	context->matSpaceToSpace("world", "camera", NULL, NULL, 0, matWtoC);
+	context->matNSpaceToSpace("world", "camera", NULL, NULL, 0, matNWtoC);
+	context->matVSpaceToSpace("world", "camera", NULL, NULL, 0, matVWtoC);
+	topology.pPoints()->Transform(matWtoC, matNWtoC, matVWtoC);
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqTessellationKey_test)
+{
+	BOOST_CHECK(makeKey(1) == makeKey(1));
+	BOOST_CHECK_EQUAL(makeKey(1).hash(), makeKey(1).hash());
+	BOOST_CHECK(!(makeKey(1) == makeKey(2)));
+
+	// Strings are terminated, so the split between them matters.
+	CqTessellationKey k1;
+	k1.addString("ab");
+	k1.addString("c");
+	CqTessellationKey k2;
+	k2.addString("a");
+	k2.addString("bc");
+	BOOST_CHECK(!(k1 == k2));
+
+	// Matrices are part of the key.
+	CqMatrix scaled;
+	scaled.Scale(2, 2, 2);
+	CqTessellationKey k3;
+	k3.addMatrix(CqMatrix());
+	CqTessellationKey k4;
+	k4.addMatrix(scaled);
+	CqTessellationKey k5;
+	k5.addMatrix(scaled);
+	BOOST_CHECK(!(k3 == k4));
+	BOOST_CHECK(k4 == k5);
+}
+
+BOOST_AUTO_TEST_CASE(CqTessellationCache_disabled_test)
+{
+	RiBegin(RI_NULL);
+	beginWorld(0);
+	BOOST_CHECK(!cache().isEnabled());
+	boost::shared_ptr<CqSubdivision2> square = makeSquare();
+	cache().store(makeKey(1), square);
+	endWorld();
+
+	beginWorld(0);
+	BOOST_CHECK(!cache().fetch(makeKey(1)));
+	endWorld();
+	RiEnd();
+}
+
+BOOST_AUTO_TEST_CASE(CqTessellationCache_reuse_test)
+{
+	RiBegin(RI_NULL);
+	beginWorld(1024);
+	BOOST_REQUIRE(cache().isEnabled());
+	boost::shared_ptr<CqSubdivision2> square = makeSquare();
+	BOOST_CHECK(!cache().fetch(makeKey(1)));
+	cache().store(makeKey(1), square);
+	// The stored topology is in use for the rest of this world.
+	BOOST_CHECK(!cache().fetch(makeKey(1)));
+	endWorld();
+
+	beginWorld(1024);
+	BOOST_CHECK(!cache().fetch(makeKey(2)));
+	BOOST_CHECK(cache().fetch(makeKey(1)) == square);
+	// Only one gprim may use the topology in each world.
+	BOOST_CHECK(!cache().fetch(makeKey(1)));
+	endWorld();
+
+	beginWorld(1024);
+	BOOST_CHECK(cache().fetch(makeKey(1)) == square);
+	endWorld();
+
+	// Disabling the cache drops the entries.
+	beginWorld(0);
+	endWorld();
+	beginWorld(1024);
+	BOOST_CHECK(!cache().fetch(makeKey(1)));
+	endWorld();
+	RiEnd();
+}
+
+BOOST_AUTO_TEST_CASE(CqTessellationCache_camera_change_test)
+{
+	RiBegin(RI_NULL);
+	beginWorld(1024, 5);
+	boost::shared_ptr<CqSubdivision2> square = makeSquare();
+	cache().store(makeKey(1), square);
+	worldToCamera(*square);
+	BOOST_CHECK(!isClose(vectorCast<CqVector3D>(square->pPoints()->P()->pValue(0)[0]),
+				squareVerts[0], 1e-5f));
+	endWorld();
+
+	// A different camera in the next frame; the points must come back in
+	// world space.
+	beginWorld(1024, -3);
+	BOOST_REQUIRE(cache().fetch(makeKey(1)) == square);
+	for(TqInt i = 0; i < 4; ++i)
+	{
+		CqVector3D P = vectorCast<CqVector3D>(square->pPoints()->P()->pValue(i)[0]);
+		BOOST_CHECK(isClose(P, squareVerts[i], 1e-5f));
+	}
+	endWorld();
+	RiEnd();
+}
+
+BOOST_AUTO_TEST_CASE(CqTessellationCache_eviction_test)
+{
+	RiBegin(RI_NULL);
+	beginWorld(1024);
+	cache().store(makeKey(1), makeSquare());
+	cache().store(makeKey(2), makeSquare());
+	endWorld();
+
+	// Using only the second topology makes the first one the oldest.
+	beginWorld(1024);
+	BOOST_CHECK(cache().fetch(makeKey(2)));
+	endWorld();
+
+	// With too little memory for both, the least recently used goes first.
+	// The entries are smaller than 1kB, so a limit of 1kB keeps one of them.
+	beginWorld(1);
+	BOOST_CHECK(!cache().fetch(makeKey(1)));
+	BOOST_CHECK(cache().fetch(makeKey(2)));
+	endWorld();
+	RiEnd();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
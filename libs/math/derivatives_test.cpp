@@ -0,0 +1,137 @@
+// Aqsis
+// Copyright (C) 1997 - 2007, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file
+ *
+ * \brief Unit tests for grid differences
+ */
+
+#include <aqsis/math/derivatives.h>
+
+#include <cmath>
+#include <vector>
+
+#include <aqsis/math/vector3d.h>
+
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/auto_unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(derivatives_tests)
+
+using namespace Aqsis;
+
+namespace {
+
+// Deterministic, non-polynomial test data so that every stencil gives a
+// different answer.
+TqFloat testValue(TqInt i)
+{
+	return std::sin(0.7f*i) + 0.01f*i*i;
+}
+
+std::vector<TqFloat> floatGrid(TqInt uRes, TqInt vRes)
+{
+	std::vector<TqFloat> data(uRes*vRes);
+	for(TqInt i = 0; i < uRes*vRes; ++i)
+		data[i] = testValue(i);
+	return data;
+}
+
+std::vector<CqVector3D> vectorGrid(TqInt uRes, TqInt vRes)
+{
+	std::vector<CqVector3D> data(uRes*vRes);
+	for(TqInt i = 0; i < uRes*vRes; ++i)
+		data[i] = CqVector3D(testValue(i), testValue(2*i+1), -testValue(i+5));
+	return data;
+}
+
+bool isClose(TqFloat a, TqFloat b)
+{
+	return std::fabs(a - b) <= 1e-6f*(1 + std::fabs(b));
+}
+
+bool isClose(const CqVector3D& a, const CqVector3D& b)
+{
+	return Aqsis::isClose(a, b, 1e-6f);
+}
+
+// Check that the row functions agree with the per-point ones.  They use the
+// same stencils, so only floating point contraction can make them differ.
+template<typename T>
+void checkRowsMatch(const CqGridDiff& diff, const std::vector<T>& data)
+{
+	const TqInt uRes = diff.uRes();
+	std::vector<T> row(uRes);
+	for(TqInt v = 0; v < diff.vRes(); ++v)
+	{
+		diff.diffURow(&data[0], v, &row[0]);
+		for(TqInt u = 0; u < uRes; ++u)
+			BOOST_CHECK(isClose(row[u], diff.diffU(&data[0], u, v)));
+		diff.diffVRow(&data[0], v, &row[0]);
+		for(TqInt u = 0; u < uRes; ++u)
+			BOOST_CHECK(isClose(row[u], diff.diffV(&data[0], u, v)));
+	}
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqGridDiff_rows_match_points_test)
+{
+	const TqInt resolutions[] = {2, 3, 4, 7};
+	const TqInt numRes = sizeof(resolutions)/sizeof(resolutions[0]);
+	for(TqInt iu = 0; iu < numRes; ++iu)
+	{
+		for(TqInt iv = 0; iv < numRes; ++iv)
+		{
+			const TqInt uRes = resolutions[iu];
+			const TqInt vRes = resolutions[iv];
+			for(TqInt centred = 0; centred < 2; ++centred)
+			{
+				CqGridDiff diff(uRes, vRes, false, false, centred != 0);
+				checkRowsMatch(diff, floatGrid(uRes, vRes));
+				checkRowsMatch(diff, vectorGrid(uRes, vRes));
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CqGridDiff_rows_diff_zero_test)
+{
+	// 1D grids turn off the differences across the grid.
+	std::vector<TqFloat> data = floatGrid(5, 1);
+	CqGridDiff uOnly(5, 1, false, true, true);
+	checkRowsMatch(uOnly, data);
+	std::vector<TqFloat> row(5, -1);
+	uOnly.diffVRow(&data[0], 0, &row[0]);
+	for(TqInt u = 0; u < 5; ++u)
+		BOOST_CHECK_EQUAL(row[u], 0);
+
+	data = floatGrid(1, 5);
+	CqGridDiff vOnly(1, 5, true, false, true);
+	checkRowsMatch(vOnly, data);
+	for(TqInt v = 0; v < 5; ++v)
+	{
+		TqFloat result = -1;
+		vOnly.diffURow(&data[0], v, &result);
+		BOOST_CHECK_EQUAL(result, 0);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
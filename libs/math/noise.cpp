@@ -26,6 +26,8 @@
 
 #include <aqsis/math/noise.h>
 
+#include <algorithm>
+
 #include <aqsis/math/noise1234.h>
 #include <aqsis/math/vectorcast.h>
 
@@ -59,6 +61,69 @@ namespace Aqsis {
 #define	O3z	31.91
 #define	O3t	37.48
 
+namespace {
+
+/// Number of points deinterleaved at a time by the array noise functions.
+const TqInt noiseChunkSize = 64;
+
+/** Evaluate float noise in [0,1] at up to noiseChunkSize offset points.
+ *
+ * The offset is added in double precision as in the single point functions
+ * so that the results are identical.  Periodic noise is used if px > 0.
+ */
+void noise3Chunk( const CqVector3D* v, double ox, double oy, double oz,
+                  TqInt px, TqInt py, TqInt pz, TqFloat* result, TqInt count )
+{
+	TqFloat x[noiseChunkSize];
+	TqFloat y[noiseChunkSize];
+	TqFloat z[noiseChunkSize];
+	for ( TqInt i = 0; i < count; ++i )
+	{
+		x[i] = v[i].x() + ox;
+		y[i] = v[i].y() + oy;
+		z[i] = v[i].z() + oz;
+	}
+	if ( px > 0 )
+		CqNoise1234::pnoise( x, y, z, px, py, pz, result, count );
+	else
+		CqNoise1234::noise( x, y, z, result, count );
+	for ( TqInt i = 0; i < count; ++i )
+		result[i] = 0.5f * ( 1.0f + result[i] );
+}
+
+/** Evaluate float noise at count points, periodic if px > 0.
+ */
+void fgNoise3Array( const CqVector3D* v, TqInt px, TqInt py, TqInt pz,
+                    TqFloat* result, TqInt count )
+{
+	for ( TqInt i = 0; i < count; i += noiseChunkSize )
+	{
+		TqInt n = std::min( noiseChunkSize, count - i );
+		noise3Chunk( v + i, 0, 0, 0, px, py, pz, result + i, n );
+	}
+}
+
+/** Evaluate vector noise at count points, periodic if px > 0.
+ */
+void pgNoise3Array( const CqVector3D* v, TqInt px, TqInt py, TqInt pz,
+                    CqVector3D* result, TqInt count )
+{
+	TqFloat a[noiseChunkSize];
+	TqFloat b[noiseChunkSize];
+	TqFloat c[noiseChunkSize];
+	for ( TqInt i = 0; i < count; i += noiseChunkSize )
+	{
+		TqInt n = std::min( noiseChunkSize, count - i );
+		noise3Chunk( v + i, 0, 0, 0, px, py, pz, a, n );
+		noise3Chunk( v + i, O1x, O1y, O1z, px, py, pz, b, n );
+		noise3Chunk( v + i, O2x, O2y, O2z, px, py, pz, c, n );
+		for ( TqInt j = 0; j < n; ++j )
+			result[i + j] = CqVector3D( a[j], b[j], c[j] );
+	}
+}
+
+} // unnamed namespace
+
 
 //---------------------------------------------------------------------
 /** 1D float Perlin noise, SL "noise()"
@@ -375,6 +440,51 @@ CqColor	CqNoise::CGPNoise4( const CqVector3D& v, TqFloat t, const CqVector3D& pv
 	return vectorCast<CqColor>( PGPNoise4( v, t, pv, pt ) );
 }
 
+//---------------------------------------------------------------------
+/** 3D float Perlin noise at an array of points.
+ */
+void CqNoise::FGNoise3( const CqVector3D* v, TqFloat* result, TqInt count )
+{
+	fgNoise3Array( v, 0, 0, 0, result, count );
+}
+
+//---------------------------------------------------------------------
+/** 3D float Perlin periodic noise at an array of points.
+ */
+void CqNoise::FGPNoise3( const CqVector3D* v, const CqVector3D& pv, TqFloat* result, TqInt count )
+{
+	TqFloat pfx = pv.x() + 0.5f;
+	TqFloat pfy = pv.y() + 0.5f;
+	TqFloat pfz = pv.z() + 0.5f;
+	// CqNoise1234::pnoise() treats periods less than one as one.
+	TqInt px = std::max( FASTFLOOR( pfx ), 1 );
+	TqInt py = std::max( FASTFLOOR( pfy ), 1 );
+	TqInt pz = std::max( FASTFLOOR( pfz ), 1 );
+	fgNoise3Array( v, px, py, pz, result, count );
+}
+
+//---------------------------------------------------------------------
+/** Vector-valued 3D Perlin noise at an array of points.
+ */
+void CqNoise::PGNoise3( const CqVector3D* v, CqVector3D* result, TqInt count )
+{
+	pgNoise3Array( v, 0, 0, 0, result, count );
+}
+
+//---------------------------------------------------------------------
+/** Vector-valued 3D Perlin periodic noise at an array of points.
+ */
+void CqNoise::PGPNoise3( const CqVector3D* v, const CqVector3D& pv, CqVector3D* result, TqInt count )
+{
+	TqFloat pfx = pv.x() + 0.5f;
+	TqFloat pfy = pv.y() + 0.5f;
+	TqFloat pfz = pv.z() + 0.5f;
+	TqInt px = std::max( FASTFLOOR( pfx ), 1 );
+	TqInt py = std::max( FASTFLOOR( pfy ), 1 );
+	TqInt pz = std::max( FASTFLOOR( pfz ), 1 );
+	pgNoise3Array( v, px, py, pz, result, count );
+}
+
 
 } // namespace Aqsis
 //---------------------------------------------------------------------
@@ -376,6 +376,121 @@ TqFloat CqNoise1234::pnoise( TqFloat x, TqFloat y, TqFloat z, TqInt px, TqInt py
 }
 
 
+//---------------------------------------------------------------------
+/** 3D float Perlin noise for a block of at most blockSize points.
+ *
+ * This is arranged as a series of loops over the block, so that everything
+ * except the permutation table lookups can be evaluated for several points
+ * at once.  The arithmetic is the same as for the single point versions.
+ */
+void CqNoise1234::noiseBlock( const TqFloat* x, const TqFloat* y, const TqFloat* z,
+                              bool periodic, TqInt px, TqInt py, TqInt pz,
+                              TqFloat* result, TqInt count )
+{
+	TqInt ix0[blockSize], iy0[blockSize], iz0[blockSize];
+	TqInt ix1[blockSize], iy1[blockSize], iz1[blockSize];
+	TqFloat fx0[blockSize], fy0[blockSize], fz0[blockSize];
+	TqFloat s[blockSize], t[blockSize], r[blockSize];
+
+	for ( TqInt i = 0; i < count; ++i )
+	{
+		ix0[i] = FASTFLOOR( x[i] );
+		iy0[i] = FASTFLOOR( y[i] );
+		iz0[i] = FASTFLOOR( z[i] );
+		fx0[i] = x[i] - ix0[i];
+		fy0[i] = y[i] - iy0[i];
+		fz0[i] = z[i] - iz0[i];
+		r[i] = FADE( fz0[i] );
+		t[i] = FADE( fy0[i] );
+		s[i] = FADE( fx0[i] );
+	}
+
+	if ( periodic )
+	{
+		for ( TqInt i = 0; i < count; ++i )
+		{
+			ix1[i] = (( ix0[i] + 1 ) % px ) & 0xff;
+			iy1[i] = (( iy0[i] + 1 ) % py ) & 0xff;
+			iz1[i] = (( iz0[i] + 1 ) % pz ) & 0xff;
+			ix0[i] = ( ix0[i] % px ) & 0xff;
+			iy0[i] = ( iy0[i] % py ) & 0xff;
+			iz0[i] = ( iz0[i] % pz ) & 0xff;
+		}
+	}
+	else
+	{
+		for ( TqInt i = 0; i < count; ++i )
+		{
+			ix1[i] = ( ix0[i] + 1 ) & 0xff;
+			iy1[i] = ( iy0[i] + 1 ) & 0xff;
+			iz1[i] = ( iz0[i] + 1 ) & 0xff;
+			ix0[i] = ix0[i] & 0xff;
+			iy0[i] = iy0[i] & 0xff;
+			iz0[i] = iz0[i] & 0xff;
+		}
+	}
+
+	for ( TqInt i = 0; i < count; ++i )
+	{
+		TqFloat fx1 = fx0[i] - 1.0f;
+		TqFloat fy1 = fy0[i] - 1.0f;
+		TqFloat fz1 = fz0[i] - 1.0f;
+		TqFloat nxy0, nxy1, nx0, nx1, n0, n1;
+
+		nxy0 = grad(perm[ix0[i] + perm[iy0[i] + perm[iz0[i]]]], fx0[i], fy0[i], fz0[i]);
+		nxy1 = grad(perm[ix0[i] + perm[iy0[i] + perm[iz1[i]]]], fx0[i], fy0[i], fz1);
+		nx0 = NLERP( r[i], nxy0, nxy1 );
+
+		nxy0 = grad(perm[ix0[i] + perm[iy1[i] + perm[iz0[i]]]], fx0[i], fy1, fz0[i]);
+		nxy1 = grad(perm[ix0[i] + perm[iy1[i] + perm[iz1[i]]]], fx0[i], fy1, fz1);
+		nx1 = NLERP( r[i], nxy0, nxy1 );
+
+		n0 = NLERP( t[i], nx0, nx1 );
+
+		nxy0 = grad(perm[ix1[i] + perm[iy0[i] + perm[iz0[i]]]], fx1, fy0[i], fz0[i]);
+		nxy1 = grad(perm[ix1[i] + perm[iy0[i] + perm[iz1[i]]]], fx1, fy0[i], fz1);
+		nx0 = NLERP( r[i], nxy0, nxy1 );
+
+		nxy0 = grad(perm[ix1[i] + perm[iy1[i] + perm[iz0[i]]]], fx1, fy1, fz0[i]);
+		nxy1 = grad(perm[ix1[i] + perm[iy1[i] + perm[iz1[i]]]], fx1, fy1, fz1);
+		nx1 = NLERP( r[i], nxy0, nxy1 );
+
+		n1 = NLERP( t[i], nx0, nx1 );
+
+		result[i] = 0.936f * ( NLERP( s[i], n0, n1 ) );
+	}
+}
+
+//---------------------------------------------------------------------
+/** 3D float Perlin noise for arrays of points.
+ */
+void CqNoise1234::noise( const TqFloat* x, const TqFloat* y, const TqFloat* z,
+                         TqFloat* result, TqInt count )
+{
+	for ( TqInt i = 0; i < count; i += blockSize )
+	{
+		TqInt n = count - i < blockSize ? count - i : blockSize;
+		noiseBlock( x + i, y + i, z + i, false, 0, 0, 0, result + i, n );
+	}
+}
+
+//---------------------------------------------------------------------
+/** 3D float Perlin periodic noise for arrays of points.
+ */
+void CqNoise1234::pnoise( const TqFloat* x, const TqFloat* y, const TqFloat* z,
+                          TqInt px, TqInt py, TqInt pz, TqFloat* result, TqInt count )
+{
+	if (px < 1) px = 1;
+	if (py < 1) py = 1;
+	if (pz < 1) pz = 1;
+	for ( TqInt i = 0; i < count; i += blockSize )
+	{
+		TqInt n = count - i < blockSize ? count - i : blockSize;
+		noiseBlock( x + i, y + i, z + i, true, px, py, pz, result + i, n );
+	}
+}
+
+
 //---------------------------------------------------------------------
 /** 4D float Perlin noise.
  */
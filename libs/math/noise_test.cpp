@@ -216,4 +216,30 @@ BOOST_AUTO_TEST_CASE(CqNoise_4D_color_Perlin_periodic_noise_test)
 	BOOST_CHECK_PREDICATE(colEquals, (noise.CGPNoise4(Aqsis::CqVector3D(1.0f, 2.0f, 3.0f), 2.0f, Aqsis::CqVector3D(1.0f, 2.0f, 3.0f), 2.0f))(Aqsis::CqColor(0.5f, 0.62703f, 0.349767f)));
 }
 
+BOOST_AUTO_TEST_CASE(CqNoise_3D_array_noise_test)
+{
+	// The array versions should give exactly the same results as evaluating
+	// each point separately.
+	const TqInt count = 100;
+	Aqsis::CqVector3D points[count];
+	for(TqInt i = 0; i < count; ++i)
+		points[i] = Aqsis::CqVector3D(0.37f*i - 15.0f, 2.1f - 0.13f*i, 0.71f*i);
+	Aqsis::CqVector3D period(3.0f, 4.0f, 0.2f);
+
+	TqFloat fResult[count];
+	Aqsis::CqVector3D pResult[count];
+	Aqsis::CqNoise::FGNoise3(points, fResult, count);
+	for(TqInt i = 0; i < count; ++i)
+		BOOST_CHECK_EQUAL(fResult[i], Aqsis::CqNoise::FGNoise3(points[i]));
+	Aqsis::CqNoise::FGPNoise3(points, period, fResult, count);
+	for(TqInt i = 0; i < count; ++i)
+		BOOST_CHECK_EQUAL(fResult[i], Aqsis::CqNoise::FGPNoise3(points[i], period));
+	Aqsis::CqNoise::PGNoise3(points, pResult, count);
+	for(TqInt i = 0; i < count; ++i)
+		BOOST_CHECK(pResult[i] == Aqsis::CqNoise::PGNoise3(points[i]));
+	Aqsis::CqNoise::PGPNoise3(points, period, pResult, count);
+	for(TqInt i = 0; i < count; ++i)
+		BOOST_CHECK(pResult[i] == Aqsis::CqNoise::PGPNoise3(points[i], period));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -148,6 +148,9 @@ const CqPrimvarToken standardVarsInit[] = {
 	CqPrimvarToken(class_uniform,  type_integer, 1, "texturememory"),
 	CqPrimvarToken(class_uniform,  type_integer, 2, "bucketsize"),
 	CqPrimvarToken(class_uniform,  type_integer, 1, "eyesplits"),
+	CqPrimvarToken(class_uniform,  type_integer, 1, "geometrymemory"),
+	CqPrimvarToken(class_uniform,  type_integer, 1, "tessellationcache"),
+	CqPrimvarToken(class_uniform,  type_integer, 1, "threads"),
 	CqPrimvarToken(class_uniform,  type_color,   1, "zthreshold"),
 	// Option "searchpath"
 	CqPrimvarToken(class_uniform,  type_string,  1, "shader"),
@@ -159,6 +162,8 @@ const CqPrimvarToken standardVarsInit[] = {
 	// Option "statistics"
 	CqPrimvarToken(class_uniform,  type_integer, 1, "endofframe"),
 	CqPrimvarToken(class_uniform,  type_integer, 1, "echoapi"),
+	CqPrimvarToken(class_uniform,  type_string,  1, "filename"),
+	CqPrimvarToken(class_uniform,  type_integer, 1, "shaderprofile"),
 	// Option "shutter"
 	CqPrimvarToken(class_uniform,  type_float,   1, "offset"),
 	// Projection
@@ -202,6 +207,8 @@ const CqPrimvarToken standardVarsInit[] = {
 	CqPrimvarToken(class_uniform,  type_integer, 1, "multipass"),
 	// Attribute "aqsis"
 	CqPrimvarToken(class_uniform,  type_float,   1, "expandgrids"),
+	// Attribute "light"
+	CqPrimvarToken(class_uniform,  type_float,   6, "influencebound"),
 
 	//--------------------------------------------------
 	// Extra options not used by aqsis, but apparently commonly exported in RIB files.
@@ -16,7 +16,13 @@ set(shaderexecenv_srcs
 make_absolute(shaderexecenv_srcs ${shaderexecenv_SOURCE_DIR})
 
 set(shaderexecenv_hdrs
+	sampleoptionextractor.h
 	shaderexecenv.h
 )
 make_absolute(shaderexecenv_hdrs ${shaderexecenv_SOURCE_DIR})
+
+set(shaderexecenv_test_srcs
+	sampleoptionextractor_test.cpp
+)
+make_absolute(shaderexecenv_test_srcs ${shaderexecenv_SOURCE_DIR})
 include_directories(${shaderexecenv_SOURCE_DIR})
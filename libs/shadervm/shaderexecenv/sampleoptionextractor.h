@@ -0,0 +1,447 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+/** \file
+		\brief Extraction of texture sample options from the varargs parameter
+		lists of the RSL texture shadeops.
+		\author Chris J. Foster (chris42f (at) gmail (dot) com)
+*/
+
+#ifndef SAMPLEOPTIONEXTRACTOR_H_INCLUDED
+#define SAMPLEOPTIONEXTRACTOR_H_INCLUDED 1
+
+#include	<aqsis/aqsis.h>
+
+#include	<vector>
+
+#include	<aqsis/math/math.h>
+#include	<aqsis/shadervm/ishaderdata.h>
+#include	<aqsis/tex/filtering/itexturesampler.h>
+#include	<aqsis/tex/filtering/samplequad.h>
+#include	<aqsis/tex/filtering/texturesampleoptions.h>
+#include	<aqsis/util/enum.h>
+#include	<aqsis/util/sstring.h>
+
+namespace Aqsis {
+
+//------------------------------------------------------------------------------
+/** \brief Gathers the sample regions and varying options for the running
+ * points of a grid, for a single batched texture lookup.
+ */
+class CqTextureGridBatch
+{
+	public:
+		/// Construct an empty batch with room for maxPoints points.
+		explicit CqTextureGridBatch(TqInt maxPoints)
+			: m_grid()
+		{
+			m_gridIdx.reserve(maxPoints);
+			for(TqInt i = 0; i < 6; ++i)
+				m_region[i].reserve(maxPoints);
+		}
+
+		/// Add a point to the batch.
+		void addPoint(TqInt gridIdx, const SqSamplePllgram& region)
+		{
+			m_gridIdx.push_back(gridIdx);
+			m_region[0].push_back(region.c.x());
+			m_region[1].push_back(region.c.y());
+			m_region[2].push_back(region.s1.x());
+			m_region[3].push_back(region.s1.y());
+			m_region[4].push_back(region.s2.x());
+			m_region[5].push_back(region.s2.y());
+		}
+
+		/// Get the number of points in the batch.
+		TqInt size() const
+		{
+			return m_gridIdx.size();
+		}
+		/// Get the grid index of the ith point in the batch.
+		TqInt gridIndex(TqInt i) const
+		{
+			return m_gridIdx[i];
+		}
+
+		/** \brief Gather the values of a varying option for the batch.
+		 *
+		 * \param param - shader data for the option, or null.
+		 * \param slot - storage slot to use for the values.
+		 * \return The gathered values, or null if param was null.
+		 */
+		const TqFloat* gatherOption(IqShaderData* param, TqInt slot)
+		{
+			if(!param)
+				return 0;
+			std::vector<TqFloat>& values = m_options[slot];
+			values.resize(m_gridIdx.size());
+			for(TqInt i = 0, n = m_gridIdx.size(); i < n; ++i)
+				param->GetFloat(values[i], m_gridIdx[i]);
+			return &values[0];
+		}
+
+		/// Get the grid description for IqTextureSampler::sampleGrid().
+		SqSampleGrid& grid()
+		{
+			m_grid.numPoints = m_gridIdx.size();
+			if(m_grid.numPoints > 0)
+			{
+				m_grid.cs = &m_region[0][0];
+				m_grid.ct = &m_region[1][0];
+				m_grid.s1s = &m_region[2][0];
+				m_grid.s1t = &m_region[3][0];
+				m_grid.s2s = &m_region[4][0];
+				m_grid.s2t = &m_region[5][0];
+			}
+			return m_grid;
+		}
+
+	private:
+		SqSampleGrid m_grid;
+		std::vector<TqInt> m_gridIdx;
+		/// Parallelogram centers and sides, one array per coordinate.
+		std::vector<TqFloat> m_region[6];
+		/// Storage for gathered varying options.
+		std::vector<TqFloat> m_options[3];
+};
+
+
+/** \brief Basic extractor for sample options from RSL texture() varargs
+ * parameter list.
+ *
+ * Extracts options which are valid for all texture function types.
+ */
+template<typename SampleOptsT>
+class CqSampleOptionExtractorBase
+{
+	private:
+		/**
+		 * Possible texture sample options; these will be null if no sample
+		 * options are specified.
+		 *
+		 * \todo Inspection of the parameter list would be better done at
+		 * shader load-time, assuming the parameter names are constant.
+		 */
+		IqShaderData* m_sBlur;
+		IqShaderData* m_tBlur;
+		IqShaderData* m_channel;
+
+	protected:
+		/// Determine whether a cached option has a varying value.
+		static bool isVarying(const IqShaderData* param)
+		{
+			return param && param->Class() == class_varying;
+		}
+
+		/** \brief Cache varying options, and extract uniform ones.
+		 *
+		 * \param paramList - list of additional parameters to an RSL texture()
+		 *                    call as (name,value) pairs.
+		 * \param numParams - length of paramList.
+		 * \param opts - sample options in which to place uniform options.
+		 */
+		void extractUniformAndCacheVarying(IqShaderData** paramList, TqInt numParams,
+				SampleOptsT& opts)
+		{
+			CqString paramName;
+			for(TqInt i = 0; i < numParams; i+=2)
+			{
+				// Parameter name and data
+				paramList[i]->GetString(paramName, 0);
+				IqShaderData* param = paramList[i+1];
+				handleParam(paramName, param, opts);
+			}
+		}
+
+		/** \brief extract or cache a single parameter.
+		 *
+		 * Cache the parameter in the desired member variable if it's varying.
+		 * If it's uniform then set the appropriate field in the sample
+		 * options.
+		 *
+		 * \param name - parameter name
+		 * \param value - parameter shader data
+		 * \param opts - sample options into which uniform parameters should be placed.
+		 */
+		virtual void handleParam(const CqString& name, IqShaderData* value,
+				SampleOptsT& opts)
+		{
+			// The following are varying
+			if(name == "blur")
+			{
+				m_sBlur = value;
+				m_tBlur = value;
+			}
+			else if(name == "sblur")
+			{
+				m_sBlur = value;
+			}
+			else if(name == "tblur")
+			{
+				m_tBlur = value;
+			}
+			else if(name == "channel")
+			{
+				m_channel = value;
+			}
+			// The rest are uniform
+			else if(name == "width")
+			{
+				TqFloat tmp = 0;
+				value->GetFloat(tmp, 0);
+				opts.setSWidth(tmp);
+				opts.setTWidth(tmp);
+			}
+			else if(name == "swidth")
+			{
+				TqFloat tmp = 0;
+				value->GetFloat(tmp, 0);
+				opts.setSWidth(tmp);
+			}
+			else if(name == "twidth")
+			{
+				TqFloat tmp = 0;
+				value->GetFloat(tmp, 0);
+				opts.setTWidth(tmp);
+			}
+			else if(name == "minwidth")
+			{
+				TqFloat tmp = 0;
+				value->GetFloat(tmp, 0);
+				opts.setMinWidth(tmp);
+			}
+			else if(name == "trunc")
+			{
+				TqFloat tmp = 0;
+				value->GetFloat(tmp, 0);
+				opts.setTruncAmount(tmp);
+			}
+			else if(name == "filter")
+			{
+				CqString tmp;
+				value->GetString(tmp, 0);
+				opts.setFilterType(enumCast<EqTextureFilter>(tmp.c_str()));
+			}
+		}
+
+	public:
+		/** \brief Initialize option extractor: extract uniform options, and cache varying ones.
+		 *
+		 * Cache the parameter in the desired member variable if it's varying.
+		 * If it's uniform then set the appropriate field in the sample
+		 * options.  Whether things are uniform or varying is described by the
+		 * RISpec in the section dealing with the texture() shadeops.
+		 *
+		 * \param paramList - list of additional parameters to an RSL texture()
+		 *                    call as (name,value) pairs.
+		 * \param numParams - length of paramList.
+		 * \param opts - sample options container to extract options into.
+		 */
+		CqSampleOptionExtractorBase()
+			: m_sBlur(0),
+			m_tBlur(0),
+			m_channel(0)
+		{ }
+
+		/// Null destructor
+		virtual ~CqSampleOptionExtractorBase() {}
+
+		/** \brief Extract texture sample options from cached parameters
+		 *
+		 * \param gridIdx - index into varying shader parameter data.
+		 */
+		void extractVarying(TqInt gridIdx, SampleOptsT& opts)
+		{
+			if(m_sBlur)
+			{
+				TqFloat tmp = 0;
+				m_sBlur->GetFloat(tmp, gridIdx);
+				opts.setSBlur(tmp);
+			}
+			if(m_tBlur)
+			{
+				TqFloat tmp = 0;
+				m_tBlur->GetFloat(tmp, gridIdx);
+				opts.setTBlur(tmp);
+			}
+			if(m_channel)
+			{
+				TqFloat tmp = 0;
+				m_channel->GetFloat(tmp, gridIdx);
+				opts.setStartChannel(tmp);
+			}
+		}
+
+		/** \brief Determine whether any of the cached options vary over the grid.
+		 *
+		 * Options given with a uniform value are cached as well, but they
+		 * take the same value at every point.
+		 */
+		bool hasVaryingOptions() const
+		{
+			return isVarying(m_sBlur) || isVarying(m_tBlur) || isVarying(m_channel);
+		}
+
+		/** \brief Gather texture sample options from cached parameters for
+		 * all points in a batch.
+		 */
+		void extractVarying(CqTextureGridBatch& batch)
+		{
+			SqSampleGrid& grid = batch.grid();
+			grid.sBlur = batch.gatherOption(m_sBlur, 0);
+			grid.tBlur = batch.gatherOption(m_tBlur, 1);
+			grid.startChannel = batch.gatherOption(m_channel, 2);
+		}
+};
+
+
+//------------------------------------------------------------------------------
+/** \brief Extractor for plain texture options
+ */
+class CqSampleOptionExtractor
+	: private CqSampleOptionExtractorBase<CqTextureSampleOptions>
+{
+	protected:
+		// From CqSampleOptionExtractorBase.
+		virtual void handleParam(const CqString& name, IqShaderData* value,
+				CqTextureSampleOptions& opts)
+		{
+			if(name == "fill")
+			{
+				TqFloat tmp = 0;
+				value->GetFloat(tmp, 0);
+				opts.setFill(tmp);
+			}
+			else if(name == "lerp")
+			{
+				TqFloat tmp = 0;
+				value->GetFloat(tmp, 0);
+				// Make sure lerp is one of the valid values.
+				opts.setLerp(static_cast<EqMipmapLerp>(
+							clamp<TqInt>(lround(tmp), 0, 2)));
+			}
+			else
+			{
+				// Else call through to the base class for the more basic
+				// texture sample options.
+				CqSampleOptionExtractorBase<CqTextureSampleOptions>
+					::handleParam(name, value, opts);
+			}
+		}
+	public:
+		CqSampleOptionExtractor(IqShaderData** paramList, TqInt numParams,
+				CqTextureSampleOptions& opts)
+			: CqSampleOptionExtractorBase<CqTextureSampleOptions>()
+		{
+			extractUniformAndCacheVarying(paramList, numParams, opts);
+		}
+
+		using CqSampleOptionExtractorBase<CqTextureSampleOptions>::extractVarying;
+};
+
+
+//------------------------------------------------------------------------------
+class CqShadowOptionExtractor
+	: private CqSampleOptionExtractorBase<CqShadowSampleOptions>
+{
+	private:
+		/// Cached values for varying shadow bias.
+		IqShaderData* m_biasLow;
+		IqShaderData* m_biasHigh;
+	protected:
+		// From CqSampleOptionExtractor.
+		virtual void handleParam(const CqString& name, IqShaderData* value,
+				CqShadowSampleOptions& opts)
+		{
+			if(name == "bias")
+			{
+				m_biasLow = value;
+				m_biasHigh = value;
+			}
+			else if(name == "bias0")
+			{
+				m_biasLow = value;
+				if(!m_biasHigh)
+					m_biasHigh = value;
+			}
+			else if(name == "bias1")
+			{
+				m_biasHigh = value;
+				if(!m_biasLow)
+					m_biasLow = value;
+			}
+			else if(name == "samples")
+			{
+				TqFloat tmp = 0;
+				value->GetFloat(tmp, 0);
+				opts.setNumSamples(static_cast<TqInt>(tmp));
+			}
+			else if(name == "depthapprox")
+			{
+				CqString tmp;
+				value->GetString(tmp, 0);
+				opts.setDepthApprox(enumCast<EqDepthApprox>(tmp.c_str()));
+			}
+			else
+			{
+				// Else call through to the base class for the more basic
+				// texture sample options.
+				CqSampleOptionExtractorBase<CqShadowSampleOptions>
+					::handleParam(name, value, opts);
+			}
+		}
+	public:
+		CqShadowOptionExtractor(IqShaderData** paramList, TqInt numParams,
+				CqShadowSampleOptions& opts)
+			: CqSampleOptionExtractorBase<CqShadowSampleOptions>(),
+			m_biasLow(0),
+			m_biasHigh(0)
+		{
+			extractUniformAndCacheVarying(paramList, numParams, opts);
+		}
+
+		void extractVarying(TqInt gridIdx, CqShadowSampleOptions& opts)
+		{
+			if(m_biasLow)
+			{
+				TqFloat tmp = 0;
+				m_biasLow->GetFloat(tmp, gridIdx);
+				opts.setBiasLow(tmp);
+			}
+			if(m_biasHigh)
+			{
+				TqFloat tmp = 0;
+				m_biasHigh->GetFloat(tmp, gridIdx);
+				opts.setBiasHigh(tmp);
+			}
+			CqSampleOptionExtractorBase<CqShadowSampleOptions>::extractVarying(gridIdx, opts);
+		}
+
+		/// Determine whether any of the cached options vary over the grid.
+		bool hasVaryingOptions() const
+		{
+			return isVarying(m_biasLow) || isVarying(m_biasHigh)
+				|| CqSampleOptionExtractorBase<CqShadowSampleOptions>::hasVaryingOptions();
+		}
+};
+
+} // namespace Aqsis
+
+#endif // SAMPLEOPTIONEXTRACTOR_H_INCLUDED
@@ -0,0 +1,143 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+/** \file Unit tests for extraction of texture options from shadeop varargs.
+ */
+
+#include "sampleoptionextractor.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+#include <boost/test/floating_point_comparison.hpp>
+
+#include "shadervariable.h"
+
+using namespace Aqsis;
+
+namespace {
+
+// Holds a varargs parameter list of (name,value) pairs for the extractors.
+struct ParamList
+{
+	std::vector<IqShaderData*> params;
+
+	~ParamList()
+	{
+		for(TqInt i = 0, n = params.size(); i < n; ++i)
+			delete params[i];
+	}
+
+	void addName(const char* name)
+	{
+		CqShaderVariableUniformString* s = new CqShaderVariableUniformString("name");
+		s->SetString(CqString(name));
+		params.push_back(s);
+	}
+
+	void addUniform(const char* name, TqFloat value)
+	{
+		addName(name);
+		CqShaderVariableUniformFloat* f = new CqShaderVariableUniformFloat("value");
+		f->SetFloat(value);
+		params.push_back(f);
+	}
+
+	void addVarying(const char* name, TqFloat value0, TqFloat value1)
+	{
+		addName(name);
+		CqShaderVariableVaryingFloat* f = new CqShaderVariableVaryingFloat("value");
+		f->SetSize(2);
+		f->SetFloat(value0, 0);
+		f->SetFloat(value1, 1);
+		params.push_back(f);
+	}
+
+	IqShaderData** data()
+	{
+		return &params[0];
+	}
+	TqInt size() const
+	{
+		return params.size();
+	}
+};
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_SUITE(sampleoptionextractor_tests)
+
+BOOST_AUTO_TEST_CASE(uniform_options_not_varying)
+{
+	// Uniform blur and bias must keep occlusion() on the batched grid path.
+	ParamList params;
+	params.addUniform("blur", 0.25f);
+	params.addUniform("bias", 0.5f);
+	params.addUniform("channel", 1);
+	CqShadowSampleOptions opts;
+	CqShadowOptionExtractor extractor(params.data(), params.size(), opts);
+	BOOST_CHECK(!extractor.hasVaryingOptions());
+
+	// The cached uniform values are applied by extracting at any point.
+	extractor.extractVarying(0, opts);
+	BOOST_CHECK_CLOSE(opts.sBlur(), 0.25f, 1e-5f);
+	BOOST_CHECK_CLOSE(opts.tBlur(), 0.25f, 1e-5f);
+	BOOST_CHECK_CLOSE(opts.biasLow(), 0.5f, 1e-5f);
+	BOOST_CHECK_CLOSE(opts.biasHigh(), 0.5f, 1e-5f);
+	BOOST_CHECK_EQUAL(opts.startChannel(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(no_options_not_varying)
+{
+	ParamList params;
+	params.addUniform("samples", 16);
+	CqShadowSampleOptions opts;
+	CqShadowOptionExtractor extractor(params.data(), params.size(), opts);
+	BOOST_CHECK(!extractor.hasVaryingOptions());
+	BOOST_CHECK_EQUAL(opts.numSamples(), 16);
+}
+
+BOOST_AUTO_TEST_CASE(varying_blur_is_varying)
+{
+	ParamList params;
+	params.addUniform("bias", 0.5f);
+	params.addVarying("sblur", 0.1f, 0.2f);
+	CqShadowSampleOptions opts;
+	CqShadowOptionExtractor extractor(params.data(), params.size(), opts);
+	BOOST_CHECK(extractor.hasVaryingOptions());
+
+	extractor.extractVarying(1, opts);
+	BOOST_CHECK_CLOSE(opts.sBlur(), 0.2f, 1e-5f);
+	BOOST_CHECK_CLOSE(opts.biasLow(), 0.5f, 1e-5f);
+}
+
+BOOST_AUTO_TEST_CASE(varying_bias_is_varying)
+{
+	ParamList params;
+	params.addUniform("blur", 0.25f);
+	params.addVarying("bias1", 0.1f, 0.2f);
+	CqShadowSampleOptions opts;
+	CqShadowOptionExtractor extractor(params.data(), params.size(), opts);
+	BOOST_CHECK(extractor.hasVaryingOptions());
+
+	extractor.extractVarying(0, opts);
+	BOOST_CHECK_CLOSE(opts.biasLow(), 0.1f, 1e-5f);
+	BOOST_CHECK_CLOSE(opts.biasHigh(), 0.1f, 1e-5f);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
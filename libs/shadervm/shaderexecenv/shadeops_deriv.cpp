@@ -471,6 +471,12 @@ void	CqShaderExecEnv::SO_spspline( IqShaderData* basis, IqShaderData* value, IqS
 
 void	CqShaderExecEnv::SO_fDu( IqShaderData* p, IqShaderData* Result, IqShader* pShader )
 {
+	if(canUseGridDerivatives(p, Result))
+	{
+		derivUGrid<TqFloat>(p, Result);
+		return;
+	}
+
 	bool __fVarying;
 	TqUint __iGrid;
 
@@ -492,6 +498,12 @@ void	CqShaderExecEnv::SO_fDu( IqShaderData* p, IqShaderData* Result, IqShader* p
 
 void	CqShaderExecEnv::SO_fDv( IqShaderData* p, IqShaderData* Result, IqShader* pShader )
 {
+	if(canUseGridDerivatives(p, Result))
+	{
+		derivVGrid<TqFloat>(p, Result);
+		return;
+	}
+
 	bool __fVarying;
 	TqUint __iGrid;
 
@@ -513,6 +525,12 @@ void	CqShaderExecEnv::SO_fDv( IqShaderData* p, IqShaderData* Result, IqShader* p
 
 void	CqShaderExecEnv::SO_fDeriv( IqShaderData* p, IqShaderData* den, IqShaderData* Result, IqShader* pShader )
 {
+	if(canUseGridDerivatives(p, Result) && den->Class() == class_varying)
+	{
+		derivGrid<TqFloat>(p, den, Result);
+		return;
+	}
+
 	bool __fVarying;
 	TqUint __iGrid;
 
@@ -535,6 +553,12 @@ void	CqShaderExecEnv::SO_fDeriv( IqShaderData* p, IqShaderData* den, IqShaderDat
 
 void	CqShaderExecEnv::SO_cDu( IqShaderData* p, IqShaderData* Result, IqShader* pShader )
 {
+	if(canUseGridDerivatives(p, Result))
+	{
+		derivUGrid<CqColor>(p, Result);
+		return;
+	}
+
 	bool __fVarying;
 	TqUint __iGrid;
 
@@ -556,6 +580,12 @@ void	CqShaderExecEnv::SO_cDu( IqShaderData* p, IqShaderData* Result, IqShader* p
 
 void	CqShaderExecEnv::SO_cDv( IqShaderData* p, IqShaderData* Result, IqShader* pShader )
 {
+	if(canUseGridDerivatives(p, Result))
+	{
+		derivVGrid<CqColor>(p, Result);
+		return;
+	}
+
 	bool __fVarying;
 	TqUint __iGrid;
 
@@ -577,6 +607,12 @@ void	CqShaderExecEnv::SO_cDv( IqShaderData* p, IqShaderData* Result, IqShader* p
 
 void	CqShaderExecEnv::SO_cDeriv( IqShaderData* p, IqShaderData* den, IqShaderData* Result, IqShader* pShader )
 {
+	if(canUseGridDerivatives(p, Result) && den->Class() == class_varying)
+	{
+		derivGrid<CqColor>(p, den, Result);
+		return;
+	}
+
 	bool __fVarying;
 	TqUint __iGrid;
 
@@ -599,6 +635,12 @@ void	CqShaderExecEnv::SO_cDeriv( IqShaderData* p, IqShaderData* den, IqShaderDat
 
 void	CqShaderExecEnv::SO_pDu( IqShaderData* p, IqShaderData* Result, IqShader* pShader )
 {
+	if(canUseGridDerivatives(p, Result))
+	{
+		derivUGrid<CqVector3D>(p, Result);
+		return;
+	}
+
 	bool __fVarying;
 	TqUint __iGrid;
 
@@ -620,6 +662,12 @@ void	CqShaderExecEnv::SO_pDu( IqShaderData* p, IqShaderData* Result, IqShader* p
 
 void	CqShaderExecEnv::SO_pDv( IqShaderData* p, IqShaderData* Result, IqShader* pShader )
 {
+	if(canUseGridDerivatives(p, Result))
+	{
+		derivVGrid<CqVector3D>(p, Result);
+		return;
+	}
+
 	bool __fVarying;
 	TqUint __iGrid;
 
@@ -641,6 +689,12 @@ void	CqShaderExecEnv::SO_pDv( IqShaderData* p, IqShaderData* Result, IqShader* p
 
 void	CqShaderExecEnv::SO_pDeriv( IqShaderData* p, IqShaderData* den, IqShaderData* Result, IqShader* pShader )
 {
+	if(canUseGridDerivatives(p, Result) && den->Class() == class_varying)
+	{
+		derivGrid<CqVector3D>(p, den, Result);
+		return;
+	}
+
 	bool __fVarying;
 	TqUint __iGrid;
 
@@ -664,6 +718,24 @@ void	CqShaderExecEnv::SO_pDeriv( IqShaderData* p, IqShaderData* den, IqShaderDat
 // area(P)
 void CqShaderExecEnv::SO_area( IqShaderData* p, IqShaderData* Result, IqShader* pShader )
 {
+	if(canUseGridDerivatives(p, Result))
+	{
+		TqInt count = shadingPointCount();
+		CqAutoBuffer<CqVector3D, 256> dPu(count);
+		CqAutoBuffer<CqVector3D, 256> dPv(count);
+		diffUGrid(p, dPu.get());
+		diffVGrid(p, dPv.get());
+		TqFloat* res = 0;
+		Result->GetFloatPtr(res);
+		const CqBitVector& RS = RunningState();
+		for(TqInt i = 0; i < count; ++i)
+		{
+			if(RS.Value(i))
+				res[i] = (dPu[i] % dPv[i]).Magnitude();
+		}
+		return;
+	}
+
 	bool __fVarying;
 	TqUint __iGrid;
 
@@ -24,8 +24,10 @@
 */
 
 
+#include	<algorithm>
 #include	<string>
 #include	<stdio.h>
+#include	<float.h>
 
 #include	<aqsis/math/math.h>
 #include	"shaderexecenv.h"
@@ -35,6 +37,33 @@
 
 namespace Aqsis {
 
+namespace {
+
+/// Number of times any environment has run the light shaders.
+TqUlong lightEvaluationCount = 0;
+
+/** Compare the contents of a point-like variable against a saved copy,
+ * updating the copy.
+ *
+ * \return true if the contents were unchanged.
+ */
+bool matchSavedPoints( IqShaderData* pVar, std::vector<CqVector3D>& saved )
+{
+	const CqVector3D* pData = NULL;
+	TqUint size = 0;
+	if ( pVar )
+	{
+		pVar->GetPointPtr( pData );
+		size = pVar->Size();
+	}
+	if ( size == saved.size() && std::equal( pData, pData + size, saved.begin() ) )
+		return ( true );
+	saved.assign( pData, pData + size );
+	return ( false );
+}
+
+} // unnamed namespace
+
 //----------------------------------------------------------------------
 // init_illuminance()
 // NOTE: There is duplication here between SO_init_illuminance and 
@@ -52,7 +81,8 @@ bool CqShaderExecEnv::SO_init_illuminance()
 
 	m_li = 0;
 	while ( m_li < m_pAttributes ->cLights() &&
-	        m_pAttributes ->pLight( m_li ) ->pShader() ->fAmbient() )
+	        ( m_pAttributes ->pLight( m_li ) ->pShader() ->fAmbient() ||
+	          ( m_li < m_culledLights.size() && m_culledLights[ m_li ] ) ) )
 	{
 		m_li++;
 	}
@@ -77,7 +107,8 @@ bool CqShaderExecEnv::SO_advance_illuminance()
 
 	m_li++;
 	while ( m_li < m_pAttributes ->cLights() &&
-	        m_pAttributes ->pLight( m_li ) ->pShader() ->fAmbient() )
+	        ( m_pAttributes ->pLight( m_li ) ->pShader() ->fAmbient() ||
+	          ( m_li < m_culledLights.size() && m_culledLights[ m_li ] ) ) )
 	{
 		m_li++;
 	}
@@ -146,10 +177,46 @@ void CqShaderExecEnv::ValidateIlluminanceCache( IqShaderData* pP, IqShaderData*
 
 		IqShaderData* Ns = (pN != NULL )? pN : N();
 		IqShaderData* Ps = (pP != NULL )? pP : P();
+
+		// The light shader results are kept from the last time the lights
+		// were run for this grid, and may be reused by later shaders (or
+		// later illuminance loops) as long as no other grid has run the
+		// lights since, and the points being lit are the same.
+		bool samePoints = matchSavedPoints( Ps, m_illuminanceP );
+		bool sameNormals = matchSavedPoints( Ns, m_illuminanceN );
+		if ( samePoints && sameNormals && m_lightEvaluation != 0
+				&& m_lightEvaluation == lightEvaluationCount )
+		{
+			m_IlluminanceCacheValid = true;
+			return;
+		}
+		m_lightEvaluation = ++lightEvaluationCount;
+
+		// Find the bound of the points being lit, so that lights which can't
+		// reach any of them needn't be evaluated.
+		CqVector3D vecMin( FLT_MAX, FLT_MAX, FLT_MAX );
+		CqVector3D vecMax( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+		const CqVector3D* pPoints = NULL;
+		Ps->GetPointPtr( pPoints );
+		for ( TqUint i = 0, n = Ps->Size(); i < n; ++i )
+		{
+			vecMin = min( vecMin, pPoints[ i ] );
+			vecMax = max( vecMax, pPoints[ i ] );
+		}
+
+		m_culledLights.assign( m_pAttributes ->cLights(), false );
 		TqUint li = 0;
 		while ( li < m_pAttributes ->cLights() )
 		{
 			IqLightsource * lp = m_pAttributes ->pLight( li );
+			// Ambient lights are looked up outside the illuminance loop, so
+			// they always need evaluating.
+			if ( !lp->pShader() ->fAmbient() && !lp->Influences( vecMin, vecMax ) )
+			{
+				m_culledLights[ li ] = true;
+				li++;
+				continue;
+			}
 			// Initialise the lightsource
 			lp->Initialise( uGridRes(), vGridRes(), microPolygonCount(), shadingPointCount(), m_hasValidDerivatives );
 			m_Illuminate = 0;
@@ -1062,6 +1129,29 @@ void CqShaderExecEnv::SO_calculatenormal( IqShaderData* p, IqShaderData* Result,
 	if ( !( (O && CSO) || (!O && !CSO) ) )
 		neg = -1;
 
+	if(canUseGridDerivatives(p, Result))
+	{
+		TqInt count = shadingPointCount();
+		CqAutoBuffer<CqVector3D, 256> dPu(count);
+		CqAutoBuffer<CqVector3D, 256> dPv(count);
+		diffUGrid(p, dPu.get());
+		diffVGrid(p, dPv.get());
+		CqVector3D* res = 0;
+		Result->GetNormalPtr(res);
+		const CqBitVector& RS = RunningState();
+		for(TqInt i = 0; i < count; ++i)
+		{
+			if(RS.Value(i))
+			{
+				CqVector3D N = dPu[i] % dPv[i];
+				N.Unit();
+				N *= neg;
+				res[i] = N;
+			}
+		}
+		return;
+	}
+
 	__fVarying=(p)->Class()==class_varying;
 	__fVarying=(Result)->Class()==class_varying||__fVarying;
 
@@ -28,9 +28,94 @@
 
 #include	"shaderexecenv.h"
 #include	<aqsis/math/vectorcast.h>
+#include	<aqsis/util/autobuffer.h>
 
 namespace Aqsis {
 
+namespace {
+
+/** Determine whether a 3D noise shadeop can be evaluated for the whole grid
+ * with a single call to the array noise functions.
+ *
+ * \param period - the noise period, or null for nonperiodic noise.
+ */
+bool canUseGridNoise( IqShaderData* p, IqShaderData* period, IqShaderData* Result )
+{
+	return p->Class() == class_varying && Result->Class() == class_varying
+		&& ( !period || period->Class() != class_varying );
+}
+
+/** Evaluate float 3D noise over a whole grid.
+ *
+ * \param period - the uniform noise period, or null for nonperiodic noise.
+ */
+void gridFloatNoise3( IqShaderData* p, IqShaderData* period, IqShaderData* Result,
+		const CqBitVector& RS, TqInt count )
+{
+	const CqVector3D* pP = 0;
+	p->GetPointPtr( pP );
+	CqAutoBuffer<TqFloat, 512> noise( count );
+	if ( period )
+	{
+		CqVector3D pv;
+		period->GetPoint( pv, 0 );
+		CqNoise::FGPNoise3( pP, pv, noise.get(), count );
+	}
+	else
+		CqNoise::FGNoise3( pP, noise.get(), count );
+
+	TqFloat* pResult = 0;
+	Result->GetFloatPtr( pResult );
+	for ( TqInt i = 0; i < count; ++i )
+	{
+		if ( RS.Value( i ) )
+			pResult[i] = noise[i];
+	}
+}
+
+/** Evaluate point or color 3D noise over a whole grid.
+ *
+ * \param period - the uniform noise period, or null for nonperiodic noise.
+ */
+void gridVectorNoise3( IqShaderData* p, IqShaderData* period, IqShaderData* Result,
+		const CqBitVector& RS, TqInt count )
+{
+	const CqVector3D* pP = 0;
+	p->GetPointPtr( pP );
+	CqAutoBuffer<CqVector3D, 512> noise( count );
+	if ( period )
+	{
+		CqVector3D pv;
+		period->GetPoint( pv, 0 );
+		CqNoise::PGPNoise3( pP, pv, noise.get(), count );
+	}
+	else
+		CqNoise::PGNoise3( pP, noise.get(), count );
+
+	if ( Result->Type() == type_color )
+	{
+		CqColor* pResult = 0;
+		Result->GetColorPtr( pResult );
+		for ( TqInt i = 0; i < count; ++i )
+		{
+			if ( RS.Value( i ) )
+				pResult[i] = vectorCast<CqColor>( noise[i] );
+		}
+	}
+	else
+	{
+		CqVector3D* pResult = 0;
+		Result->GetPointPtr( pResult );
+		for ( TqInt i = 0; i < count; ++i )
+		{
+			if ( RS.Value( i ) )
+				pResult[i] = noise[i];
+		}
+	}
+}
+
+} // unnamed namespace
+
 
 void	CqShaderExecEnv::SO_frandom( IqShaderData* Result, IqShader* pShader )
 {
@@ -155,6 +240,12 @@ void CqShaderExecEnv::SO_fnoise2( IqShaderData* u, IqShaderData* v, IqShaderData
 // noise(p)
 void CqShaderExecEnv::SO_fnoise3( IqShaderData* p, IqShaderData* Result, IqShader* pShader )
 {
+	if ( canUseGridNoise( p, 0, Result ) )
+	{
+		gridFloatNoise3( p, 0, Result, RunningState(), shadingPointCount() );
+		return;
+	}
+
 	bool __fVarying;
 	TqUint __iGrid;
 
@@ -258,6 +349,12 @@ void CqShaderExecEnv::SO_cnoise2( IqShaderData* u, IqShaderData* v, IqShaderData
 // noise(p)
 void CqShaderExecEnv::SO_cnoise3( IqShaderData* p, IqShaderData* Result, IqShader* pShader )
 {
+	if ( canUseGridNoise( p, 0, Result ) )
+	{
+		gridVectorNoise3( p, 0, Result, RunningState(), shadingPointCount() );
+		return;
+	}
+
 	bool __fVarying;
 	TqUint __iGrid;
 
@@ -361,6 +458,12 @@ void CqShaderExecEnv::SO_pnoise2( IqShaderData* u, IqShaderData* v, IqShaderData
 // noise(p)
 void CqShaderExecEnv::SO_pnoise3( IqShaderData* p, IqShaderData* Result, IqShader* pShader )
 {
+	if ( canUseGridNoise( p, 0, Result ) )
+	{
+		gridVectorNoise3( p, 0, Result, RunningState(), shadingPointCount() );
+		return;
+	}
+
 	bool __fVarying;
 	TqUint __iGrid;
 
@@ -760,6 +863,12 @@ void CqShaderExecEnv::SO_fpnoise2( IqShaderData* u, IqShaderData* v, IqShaderDat
 // pnoise(p,pperiod)
 void CqShaderExecEnv::SO_fpnoise3( IqShaderData* p, IqShaderData* pperiod, IqShaderData* Result, IqShader* pShader )
 {
+	if ( canUseGridNoise( p, pperiod, Result ) )
+	{
+		gridFloatNoise3( p, pperiod, Result, RunningState(), shadingPointCount() );
+		return;
+	}
+
 	bool __fVarying;
 	TqUint __iGrid;
 
@@ -883,6 +992,12 @@ void CqShaderExecEnv::SO_cpnoise2( IqShaderData* u, IqShaderData* v, IqShaderDat
 // pnoise(p,pperiod)
 void CqShaderExecEnv::SO_cpnoise3( IqShaderData* p, IqShaderData* pperiod, IqShaderData* Result, IqShader* pShader )
 {
+	if ( canUseGridNoise( p, pperiod, Result ) )
+	{
+		gridVectorNoise3( p, pperiod, Result, RunningState(), shadingPointCount() );
+		return;
+	}
+
 	bool __fVarying;
 	TqUint __iGrid;
 
@@ -1006,6 +1121,12 @@ void CqShaderExecEnv::SO_ppnoise2( IqShaderData* u, IqShaderData* v, IqShaderDat
 // pnoise(p,pperiod)
 void CqShaderExecEnv::SO_ppnoise3( IqShaderData* p, IqShaderData* pperiod, IqShaderData* Result, IqShader* pShader )
 {
+	if ( canUseGridNoise( p, pperiod, Result ) )
+	{
+		gridVectorNoise3( p, pperiod, Result, RunningState(), shadingPointCount() );
+		return;
+	}
+
 	bool __fVarying;
 	TqUint __iGrid;
 
@@ -33,6 +33,7 @@
 #include	<string>
 #include	<cstdio>
 #include	<cstring>
+#include	<vector>
 
 #include	"shaderexecenv.h"
 #include	<aqsis/tex/filtering/ienvironmentsampler.h>
@@ -42,6 +43,7 @@
 #include	<aqsis/tex/filtering/itexturesampler.h>
 #include	<aqsis/tex/io/texfileheader.h>
 #include	<aqsis/tex/buffers/channellist.h>
+#include	"sampleoptionextractor.h"
 
 namespace Aqsis
 {
@@ -49,294 +51,6 @@ namespace Aqsis
 namespace
 {
 
-// helper functions and classes.
-
-/** \brief Basic extractor for sample options from RSL texture() varargs
- * parameter list.
- *
- * Extracts options which are valid for all texture function types.
- */
-template<typename SampleOptsT>
-class CqSampleOptionExtractorBase
-{
-	private:
-		/**
-		 * Possible texture sample options; these will be null if no sample
-		 * options are specified.
-		 *
-		 * \todo Inspection of the parameter list would be better done at
-		 * shader load-time, assuming the parameter names are constant.
-		 */
-		IqShaderData* m_sBlur;
-		IqShaderData* m_tBlur;
-		IqShaderData* m_channel;
-
-	protected:
-		/** \brief Cache varying options, and extract uniform ones.
-		 *
-		 * \param paramList - list of additional parameters to an RSL texture()
-		 *                    call as (name,value) pairs.
-		 * \param numParams - length of paramList.
-		 * \param opts - sample options in which to place uniform options.
-		 */
-		void extractUniformAndCacheVarying(IqShaderData** paramList, TqInt numParams,
-				SampleOptsT& opts)
-		{
-			CqString paramName;
-			for(TqInt i = 0; i < numParams; i+=2)
-			{
-				// Parameter name and data
-				paramList[i]->GetString(paramName, 0);
-				IqShaderData* param = paramList[i+1];
-				handleParam(paramName, param, opts);
-			}
-		}
-
-		/** \brief extract or cache a single parameter.
-		 *
-		 * Cache the parameter in the desired member variable if it's varying.
-		 * If it's uniform then set the appropriate field in the sample
-		 * options.
-		 *
-		 * \param name - parameter name
-		 * \param value - parameter shader data
-		 * \param opts - sample options into which uniform parameters should be placed.
-		 */
-		virtual void handleParam(const CqString& name, IqShaderData* value,
-				SampleOptsT& opts)
-		{
-			// The following are varying
-			if(name == "blur")
-			{
-				m_sBlur = value;
-				m_tBlur = value;
-			}
-			else if(name == "sblur")
-			{
-				m_sBlur = value;
-			}
-			else if(name == "tblur")
-			{
-				m_tBlur = value;
-			}
-			else if(name == "channel")
-			{
-				m_channel = value;
-			}
-			// The rest are uniform
-			else if(name == "width")
-			{
-				TqFloat tmp = 0;
-				value->GetFloat(tmp, 0);
-				opts.setSWidth(tmp);
-				opts.setTWidth(tmp);
-			}
-			else if(name == "swidth")
-			{
-				TqFloat tmp = 0;
-				value->GetFloat(tmp, 0);
-				opts.setSWidth(tmp);
-			}
-			else if(name == "twidth")
-			{
-				TqFloat tmp = 0;
-				value->GetFloat(tmp, 0);
-				opts.setTWidth(tmp);
-			}
-			else if(name == "minwidth")
-			{
-				TqFloat tmp = 0;
-				value->GetFloat(tmp, 0);
-				opts.setMinWidth(tmp);
-			}
-			else if(name == "trunc")
-			{
-				TqFloat tmp = 0;
-				value->GetFloat(tmp, 0);
-				opts.setTruncAmount(tmp);
-			}
-			else if(name == "filter")
-			{
-				CqString tmp;
-				value->GetString(tmp, 0);
-				opts.setFilterType(enumCast<EqTextureFilter>(tmp.c_str()));
-			}
-		}
-
-	public:
-		/** \brief Initialize option extractor: extract uniform options, and cache varying ones.
-		 *
-		 * Cache the parameter in the desired member variable if it's varying.
-		 * If it's uniform then set the appropriate field in the sample
-		 * options.  Whether things are uniform or varying is described by the
-		 * RISpec in the section dealing with the texture() shadeops.
-		 *
-		 * \param paramList - list of additional parameters to an RSL texture()
-		 *                    call as (name,value) pairs.
-		 * \param numParams - length of paramList.
-		 * \param opts - sample options container to extract options into.
-		 */
-		CqSampleOptionExtractorBase()
-			: m_sBlur(0),
-			m_tBlur(0),
-			m_channel(0)
-		{ }
-
-		/// Null destructor
-		virtual ~CqSampleOptionExtractorBase() {}
-
-		/** \brief Extract texture sample options from cached parameters
-		 *
-		 * \param gridIdx - index into varying shader parameter data.
-		 */
-		void extractVarying(TqInt gridIdx, SampleOptsT& opts)
-		{
-			if(m_sBlur)
-			{
-				TqFloat tmp = 0;
-				m_sBlur->GetFloat(tmp, gridIdx);
-				opts.setSBlur(tmp);
-			}
-			if(m_tBlur)
-			{
-				TqFloat tmp = 0;
-				m_tBlur->GetFloat(tmp, gridIdx);
-				opts.setTBlur(tmp);
-			}
-			if(m_channel)
-			{
-				TqFloat tmp = 0;
-				m_channel->GetFloat(tmp, gridIdx);
-				opts.setStartChannel(tmp);
-			}
-		}
-};
-
-
-//------------------------------------------------------------------------------
-/** \brief Extractor for plain texture options
- */
-class CqSampleOptionExtractor
-	: private CqSampleOptionExtractorBase<CqTextureSampleOptions>
-{
-	protected:
-		// From CqSampleOptionExtractorBase.
-		virtual void handleParam(const CqString& name, IqShaderData* value,
-				CqTextureSampleOptions& opts)
-		{
-			if(name == "fill")
-			{
-				TqFloat tmp = 0;
-				value->GetFloat(tmp, 0);
-				opts.setFill(tmp);
-			}
-			else if(name == "lerp")
-			{
-				TqFloat tmp = 0;
-				value->GetFloat(tmp, 0);
-				// Make sure lerp is one of the valid values.
-				opts.setLerp(static_cast<EqMipmapLerp>(
-							clamp<TqInt>(lround(tmp), 0, 2)));
-			}
-			else
-			{
-				// Else call through to the base class for the more basic
-				// texture sample options.
-				CqSampleOptionExtractorBase<CqTextureSampleOptions>
-					::handleParam(name, value, opts);
-			}
-		}
-	public:
-		CqSampleOptionExtractor(IqShaderData** paramList, TqInt numParams,
-				CqTextureSampleOptions& opts)
-			: CqSampleOptionExtractorBase<CqTextureSampleOptions>()
-		{
-			extractUniformAndCacheVarying(paramList, numParams, opts);
-		}
-
-		using CqSampleOptionExtractorBase<CqTextureSampleOptions>::extractVarying;
-};
-
-
-//------------------------------------------------------------------------------
-class CqShadowOptionExtractor
-	: private CqSampleOptionExtractorBase<CqShadowSampleOptions>
-{
-	private:
-		/// Cached values for varying shadow bias.
-		IqShaderData* m_biasLow;
-		IqShaderData* m_biasHigh;
-	protected:
-		// From CqSampleOptionExtractor.
-		virtual void handleParam(const CqString& name, IqShaderData* value,
-				CqShadowSampleOptions& opts)
-		{
-			if(name == "bias")
-			{
-				m_biasLow = value;
-				m_biasHigh = value;
-			}
-			else if(name == "bias0")
-			{
-				m_biasLow = value;
-				if(!m_biasHigh)
-					m_biasHigh = value;
-			}
-			else if(name == "bias1")
-			{
-				m_biasHigh = value;
-				if(!m_biasLow)
-					m_biasLow = value;
-			}
-			else if(name == "samples")
-			{
-				TqFloat tmp = 0;
-				value->GetFloat(tmp, 0);
-				opts.setNumSamples(static_cast<TqInt>(tmp));
-			}
-			else if(name == "depthapprox")
-			{
-				CqString tmp;
-				value->GetString(tmp, 0);
-				opts.setDepthApprox(enumCast<EqDepthApprox>(tmp.c_str()));
-			}
-			else
-			{
-				// Else call through to the base class for the more basic
-				// texture sample options.
-				CqSampleOptionExtractorBase<CqShadowSampleOptions>
-					::handleParam(name, value, opts);
-			}
-		}
-	public:
-		CqShadowOptionExtractor(IqShaderData** paramList, TqInt numParams,
-				CqShadowSampleOptions& opts)
-			: CqSampleOptionExtractorBase<CqShadowSampleOptions>(),
-			m_biasLow(0),
-			m_biasHigh(0)
-		{
-			extractUniformAndCacheVarying(paramList, numParams, opts);
-		}
-
-		void extractVarying(TqInt gridIdx, CqShadowSampleOptions& opts)
-		{
-			if(m_biasLow)
-			{
-				TqFloat tmp = 0;
-				m_biasLow->GetFloat(tmp, gridIdx);
-				opts.setBiasLow(tmp);
-			}
-			if(m_biasHigh)
-			{
-				TqFloat tmp = 0;
-				m_biasHigh->GetFloat(tmp, gridIdx);
-				opts.setBiasHigh(tmp);
-			}
-			CqSampleOptionExtractorBase<CqShadowSampleOptions>::extractVarying(gridIdx, opts);
-		}
-};
-
-
 //------------------------------------------------------------------------------
 /// Fill any shadow sampling options obtainable from the renderer context via RiOptions.
 void getRenderContextShadowOpts(const IqRenderer& context, CqShadowSampleOptions& sampleOpts)
@@ -385,13 +99,15 @@ void CqShaderExecEnv::SO_ftexture2(IqShaderData* name, IqShaderData* s, IqShader
 	// Initialize extraction of varargs texture options.
 	CqSampleOptionExtractor optExtractor(apParams, cParams, sampleOpts);
 
+	// Gather the filter regions for all running points so they can be
+	// sampled in one batch.
+	CqTextureGridBatch batch(shadingPointCount());
 	const CqBitVector& RS = RunningState();
 	gridIdx = 0;
 	do
 	{
 		if(RS.Value(gridIdx))
 		{
-			optExtractor.extractVarying(gridIdx, sampleOpts);
 			// Edges of region to be filtered.
 			CqVector2D diffUst(diffU<TqFloat>(s, gridIdx), diffU<TqFloat>(t, gridIdx));
 			CqVector2D diffVst(diffV<TqFloat>(s, gridIdx), diffV<TqFloat>(t, gridIdx));
@@ -401,14 +117,19 @@ void CqShaderExecEnv::SO_ftexture2(IqShaderData* name, IqShaderData* s, IqShader
 			s->GetFloat(ss,gridIdx);
 			t->GetFloat(tt,gridIdx);
 			// Filter region
-			SqSamplePllgram region(CqVector2D(ss,tt), diffUst, diffVst);
-			// length-1 "array" where filtered results will be placed.
-			TqFloat texSample = 0;
-			texSampler.sample(region, sampleOpts, &texSample);
-			Result->SetFloat(texSample, gridIdx);
+			batch.addPoint(gridIdx, SqSamplePllgram(CqVector2D(ss,tt), diffUst, diffVst));
 		}
 	}
 	while( ++gridIdx < static_cast<TqInt>(shadingPointCount()) );
+
+	if(batch.size() == 0)
+		return;
+	optExtractor.extractVarying(batch);
+	// array where filtered results will be placed.
+	std::vector<TqFloat> texSamples(batch.size());
+	texSampler.sampleGrid(batch.grid(), sampleOpts, &texSamples[0]);
+	for(TqInt i = 0; i < batch.size(); ++i)
+		Result->SetFloat(texSamples[i], batch.gridIndex(i));
 }
 
 //----------------------------------------------------------------------
@@ -437,13 +158,15 @@ void CqShaderExecEnv::SO_ftexture3( IqShaderData* name, IqShaderData* s1, IqShad
 	// Initialize extraction of varargs texture options.
 	CqSampleOptionExtractor optExtractor(apParams, cParams, sampleOpts);
 
+	// Gather the filter regions for all running points so they can be
+	// sampled in one batch.
+	CqTextureGridBatch batch(shadingPointCount());
 	const CqBitVector& RS = RunningState();
 	gridIdx = 0;
 	do
 	{
 		if(RS.Value(gridIdx))
 		{
-			optExtractor.extractVarying(gridIdx, sampleOpts);
 			// Compute the sample quadrilateral box.  Unfortunately we need all
 			// these temporaries because the shader data interface leaves a bit
 			// to be desired ;-)
@@ -456,15 +179,20 @@ void CqShaderExecEnv::SO_ftexture3( IqShaderData* name, IqShaderData* s1, IqShad
 			TqFloat t3Val = 0;  t3->GetFloat(t3Val, gridIdx);
 			TqFloat t4Val = 0;  t4->GetFloat(t4Val, gridIdx);
 			SqSampleQuad sampleQuad(CqVector2D(s1Val, t1Val), CqVector2D(s2Val, t2Val),
-						CqVector2D(s3Val, t3Val), CqVector2D(s4Val, t4Val));
-
-			// length-1 "array" where filtered results will be placed.
-			TqFloat texSample = 0;
-			texSampler.sample(sampleQuad, sampleOpts, &texSample);
-			Result->SetFloat(texSample, gridIdx);
+					CqVector2D(s3Val, t3Val), CqVector2D(s4Val, t4Val));
+			batch.addPoint(gridIdx, SqSamplePllgram(sampleQuad));
 		}
 	}
 	while( ++gridIdx < static_cast<TqInt>(shadingPointCount()) );
+
+	if(batch.size() == 0)
+		return;
+	optExtractor.extractVarying(batch);
+	// array where filtered results will be placed.
+	std::vector<TqFloat> texSamples(batch.size());
+	texSampler.sampleGrid(batch.grid(), sampleOpts, &texSamples[0]);
+	for(TqInt i = 0; i < batch.size(); ++i)
+		Result->SetFloat(texSamples[i], batch.gridIndex(i));
 }
 
 //----------------------------------------------------------------------
@@ -500,13 +228,15 @@ void CqShaderExecEnv::SO_ctexture2( IqShaderData* name, IqShaderData* s, IqShade
 	// Initialize extraction of varargs texture options.
 	CqSampleOptionExtractor optExtractor(apParams, cParams, sampleOpts);
 
+	// Gather the filter regions for all running points so they can be
+	// sampled in one batch.
+	CqTextureGridBatch batch(shadingPointCount());
 	const CqBitVector& RS = RunningState();
 	gridIdx = 0;
 	do
 	{
 		if(RS.Value(gridIdx))
 		{
-			optExtractor.extractVarying(gridIdx, sampleOpts);
 			// Edges of region to be filtered.
 			CqVector2D diffUst(diffU<TqFloat>(s, gridIdx), diffU<TqFloat>(t, gridIdx));
 			CqVector2D diffVst(diffV<TqFloat>(s, gridIdx), diffV<TqFloat>(t, gridIdx));
@@ -516,15 +246,22 @@ void CqShaderExecEnv::SO_ctexture2( IqShaderData* name, IqShaderData* s, IqShade
 			s->GetFloat(ss,gridIdx);
 			t->GetFloat(tt,gridIdx);
 			// Filter region
-			SqSamplePllgram region(CqVector2D(ss,tt), diffUst, diffVst);
-			// array where filtered results will be placed.
-			TqFloat texSample[3] = {0,0,0};
-			texSampler.sample(region, sampleOpts, texSample);
-			CqColor resultCol(texSample[0], texSample[1], texSample[2]);
-			Result->SetColor(resultCol, gridIdx);
+			batch.addPoint(gridIdx, SqSamplePllgram(CqVector2D(ss,tt), diffUst, diffVst));
 		}
 	}
 	while( ++gridIdx < static_cast<TqInt>(shadingPointCount()) );
+
+	if(batch.size() == 0)
+		return;
+	optExtractor.extractVarying(batch);
+	// array where filtered results will be placed.
+	std::vector<TqFloat> texSamples(3*batch.size());
+	texSampler.sampleGrid(batch.grid(), sampleOpts, &texSamples[0]);
+	for(TqInt i = 0; i < batch.size(); ++i)
+	{
+		CqColor resultCol(texSamples[3*i], texSamples[3*i+1], texSamples[3*i+2]);
+		Result->SetColor(resultCol, batch.gridIndex(i));
+	}
 }
 
 //----------------------------------------------------------------------
@@ -553,13 +290,15 @@ void CqShaderExecEnv::SO_ctexture3( IqShaderData* name, IqShaderData* s1, IqShad
 	// Initialize extraction of varargs texture options.
 	CqSampleOptionExtractor optExtractor(apParams, cParams, sampleOpts);
 
+	// Gather the filter regions for all running points so they can be
+	// sampled in one batch.
+	CqTextureGridBatch batch(shadingPointCount());
 	const CqBitVector& RS = RunningState();
 	gridIdx = 0;
 	do
 	{
 		if(RS.Value(gridIdx))
 		{
-			optExtractor.extractVarying(gridIdx, sampleOpts);
 			// Compute the sample quadrilateral box.  Unfortunately we need all
 			// these temporaries because the shader data interface leaves a bit
 			// to be desired ;-)
@@ -573,14 +312,22 @@ void CqShaderExecEnv::SO_ctexture3( IqShaderData* name, IqShaderData* s1, IqShad
 			TqFloat t4Val = 0;  t4->GetFloat(t4Val, gridIdx);
 			SqSampleQuad sampleQuad(CqVector2D(s1Val, t1Val), CqVector2D(s2Val, t2Val),
 					CqVector2D(s3Val, t3Val), CqVector2D(s4Val, t4Val));
-			// array where filtered results will be placed.
-			TqFloat texSample[3] = {0,0,0};
-			texSampler.sample(sampleQuad, sampleOpts, texSample);
-			CqColor resultCol(texSample[0], texSample[1], texSample[2]);
-			Result->SetColor(resultCol, gridIdx);
+			batch.addPoint(gridIdx, SqSamplePllgram(sampleQuad));
 		}
 	}
 	while( ++gridIdx < static_cast<TqInt>(shadingPointCount()) );
+
+	if(batch.size() == 0)
+		return;
+	optExtractor.extractVarying(batch);
+	// array where filtered results will be placed.
+	std::vector<TqFloat> texSamples(3*batch.size());
+	texSampler.sampleGrid(batch.grid(), sampleOpts, &texSamples[0]);
+	for(TqInt i = 0; i < batch.size(); ++i)
+	{
+		CqColor resultCol(texSamples[3*i], texSamples[3*i+1], texSamples[3*i+2]);
+		Result->SetColor(resultCol, batch.gridIndex(i));
+	}
 }
 
 
@@ -1327,6 +1074,46 @@ void CqShaderExecEnv::SO_occlusion(IqShaderData* name, IqShaderData* P, IqShader
 	CqShadowOptionExtractor optExtractor(apParams, cParams, sampleOpts);
 
 	const CqBitVector& RS = RunningState();
+	if(!optExtractor.hasVaryingOptions())
+	{
+		// With uniform options the whole grid can be sampled in one batch,
+		// which lets the sampler share work between the points.  Options
+		// given with uniform values are still cached by the extractor, so
+		// apply them once for the whole grid.
+		optExtractor.extractVarying(0, sampleOpts);
+		std::vector<Sq3DSamplePllgram> regions;
+		std::vector<CqVector3D> normals;
+		std::vector<TqInt> gridIndices;
+		regions.reserve(shadingPointCount());
+		normals.reserve(shadingPointCount());
+		gridIndices.reserve(shadingPointCount());
+		gridIdx = 0;
+		do
+		{
+			if(RS.Value(gridIdx))
+			{
+				CqVector3D NN;
+				N->GetNormal(NN, gridIdx);
+				normals.push_back(NN);
+				CqVector3D PP;
+				P->GetPoint(PP, gridIdx);
+				regions.push_back(Sq3DSamplePllgram(PP,
+						diffU<CqVector3D>(P, gridIdx), diffV<CqVector3D>(P, gridIdx)));
+				gridIndices.push_back(gridIdx);
+			}
+		}
+		while( ++gridIdx < static_cast<TqInt>(shadingPointCount()) );
+
+		if(gridIndices.empty())
+			return;
+		std::vector<TqFloat> occSamples(gridIndices.size());
+		occSampler.sampleGrid(&regions[0], &normals[0], gridIndices.size(),
+				sampleOpts, &occSamples[0]);
+		for(TqInt i = 0, n = gridIndices.size(); i < n; ++i)
+			Result->SetFloat(occSamples[i], gridIndices[i]);
+		return;
+	}
+
 	gridIdx = 0;
 	do
 	{
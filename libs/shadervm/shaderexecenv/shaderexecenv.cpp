@@ -136,6 +136,10 @@ CqShaderExecEnv::CqShaderExecEnv(IqRenderer* pRenderContext)
 	m_li(0),
 	m_Illuminate(0),
 	m_IlluminanceCacheValid(false),
+	m_culledLights(),
+	m_illuminanceP(),
+	m_illuminanceN(),
+	m_lightEvaluation(0),
 	m_gatherSample(0),
 	m_pAttributes(),
 	m_pTransform(),
@@ -189,6 +193,7 @@ void CqShaderExecEnv::Initialise( const TqInt uGridRes, const TqInt vGridRes,
 	m_li = 0;
 	m_Illuminate = 0;
 	m_IlluminanceCacheValid = false;
+	m_lightEvaluation = 0;
 
 	// Initialise the state bitvectors
 	m_CurrentState.SetSize( m_shadingPointCount );
@@ -47,6 +47,7 @@
 #include	<aqsis/core/irenderer.h>
 #include	<aqsis/math/matrix.h>
 #include	<aqsis/math/derivatives.h>
+#include	<aqsis/util/autobuffer.h>
 
 #include	<aqsis/core/iattributes.h>
 #include	<aqsis/core/itransform.h>
@@ -372,6 +373,37 @@ class AQSIS_SHADERVM_SHARE CqShaderExecEnv : public IqShaderExecEnv, boost::nonc
 		template<typename T>
 		T deriv(IqShaderData* y, IqShaderData* x, TqInt gridIdx);
 
+		/** \brief Determine whether derivatives of var can be computed a whole
+		 * grid at a time.
+		 *
+		 * This is possible when the grid has valid derivatives and both var
+		 * and Result are varying, in which case the *Grid() versions of the
+		 * derivative functions below may be used.
+		 */
+		bool canUseGridDerivatives(IqShaderData* var, IqShaderData* Result) const;
+		/** \brief Evaluate diffU() for every point of the grid.
+		 *
+		 * \param var - varying variable to take the difference of.
+		 * \param result - output array of length shadingPointCount().
+		 */
+		template<typename T>
+		void diffUGrid(IqShaderData* var, T* result);
+		/// Evaluate diffV() for every point of the grid.
+		template<typename T>
+		void diffVGrid(IqShaderData* var, T* result);
+		/** \brief Store derivU() of var into the running points of Result.
+		 *
+		 * du is fetched once for the whole grid rather than once per point.
+		 */
+		template<typename T>
+		void derivUGrid(IqShaderData* var, IqShaderData* Result);
+		/// Store derivV() of var into the running points of Result.
+		template<typename T>
+		void derivVGrid(IqShaderData* var, IqShaderData* Result);
+		/// Store deriv() of y with respect to x into the running points of Result.
+		template<typename T>
+		void derivGrid(IqShaderData* y, IqShaderData* x, IqShaderData* Result);
+
 		/// Helper function for SO_occlusion_rt and SO_indirectdiffuse.
 		///
 		/// Integrates occlusion or radiosity data from a point cloud,
@@ -431,6 +463,10 @@ class AQSIS_SHADERVM_SHARE CqShaderExecEnv : public IqShaderExecEnv, boost::nonc
 		TqUint	m_li;					///< Light index, used during illuminance loop.
 		TqInt	m_Illuminate;
 		bool	m_IlluminanceCacheValid;	///< Flag indicating whether the illuminance cache is valid.
+		std::vector<bool>	m_culledLights;	///< Flags for lights which can't reach the points in the illuminance cache.
+		std::vector<CqVector3D>	m_illuminanceP;	///< Points the lights were last evaluated at.
+		std::vector<CqVector3D>	m_illuminanceN;	///< Normals the lights were last evaluated with.
+		TqUlong	m_lightEvaluation;		///< Identifies the last light evaluation for this environment, 0 for none.
 		TqUint	m_gatherSample;				///< Sample index, used during gather loop.
 		IqConstAttributesPtr m_pAttributes;	///< Pointer to the associated attributes.
 		IqConstTransformPtr m_pTransform;		///< Pointer to the associated transform.
@@ -746,6 +782,104 @@ inline T CqShaderExecEnv::derivV(IqShaderData* var, TqInt gridIdx, const T& unde
 	return diffV<T>(var, gridIdx) * (1/dvVal);
 }
 
+inline bool CqShaderExecEnv::canUseGridDerivatives(IqShaderData* var,
+		IqShaderData* Result) const
+{
+	return m_hasValidDerivatives
+		&& var->Class() == class_varying && Result->Class() == class_varying
+		&& static_cast<TqInt>(shadingPointCount()) == m_diff.uRes()*m_diff.vRes();
+}
+
+template<typename T>
+void CqShaderExecEnv::diffUGrid(IqShaderData* var, T* result)
+{
+	const T* data = 0;
+	var->GetValuePtr(data);
+	const TqInt uRes = m_diff.uRes();
+	for(TqInt v = 0, vRes = m_diff.vRes(); v < vRes; ++v)
+		m_diff.diffURow(data, v, result + v*uRes);
+}
+
+template<typename T>
+void CqShaderExecEnv::diffVGrid(IqShaderData* var, T* result)
+{
+	const T* data = 0;
+	var->GetValuePtr(data);
+	const TqInt uRes = m_diff.uRes();
+	for(TqInt v = 0, vRes = m_diff.vRes(); v < vRes; ++v)
+		m_diff.diffVRow(data, v, result + v*uRes);
+}
+
+namespace detail {
+
+/// Divide grid differences by the parameter spacing and store into the running points of Result.
+template<typename T>
+void storeGridDeriv(const T* diff, IqShaderData* spacing, IqShaderData* Result,
+		const CqBitVector& RS, TqInt count)
+{
+	const TqFloat* spacingData = 0;
+	spacing->GetFloatPtr(spacingData);
+	const TqInt spacingStride = spacing->Class() == class_varying ? 1 : 0;
+	T* res = 0;
+	Result->GetValuePtr(res);
+	for(TqInt i = 0; i < count; ++i)
+	{
+		if(RS.Value(i))
+		{
+			TqFloat d = spacingData[i*spacingStride];
+			res[i] = d == 0 ? T() : diff[i] * (1/d);
+		}
+	}
+}
+
+} // namespace detail
+
+template<typename T>
+void CqShaderExecEnv::derivUGrid(IqShaderData* var, IqShaderData* Result)
+{
+	TqInt count = shadingPointCount();
+	CqAutoBuffer<T, 256> diff(count);
+	diffUGrid(var, diff.get());
+	detail::storeGridDeriv(diff.get(), du(), Result, RunningState(), count);
+}
+
+template<typename T>
+void CqShaderExecEnv::derivVGrid(IqShaderData* var, IqShaderData* Result)
+{
+	TqInt count = shadingPointCount();
+	CqAutoBuffer<T, 256> diff(count);
+	diffVGrid(var, diff.get());
+	detail::storeGridDeriv(diff.get(), dv(), Result, RunningState(), count);
+}
+
+template<typename T>
+void CqShaderExecEnv::derivGrid(IqShaderData* y, IqShaderData* x, IqShaderData* Result)
+{
+	TqInt count = shadingPointCount();
+	CqAutoBuffer<TqFloat, 256> dxu(count);
+	CqAutoBuffer<TqFloat, 256> dxv(count);
+	CqAutoBuffer<T, 256> dyu(count);
+	CqAutoBuffer<T, 256> dyv(count);
+	diffUGrid(x, dxu.get());
+	diffVGrid(x, dxv.get());
+	diffUGrid(y, dyu.get());
+	diffVGrid(y, dyv.get());
+	T* res = 0;
+	Result->GetValuePtr(res);
+	const CqBitVector& RS = RunningState();
+	for(TqInt i = 0; i < count; ++i)
+	{
+		if(!RS.Value(i))
+			continue;
+		// Same choice of direction as deriv().
+		TqFloat absDxu = std::fabs(dxu[i]);
+		if(absDxu >= std::fabs(dxv[i]))
+			res[i] = absDxu > 0 ? dyu[i] / dxu[i] : T();
+		else
+			res[i] = dyv[i] / dxv[i];
+	}
+}
+
 //-----------------------------------------------------------------------
 
 } // namespace Aqsis
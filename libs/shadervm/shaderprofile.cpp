@@ -0,0 +1,225 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+
+/** \file
+		\brief Implements the execution profile gathered for shader programs.
+*/
+
+#include	"shaderprofile.h"
+
+#include	<algorithm>
+#include	<iomanip>
+#include	<iostream>
+#include	<map>
+#include	<sstream>
+
+#include	<boost/shared_ptr.hpp>
+
+namespace Aqsis {
+
+bool CqShaderProfile::m_enabled = false;
+
+namespace {
+
+/// Profiling session, incremented each time profiling is turned on.
+TqInt g_generation = 0;
+/// Profiles which have gathered samples in the current session.
+std::vector<boost::shared_ptr<CqShaderProfile> > g_profiles;
+boost::mutex g_profilesMutex;
+
+/// A row of one of the report tables.
+struct SqReportRow
+{
+	std::string	name;
+	CqShaderProfile::SqSample	sample;
+
+	/// Order rows by decreasing time.
+	bool operator<(const SqReportRow& other) const
+	{
+		return sample.time > other.sample.time;
+	}
+};
+
+typedef std::map<std::string, SqReportRow> TqReportTable;
+
+void addSample(TqReportTable& table, const std::string& name,
+		const CqShaderProfile::SqSample& sample)
+{
+	SqReportRow& row = table[name];
+	row.name = name;
+	row.sample.time += sample.time;
+	row.sample.calls += sample.calls;
+	row.sample.points += sample.points;
+}
+
+/// Print the most expensive rows of a table.
+void printTable(std::ostream& out, const char* title, const TqReportTable& table,
+		double totalTime, TqUint maxRows)
+{
+	std::vector<SqReportRow> rows;
+	for(TqReportTable::const_iterator i = table.begin(); i != table.end(); ++i)
+		rows.push_back(i->second);
+	std::sort(rows.begin(), rows.end());
+	if(rows.size() > maxRows)
+		rows.resize(maxRows);
+
+	out << title << "\n"
+		<< std::setw(12) << "seconds" << std::setw(8) << "%"
+		<< std::setw(14) << "calls" << std::setw(16) << "points" << "  name\n";
+	for(std::vector<SqReportRow>::const_iterator row = rows.begin(); row != rows.end(); ++row)
+	{
+		out << std::setw(12) << std::setprecision(4) << row->sample.time
+			<< std::setw(7) << std::setprecision(1)
+			<< (totalTime > 0 ? 100*row->sample.time/totalTime : 0) << "%"
+			<< std::setw(14) << row->sample.calls
+			<< std::setw(16) << row->sample.points
+			<< "  " << row->name << "\n";
+	}
+	out << "\n";
+}
+
+} // unnamed namespace
+
+CqShaderProfile::CqShaderProfile()
+	: m_shaderName(),
+	m_files(),
+	m_lines(),
+	m_fileIndices(),
+	m_opNames(),
+	m_samples(),
+	m_runs(0),
+	m_points(0),
+	m_generation(0),
+	m_mutex()
+{ }
+
+void CqShaderProfile::setShaderName(const std::string& name)
+{
+	m_shaderName = name;
+}
+
+void CqShaderProfile::setLocation(TqInt programSize, TqInt line, const std::string& file)
+{
+	std::vector<std::string>::iterator f = std::find(m_files.begin(), m_files.end(), file);
+	TqInt fileIndex = f - m_files.begin();
+	if(f == m_files.end())
+		m_files.push_back(file);
+	m_lines.resize(programSize, line);
+	m_fileIndices.resize(programSize, fileIndex);
+}
+
+void CqShaderProfile::setOpName(TqInt pos, const std::string& name)
+{
+	if(static_cast<TqInt>(m_opNames.size()) <= pos)
+		m_opNames.resize(pos + 1);
+	m_opNames[pos] = name;
+}
+
+void CqShaderProfile::record(const TqSampleVec& samples, TqUlong points)
+{
+	boost::mutex::scoped_lock lock(m_mutex);
+	if(m_generation != g_generation)
+	{
+		// First samples in this session.
+		m_samples.clear();
+		m_runs = 0;
+		m_points = 0;
+		m_generation = g_generation;
+		boost::mutex::scoped_lock profilesLock(g_profilesMutex);
+		g_profiles.push_back(shared_from_this());
+	}
+	if(m_samples.size() < samples.size())
+		m_samples.resize(samples.size());
+	for(TqUint i = 0; i < samples.size(); ++i)
+	{
+		m_samples[i].time += samples[i].time;
+		m_samples[i].calls += samples[i].calls;
+		m_samples[i].points += samples[i].points;
+	}
+	++m_runs;
+	m_points += points;
+}
+
+void CqShaderProfile::setEnabled(bool enabled)
+{
+	if(enabled)
+	{
+		boost::mutex::scoped_lock lock(g_profilesMutex);
+		++g_generation;
+		g_profiles.clear();
+	}
+	m_enabled = enabled;
+}
+
+void CqShaderProfile::printAll(std::ostream& out)
+{
+	std::vector<boost::shared_ptr<CqShaderProfile> > profiles;
+	{
+		boost::mutex::scoped_lock lock(g_profilesMutex);
+		profiles = g_profiles;
+	}
+
+	TqReportTable shaders;
+	TqReportTable lines;
+	TqReportTable opcodes;
+	double totalTime = 0;
+	for(TqUint p = 0; p < profiles.size(); ++p)
+	{
+		CqShaderProfile& profile = *profiles[p];
+		boost::mutex::scoped_lock lock(profile.m_mutex);
+		SqSample shaderSample;
+		shaderSample.calls = profile.m_runs;
+		shaderSample.points = profile.m_points;
+		for(TqUint i = 0; i < profile.m_samples.size(); ++i)
+		{
+			const SqSample& sample = profile.m_samples[i];
+			if(sample.calls == 0)
+				continue;
+			shaderSample.time += sample.time;
+
+			std::ostringstream lineName;
+			lineName << profile.m_shaderName << " (";
+			if(i < profile.m_lines.size() && profile.m_lines[i] >= 0)
+				lineName << profile.m_files[profile.m_fileIndices[i]] << ":" << profile.m_lines[i];
+			else
+				lineName << "unknown line";
+			lineName << ")";
+			addSample(lines, lineName.str(), sample);
+
+			if(i < profile.m_opNames.size() && !profile.m_opNames[i].empty())
+				addSample(opcodes, profile.m_opNames[i], sample);
+		}
+		addSample(shaders, profile.m_shaderName, shaderSample);
+		totalTime += shaderSample.time;
+	}
+
+	std::ios_base::fmtflags flags = out.flags();
+	out.setf(std::ios_base::fixed, std::ios_base::floatfield);
+	out << std::setw(65) << std::setfill('-') << "-\n" << std::setfill(' ')
+		<< "Shader profile\n"
+		<< std::setw(65) << std::setfill('-') << "-\n" << std::setfill(' ');
+	printTable(out, "Shaders:", shaders, totalTime, 20);
+	printTable(out, "Source lines:", lines, totalTime, 20);
+	printTable(out, "Opcodes:", opcodes, totalTime, 20);
+	out.flags(flags);
+}
+
+} // namespace Aqsis
@@ -0,0 +1,127 @@
+// Aqsis
+// Copyright (C) 1997 - 2001, Paul C. Gregory
+//
+// Contact: pgregory@aqsis.org
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public
+// License as published by the Free Software Foundation; either
+// version 2 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// General Public License for more details.
+//
+// You should have received a copy of the GNU General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+
+
+
+/** \file
+		\brief Declares the execution profile gathered for shader programs.
+*/
+
+//? Is .h included already?
+#ifndef SHADERPROFILE_H_INCLUDED
+#define SHADERPROFILE_H_INCLUDED 1
+
+#include	<aqsis/aqsis.h>
+
+#include	<iosfwd>
+#include	<string>
+#include	<vector>
+
+#include	<boost/enable_shared_from_this.hpp>
+#include	<boost/thread/mutex.hpp>
+
+namespace Aqsis {
+
+//----------------------------------------------------------------------
+/** \class CqShaderProfile
+ * Execution profile of a single shader program.
+ *
+ * The profile records the time spent in each instruction of the main program
+ * segment, along with how often it was executed and on how many grid points.
+ * Each instruction is tagged with the source line it was compiled from, as
+ * given by the "line" statements in the compiled shader, so that the time can
+ * be attributed to the shader, to source lines, or to opcodes.
+ *
+ * A profile is shared between all the instances of a loaded shader.
+ * Profiling is turned on for a frame with setEnabled(), and the profiles of
+ * all shaders run since then are reported by printAll().
+ */
+
+class CqShaderProfile : public boost::enable_shared_from_this<CqShaderProfile>
+{
+	public:
+		/// Samples gathered for a single instruction.
+		struct SqSample
+		{
+			double	time;		///< Time spent executing the instruction, in seconds.
+			TqUlong	calls;		///< Number of times the instruction was executed.
+			TqUlong	points;		///< Number of grid points running when it was executed.
+
+			SqSample() : time(0), calls(0), points(0) {}
+		};
+		typedef std::vector<SqSample> TqSampleVec;
+
+		CqShaderProfile();
+
+		/// Set the name the shader is reported under.
+		void setShaderName(const std::string& name);
+
+		/** Set the source location of the program elements added since the
+		 * last call.
+		 *
+		 * \param programSize - current size of the main program.
+		 * \param line - source line, or -1 if unknown.
+		 * \param file - source file name.
+		 */
+		void setLocation(TqInt programSize, TqInt line, const std::string& file);
+		/// Name the opcode at the given position of the main program.
+		void setOpName(TqInt pos, const std::string& name);
+
+		/** Add the samples from one run of the program.
+		 *
+		 * \param samples - samples indexed by program position.
+		 * \param points - number of grid points the program was run on.
+		 */
+		void record(const TqSampleVec& samples, TqUlong points);
+
+		/// Determine whether profiling is turned on.
+		static bool enabled()
+		{
+			return m_enabled;
+		}
+		/** Turn profiling on or off.
+		 *
+		 * Turning profiling on discards the results gathered so far.  This
+		 * should only be called while no shaders are running.
+		 */
+		static void setEnabled(bool enabled);
+		/** Print ranked tables of the time spent in each shader, source line
+		 * and opcode since profiling was turned on.
+		 */
+		static void printAll(std::ostream& out);
+
+	private:
+
+		std::string	m_shaderName;			///< Name of the shader.
+		std::vector<std::string>	m_files;	///< Source files of the shader.
+		std::vector<TqInt>	m_lines;		///< Source line of each program element.
+		std::vector<TqInt>	m_fileIndices;	///< Index into m_files of each program element.
+		std::vector<std::string>	m_opNames;	///< Opcode name at each instruction position.
+		TqSampleVec	m_samples;				///< Samples at each program position.
+		TqUlong	m_runs;						///< Number of times the program was run.
+		TqUlong	m_points;					///< Number of grid points the program was run on.
+		TqInt	m_generation;				///< Profiling session the samples belong to.
+		boost::mutex	m_mutex;
+
+		static bool	m_enabled;
+};
+
+} // namespace Aqsis
+
+#endif	// !SHADERPROFILE_H_INCLUDED
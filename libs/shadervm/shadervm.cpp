@@ -25,6 +25,7 @@
 
 #include "shadervm.h"
 
+#include <cstdlib>
 #include <cstring>
 #include <ctype.h>
 #include <iostream>
@@ -64,6 +65,16 @@ void shutdownShaderVM()
 	CqShaderVM::ShutdownShaderEngine();
 }
 
+void setShaderProfiling(bool enabled)
+{
+	CqShaderProfile::setEnabled(enabled);
+}
+
+void printShaderProfile(std::ostream& out)
+{
+	CqShaderProfile::printAll(out);
+}
+
 //------------------------------------------------------------------------------
 
 /*
@@ -490,6 +501,7 @@ static const TqUlong uhash = CqString::hash("uniform");
 static const TqUlong ushash = CqString::hash("USES");
 static const TqUlong ehash = CqString::hash("external");
 static const TqUlong ohash = CqString::hash("output");
+static const TqUlong lhash = CqString::hash("line");
 
 
 CqShaderVM::CqShaderVM(IqRenderer* pRenderContext)
@@ -506,6 +518,7 @@ CqShaderVM::CqShaderVM(IqRenderer* pRenderContext)
 	m_ProgramInit(),
 	m_Program(),
 	m_ProgramStrings(),
+	m_profile(),
 	m_uGridRes(0),
 	m_vGridRes(0),
 	m_shadingPointCount(0),
@@ -539,6 +552,7 @@ CqShaderVM::CqShaderVM(const CqShaderVM& From)
 	m_ProgramInit(),
 	m_Program(),
 	m_ProgramStrings(),
+	m_profile(),
 	m_uGridRes(0),
 	m_vGridRes(0),
 	m_shadingPointCount(0),
@@ -931,6 +945,10 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 	boost::shared_ptr<CqShaderExecEnv> StdEnv(new CqShaderExecEnv(m_pRenderContext));
 	TqInt	array_count = 0;
 	TqUlong  htoken, i;
+	// Source location of the code being read, for the profiler.
+	boost::shared_ptr<CqShaderProfile> profile(new CqShaderProfile());
+	TqInt	sourceLine = -1;
+	CqString	sourceFile;
 
 	bool fShaderSpec = false;
 	while ( !pFile->eof() )
@@ -982,15 +1000,19 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 		if ( strcmp( token, "AQSIS_V" ) == 0 )
 		{
 			GetToken( token, 255, pFile );
-			// Check that the version string matches the current one.  If not,
-			// fail fatally.
-			const char* slxVersion = AQSIS_XSTR(AQSIS_SLX_VERSION);
-			if( strcmp( token, slxVersion ) != 0 )
+			// Check that the version is one we can load.  If not, fail
+			// fatally.  Older shaders have no line markers, so their
+			// profiles can't be broken down by source line.
+			char* versionEnd = 0;
+			long slxVersion = strtol( token, &versionEnd, 10 );
+			if( versionEnd == token || *versionEnd != '\0'
+				|| slxVersion < AQSIS_SLX_OLDEST_VERSION
+				|| slxVersion > AQSIS_SLX_VERSION )
 			{
 				AQSIS_THROW_XQERROR(XqBadShader, EqE_NoShader,
 					"Incompatible compiled shader version " << token
-					<< " found (expected version " << slxVersion
-					<< ").  Please recompile.");
+					<< " found (expected version " AQSIS_XSTR(AQSIS_SLX_OLDEST_VERSION)
+					<< " to " AQSIS_XSTR(AQSIS_SLX_VERSION) << ").  Please recompile.");
 			}
 			continue;
 		}
@@ -1081,6 +1103,20 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 
 				case Seg_Init:
 				case Seg_Code:
+					// Check if it is a source line marker
+					if ( lhash == htoken ) // == "line"
+					{
+						TqInt line = -1;
+						( *pFile ) >> std::ws >> line;
+						CqString file = GetString( pFile );
+						if ( Segment == Seg_Code )
+						{
+							profile->setLocation( m_Program.size(), sourceLine, sourceFile );
+							sourceLine = line;
+							sourceFile = file;
+						}
+						break;
+					}
 					// Check if it is a label
 					if ( strcmp( token, ":" ) == 0 )
 					{
@@ -1230,6 +1266,8 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 								(*candidate)->initialised = true;
 							}
 
+							if ( Segment == Seg_Code )
+								profile->setOpName( m_Program.size(), "external " + strFunc );
 							AddCommand( &CqShaderVM::SO_external, pProgramArea );
 							AddDSOExternalCall( (*candidate),pProgramArea );
 
@@ -1251,6 +1289,8 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 								m_fAmbient = false;
 
 							// Add this opcode to the program segment.
+							if ( Segment == Seg_Code )
+								profile->setOpName( m_Program.size(), m_TransTable[ i ].m_strName );
 							AddCommand( m_TransTable[ i ].m_pCommand, pProgramArea );
 
 							// Process this opcodes parameters.
@@ -1315,6 +1355,9 @@ void CqShaderVM::LoadProgram( std::istream* pFile )
 		}
 		( *pFile ) >> std::ws;
 	}
+	profile->setLocation( m_Program.size(), sourceLine, sourceFile );
+	m_profile = profile;
+
 	// Now we need to complete any label jump statements.
 	i = 0;
 	while ( i < m_Program.size() )
@@ -1524,6 +1567,7 @@ CqShaderVM&	CqShaderVM::operator=( const CqShaderVM& From )
 
 	// Copy the main program.
 	m_Program.assign(From.m_Program.begin(), From.m_Program.end());
+	m_profile = From.m_profile;
 
 	return ( *this );
 }
@@ -1549,10 +1593,15 @@ void CqShaderVM::Execute(IqShaderExecEnv* pEnv)
 	m_PE = m_Program.size();
 	UsProgramElement* pE;
 
-	while ( !fDone() )
+	if ( m_profile && CqShaderProfile::enabled() )
+		ExecuteProfiled();
+	else
 	{
-		pE = &ReadNext();
-		( this->*pE->m_Command ) ();
+		while ( !fDone() )
+		{
+			pE = &ReadNext();
+			( this->*pE->m_Command ) ();
+		}
 	}
 	// Check that the stack is empty.
 	assert( m_iTop == 0 );
@@ -1560,6 +1609,42 @@ void CqShaderVM::Execute(IqShaderExecEnv* pEnv)
 }
 
 
+//---------------------------------------------------------------------
+/**	Execute the main program, timing each instruction.
+ *
+ * Shaders may run other shaders (eg, light shaders from an illuminance loop),
+ * so the time spent in nested runs is subtracted from the instruction which
+ * started them, giving the time spent in each shader itself.
+ */
+
+void CqShaderVM::ExecuteProfiled()
+{
+	typedef std::chrono::steady_clock TqClock;
+	// Total time spent in shader runs on this thread.
+	static thread_local double nestedTime = 0;
+
+	TqClock::time_point runStart = TqClock::now();
+	CqShaderProfile::TqSampleVec samples( m_PE );
+	while ( !fDone() )
+	{
+		TqInt pos = m_PO;
+		TqInt points = m_pEnv->RunningState().Count();
+		double nestedBefore = nestedTime;
+		TqClock::time_point start = TqClock::now();
+		UsProgramElement* pE = &ReadNext();
+		( this->*pE->m_Command ) ();
+		double time = std::chrono::duration<double>( TqClock::now() - start ).count();
+
+		CqShaderProfile::SqSample& sample = samples[ pos ];
+		sample.time += time - ( nestedTime - nestedBefore );
+		++sample.calls;
+		sample.points += points;
+	}
+	m_profile->record( samples, m_shadingPointCount );
+	nestedTime += std::chrono::duration<double>( TqClock::now() - runStart ).count();
+}
+
+
 //---------------------------------------------------------------------
 /**	Execute the program segment which initialises the default values of instance variables.
 */
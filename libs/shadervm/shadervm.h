@@ -44,6 +44,7 @@
 #include	<aqsis/core/irenderer.h>
 #include	<aqsis/core/iparameter.h>
 #include	"shaderexecenv.h"
+#include	"shaderprofile.h"
 #include	"shaderstack.h"
 #include	"shadervariable.h"
 //#include 	"parameters.h"
@@ -137,6 +138,8 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 		virtual	void	SetstrName( const char* strName )
 		{
 			m_strName = strName;
+			if ( m_profile )
+				m_profile->setShaderName( strName );
 		}
 		virtual	const CqString& strName() const
 		{
@@ -213,6 +216,10 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 		 */
 		void	LoadProgram( std::istream* pFile );
 		void	Execute( IqShaderExecEnv* pEnv );
+		/** Run the main program, recording the time spent in each
+		 * instruction into the shader profile.
+		 */
+		void	ExecuteProfiled();
 		void	ExecuteInit();
 
 		// Allow createShaderVM to call LoadProgram:
@@ -241,6 +248,7 @@ class AQSIS_SHADERVM_SHARE CqShaderVM : public CqShaderStack, public IqShader, p
 		std::vector<UsProgramElement>	m_ProgramInit;		///< Bytecodes of the intialisation program.
 		std::vector<UsProgramElement>	m_Program;			///< Bytecodes of the main program.
 		std::list<CqString*>			m_ProgramStrings;	///< Strings used by the program, which are stored additionally as UsProgramElements.
+		boost::shared_ptr<CqShaderProfile>	m_profile;		///< Execution profile of the main program, shared with clones.
 		TqInt	m_uGridRes;
 		TqInt	m_vGridRes;
 		TqInt	m_shadingPointCount;
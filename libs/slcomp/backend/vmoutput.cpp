@@ -56,11 +56,31 @@ void CqCodeGenOutput::Visit( IqParseNode& N )
 	IqParseNode * pNext = N.pChild();
 	while ( pNext )
 	{
+		outputSourceLine( *pNext );
 		pNext->Accept( *this );
 		pNext = pNext->pNextSibling();
 	}
 }
 
+void CqCodeGenOutput::outputSourceLine( const IqParseNode& N )
+{
+	const char* file = N.strFileName();
+	if ( N.LineNo() < 0 || !file )
+		return;
+	if ( N.LineNo() == m_sourceLine && m_sourceFile == file )
+		return;
+	m_sourceLine = N.LineNo();
+	m_sourceFile = file;
+	m_slxFile << "\tline " << m_sourceLine << " \"";
+	for ( const char* c = file; *c; ++c )
+	{
+		if ( *c == '\\' || *c == '"' )
+			m_slxFile << '\\';
+		m_slxFile << *c;
+	}
+	m_slxFile << "\"" << std::endl;
+}
+
 void CqCodeGenOutput::Visit( IqParseNodeShader& S )
 {
 	IqParseNode * pNode;
@@ -134,6 +154,7 @@ void CqCodeGenOutput::Visit( IqParseNodeShader& S )
 	}
 
 	m_slxFile << std::endl << std::endl << "segment Code" << std::endl;
+	m_sourceLine = -1;
 	IqParseNode* pCode = pNode->pChild();
 	// Output the code tree.
 	if ( pCode )
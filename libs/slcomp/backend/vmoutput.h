@@ -52,7 +52,9 @@ class CqCodeGenOutput : public IqParseNodeVisitor
 		CqCodeGenOutput( CqCodeGenDataGather* pDataGather, std::string strOutName ) :
 		       	m_strOutName( strOutName ),
 		       	m_gcLabels( 0 ),
-		       	m_pDataGather( pDataGather )
+		       	m_pDataGather( pDataGather ),
+		       	m_sourceLine( -1 ),
+		       	m_sourceFile()
 		{}
 
 		virtual	void Visit( IqParseNode& );
@@ -106,6 +108,10 @@ class CqCodeGenOutput : public IqParseNodeVisitor
 	private:
 		void rsPush();
 		void rsPop();
+		/** Output a line marker for the source location of a statement, so
+		 * that the VM can attribute the following code to it.
+		 */
+		void outputSourceLine( const IqParseNode& N );
 
 		CqString	m_strOutName;
 		TqInt	m_gcLabels;
@@ -115,6 +121,8 @@ class CqCodeGenOutput : public IqParseNodeVisitor
 		std::vector<std::vector<SqVarRefTranslator> > m_saTransTable;
 		std::deque<std::map<std::string, std::string> >	m_StackVarMap;
 		std::vector<TqInt> m_breakDepthStack;
+		TqInt	m_sourceLine;		///< Line of the last line marker output.
+		std::string	m_sourceFile;	///< File of the last line marker output.
 };
 
 
@@ -0,0 +1,108 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief A bilinear filter functor for cheap texture lookups.
+ */
+
+#ifndef BILINEARFILTER_H_INCLUDED
+#define BILINEARFILTER_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <aqsis/math/math.h>
+#include <aqsis/math/vector2d.h>
+#include <aqsis/tex/buffers/filtersupport.h>
+
+namespace Aqsis {
+
+//------------------------------------------------------------------------------
+/** \brief A filter functor giving bilinear interpolation weights.
+ *
+ * The filter covers the 2x2 block of pixels surrounding a point in raster
+ * space, and is a cheap substitute for an EWA filter when the filter
+ * footprint is about the size of a pixel.  The weights sum to one, so the
+ * filter is pre-normalized.
+ */
+class CqBilinearFilter
+{
+	public:
+		/** \brief Construct the filter centered at the given raster position.
+		 *
+		 * \param filterCenter - position in raster space, using the same
+		 *            convention as CqEwaFilter (pixel centers at integer
+		 *            coordinates).
+		 */
+		CqBilinearFilter(const CqVector2D& filterCenter);
+
+		/// Bilinear weights sum to one; return true.
+		static bool isNormalized() { return true; }
+
+		/// Evaluate the filter weight for the pixel at (x,y)
+		TqFloat operator()(TqInt x, TqInt y) const;
+		/// Get the 2x2 support of the filter.
+		SqFilterSupport support() const;
+
+	private:
+		/// Top left pixel of the support.
+		TqInt m_x0;
+		TqInt m_y0;
+		/// Interpolation weights for the right and bottom pixels.
+		TqFloat m_fx;
+		TqFloat m_fy;
+};
+
+
+//==============================================================================
+// Implementation details
+//==============================================================================
+inline CqBilinearFilter::CqBilinearFilter(const CqVector2D& filterCenter)
+	: m_x0(lfloor(filterCenter.x())),
+	m_y0(lfloor(filterCenter.y())),
+	m_fx(filterCenter.x() - m_x0),
+	m_fy(filterCenter.y() - m_y0)
+{ }
+
+inline TqFloat CqBilinearFilter::operator()(TqInt x, TqInt y) const
+{
+	assert(x == m_x0 || x == m_x0+1);
+	assert(y == m_y0 || y == m_y0+1);
+	return (x == m_x0 ? 1-m_fx : m_fx) * (y == m_y0 ? 1-m_fy : m_fy);
+}
+
+inline SqFilterSupport CqBilinearFilter::support() const
+{
+	return SqFilterSupport(m_x0, m_x0+2, m_y0, m_y0+2);
+}
+
+} // namespace Aqsis
+
+#endif // BILINEARFILTER_H_INCLUDED
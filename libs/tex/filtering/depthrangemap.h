@@ -0,0 +1,257 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Hierarchical min/max depth ranges for shadow maps.
+ */
+
+#ifndef DEPTHRANGEMAP_H_INCLUDED
+#define DEPTHRANGEMAP_H_INCLUDED
+
+#include <aqsis/aqsis.h>
+
+#include <float.h>
+#include <vector>
+
+#include <aqsis/math/math.h>
+#include <aqsis/tex/buffers/filtersupport.h>
+#include <aqsis/tex/filtering/texturesampleoptions.h>
+
+namespace Aqsis {
+
+/** \brief A pyramid of minimum and maximum depths over blocks of a depth map.
+ *
+ * The base level holds the depth range over square blocks of texels, and each
+ * subsequent level holds the range over 2x2 blocks of the previous one.  This
+ * allows a conservative depth range for a filter support of any size to be
+ * found by looking at no more than a few cells of the appropriate level.
+ *
+ * Cells are filled in the first time a query touches them, so only the parts
+ * of a tiled depth map which are actually sampled get loaded.
+ *
+ * Shadow sampling uses the range to decide when a filter support is
+ * entirely in front of or behind the shadow map, in which case percentage
+ * closer filtering isn't needed.
+ */
+template<typename ArrayT>
+class CqDepthRangeMap
+{
+	public:
+		/** \brief Set up an empty pyramid over a depth map.
+		 *
+		 * \param depths - array of depths, which must provide width(),
+		 *                 height() and begin(support) like CqTileArray.  The
+		 *                 first channel is taken as the depth.  The array
+		 *                 must outlive the depth range map.
+		 */
+		explicit CqDepthRangeMap(const ArrayT& depths);
+
+		/** \brief Get a conservative depth range over the given support.
+		 *
+		 * The returned range contains the depths of all texels in the
+		 * support, but may be larger since whole blocks are considered.
+		 *
+		 * \param support - filter support, which must intersect the map.
+		 * \param minDepth - returns the minimum depth.
+		 * \param maxDepth - returns the maximum depth.
+		 */
+		void range(const SqFilterSupport& support, TqFloat& minDepth,
+				TqFloat& maxDepth) const;
+
+	private:
+		struct SqLevel
+		{
+			TqInt width;
+			TqInt height;
+			std::vector<TqFloat> minDepth;
+			std::vector<TqFloat> maxDepth;
+			/// Cells whose depth range has been computed.
+			std::vector<bool> done;
+
+			SqLevel(TqInt width, TqInt height)
+				: width(width),
+				height(height),
+				minDepth(width*height, FLT_MAX),
+				maxDepth(width*height, -FLT_MAX),
+				done(width*height, false)
+			{ }
+		};
+
+		/// Compute the depth range of a cell if it isn't known yet.
+		void fillCell(TqInt level, TqInt x, TqInt y) const;
+
+		/// log2 of the width of the square texel blocks in the base level.
+		static const TqInt m_log2BlockSize = 3;
+
+		/// Depth map which the ranges are computed from.
+		const ArrayT& m_depths;
+		/// Width of the depth map.
+		TqInt m_width;
+		/// Height of the depth map.
+		TqInt m_height;
+		/// Levels of the pyramid, from the finest to a single cell.
+		mutable std::vector<SqLevel> m_levels;
+};
+
+
+//==============================================================================
+// Implementation details
+//==============================================================================
+
+template<typename ArrayT>
+CqDepthRangeMap<ArrayT>::CqDepthRangeMap(const ArrayT& depths)
+	: m_depths(depths),
+	m_width(depths.width()),
+	m_height(depths.height()),
+	m_levels()
+{
+	const TqInt blockSize = 1 << m_log2BlockSize;
+	m_levels.push_back(SqLevel((m_width + blockSize - 1) >> m_log2BlockSize,
+				(m_height + blockSize - 1) >> m_log2BlockSize));
+	while(m_levels.back().width > 1 || m_levels.back().height > 1)
+	{
+		const SqLevel& prev = m_levels.back();
+		m_levels.push_back(SqLevel((prev.width + 1)/2, (prev.height + 1)/2));
+	}
+}
+
+template<typename ArrayT>
+void CqDepthRangeMap<ArrayT>::fillCell(TqInt level, TqInt x, TqInt y) const
+{
+	SqLevel& l = m_levels[level];
+	const TqInt cell = y*l.width + x;
+	if(l.done[cell])
+		return;
+	TqFloat minDepth = FLT_MAX;
+	TqFloat maxDepth = -FLT_MAX;
+	if(level == 0)
+	{
+		const TqInt blockSize = 1 << m_log2BlockSize;
+		SqFilterSupport block(x*blockSize, min((x+1)*blockSize, m_width),
+				y*blockSize, min((y+1)*blockSize, m_height));
+		for(typename ArrayT::TqIterator i = m_depths.begin(block);
+				i.inSupport(); ++i)
+		{
+			TqFloat z = (*i)[0];
+			if(z < minDepth)
+				minDepth = z;
+			if(z > maxDepth)
+				maxDepth = z;
+		}
+	}
+	else
+	{
+		const SqLevel& prev = m_levels[level-1];
+		for(TqInt py = 2*y; py < min(2*y + 2, prev.height); ++py)
+		{
+			for(TqInt px = 2*x; px < min(2*x + 2, prev.width); ++px)
+			{
+				fillCell(level-1, px, py);
+				TqInt prevCell = py*prev.width + px;
+				if(prev.minDepth[prevCell] < minDepth)
+					minDepth = prev.minDepth[prevCell];
+				if(prev.maxDepth[prevCell] > maxDepth)
+					maxDepth = prev.maxDepth[prevCell];
+			}
+		}
+	}
+	l.minDepth[cell] = minDepth;
+	l.maxDepth[cell] = maxDepth;
+	l.done[cell] = true;
+}
+
+template<typename ArrayT>
+void CqDepthRangeMap<ArrayT>::range(const SqFilterSupport& support,
+		TqFloat& minDepth, TqFloat& maxDepth) const
+{
+	SqFilterSupport s = intersect(support, SqFilterSupport(0, m_width, 0, m_height));
+	TqInt x0 = s.sx.start >> m_log2BlockSize;
+	TqInt x1 = (s.sx.end - 1) >> m_log2BlockSize;
+	TqInt y0 = s.sy.start >> m_log2BlockSize;
+	TqInt y1 = (s.sy.end - 1) >> m_log2BlockSize;
+	// Move up the pyramid until the support covers at most 2x2 cells.
+	TqInt level = 0;
+	while((x1 - x0 > 1 || y1 - y0 > 1) && level + 1 < static_cast<TqInt>(m_levels.size()))
+	{
+		x0 >>= 1;
+		x1 >>= 1;
+		y0 >>= 1;
+		y1 >>= 1;
+		++level;
+	}
+	const SqLevel& l = m_levels[level];
+	minDepth = FLT_MAX;
+	maxDepth = -FLT_MAX;
+	for(TqInt y = y0; y <= y1; ++y)
+	{
+		for(TqInt x = x0; x <= x1; ++x)
+		{
+			fillCell(level, x, y);
+			TqInt cell = y*l.width + x;
+			if(l.minDepth[cell] < minDepth)
+				minDepth = l.minDepth[cell];
+			if(l.maxDepth[cell] > maxDepth)
+				maxDepth = l.maxDepth[cell];
+		}
+	}
+}
+
+/** \brief Determine whether PCF over a support can only give 0 or 1.
+ *
+ * The result of PCF is fully visible (0) if the surface is no deeper than
+ * the shadow map plus the low bias at every texel of the support, and fully
+ * occluded (1) if it is deeper than the map plus the high bias everywhere.
+ * This is decided conservatively from the range of the surface and map
+ * depths over the support.
+ *
+ * \return true and sets outSamps[0] if the result is known.
+ */
+inline bool classifyPCF(TqFloat surfMin, TqFloat surfMax, TqFloat mapMin,
+		TqFloat mapMax, const CqShadowSampleOptions& sampleOpts, TqFloat* outSamps)
+{
+	if(surfMax <= mapMin + sampleOpts.biasLow()
+			&& surfMax < mapMin + sampleOpts.biasHigh())
+	{
+		outSamps[0] = 0;
+		return true;
+	}
+	if(surfMin > mapMax + sampleOpts.biasHigh()
+			&& surfMin > mapMax + sampleOpts.biasLow())
+	{
+		outSamps[0] = 1;
+		return true;
+	}
+	return false;
+}
+
+} // namespace Aqsis
+
+#endif // DEPTHRANGEMAP_H_INCLUDED
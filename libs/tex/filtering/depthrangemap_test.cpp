@@ -0,0 +1,221 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Unit tests for the shadow map depth range pyramid.
+ */
+
+#include "depthrangemap.h"
+
+#include <aqsis/math/random.h>
+#include <aqsis/tex/buffers/texturebuffer.h>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(depthrangemap_tests)
+
+using namespace Aqsis;
+
+namespace {
+
+/// Depth buffer which counts the texels read through it.
+class CqCountingDepths
+{
+	public:
+		typedef CqTextureBuffer<TqFloat>::TqIterator TqIterator;
+
+		CqCountingDepths(const CqTextureBuffer<TqFloat>& buf)
+			: m_buf(buf),
+			m_texelsRead(0)
+		{ }
+		TqInt width() const { return m_buf.width(); }
+		TqInt height() const { return m_buf.height(); }
+		TqIterator begin(const SqFilterSupport& support) const
+		{
+			m_texelsRead += support.area();
+			return m_buf.begin(support);
+		}
+		TqInt texelsRead() const { return m_texelsRead; }
+
+	private:
+		const CqTextureBuffer<TqFloat>& m_buf;
+		mutable TqInt m_texelsRead;
+};
+
+/// Fill a buffer with depth 1 to the left of splitX and 5 to the right.
+void fillStep(CqTextureBuffer<TqFloat>& buf, TqInt splitX)
+{
+	for(TqInt y = 0; y < buf.height(); ++y)
+		for(TqInt x = 0; x < buf.width(); ++x)
+			*buf.value(x, y) = x < splitX ? 1 : 5;
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqDepthRangeMap_classify_test)
+{
+	CqTextureBuffer<TqFloat> buf(100, 70, 1);
+	fillStep(buf, 64);
+	CqDepthRangeMap<CqTextureBuffer<TqFloat> > depthRange(buf);
+
+	// Wholly on one side of the step; a surface at depth 2 is lit on the
+	// left and in shadow on the right.
+	TqFloat minDepth = 0;
+	TqFloat maxDepth = 0;
+	depthRange.range(SqFilterSupport(3, 20, 10, 30), minDepth, maxDepth);
+	BOOST_CHECK_EQUAL(minDepth, 1);
+	BOOST_CHECK_EQUAL(maxDepth, 1);
+	depthRange.range(SqFilterSupport(64, 96, 0, 16), minDepth, maxDepth);
+	BOOST_CHECK_EQUAL(minDepth, 5);
+	BOOST_CHECK_EQUAL(maxDepth, 5);
+
+	// Straddling the step needs filtering.
+	depthRange.range(SqFilterSupport(56, 72, 20, 25), minDepth, maxDepth);
+	BOOST_CHECK_EQUAL(minDepth, 1);
+	BOOST_CHECK_EQUAL(maxDepth, 5);
+
+	// Large supports are classified using coarser blocks, and those which
+	// stick out of the map only see the texels inside it.
+	depthRange.range(SqFilterSupport(-10, 8, -5, 200), minDepth, maxDepth);
+	BOOST_CHECK_EQUAL(minDepth, 1);
+	BOOST_CHECK_EQUAL(maxDepth, 1);
+}
+
+BOOST_AUTO_TEST_CASE(CqDepthRangeMap_conservative_test)
+{
+	const TqInt width = 93;
+	const TqInt height = 61;
+	CqTextureBuffer<TqFloat> buf(width, height, 1);
+	CqRandom rand(42);
+	for(TqInt y = 0; y < height; ++y)
+		for(TqInt x = 0; x < width; ++x)
+			*buf.value(x, y) = rand.RandomFloat(10);
+	CqDepthRangeMap<CqTextureBuffer<TqFloat> > depthRange(buf);
+
+	for(TqInt i = 0; i < 500; ++i)
+	{
+		TqInt x0 = rand.RandomInt(width);
+		TqInt y0 = rand.RandomInt(height);
+		SqFilterSupport support(x0, x0 + 1 + rand.RandomInt(width - x0),
+				y0, y0 + 1 + rand.RandomInt(height - y0));
+		TqFloat minDepth = 0;
+		TqFloat maxDepth = 0;
+		depthRange.range(support, minDepth, maxDepth);
+		TqFloat trueMin = FLT_MAX;
+		TqFloat trueMax = -FLT_MAX;
+		for(TqInt y = support.sy.start; y < support.sy.end; ++y)
+		{
+			for(TqInt x = support.sx.start; x < support.sx.end; ++x)
+			{
+				trueMin = min(trueMin, *buf.value(x, y));
+				trueMax = max(trueMax, *buf.value(x, y));
+			}
+		}
+		BOOST_CHECK_LE(minDepth, trueMin);
+		BOOST_CHECK_GE(maxDepth, trueMax);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CqDepthRangeMap_lazy_test)
+{
+	CqTextureBuffer<TqFloat> buf(256, 256, 1);
+	fillStep(buf, 128);
+	CqCountingDepths depths(buf);
+	CqDepthRangeMap<CqCountingDepths> depthRange(depths);
+	BOOST_CHECK_EQUAL(depths.texelsRead(), 0);
+
+	// A small support only reads the 8x8 block it lies in.
+	TqFloat minDepth = 0;
+	TqFloat maxDepth = 0;
+	depthRange.range(SqFilterSupport(10, 14, 10, 14), minDepth, maxDepth);
+	BOOST_CHECK_EQUAL(depths.texelsRead(), 64);
+	// A larger one uses a 2x2 group of 16x16 blocks, reading each texel once.
+	depthRange.range(SqFilterSupport(6, 18, 6, 18), minDepth, maxDepth);
+	BOOST_CHECK_EQUAL(depths.texelsRead(), 32*32);
+	depthRange.range(SqFilterSupport(10, 14, 10, 14), minDepth, maxDepth);
+	BOOST_CHECK_EQUAL(depths.texelsRead(), 32*32);
+	BOOST_CHECK_EQUAL(minDepth, 1);
+	BOOST_CHECK_EQUAL(maxDepth, 1);
+}
+
+BOOST_AUTO_TEST_CASE(classifyPCF_test)
+{
+	CqTextureBuffer<TqFloat> buf(100, 70, 1);
+	fillStep(buf, 64);
+	CqDepthRangeMap<CqTextureBuffer<TqFloat> > depthRange(buf);
+	TqFloat mapMin = 0;
+	TqFloat mapMax = 0;
+	CqShadowSampleOptions opts;
+	opts.setBiasLow(0.25);
+	opts.setBiasHigh(0.5);
+	TqFloat result = -1;
+
+	// Support wholly over depth 1: surfaces up to the low bias in front of
+	// it are fully lit, those beyond the high bias are fully occluded.
+	depthRange.range(SqFilterSupport(3, 20, 10, 30), mapMin, mapMax);
+	BOOST_CHECK(classifyPCF(0.5, 1.25, mapMin, mapMax, opts, &result));
+	BOOST_CHECK_EQUAL(result, 0);
+	BOOST_CHECK(classifyPCF(1.5625, 3, mapMin, mapMax, opts, &result));
+	BOOST_CHECK_EQUAL(result, 1);
+	// Between the biases PCF gives a partial result, so nothing is known.
+	result = -1;
+	BOOST_CHECK(!classifyPCF(0.5, 1.3125, mapMin, mapMax, opts, &result));
+	BOOST_CHECK(!classifyPCF(1.3125, 3, mapMin, mapMax, opts, &result));
+	// Exactly at the high bias is left to the filter.
+	BOOST_CHECK(!classifyPCF(1.5, 3, mapMin, mapMax, opts, &result));
+	// A surface straddling the map depth isn't classified either.
+	BOOST_CHECK(!classifyPCF(0.5, 3, mapMin, mapMax, opts, &result));
+	BOOST_CHECK_EQUAL(result, -1);
+
+	// Support straddling the step in the map.
+	depthRange.range(SqFilterSupport(56, 72, 20, 25), mapMin, mapMax);
+	BOOST_CHECK(classifyPCF(0.5, 1.25, mapMin, mapMax, opts, &result));
+	BOOST_CHECK_EQUAL(result, 0);
+	BOOST_CHECK(!classifyPCF(2, 3, mapMin, mapMax, opts, &result));
+	BOOST_CHECK(classifyPCF(5.5625, 6, mapMin, mapMax, opts, &result));
+	BOOST_CHECK_EQUAL(result, 1);
+
+	// With equal biases the comparison is a strict surface > map + bias, so
+	// a surface exactly at the low bias can't be classified as lit.
+	opts.setBiasHigh(0.25);
+	depthRange.range(SqFilterSupport(3, 20, 10, 30), mapMin, mapMax);
+	result = -1;
+	BOOST_CHECK(!classifyPCF(0.5, 1.25, mapMin, mapMax, opts, &result));
+	BOOST_CHECK(!classifyPCF(1.25, 3, mapMin, mapMax, opts, &result));
+	BOOST_CHECK_EQUAL(result, -1);
+	BOOST_CHECK(classifyPCF(0.5, 1.125, mapMin, mapMax, opts, &result));
+	BOOST_CHECK_EQUAL(result, 0);
+	BOOST_CHECK(classifyPCF(1.3125, 3, mapMin, mapMax, opts, &result));
+	BOOST_CHECK_EQUAL(result, 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -47,11 +47,12 @@ namespace {
  *
  * \param covariance - Covariance matrix for a gaussian filter
  * \param minorAxisWidth - return the width of the minor ellipse axis in here.
+ * \param majorAxisWidth - return the width of the major ellipse axis in here.
  * \param maxAspectRatio - maximum allowable aspect ratio for the filter.
  * \param logEdgeWeight - log of the filter weight at the filter edge.
  */
 inline void clampEccentricity(SqMatrix2D& covariance, TqFloat& minorAxisWidth,
-		TqFloat maxAspectRatio, TqFloat logEdgeWeight)
+		TqFloat& majorAxisWidth, TqFloat maxAspectRatio, TqFloat logEdgeWeight)
 {
 	TqFloat eig1 = 1;
 	TqFloat eig2 = 1;
@@ -73,6 +74,7 @@ inline void clampEccentricity(SqMatrix2D& covariance, TqFloat& minorAxisWidth,
 		covariance = R * SqMatrix2D(eig1, eig2) * R.transpose();
 	}
 	minorAxisWidth = std::sqrt(8*eig2*logEdgeWeight);
+	majorAxisWidth = std::sqrt(8*eig1*logEdgeWeight);
 }
 
 } // unnamed namespace
@@ -136,7 +138,7 @@ void CqEwaFilterFactory::computeFilter(const SqSamplePllgram& samplePllgram,
 	coVar += SqMatrix2D(reconsVar);
 
 	// Clamp the eccentricity of the filter.
-	clampEccentricity(coVar, m_minorAxisWidth, maxAspectRatio, m_logEdgeWeight);
+	clampEccentricity(coVar, m_minorAxisWidth, m_majorAxisWidth, maxAspectRatio, m_logEdgeWeight);
 	// Get the quadratic form
 	m_quadForm = 0.5*coVar.inv();
 }
@@ -43,6 +43,7 @@
 #include <vector>
 
 #include <aqsis/math/math.h>
+#include <aqsis/util/autobuffer.h>
 #include <aqsis/tex/buffers/filtersupport.h>
 #include <aqsis/math/matrix2d.h>
 #include <aqsis/tex/filtering/samplequad.h>
@@ -93,8 +94,22 @@ class CqEwaFilter
 		 *            don't have to)
 		 */
 		TqFloat operator()(TqFloat x, TqFloat y) const;
+		/** \brief Evaluate the filter along a row of pixels.
+		 *
+		 * This is equivalent to calling operator() at each of the integer
+		 * positions (x,y) for x in [xStart,xEnd), but hoists everything
+		 * which only depends on y out of the loop over x.
+		 *
+		 * \param y - raster y-coordinate of the row
+		 * \param xStart - first x-coordinate in the row
+		 * \param xEnd - one past the last x-coordinate in the row
+		 * \param weights - output array of length xEnd-xStart.
+		 */
+		void evaluateRow(TqInt y, TqInt xStart, TqInt xEnd, TqFloat* weights) const;
 		/// Get the extent of the filter in integer raster coordinates.
 		SqFilterSupport support() const;
+		/// Get the filter center in raster coordinates.
+		const CqVector2D& center() const;
 
 	private:
 		/// Quadratic form matrix
@@ -105,6 +120,46 @@ class CqEwaFilter
 		const TqFloat m_logEdgeWeight;
 };
 
+//------------------------------------------------------------------------------
+/** \brief Table of EWA filter weights precomputed over a filter support.
+ *
+ * Filtering calls the weight function once for every pixel of the support,
+ * and for multichannel textures the pixel data is interleaved with the
+ * weight evaluation.  Computing all the weights up front instead lets each
+ * row be evaluated with a tight loop which the compiler can vectorize, and
+ * reduces the per-pixel cost during accumulation to a table lookup.
+ *
+ * The table has the same weights as the CqEwaFilter it's constructed from,
+ * but may only be evaluated at integer positions inside the support.
+ */
+class CqEwaWeightTable
+{
+	public:
+		/** \brief Compute filter weights over the given support.
+		 *
+		 * \param filter - filter to take the weights from.
+		 * \param support - pixel region over which weights are needed.
+		 *            This is typically filter.support(), possibly truncated.
+		 */
+		CqEwaWeightTable(const CqEwaFilter& filter, const SqFilterSupport& support);
+
+		/// EWA filters are never pre-normalized; return false.
+		static bool isNormalized() { return false; }
+
+		/// Get the tabulated filter weight for the pixel at (x,y)
+		TqFloat operator()(TqInt x, TqInt y) const;
+		/// Get the region over which the weights were computed.
+		const SqFilterSupport& support() const;
+
+	private:
+		/// Region covered by the table
+		SqFilterSupport m_support;
+		/// Number of weights in each row of the table
+		TqInt m_rowLength;
+		/// Weights, stored row by row.
+		CqAutoBuffer<TqFloat, 64> m_weights;
+};
+
 //------------------------------------------------------------------------------
 /** \brief A class encapsulating Elliptically Weighted Average (EWA) filter
  * weight computation.
@@ -233,6 +288,8 @@ class CqEwaFilterFactory
 
 		/// Get the width of the filter along the minor axis of the ellipse
 		TqFloat minorAxisWidth() const;
+		/// Get the width of the filter along the major axis of the ellipse
+		TqFloat majorAxisWidth() const;
 	private:
 		/** \brief Compute and cache EWA filter coefficients
 		 *
@@ -241,8 +298,9 @@ class CqEwaFilterFactory
 		 *   Q = [a b]
 		 *       [c d]
 		 * which represents the EWA filter over the quadrilateral given by
-		 * sampleQuad.  Q is cached in m_quadForm.  The minimum width along
-		 * the minor axis of the filter is cached in m_minorAxisWidth.
+		 * sampleQuad.  Q is cached in m_quadForm.  The widths along the
+		 * minor and major axes of the filter are cached in m_minorAxisWidth
+		 * and m_majorAxisWidth.
 		 *
 		 * For parameters, see the corresponding ones in the
 		 * CqEwaFilterFactory constructor.
@@ -260,6 +318,8 @@ class CqEwaFilterFactory
 		TqFloat m_logEdgeWeight;
 		/// Width of the semi-minor axis of the elliptical filter
 		TqFloat m_minorAxisWidth;
+		/// Width of the semi-major axis of the elliptical filter
+		TqFloat m_majorAxisWidth;
 };
 
 
@@ -285,7 +345,8 @@ inline CqEwaFilterFactory::CqEwaFilterFactory(const SqSampleQuad& sQuad,
 	: m_quadForm(0),
 	m_filterCenter(sQuad.center()),
 	m_logEdgeWeight(logEdgeWeight),
-	m_minorAxisWidth(0)
+	m_minorAxisWidth(0),
+	m_majorAxisWidth(0)
 {
 	// Scale the filterCenter up to the dimensions of the base texture, and
 	// adjust by -0.5 in both directions such that the base texture is
@@ -305,7 +366,8 @@ inline CqEwaFilterFactory::CqEwaFilterFactory(
 	: m_quadForm(0),
 	m_filterCenter(samplePllgram.c),
 	m_logEdgeWeight(logEdgeWeight),
-	m_minorAxisWidth(0)
+	m_minorAxisWidth(0),
+	m_majorAxisWidth(0)
 {
 	// Scale the filterCenter up to the dimensions of the base texture, and
 	// adjust by -0.5 in both directions such that the base texture is
@@ -359,6 +421,11 @@ inline TqFloat CqEwaFilterFactory::minorAxisWidth() const
 	return m_minorAxisWidth;
 }
 
+inline TqFloat CqEwaFilterFactory::majorAxisWidth() const
+{
+	return m_majorAxisWidth;
+}
+
 
 //------------------------------------------------------------------------------
 namespace detail {
@@ -441,6 +508,31 @@ inline TqFloat CqEwaFilter::operator()(TqFloat x, TqFloat y) const
 	return 0;
 }
 
+inline void CqEwaFilter::evaluateRow(TqInt y, TqInt xStart, TqInt xEnd,
+		TqFloat* weights) const
+{
+	TqFloat dy = y - m_filterCenter.y();
+	// Coefficients of the quadratic form which are constant along the row.
+	TqFloat a = m_quadForm.a;
+	TqFloat e = (m_quadForm.b+m_quadForm.c)*dy;
+	TqFloat f = m_quadForm.d*dy*dy;
+	TqFloat dx0 = xStart - m_filterCenter.x();
+	TqInt rowLength = xEnd - xStart;
+	// Evaluate the quadratic form in a separate pass from the table lookup,
+	// since this loop has no branches and no dependencies between
+	// iterations.
+	for(TqInt i = 0; i < rowLength; ++i)
+	{
+		TqFloat dx = dx0 + i;
+		weights[i] = dx*(a*dx + e) + f;
+	}
+	for(TqInt i = 0; i < rowLength; ++i)
+	{
+		TqFloat q = weights[i];
+		weights[i] = q < m_logEdgeWeight ? detail::negExpTable(q) : 0;
+	}
+}
+
 inline SqFilterSupport CqEwaFilter::support() const
 {
 	TqFloat detQ = m_quadForm.det();
@@ -455,6 +547,36 @@ inline SqFilterSupport CqEwaFilter::support() const
 		);
 }
 
+inline const CqVector2D& CqEwaFilter::center() const
+{
+	return m_filterCenter;
+}
+
+//------------------------------------------------------------------------------
+// CqEwaWeightTable implementation
+inline CqEwaWeightTable::CqEwaWeightTable(const CqEwaFilter& filter,
+		const SqFilterSupport& support)
+	: m_support(support),
+	m_rowLength(max(support.sx.range(), 0)),
+	m_weights(m_rowLength*max(support.sy.range(), 0))
+{
+	TqFloat* row = m_weights.get();
+	for(TqInt y = support.sy.start; y < support.sy.end; ++y, row += m_rowLength)
+		filter.evaluateRow(y, support.sx.start, support.sx.end, row);
+}
+
+inline TqFloat CqEwaWeightTable::operator()(TqInt x, TqInt y) const
+{
+	assert(x >= m_support.sx.start && x < m_support.sx.end);
+	assert(y >= m_support.sy.start && y < m_support.sy.end);
+	return m_weights[(y - m_support.sy.start)*m_rowLength + x - m_support.sx.start];
+}
+
+inline const SqFilterSupport& CqEwaWeightTable::support() const
+{
+	return m_support;
+}
+
 } // namespace Aqsis
 
 #endif // EWAFILTER_H_INCLUDED
@@ -0,0 +1,131 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Unit tests for EWA filter weights.
+ */
+
+#include "ewafilter.h"
+
+#include <cmath>
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(ewafilter_tests)
+
+using namespace Aqsis;
+
+namespace {
+
+/** Make a filter with an elliptical footprint.
+ *
+ * \param sigma1, sigma2 - widths along the axes of the ellipse
+ * \param angle - rotation of the first axis from the x-axis
+ */
+CqEwaFilter makeFilter(TqFloat sigma1, TqFloat sigma2, TqFloat angle,
+		const CqVector2D& center)
+{
+	TqFloat c = std::cos(angle);
+	TqFloat s = std::sin(angle);
+	TqFloat l1 = 1/(sigma1*sigma1);
+	TqFloat l2 = 1/(sigma2*sigma2);
+	// Q = R^T * diag(l1,l2) * R, split evenly between the off-diagonals.
+	TqFloat offDiag = (l1 - l2)*c*s;
+	SqMatrix2D quadForm(l1*c*c + l2*s*s, offDiag, offDiag, l1*s*s + l2*c*c);
+	return CqEwaFilter(quadForm, center, 4);
+}
+
+// Check the tabulated weights against evaluating the filter at each pixel.
+void checkTable(const CqEwaFilter& filter, const SqFilterSupport& support)
+{
+	CqEwaWeightTable table(filter, support);
+	BOOST_CHECK_EQUAL(table.support().sx.start, support.sx.start);
+	BOOST_CHECK_EQUAL(table.support().sx.end, support.sx.end);
+	BOOST_CHECK_EQUAL(table.support().sy.start, support.sy.start);
+	BOOST_CHECK_EQUAL(table.support().sy.end, support.sy.end);
+	TqFloat maxErr = 0;
+	for(TqInt y = support.sy.start; y < support.sy.end; ++y)
+	{
+		for(TqInt x = support.sx.start; x < support.sx.end; ++x)
+			maxErr = std::max(maxErr, std::fabs(table(x,y) - filter(x,y)));
+	}
+	BOOST_CHECK_SMALL(maxErr, 1e-5f);
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(CqEwaWeightTable_matches_filter_test)
+{
+	const TqFloat angles[] = {0, 0.3f, 1.2f, 2.5f};
+	const TqFloat widths[] = {0.5f, 1.0f, 3.7f, 12.0f};
+	for(TqInt ia = 0; ia < 4; ++ia)
+	{
+		for(TqInt iw1 = 0; iw1 < 4; ++iw1)
+		{
+			for(TqInt iw2 = 0; iw2 < 4; ++iw2)
+			{
+				CqEwaFilter filter = makeFilter(widths[iw1], widths[iw2],
+						angles[ia], CqVector2D(20.3f + ia, 15.8f - iw1));
+				checkTable(filter, filter.support());
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(CqEwaWeightTable_truncated_support_test)
+{
+	CqEwaFilter filter = makeFilter(4, 1.5f, 0.7f, CqVector2D(2.2f, 3.6f));
+	SqFilterSupport support = filter.support();
+	// Truncate against the edges of an image, as done for texture lookups.
+	checkTable(filter, intersect(support, SqFilterSupport(0, 5, 0, 100)));
+	checkTable(filter, intersect(support, SqFilterSupport(3, 100, 1, 4)));
+	// An empty support gives an empty table.
+	CqEwaWeightTable empty(filter, SqFilterSupport(10, 10, 3, 5));
+	BOOST_CHECK(empty.support().isEmpty());
+}
+
+BOOST_AUTO_TEST_CASE(CqEwaFilter_evaluateRow_test)
+{
+	CqEwaFilter filter = makeFilter(2, 0.8f, -0.4f, CqVector2D(0.5f, -1.2f));
+	// Rows which extend well outside the support should be zero there.
+	const TqInt xStart = -30;
+	const TqInt xEnd = 30;
+	TqFloat weights[xEnd - xStart];
+	for(TqInt y = -10; y <= 10; ++y)
+	{
+		filter.evaluateRow(y, xStart, xEnd, weights);
+		for(TqInt x = xStart; x < xEnd; ++x)
+			BOOST_CHECK_SMALL(weights[x - xStart] - filter(x,y), 1e-5f);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -80,6 +80,17 @@ void IqTextureSampler::sample(const SqSampleQuad& sampleQuad,
 	sample(SqSamplePllgram(sampleQuad), sampleOpts, outSamps);
 }
 
+void IqTextureSampler::sampleGrid(const SqSampleGrid& grid,
+		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	CqTextureSampleOptions opts(sampleOpts);
+	for(TqInt i = 0; i < grid.numPoints; ++i)
+	{
+		grid.varyingOptions(i, opts);
+		sample(grid.pllgram(i), opts, outSamps + i*opts.numChannels());
+	}
+}
+
 const CqTextureSampleOptions& IqTextureSampler::defaultSampleOptions() const
 {
 	static const CqTextureSampleOptions defaultOptions;
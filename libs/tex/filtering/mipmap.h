@@ -48,6 +48,8 @@
 #include <aqsis/util/autobuffer.h>
 #include <aqsis/util/exception.h>
 #include <aqsis/tex/filtering/filtertexture.h>
+#include "bilinearfilter.h"
+#include "ewafilter.h"
 #include <aqsis/tex/io/itiledtexinputfile.h>
 #include <aqsis/util/logging.h>
 #include <aqsis/tex/filtering/sampleaccum.h>
@@ -119,6 +121,36 @@ class CqMipmap
 		void applyFilter(const FilterFactoryT& filterFactory,
 				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps);
 
+		/** \brief Choose the mipmap level(s) to filter over.
+		 *
+		 * This is the first half of applyFilter(), split out so that the
+		 * filtering for a batch of samples can be sorted by level.
+		 *
+		 * \param filterFactory - filter factory, as for applyFilter().
+		 * \param sampleOpts - Sample options structure.
+		 * \param levelInterp - Output variable - the weight with which to
+		 *            mix in the result from the next level, or zero.
+		 * \return The main mipmap level to filter over.
+		 */
+		template<typename FilterFactoryT>
+		TqInt chooseLevel(const FilterFactoryT& filterFactory,
+				const CqTextureSampleOptions& sampleOpts, TqFloat& levelInterp) const;
+		/** \brief Filter over levels previously chosen by chooseLevel().
+		 *
+		 * This is the second half of applyFilter().
+		 */
+		template<typename FilterFactoryT>
+		void filterLevels(TqInt level, TqFloat levelInterp,
+				const FilterFactoryT& filterFactory,
+				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const;
+		/** \brief Get an index for the tile of a level containing the given
+		 * texture coordinates.
+		 *
+		 * Sorting filter operations on a level by tile index makes
+		 * successive operations likely to touch the same tiles.
+		 */
+		TqInt tileIndex(TqInt level, const CqVector2D& st) const;
+
 	private:
 		/// Initialize all mipmap levels
 		void initLevels();
@@ -257,6 +289,16 @@ template<typename TextureBufferT>
 template<typename FilterFactoryT>
 void CqMipmap<TextureBufferT>::applyFilter(const FilterFactoryT& filterFactory,
 		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps)
+{
+	TqFloat levelInterp = 0;
+	TqInt level = chooseLevel(filterFactory, sampleOpts, levelInterp);
+	filterLevels(level, levelInterp, filterFactory, sampleOpts, outSamps);
+}
+
+template<typename TextureBufferT>
+template<typename FilterFactoryT>
+TqInt CqMipmap<TextureBufferT>::chooseLevel(const FilterFactoryT& filterFactory,
+		const CqTextureSampleOptions& sampleOpts, TqFloat& levelInterp) const
 {
 	// Select mipmap level to use.
 	//
@@ -284,11 +326,9 @@ void CqMipmap<TextureBufferT>::applyFilter(const FilterFactoryT& filterFactory,
 	TqFloat levelCts = log2(filterFactory.minorAxisWidth()/minFilterWidth);
 	TqInt level = clamp<TqInt>(lfloor(levelCts), 0, numLevels()-1);
 
-	filterLevel(level, filterFactory, sampleOpts, outSamps);
-
 	// Sometimes we might want to interpolate between the filtered result
-	// already computed above and the next lower mipmap level.  We do that now
-	// if necessary.
+	// on the chosen level and the next lower mipmap level.
+	levelInterp = 0;
 	if( ( sampleOpts.lerp() == Lerp_Always
 		|| (sampleOpts.lerp() == Lerp_Auto && blurRatio > 0.2) )
 		&& level < numLevels()-1 && levelCts > 0)
@@ -310,17 +350,30 @@ void CqMipmap<TextureBufferT>::applyFilter(const FilterFactoryT& filterFactory,
 		// Since this extra interpolation isn't really needed for small amounts
 		// of blur, we only do the interpolation when the blur ratio is large
 		// enough to make it worthwhile.
+		levelInterp = levelCts - level;
+		// We square levelInterp here in order to bias the interpolation toward
+		// the higher resolution mipmap level, since the filtered result on the
+		// higher level is more accurate.
+		levelInterp *= levelInterp;
+	}
+	return level;
+}
 
+template<typename TextureBufferT>
+template<typename FilterFactoryT>
+void CqMipmap<TextureBufferT>::filterLevels(TqInt level, TqFloat levelInterp,
+		const FilterFactoryT& filterFactory,
+		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	filterLevel(level, filterFactory, sampleOpts, outSamps);
+
+	if(levelInterp > 0)
+	{
 		// Filter second level into tmpSamps.
 		CqAutoBuffer<TqFloat, 16> tmpSamps(sampleOpts.numChannels());
 		filterLevel(level+1, filterFactory, sampleOpts, tmpSamps.get());
 
 		// Mix outSamps and tmpSamps.
-		TqFloat levelInterp = levelCts - level;
-		// We square levelInterp here in order to bias the interpolation toward
-		// the higher resolution mipmap level, since the filtered result on the
-		// higher level is more accurate.
-		levelInterp *= levelInterp;
 		for(TqInt i = 0; i < sampleOpts.numChannels(); ++i)
 			outSamps[i] = (1-levelInterp) * outSamps[i] + levelInterp*tmpSamps[i];
 	}
@@ -328,6 +381,19 @@ void CqMipmap<TextureBufferT>::applyFilter(const FilterFactoryT& filterFactory,
 	// outSamps[level%sampleOpts.numCahnnels()] += 0.1;
 }
 
+template<typename TextureBufferT>
+TqInt CqMipmap<TextureBufferT>::tileIndex(TqInt level, const CqVector2D& st) const
+{
+	SqTileInfo tileInfo = m_texFile->tileInfo();
+	TqInt width = m_texFile->width(level);
+	TqInt height = m_texFile->height(level);
+	TqInt widthInTiles = (width-1)/tileInfo.width + 1;
+	TqInt heightInTiles = (height-1)/tileInfo.height + 1;
+	TqInt tx = clamp<TqInt>(lfloor(st.x()*width)/tileInfo.width, 0, widthInTiles-1);
+	TqInt ty = clamp<TqInt>(lfloor(st.y()*height)/tileInfo.height, 0, heightInTiles-1);
+	return ty*widthInTiles + tx;
+}
+
 template<typename TextureBufferT>
 const TextureBufferT& CqMipmap<TextureBufferT>::getLevel(TqInt levelNum) const
 {
@@ -429,14 +495,26 @@ void CqMipmap<TextureBufferT>::filterLevel(
 		trans.xScale, trans.xOffset,
 		trans.yScale, trans.yOffset
 	);
-	// Create an accumulator for the samples.
-	CqSampleAccum<CqEwaFilter> accumulator(
-		weights,
-		sampleOpts.startChannel(),
-		sampleOpts.numChannels(),
-		outSamps,
-		sampleOpts.fill()
-	);
+	SqWrapModes wrapModes(sampleOpts.sWrapMode(), sampleOpts.tWrapMode());
+	if(sampleOpts.filterType() == TextureFilter_Bilinear
+		&& filterFactory.majorAxisWidth()*trans.xScale < 2*sampleOpts.minWidth())
+	{
+		// The footprint is small and roughly isotropic on this level, so the
+		// EWA filter covers little more than the pixels surrounding its
+		// center.  A bilinear lookup gives a similar result for much less
+		// work.  (Interpolation between levels then makes it trilinear.)
+		CqBilinearFilter bilinearWeights(weights.center());
+		CqSampleAccum<CqBilinearFilter> accumulator(
+			bilinearWeights,
+			sampleOpts.startChannel(),
+			sampleOpts.numChannels(),
+			outSamps,
+			sampleOpts.fill()
+		);
+		filterTexture(accumulator, getLevel(level), bilinearWeights.support(),
+				wrapModes);
+		return;
+	}
 	SqFilterSupport support = weights.support();
 	if(level == numLevels() - 1)
 	{
@@ -447,13 +525,19 @@ void CqMipmap<TextureBufferT>::filterLevel(
 		TqInt cy = (support.sy.start + support.sy.end)/2;
 		support = intersect(support, SqFilterSupport(cx-10, cx+11, cy-10, cy+11));
 	}
-	// filter the texture
-	filterTexture(
-		accumulator,
-		getLevel(level),
-		support,
-		SqWrapModes(sampleOpts.sWrapMode(), sampleOpts.tWrapMode())
+	// Tabulate the weights over the support up front, rather than evaluating
+	// the filter as each pixel is accumulated.
+	CqEwaWeightTable weightTable(weights, support);
+	// Create an accumulator for the samples.
+	CqSampleAccum<CqEwaWeightTable> accumulator(
+		weightTable,
+		sampleOpts.startChannel(),
+		sampleOpts.numChannels(),
+		outSamps,
+		sampleOpts.fill()
 	);
+	// filter the texture
+	filterTexture(accumulator, getLevel(level), support, wrapModes);
 }
 
 } // namespace Aqsis
@@ -37,11 +37,14 @@
 
 #include "occlusionsampler.h"
 
+#include <cmath>
+
 #include <aqsis/math/math.h>
 #include <aqsis/tex/filtering/filtertexture.h>
 #include <aqsis/tex/filtering/sampleaccum.h>
 #include <aqsis/tex/texexception.h>
 #include <aqsis/tex/buffers/tilearray.h>
+#include <aqsis/util/autobuffer.h>
 
 #include "depthapprox.h"
 
@@ -198,7 +201,7 @@ class CqOcclusionSampler::CqOccView
 		 *
 		 * \param N - surface normal.
 		 */
-		TqFloat weight(const CqVector3D& N)
+		TqFloat weight(const CqVector3D& N) const
 		{
 			return N*m_negViewDirec;
 		}
@@ -275,28 +278,69 @@ CqOcclusionSampler::CqOcclusionSampler(
 void CqOcclusionSampler::sample(const Sq3DSamplePllgram& samplePllgram,
 		const CqVector3D& normal, const CqShadowSampleOptions& sampleOpts,
 		TqFloat* outSamps) const
+{
+	sampleGrid(&samplePllgram, &normal, 1, sampleOpts, outSamps);
+}
+
+void CqOcclusionSampler::sampleGrid(const Sq3DSamplePllgram* regions,
+		const CqVector3D* normals, TqInt numPoints,
+		const CqShadowSampleOptions& sampleOpts, TqFloat* outSamps) const
 {
 	assert(sampleOpts.numChannels() == 1);
+	if(numPoints <= 0)
+		return;
 
-	// Unit normal indicating the hemisphere to sample for occlusion.
-	CqVector3D N = normal;
-	N.Unit();
+	// Unit normals indicating the hemisphere to sample for occlusion.
+	CqAutoBuffer<CqVector3D, 16> N(numPoints);
+	CqVector3D coneAxis(0,0,0);
+	for(TqInt i = 0; i < numPoints; ++i)
+	{
+		N[i] = normals[i];
+		N[i].Unit();
+		coneAxis += N[i];
+	}
+	// Bound the normals by a cone.  A view can only contribute to a point in
+	// the grid if it's less than 90 degrees from some normal inside the cone,
+	// so views further than 90 degrees plus the cone half-angle from the cone
+	// axis can be skipped for the whole grid.  If the normals are too spread
+	// out to fit in a hemisphere, no views are culled.
+	TqFloat minAxisWeight = -1;
+	TqFloat axisLength = coneAxis.Magnitude();
+	if(axisLength > 0)
+	{
+		coneAxis /= axisLength;
+		TqFloat cosHalfAngle = 1;
+		for(TqInt i = 0; i < numPoints; ++i)
+			cosHalfAngle = min(cosHalfAngle, N[i]*coneAxis);
+		if(cosHalfAngle > 0)
+			minAxisWeight = -std::sqrt(1 - cosHalfAngle*cosHalfAngle);
+	}
+	// Slack in the culling test to allow for rounding.
+	const TqFloat cullEps = 1e-4;
 
 	const TqFloat sampNumMult = 4.0 * sampleOpts.numSamples() / m_maps.size();
 
 	// Accumulate the total occlusion over all directions.  Here we use an
 	// importance sampling approach: we decide how many samples each map should
 	// have based on it's relative importance as measured by the map weight.
-	TqFloat totOcc = 0;
-	TqInt totNumSamples = 0;
-	TqFloat maxWeight = 0;
-	TqViewVec::const_iterator maxWeightMap = m_maps.begin();
-	for(TqViewVec::const_iterator map = m_maps.begin(), end = m_maps.end();
-			map != end; ++map)
+	//
+	// The views are visited in the outer loop so that all the depth lookups
+	// into a view happen together, and its tiles only need to be brought
+	// into the cache once per grid.
+	CqAutoBuffer<TqFloat, 16> totOcc(numPoints, 0);
+	CqAutoBuffer<TqInt, 16> totNumSamples(numPoints, 0);
+	CqAutoBuffer<TqFloat, 16> maxWeight(numPoints, 0);
+	CqAutoBuffer<TqInt, 16> maxWeightMap(numPoints, 0);
+	for(TqInt mapIdx = 0, numMaps = m_maps.size(); mapIdx < numMaps; ++mapIdx)
 	{
-		TqFloat weight = (*map)->weight(N);
-		if(weight > 0)
+		CqOccView& map = *m_maps[mapIdx];
+		if(map.weight(coneAxis) < minAxisWeight - cullEps)
+			continue;
+		for(TqInt i = 0; i < numPoints; ++i)
 		{
+			TqFloat weight = map.weight(N[i]);
+			if(weight <= 0)
+				continue;
 			// Compute the number of samples to use.  Assuming that the shadow
 			// maps are spread evenly over the sphere, we have an area of 
 			//
@@ -322,33 +366,35 @@ void CqOcclusionSampler::sample(const Sq3DSamplePllgram& samplePllgram,
 			{
 				// Compute amount of occlusion from the current view.
 				TqFloat occ = 0;
-				(*map)->sample(samplePllgram, sampleOpts, numSamples, &occ);
+				map.sample(regions[i], sampleOpts, numSamples, &occ);
 				// Accumulate into total occlusion and weight.
-				totOcc += occ*numSamples;
-				totNumSamples += numSamples;
+				totOcc[i] += occ*numSamples;
+				totNumSamples[i] += numSamples;
 			}
-			if(weight > maxWeight)
+			if(weight > maxWeight[i])
 			{
-				maxWeight = weight;
-				maxWeightMap = map;
+				maxWeight[i] = weight;
+				maxWeightMap[i] = mapIdx;
 			}
 		}
 	}
 
-	// The algorithm above sometimes results in no samples being computed for
-	// low total sample numbers.  Here we attempt to allow very small numbers
-	// of samples to be useful by sampling the most highly weighted map if no
-	// samples have been taken
-	if(totNumSamples == 0 && maxWeight > 0)
+	for(TqInt i = 0; i < numPoints; ++i)
 	{
-		TqFloat occ = 0;
-		(*maxWeightMap)->sample(samplePllgram, sampleOpts, 1, &occ);
-		totOcc += occ;
-		totNumSamples += 1;
+		// The algorithm above sometimes results in no samples being computed
+		// for low total sample numbers.  Here we attempt to allow very small
+		// numbers of samples to be useful by sampling the most highly
+		// weighted map if no samples have been taken
+		if(totNumSamples[i] == 0 && maxWeight[i] > 0)
+		{
+			TqFloat occ = 0;
+			m_maps[maxWeightMap[i]]->sample(regions[i], sampleOpts, 1, &occ);
+			totOcc[i] += occ;
+			totNumSamples[i] += 1;
+		}
+		// Normalize the sample
+		outSamps[i] = totOcc[i] / totNumSamples[i];
 	}
-
-	// Normalize the sample
-	*outSamps = totOcc / totNumSamples;
 }
 
 const CqShadowSampleOptions& CqOcclusionSampler::defaultSampleOptions() const
@@ -83,6 +83,9 @@ class AQSIS_TEX_SHARE CqOcclusionSampler : public IqOcclusionSampler
 		virtual void sample(const Sq3DSamplePllgram& samplePllgram,
 				const CqVector3D& normal, const CqShadowSampleOptions& sampleOpts,
 				TqFloat* outSamps) const;
+		virtual void sampleGrid(const Sq3DSamplePllgram* regions,
+				const CqVector3D* normals, TqInt numPoints,
+				const CqShadowSampleOptions& sampleOpts, TqFloat* outSamps) const;
 		virtual const CqShadowSampleOptions& defaultSampleOptions() const;
 	private:
 		class CqOccView;
@@ -15,7 +15,9 @@ set(filtering_srcs
 make_absolute(filtering_srcs ${filtering_SOURCE_DIR})
 
 set(filtering_hdrs
+	bilinearfilter.h
 	cubeenvironmentsampler.h
+	depthrangemap.h
 	dummyenvironmentsampler.h
 	dummyocclusionsampler.h
 	dummyshadowsampler.h
@@ -34,6 +36,8 @@ make_absolute(filtering_hdrs ${filtering_SOURCE_DIR})
 include_directories(${filtering_SOURCE_DIR})
 
 set(filtering_test_srcs
+	depthrangemap_test.cpp
+	ewafilter_test.cpp
 	samplequad_test.cpp
 )
 make_absolute(filtering_test_srcs ${filtering_SOURCE_DIR})
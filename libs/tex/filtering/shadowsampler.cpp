@@ -44,6 +44,7 @@
 #include <aqsis/tex/buffers/tilearray.h>
 
 #include "depthapprox.h"
+#include "depthrangemap.h"
 #include "ewafilter.h"
 
 namespace Aqsis {
@@ -118,6 +119,8 @@ class CqShadowSampler::CqShadowView
 		CqVector3D m_lightPos;
 		/// Pixel data for shadow map.
 		CqTileArray<TqFloat> m_pixels;
+		/// Depth range pyramid for quickly classifying filter supports.
+		CqDepthRangeMap<CqTileArray<TqFloat> > m_depthRange;
 
 	public:
 		/** \brief Create a view from imageNum of the provided file.
@@ -132,7 +135,8 @@ class CqShadowSampler::CqShadowView
 			m_currToRaster(),
 			m_currToRasterVec(),
 			m_viewDirec(),
-			m_pixels(file, imageNum)
+			m_pixels(file, imageNum),
+			m_depthRange(m_pixels)
 		{
 			// TODO refactor with CqShadowSampler, also refactor this function,
 			// since it's a bit unweildly...
@@ -240,18 +244,24 @@ class CqShadowSampler::CqShadowView
 					m_pixels.height(), sampleOpts.sBlur(), sampleOpts.tBlur(), 2);
 			CqEwaFilter ewaWeights = ewaFactory.createFilter();
 
-			/** \todo Optimization: Cull the query if it's outside the [min,max] depth
-			 * range of the support.  Being able to determine the range from the tiles
-			 * covered by the filter support will be a big advantage.
-			 */
-
 			SqFilterSupport support = ewaWeights.support();
 			if(support.intersectsRange(0, m_pixels.width(), 0, m_pixels.height()))
 			{
+				// The depth range of the map over the support lets us skip
+				// PCF entirely for supports which are wholly lit or wholly
+				// in shadow, so that only penumbra regions pay for filtering.
+				TqFloat mapMin = 0;
+				TqFloat mapMax = 0;
+				bool useRange = sampleOpts.startChannel() == 0;
+				if(useRange)
+					m_depthRange.range(support, mapMin, mapMax);
 				if(sampleOpts.depthApprox() == DApprox_Constant)
 				{
 					// Functor which approximates the surface depth using a constant.
 					CqConstDepthApprox depthFunc(quadLightCoord.center().z());
+					TqFloat z = depthFunc(0, 0);
+					if(useRange && classifyPCF(z, z, mapMin, mapMax, sampleOpts, outSamps))
+						return;
 					applyPCF(m_pixels, sampleOpts, support, ewaWeights, depthFunc, outSamps);
 				}
 				else
@@ -262,6 +272,25 @@ class CqShadowSampler::CqShadowView
 					quadLightCoord.copy2DCoords(texQuad);
 					CqSampleQuadDepthApprox depthFunc(quadLightCoord, m_pixels.width(),
 							m_pixels.height());
+					if(useRange)
+					{
+						// The surface depth is linear, so its extremes over
+						// the support are at the corners.
+						SqFilterSupport s = intersect(support,
+								SqFilterSupport(0, m_pixels.width(), 0, m_pixels.height()));
+						TqFloat z00 = depthFunc(s.sx.start, s.sy.start);
+						TqFloat z10 = depthFunc(s.sx.end-1, s.sy.start);
+						TqFloat z01 = depthFunc(s.sx.start, s.sy.end-1);
+						TqFloat z11 = depthFunc(s.sx.end-1, s.sy.end-1);
+						TqFloat surfMin = min(min(z00, z10), min(z01, z11));
+						TqFloat surfMax = max(max(z00, z10), max(z01, z11));
+						// Allow for rounding in evaluating the depth at
+						// interior points.
+						TqFloat eps = 1e-5f*max(std::fabs(surfMin), std::fabs(surfMax));
+						if(classifyPCF(surfMin - eps, surfMax + eps, mapMin, mapMax,
+									sampleOpts, outSamps))
+							return;
+					}
 					applyPCF(m_pixels, sampleOpts, support, ewaWeights, depthFunc, outSamps);
 				}
 			}
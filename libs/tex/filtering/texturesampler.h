@@ -40,6 +40,9 @@
 
 #include <aqsis/aqsis.h>
 
+#include <algorithm>
+#include <vector>
+
 #include <boost/shared_ptr.hpp>
 
 #include "ewafilter.h"
@@ -65,8 +68,38 @@ class AQSIS_TEX_SHARE CqTextureSampler : public IqTextureSampler
 		// from IqTextureSampler
 		virtual void sample(const SqSamplePllgram& samplePllgram,
 				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const;
+		virtual void sampleGrid(const SqSampleGrid& grid,
+				const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const;
 		virtual const CqTextureSampleOptions& defaultSampleOptions() const;
 	private:
+		/// Filter and mipmap level choice for one point of a grid.
+		struct SqGridFilter
+		{
+			TqInt index;
+			TqInt level;
+			TqInt tile;
+			TqFloat levelInterp;
+			CqEwaFilterFactory factory;
+
+			SqGridFilter(TqInt index, TqInt level, TqInt tile,
+					TqFloat levelInterp, const CqEwaFilterFactory& factory)
+				: index(index), level(level), tile(tile),
+				levelInterp(levelInterp), factory(factory)
+			{ }
+			/// Order by level, and then by tile within a level.
+			bool operator<(const SqGridFilter& rhs) const
+			{
+				return level < rhs.level || (level == rhs.level && tile < rhs.tile);
+			}
+		};
+
+		/// Scale and remap a sample region according to the sample options.
+		SqSamplePllgram adjustRegion(const SqSamplePllgram& samplePllgram,
+				const CqTextureSampleOptions& sampleOpts) const;
+		/// Construct the EWA filter factory for an adjusted sample region.
+		CqEwaFilterFactory filterFactory(const SqSamplePllgram& pllgram,
+				const CqTextureSampleOptions& sampleOpts) const;
+
 		boost::shared_ptr<LevelCacheT> m_levels;
 };
 
@@ -84,6 +117,49 @@ CqTextureSampler<LevelCacheT>::CqTextureSampler(
 template<typename LevelCacheT>
 void CqTextureSampler<LevelCacheT>::sample(const SqSamplePllgram& samplePllgram,
 		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	SqSamplePllgram pllgram = adjustRegion(samplePllgram, sampleOpts);
+	// Call through to the mipmap class to do the main filtering work.
+	m_levels->applyFilter(filterFactory(pllgram, sampleOpts), sampleOpts, outSamps);
+}
+
+template<typename LevelCacheT>
+void CqTextureSampler<LevelCacheT>::sampleGrid(const SqSampleGrid& grid,
+		const CqTextureSampleOptions& sampleOpts, TqFloat* outSamps) const
+{
+	// Set up the filters and choose mipmap levels for all points up front.
+	// The filtering itself can then be done level by level and tile by
+	// tile, so that each tile is brought into cache once rather than
+	// repeatedly as the grid crosses tile boundaries.
+	std::vector<SqGridFilter> filters;
+	filters.reserve(grid.numPoints);
+	CqTextureSampleOptions opts(sampleOpts);
+	for(TqInt i = 0; i < grid.numPoints; ++i)
+	{
+		grid.varyingOptions(i, opts);
+		SqSamplePllgram pllgram = adjustRegion(grid.pllgram(i), opts);
+		CqEwaFilterFactory factory = filterFactory(pllgram, opts);
+		TqFloat levelInterp = 0;
+		TqInt level = m_levels->chooseLevel(factory, opts, levelInterp);
+		filters.push_back(SqGridFilter(i, level,
+					m_levels->tileIndex(level, pllgram.c), levelInterp, factory));
+	}
+	std::sort(filters.begin(), filters.end());
+
+	TqInt numChannels = sampleOpts.numChannels();
+	for(typename std::vector<SqGridFilter>::const_iterator f = filters.begin();
+			f != filters.end(); ++f)
+	{
+		grid.varyingOptions(f->index, opts);
+		m_levels->filterLevels(f->level, f->levelInterp, f->factory, opts,
+				outSamps + f->index*numChannels);
+	}
+}
+
+template<typename LevelCacheT>
+SqSamplePllgram CqTextureSampler<LevelCacheT>::adjustRegion(
+		const SqSamplePllgram& samplePllgram,
+		const CqTextureSampleOptions& sampleOpts) const
 {
 	// Scale width if necessary
 	SqSamplePllgram pllgram(samplePllgram);
@@ -91,14 +167,17 @@ void CqTextureSampler<LevelCacheT>::sample(const SqSamplePllgram& samplePllgram,
 	// Remap onto the main part of the texture if periodic.
 	pllgram.remapPeriodic(sampleOpts.sWrapMode() == WrapMode_Periodic,
 			sampleOpts.tWrapMode() == WrapMode_Periodic);
+	return pllgram;
+}
 
-	// Construct EWA filter factory
-	CqEwaFilterFactory ewaFactory(pllgram, m_levels->width0(), m_levels->height0(),
+template<typename LevelCacheT>
+CqEwaFilterFactory CqTextureSampler<LevelCacheT>::filterFactory(
+		const SqSamplePllgram& pllgram,
+		const CqTextureSampleOptions& sampleOpts) const
+{
+	return CqEwaFilterFactory(pllgram, m_levels->width0(), m_levels->height0(),
 			ewaBlurMatrix(sampleOpts.sBlur(), sampleOpts.tBlur()),
 			-sampleOpts.logTruncAmount());
-
-	// Call through to the mipmap class to do the main filtering work.
-	m_levels->applyFilter(ewaFactory, sampleOpts, outSamps);
 }
 
 template<typename LevelCacheT>
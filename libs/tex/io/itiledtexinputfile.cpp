@@ -44,6 +44,11 @@
 
 namespace Aqsis {
 
+namespace {
+/// Tile data read by each thread, in bytes.
+thread_local TqUlong g_threadBytesRead = 0;
+}
+
 boost::shared_ptr<IqTiledTexInputFile> IqTiledTexInputFile::open(
 		const boostfs::path& fileName)
 {
@@ -73,4 +78,14 @@ boost::shared_ptr<IqTiledTexInputFile> IqTiledTexInputFile::openAny(
 	return boost::shared_ptr<IqTiledTexInputFile>(new CqTiledAnyInputFile(fileName));
 }
 
+TqUlong IqTiledTexInputFile::threadBytesRead()
+{
+	return g_threadBytesRead;
+}
+
+void IqTiledTexInputFile::addThreadBytesRead(TqUlong bytes)
+{
+	g_threadBytesRead += bytes;
+}
+
 } // namespace Aqsis
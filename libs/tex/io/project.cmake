@@ -52,6 +52,7 @@ include_directories(${AQSIS_TIFF_INCLUDE_DIR})
 set(io_linklibs
     ${AQSIS_TIFF_LIBRARIES}
     ${AQSIS_TIFFXX_LIBRARIES}
+    ${Boost_THREAD_LIBRARY}
 )
 if(AQSIS_USE_PNG)
 	list(APPEND io_linklibs ${AQSIS_PNG_LIBRARIES})
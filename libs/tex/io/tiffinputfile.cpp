@@ -111,6 +111,24 @@ void CqTiffInputFile::readPixelsStripped(TqUint8* buffer, TqInt startLine,
 	//
 	// In the unlikely event that it turns out to be a problem, we should look
 	// at using the strip-based interface via TIFFReadEncodedStrip & friends.
+	//
+	// libtiff can't seek to a scanline part way through a compressed strip,
+	// so reading starts at the beginning of the strip and the scanlines
+	// before startLine are thrown away.
+	const uint32_t rowsPerStrip = min(dirHandle.tiffTagValue<uint32_t>(
+				TIFFTAG_ROWSPERSTRIP, m_header.height()),
+			static_cast<uint32_t>(m_header.height()));
+	const TqInt stripStartLine = startLine - startLine % rowsPerStrip;
+	if(stripStartLine < startLine)
+	{
+		boost::scoped_array<TqUint8> skipBuf(new TqUint8[bytesPerRow]);
+		for(TqInt line = stripStartLine; line < startLine; ++line)
+		{
+			TIFFReadScanline(dirHandle.tiffPtr(),
+					reinterpret_cast<tdata_t>(skipBuf.get()),
+					static_cast<uint32_t>(line));
+		}
+	}
 	for(TqInt line = startLine; line < startLine + numScanlines; ++line)
 	{
 		TIFFReadScanline(dirHandle.tiffPtr(), reinterpret_cast<tdata_t>(buffer),
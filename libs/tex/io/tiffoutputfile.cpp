@@ -158,7 +158,15 @@ void CqTiffOutputFile::writeScanlinePixels(const CqMixedImageBuffer& buffer)
 void CqTiffOutputFile::writeTiledPixels(const CqMixedImageBuffer& buffer)
 {
 	SqTileInfo tileInfo = m_header.find<Attr::TileInfo>();
-	// Check that the buffer has a height that is a multiple of the tile height.
+	// Buffers may be written in several parts, but each part must start on a
+	// tile boundary...
+	if(m_currentLine % tileInfo.height != 0)
+	{
+		AQSIS_THROW_XQERROR(XqInternal, EqE_Bug,
+				"pixel buffer must start at a multiple of the requested tile height (= "
+				<< tileInfo.height << "), not at line " << m_currentLine << ".");
+	}
+	// ...and have a height that is a multiple of the tile height.
 	if( buffer.height() % tileInfo.height != 0
 		&& m_currentLine + buffer.height() != m_header.height() )
 	{
@@ -186,7 +194,7 @@ void CqTiffOutputFile::writeTiledPixels(const CqMixedImageBuffer& buffer)
 		{
 			const TqInt tileDataLen = min(tileRowStride,
 					rowStride - tileCol*tileRowStride);
-			const TqInt tileDataHeight = min(tileInfo.height, buffer.height() - line);
+			const TqInt tileDataHeight = min(tileInfo.height, endLine - line);
 			// Copy parts of the scanlines into the tile buffer.
 			stridedCopy(tileBuf.get(), tileRowStride, srcBuf, rowStride,
 					tileDataHeight, tileDataLen);
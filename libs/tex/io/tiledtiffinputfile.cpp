@@ -37,23 +37,66 @@
 
 #include "tiledtiffinputfile.h"
 
+#ifndef AQSIS_SYSTEM_WIN32
+#	include <cerrno>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
 #include <boost/scoped_array.hpp>
 
 #include <aqsis/tex/texexception.h>
 
 namespace Aqsis {
 
+namespace {
+
+/** \brief Read size bytes at the given offset in a file, without using or
+ * modifying the file position.
+ *
+ * \return false if the data couldn't be read.
+ */
+bool preadAll(int fd, TqUint8* buf, uint64_t size, uint64_t offset)
+{
+#ifndef AQSIS_SYSTEM_WIN32
+	while(size > 0)
+	{
+		ssize_t numRead = ::pread(fd, buf, size, offset);
+		if(numRead < 0)
+		{
+			if(errno == EINTR)
+				continue;
+			return false;
+		}
+		if(numRead == 0)
+			return false;
+		buf += numRead;
+		size -= numRead;
+		offset += numRead;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+} // unnamed namespace
+
 CqTiledTiffInputFile::CqTiledTiffInputFile(const boostfs::path& fileName)
 	: m_headers(),
 	m_fileHandle(new CqTiffFileHandle(fileName, "r")),
 	m_numDirs(m_fileHandle->numDirectories()),
 	m_tileInfo(0,0),
 	m_widths(),
-	m_heights()
+	m_heights(),
+	m_layouts(),
+	m_fd(-1),
+	m_tiffMutex()
 {
 	m_headers.reserve(m_numDirs);
 	m_widths.reserve(m_numDirs);
 	m_heights.reserve(m_numDirs);
+	m_layouts.resize(m_numDirs);
 	// Iterate through all subimages and check some conditions which will
 	// become assumptions in the rest of the code.
 	for(TqInt i = 0; i < m_numDirs; ++i)
@@ -98,7 +141,46 @@ CqTiledTiffInputFile::CqTiledTiffInputFile(const boostfs::path& fileName)
 		// define special extra methods for these, but it bloats up the
 		// interface a bit.
 		m_headers.push_back(tmpHeader);
+
+		// Cache the location of the tile data so that tiles can be read
+		// without going through libtiff.
+		SqTileLayout& layout = m_layouts[i];
+		layout.tilesPerRow = (tmpHeader->width() + m_tileInfo.width - 1)
+			/ m_tileInfo.width;
+		TIFF* tif = dirHandle.tiffPtr();
+#if TIFFLIB_VERSION >= 20111221
+		// libtiff 4 returns 64 bit offsets; older versions use 32 bit ones,
+		// and those files are left to TIFFReadTile().
+		uint64_t* offsets = 0;
+		uint64_t* byteCounts = 0;
+		if(TIFFGetField(tif, TIFFTAG_TILEOFFSETS, &offsets)
+				&& TIFFGetField(tif, TIFFTAG_TILEBYTECOUNTS, &byteCounts))
+		{
+			TqInt numTiles = TIFFNumberOfTiles(tif);
+			layout.offsets.assign(offsets, offsets + numTiles);
+			layout.byteCounts.assign(byteCounts, byteCounts + numTiles);
+		}
+#endif
+		uint16_t compression = dirHandle.tiffTagValue<uint16_t>(
+				TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+		uint16_t bitsPerSample = dirHandle.tiffTagValue<uint16_t>(
+				TIFFTAG_BITSPERSAMPLE, 1);
+		layout.isRaw = !layout.offsets.empty()
+			&& compression == COMPRESSION_NONE
+			&& (bitsPerSample == 8 || !TIFFIsByteSwapped(tif));
 	}
+
+#ifndef AQSIS_SYSTEM_WIN32
+	m_fd = ::open(native(fileName).c_str(), O_RDONLY);
+#endif
+}
+
+CqTiledTiffInputFile::~CqTiledTiffInputFile()
+{
+#ifndef AQSIS_SYSTEM_WIN32
+	if(m_fd >= 0)
+		::close(m_fd);
+#endif
 }
 
 boostfs::path CqTiledTiffInputFile::fileName() const
@@ -144,7 +226,15 @@ TqInt CqTiledTiffInputFile::height(TqInt index) const
 void CqTiledTiffInputFile::readTileImpl(TqUint8* buffer, TqInt x, TqInt y,
 		TqInt subImageIdx, const SqTileInfo tileSize) const
 {
-	CqTiffDirHandle dirHandle(m_fileHandle, subImageIdx);
+	const SqTileLayout& layout = m_layouts[subImageIdx];
+	TqInt tileIdx = y*layout.tilesPerRow + x;
+	TqInt bytesPerPixel = m_headers[subImageIdx]->channelList().bytesPerPixel();
+	TqInt rowSize = tileSize.width*bytesPerPixel;
+	// Uncompressed tiles can be read straight into the buffer.
+	if(layout.isRaw && readRawTile(buffer, rowSize, tileSize.height,
+				m_tileInfo.width*bytesPerPixel, layout, tileIdx))
+		return;
+
 	if((x+1)*m_tileInfo.width > m_widths[subImageIdx]
 			|| (y+1)*m_tileInfo.height > m_heights[subImageIdx])
 	{
@@ -153,21 +243,67 @@ void CqTiledTiffInputFile::readTileImpl(TqUint8* buffer, TqInt x, TqInt y,
 		// the tile as the same size as all other tiles, not touching the parts
 		// of buffer outside the image.  We want to truncate the tile instead.
 		boost::scoped_array<TqUint8> tmpBuf(
-				new TqUint8[TIFFTileSize(dirHandle.tiffPtr())]);
-		TIFFReadTile(dirHandle.tiffPtr(), static_cast<tdata_t>(tmpBuf.get()),
-				x*m_tileInfo.width, y*m_tileInfo.height, 0, 0);
-		TqInt bytesPerPixel = m_headers[subImageIdx]->channelList().bytesPerPixel();
-		stridedCopy(buffer, tileSize.width*bytesPerPixel, tmpBuf.get(),
-				m_tileInfo.width*bytesPerPixel, tileSize.height,
-				tileSize.width*bytesPerPixel);
+				new TqUint8[m_tileInfo.width*m_tileInfo.height*bytesPerPixel]);
+		decodeTile(tmpBuf.get(), x, y, subImageIdx);
+		stridedCopy(buffer, rowSize, tmpBuf.get(),
+				m_tileInfo.width*bytesPerPixel, tileSize.height, rowSize);
 	}
 	else
 	{
 		// Simple case for wholly contained buffers - the provided buffer is
-		// the correct size, and we get libtiff to read directly into it.
-		TIFFReadTile(dirHandle.tiffPtr(), static_cast<tdata_t>(buffer),
-				x*m_tileInfo.width, y*m_tileInfo.height, 0, 0);
+		// the correct size, and we get libtiff to decode directly into it.
+		decodeTile(buffer, x, y, subImageIdx);
+	}
+}
+
+bool CqTiledTiffInputFile::readRawTile(TqUint8* buffer, TqInt rowSize,
+		TqInt numRows, TqInt fileRowSize, const SqTileLayout& layout,
+		TqInt tileIdx) const
+{
+	if(m_fd < 0 || layout.byteCounts[tileIdx]
+			< static_cast<uint64_t>(fileRowSize*m_tileInfo.height))
+		return false;
+	uint64_t offset = layout.offsets[tileIdx];
+	if(rowSize == fileRowSize)
+		return preadAll(m_fd, buffer, rowSize*numRows, offset);
+	// Tiles on the right edge are truncated, so read them a row at a time.
+	for(TqInt row = 0; row < numRows; ++row)
+	{
+		if(!preadAll(m_fd, buffer + row*rowSize, rowSize,
+					offset + row*fileRowSize))
+			return false;
 	}
+	return true;
+}
+
+void CqTiledTiffInputFile::decodeTile(TqUint8* outBuf, TqInt x, TqInt y,
+		TqInt subImageIdx) const
+{
+#if TIFFLIB_VERSION >= 20191103
+	// Read the compressed data without holding the lock, so that only the
+	// decoding is serialized.
+	const SqTileLayout& layout = m_layouts[subImageIdx];
+	if(m_fd >= 0 && !layout.offsets.empty())
+	{
+		TqInt tileIdx = y*layout.tilesPerRow + x;
+		TqInt tileBytes = m_tileInfo.width*m_tileInfo.height
+			* m_headers[subImageIdx]->channelList().bytesPerPixel();
+		uint64_t inSize = layout.byteCounts[tileIdx];
+		boost::scoped_array<TqUint8> inBuf(new TqUint8[inSize]);
+		if(preadAll(m_fd, inBuf.get(), inSize, layout.offsets[tileIdx]))
+		{
+			boost::mutex::scoped_lock lock(m_tiffMutex);
+			CqTiffDirHandle dirHandle(m_fileHandle, subImageIdx);
+			if(TIFFReadFromUserBuffer(dirHandle.tiffPtr(), tileIdx,
+						inBuf.get(), inSize, outBuf, tileBytes))
+				return;
+		}
+	}
+#endif
+	boost::mutex::scoped_lock lock(m_tiffMutex);
+	CqTiffDirHandle dirHandle(m_fileHandle, subImageIdx);
+	TIFFReadTile(dirHandle.tiffPtr(), static_cast<tdata_t>(outBuf),
+			x*m_tileInfo.width, y*m_tileInfo.height, 0, 0);
 }
 
 } // namespace Aqsis
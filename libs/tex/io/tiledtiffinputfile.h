@@ -42,6 +42,8 @@
 
 #include <vector>
 
+#include <boost/thread/mutex.hpp>
+
 #include <aqsis/tex/io/itiledtexinputfile.h>
 #include "tiffdirhandle.h"
 
@@ -59,6 +61,13 @@ namespace Aqsis {
  *   - The pixel format is directly addressable (8, 16, 32 bits per channel)
  *   - Pixel channels are stored interleaved rather than "planar"
  *   - Probably misc. other restrictions (see tiffdirhandle.cpp)
+ *
+ * Tiles are read straight into the caller's buffer wherever possible.  The
+ * offsets of all tiles are cached when the file is opened, and the raw tile
+ * data is read with pread() on a separate file descriptor, so several
+ * threads may read tiles at once.  Uncompressed tiles need no further work.
+ * Compressed tiles still need libtiff to decode them, which is done while
+ * holding a lock on the libtiff handle.
  */
 class AQSIS_TEX_SHARE CqTiledTiffInputFile : public IqTiledTexInputFile
 {
@@ -69,6 +78,7 @@ class AQSIS_TEX_SHARE CqTiledTiffInputFile : public IqTiledTexInputFile
 		 * assumptions.
 		 */
 		CqTiledTiffInputFile(const boostfs::path& fileName);
+		virtual ~CqTiledTiffInputFile();
 
 		virtual boostfs::path fileName() const;
 		virtual EqImageFileType fileType() const;
@@ -82,6 +92,39 @@ class AQSIS_TEX_SHARE CqTiledTiffInputFile : public IqTiledTexInputFile
 		virtual void readTileImpl(TqUint8* buffer, TqInt tileX, TqInt tileY,
 				TqInt subImageIdx, const SqTileInfo tileSize) const;
 
+		/// Location of the tile data for a subimage within the file.
+		struct SqTileLayout
+		{
+			/// Number of tiles across the subimage.
+			TqInt tilesPerRow;
+			/// Byte offset of each tile in the file.
+			std::vector<uint64_t> offsets;
+			/// Size in bytes of each tile in the file.
+			std::vector<uint64_t> byteCounts;
+			/// True if the tiles are stored uncompressed in native byte order.
+			bool isRaw;
+		};
+		/** \brief Read the raw data for a tile with pread().
+		 *
+		 * \param buffer - destination for the tile, with rows packed rowSize
+		 *                 bytes apart.
+		 * \param rowSize - bytes to read from each row of the tile.  This is
+		 *                  less than fileRowSize for tiles truncated by the
+		 *                  right edge of the image.
+		 * \param numRows - number of rows to read from the top of the tile.
+		 * \param fileRowSize - size in bytes of a full tile row in the file.
+		 *
+		 * \return false if the data couldn't be read.
+		 */
+		bool readRawTile(TqUint8* buffer, TqInt rowSize, TqInt numRows,
+				TqInt fileRowSize, const SqTileLayout& layout, TqInt tileIdx) const;
+		/** \brief Decode a tile with libtiff.
+		 *
+		 * \param outBuf - destination for the decoded tile, which must hold a
+		 *                 whole tile of the natural size.
+		 */
+		void decodeTile(TqUint8* outBuf, TqInt x, TqInt y, TqInt subImageIdx) const;
+
 		/// Header information
 		std::vector<boost::shared_ptr<CqTexFileHeader> > m_headers;
 		/// Handle to the underlying TIFF structure.
@@ -94,6 +137,12 @@ class AQSIS_TEX_SHARE CqTiledTiffInputFile : public IqTiledTexInputFile
 		std::vector<TqInt> m_widths;
 		/// Image height
 		std::vector<TqInt> m_heights;
+		/// Tile layout for each subimage.
+		std::vector<SqTileLayout> m_layouts;
+		/// File descriptor for reading tile data, or -1 if unavailable.
+		int m_fd;
+		/// Lock protecting m_fileHandle, which libtiff doesn't allow to be shared.
+		mutable boost::mutex m_tiffMutex;
 };
 
 } // namespace Aqsis
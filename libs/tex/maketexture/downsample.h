@@ -40,6 +40,8 @@
 
 #include <aqsis/aqsis.h>
 
+#include <vector>
+
 #include <boost/shared_ptr.hpp>
 
 #include <aqsis/math/math.h>
@@ -115,6 +117,27 @@ template<typename ArrayT>
 boost::shared_ptr<ArrayT> downsample(const ArrayT& srcBuf,
 		const SqFilterInfo& filterInfo, const SqWrapModes& wrapModes);
 
+/** \brief Compute a range of rows of a downsampled image.
+ *
+ * The source buffer need only hold the source rows which the filter support
+ * covers for the destination rows being computed; this allows large images
+ * to be downsampled one band at a time.  The rows are computed in parallel.
+ *
+ * \param srcBuf - source pixels.  Row 0 of srcBuf is row srcStartY of the
+ *                 full source image.
+ * \param srcStartY - row of the full source image at the top of srcBuf.
+ * \param mipmapRatio - scale factor between the source and destination.
+ * \param filterWeights - precomputed kernel of filter weights.
+ * \param wrapModes - specify how the texture will be wrapped at the edges.
+ * \param destBuf - destination buffer for the full downsampled image.
+ * \param destStartY
+ * \param destEndY - range [destStartY, destEndY) of rows to compute.
+ */
+template<typename ArrayT>
+void downsampleRows(const ArrayT& srcBuf, TqInt srcStartY, TqInt mipmapRatio,
+		const CqCachedFilter& filterWeights, const SqWrapModes& wrapModes,
+		ArrayT& destBuf, TqInt destStartY, TqInt destEndY);
+
 
 
 //==============================================================================
@@ -180,34 +203,53 @@ namespace detail {
 template<typename ArrayT>
 boost::shared_ptr<ArrayT> downsampleNonseperable(
 		const ArrayT& srcBuf, TqInt mipmapRatio,
-		CqCachedFilter& filterWeights, const SqWrapModes& wrapModes)
+		const CqCachedFilter& filterWeights, const SqWrapModes& wrapModes)
 {
 	TqInt newWidth = lceil(TqFloat(srcBuf.width())/mipmapRatio);
 	TqInt newHeight = lceil(TqFloat(srcBuf.height())/mipmapRatio);
 	TqInt numChannels = srcBuf.numChannels();
 	boost::shared_ptr<ArrayT> destBuf(new ArrayT(newWidth, newHeight, numChannels));
+	downsampleRows(srcBuf, 0, mipmapRatio, filterWeights, wrapModes,
+			*destBuf, 0, newHeight);
+	return destBuf;
+}
+
+} // namespace detail
+
+template<typename ArrayT>
+void downsampleRows(const ArrayT& srcBuf, TqInt srcStartY, TqInt mipmapRatio,
+		const CqCachedFilter& filterWeights, const SqWrapModes& wrapModes,
+		ArrayT& destBuf, TqInt destStartY, TqInt destEndY)
+{
+	TqInt newWidth = destBuf.width();
+	TqInt numChannels = srcBuf.numChannels();
 	TqInt filterOffsetX = (filterWeights.width()-1) / 2;
 	TqInt filterOffsetY = (filterWeights.height()-1) / 2;
-	std::vector<TqFloat> accumBuf(numChannels);
-	// Loop over pixels in the output image.
-	for(TqInt y = 0; y < newHeight; ++y)
+	// Output rows are independent, so they're computed in parallel.  Each
+	// thread needs its own copy of the filter, since the position of the
+	// filter support is part of its state.
+#pragma omp parallel
 	{
-		for(TqInt x = 0; x < newWidth; ++x)
+		CqCachedFilter weights(filterWeights);
+		std::vector<TqFloat> accumBuf(numChannels);
+#pragma omp for schedule(dynamic)
+		for(TqInt y = destStartY; y < destEndY; ++y)
 		{
-			// Filter the source buffer to get the channels for a single pixel
-			// in the destination buffer.
-			filterWeights.setSupportTopLeft(2*x-filterOffsetX, 2*y-filterOffsetY);
-			CqSampleAccum<CqCachedFilter> accumulator(filterWeights, 0, numChannels, &accumBuf[0]);
-			filterTexture(accumulator, srcBuf, filterWeights.support(),
-					SqWrapModes(wrapModes.sWrap, wrapModes.tWrap));
-			destBuf->setPixel(x, y, &accumBuf[0]);
+			for(TqInt x = 0; x < newWidth; ++x)
+			{
+				// Filter the source buffer to get the channels for a single pixel
+				// in the destination buffer.
+				weights.setSupportTopLeft(mipmapRatio*x - filterOffsetX,
+						mipmapRatio*y - filterOffsetY - srcStartY);
+				CqSampleAccum<CqCachedFilter> accumulator(weights, 0, numChannels, &accumBuf[0]);
+				filterTexture(accumulator, srcBuf, weights.support(),
+						SqWrapModes(wrapModes.sWrap, wrapModes.tWrap));
+				destBuf.setPixel(x, y, &accumBuf[0]);
+			}
 		}
 	}
-	return destBuf;
 }
 
-} // namespace detail
-
 
 template<typename ArrayT>
 boost::shared_ptr<ArrayT> downsample(const ArrayT& srcBuf,
@@ -38,6 +38,7 @@
 #include <aqsis/tex/maketexture.h>
 
 #include <algorithm>
+#include <cstring>
 
 #include <boost/shared_ptr.hpp>
 
@@ -45,6 +46,7 @@
 #include "bake.h"
 #include <aqsis/tex/io/itexinputfile.h>
 #include <aqsis/tex/io/itexoutputfile.h>
+#include <aqsis/tex/io/texfileattributes.h>
 #include <aqsis/util/logging.h>
 #include "magicnumber.h"
 #include "downsample.h"
@@ -86,6 +88,62 @@ void downsampleToFile(boost::shared_ptr<CqTextureBuffer<ChannelT> >& buf,
 	}
 }
 
+/// Number of rows of the first downsampled level computed per band.
+const TqInt mipmapBandHeight = 64;
+
+/** \brief Read scanlines from a file, converting to the given channel type.
+ *
+ * FileChannelT is the channel type held in the file.
+ */
+template<typename FileChannelT, typename ChannelT>
+void readScanlines(const IqTexInputFile& inFile, TqInt startLine, TqInt numLines,
+		CqTextureBuffer<ChannelT>& buf)
+{
+	CqTextureBuffer<FileChannelT> fileBuf;
+	inFile.readPixels(fileBuf, startLine, numLines);
+	buf = fileBuf;
+}
+
+/** \brief Copy whole rows of one texture buffer into another.
+ *
+ * \param src - source buffer
+ * \param srcRow - first row to copy from src
+ * \param dest - destination buffer, with the same width and channels as src.
+ * \param destRow - first row to copy to in dest
+ * \param numRows - number of rows to copy
+ */
+template<typename ChannelT>
+void copyRows(const CqTextureBuffer<ChannelT>& src, TqInt srcRow,
+		CqTextureBuffer<ChannelT>& dest, TqInt destRow, TqInt numRows)
+{
+	assert(src.width() == dest.width());
+	assert(src.numChannels() == dest.numChannels());
+	TqInt rowBytes = src.width()*src.numChannels()*sizeof(ChannelT);
+	std::memcpy(dest.rawData() + destRow*rowBytes,
+			src.rawData() + srcRow*rowBytes, numRows*rowBytes);
+}
+
+/** \brief Find the image row which wraps onto a row outside the image.
+ *
+ * This mirrors the wrapping done by filterTexture().
+ *
+ * \return the wrapped row, or -1 if the row is black.
+ */
+TqInt wrapRow(TqInt row, TqInt height, EqWrapMode wrapMode)
+{
+	if(row >= 0 && row < height)
+		return row;
+	switch(wrapMode)
+	{
+		case WrapMode_Black:
+			return -1;
+		case WrapMode_Clamp:
+			return clamp(row, 0, height-1);
+		default:
+			return ((row % height) + height) % height;
+	}
+}
+
 /** \brief Create a mipmap from pixel data in the given input file.
  *
  * ChannelT is the pixel component type.
@@ -95,7 +153,7 @@ void downsampleToFile(boost::shared_ptr<CqTextureBuffer<ChannelT> >& buf,
  * \param filterInfo - information about which filter type and size to use
  * \param wrapModes - specifies how the texture will be wrapped at the edges.
  */
-template<typename TexSrcT, typename ChannelT>
+template<typename ChannelT, typename TexSrcT>
 void createMipmapTyped(const TexSrcT& texSrc, IqMultiTexOutputFile& outFile,
 		const SqFilterInfo& filterInfo, const SqWrapModes wrapModes)
 {
@@ -105,6 +163,121 @@ void createMipmapTyped(const TexSrcT& texSrc, IqMultiTexOutputFile& outFile,
 	downsampleToFile(buf, outFile, filterInfo, wrapModes);
 }
 
+/** \brief Create a mipmap from an input file without reading the whole file.
+ *
+ * The full resolution image is the largest by far, so it's streamed through
+ * in bands: each band of source rows is copied to the output file and used
+ * to compute the corresponding rows of the first downsampled level.  Only
+ * the smaller levels are held in memory in their entirety.
+ *
+ * FileChannelT is the channel type of the file, which is converted to
+ * ChannelT for mipmapping.
+ */
+template<typename FileChannelT, typename ChannelT>
+void createMipmapStreamed(const IqTexInputFile& inFile, IqMultiTexOutputFile& outFile,
+		const SqFilterInfo& filterInfo, const SqWrapModes wrapModes)
+{
+	const TqInt width = inFile.header().width();
+	const TqInt height = inFile.header().height();
+	const TqInt numChannels = inFile.header().channelList().numChannels();
+	if(width <= 1 && height <= 1)
+	{
+		boost::shared_ptr<CqTextureBuffer<ChannelT> > buf(new CqTextureBuffer<ChannelT>());
+		readScanlines<FileChannelT>(inFile, 0, height, *buf);
+		outFile.writePixels(*buf);
+		return;
+	}
+
+	const TqInt mipmapRatio = 2;
+	CqCachedFilter weights(filterInfo, width % 2 != 0, height % 2 != 0,
+			1.0f/mipmapRatio);
+	const TqInt filterOffsetY = (weights.height()-1) / 2;
+	boost::shared_ptr<CqTextureBuffer<ChannelT> > nextLevel(
+			new CqTextureBuffer<ChannelT>(lceil(TqFloat(width)/mipmapRatio),
+				lceil(TqFloat(height)/mipmapRatio), numChannels));
+
+	// Tiled output has to be written a whole row of tiles at a time, so rows
+	// are held back until they fill a tile row.
+	TqInt writeGranularity = 1;
+	if(const SqTileInfo* tileInfo = outFile.header().findPtr<Attr::TileInfo>())
+		writeGranularity = tileInfo->height;
+	// Number of rows of the full resolution image written so far.
+	TqInt rowsWritten = 0;
+	CqTextureBuffer<ChannelT> inBuf;
+	CqTextureBuffer<ChannelT> bandBuf;
+	CqTextureBuffer<ChannelT> rowBuf;
+	for(TqInt destStart = 0; destStart < nextLevel->height();
+			destStart += mipmapBandHeight)
+	{
+		TqInt destEnd = min(destStart + mipmapBandHeight, nextLevel->height());
+		// Source rows covered by the filter for this band.
+		TqInt srcStart = mipmapRatio*destStart - filterOffsetY;
+		TqInt srcEnd = mipmapRatio*(destEnd-1) - filterOffsetY + weights.height();
+		TqInt inStart = max(srcStart, 0);
+		TqInt inEnd = min(srcEnd, height);
+		readScanlines<FileChannelT>(inFile, inStart, inEnd - inStart, inBuf);
+
+		// Pass newly read rows through to the output.
+		TqInt writeEnd = inEnd == height ? height
+			: inEnd / writeGranularity * writeGranularity;
+		if(writeEnd > rowsWritten)
+		{
+			rowBuf.resize(width, writeEnd - rowsWritten, numChannels);
+			// Rows held back from earlier bands needn't be in this one.
+			TqInt copyStart = min(max(rowsWritten, inStart), writeEnd);
+			if(copyStart > rowsWritten)
+			{
+				CqTextureBuffer<ChannelT> heldBuf;
+				readScanlines<FileChannelT>(inFile, rowsWritten,
+						copyStart - rowsWritten, heldBuf);
+				copyRows(heldBuf, 0, rowBuf, 0, copyStart - rowsWritten);
+			}
+			copyRows(inBuf, copyStart - inStart, rowBuf, copyStart - rowsWritten,
+					writeEnd - copyStart);
+			outFile.writePixels(rowBuf);
+			rowsWritten = writeEnd;
+		}
+
+		// Assemble the band, resolving the vertical wrap mode explicitly so
+		// that the filter support never leaves the band vertically.
+		bandBuf.resize(width, srcEnd - srcStart, numChannels);
+		for(TqInt row = srcStart; row < srcEnd; ++row)
+		{
+			TqInt srcRow = wrapRow(row, height, wrapModes.tWrap);
+			if(srcRow < 0)
+			{
+				TqInt rowBytes = width*numChannels*sizeof(ChannelT);
+				std::memset(bandBuf.rawData() + (row - srcStart)*rowBytes, 0, rowBytes);
+			}
+			else if(srcRow >= inStart && srcRow < inEnd)
+				copyRows(inBuf, srcRow - inStart, bandBuf, row - srcStart, 1);
+			else
+			{
+				readScanlines<FileChannelT>(inFile, srcRow, 1, rowBuf);
+				copyRows(rowBuf, 0, bandBuf, row - srcStart, 1);
+			}
+		}
+		downsampleRows(bandBuf, srcStart, mipmapRatio, weights, wrapModes,
+				*nextLevel, destStart, destEnd);
+	}
+	if(rowsWritten < height)
+	{
+		readScanlines<FileChannelT>(inFile, rowsWritten, height - rowsWritten, inBuf);
+		outFile.writePixels(inBuf);
+	}
+
+	outFile.newSubImage(nextLevel->width(), nextLevel->height());
+	downsampleToFile(nextLevel, outFile, filterInfo, wrapModes);
+}
+
+/// Input files are mipmapped a band at a time to limit memory use.
+template<typename ChannelT>
+void createMipmapTyped(const IqTexInputFile& inFile, IqMultiTexOutputFile& outFile,
+		const SqFilterInfo& filterInfo, const SqWrapModes wrapModes)
+{
+	createMipmapStreamed<ChannelT, ChannelT>(inFile, outFile, filterInfo, wrapModes);
+}
+
 /// Specialization for OpenEXR half data format (TIFF can't handle half data)
 template<typename TexSrcT>
 void createMipmapTypedHalf(const TexSrcT& texSrc, IqMultiTexOutputFile& outFile,
@@ -113,16 +286,30 @@ void createMipmapTypedHalf(const TexSrcT& texSrc, IqMultiTexOutputFile& outFile,
 #	ifdef USE_OPENEXR
 	// Read pixels into the input buffer and convert to 32-bit floating point
 	// since TIFF can't the half data type.
-	CqTextureBuffer<half> halfBuf;
-	texSrc.readPixels(halfBuf);
-	boost::shared_ptr<CqTextureBuffer<TqFloat> > buf(
-			new CqTextureBuffer<TqFloat>(halfBuf));
+	boost::shared_ptr<CqTextureBuffer<TqFloat> > buf;
+	{
+		CqTextureBuffer<half> halfBuf;
+		texSrc.readPixels(halfBuf);
+		buf.reset(new CqTextureBuffer<TqFloat>(halfBuf));
+	}
 	downsampleToFile(buf, outFile, filterInfo, wrapModes);
 #	else
 	assert(0 && "Compiled without OpenEXR support");
 #	endif
 }
 
+/// Half data from input files is converted to float a band at a time.
+inline void createMipmapTypedHalf(const IqTexInputFile& inFile,
+		IqMultiTexOutputFile& outFile, const SqFilterInfo& filterInfo,
+		const SqWrapModes wrapModes)
+{
+#	ifdef USE_OPENEXR
+	createMipmapStreamed<half, TqFloat>(inFile, outFile, filterInfo, wrapModes);
+#	else
+	assert(0 && "Compiled without OpenEXR support");
+#	endif
+}
+
 /** \brief Create a mipmap given a texture source and save it to a file.
  *
  * \param texSrc - a "texture source" class.  Needs one method, readPixels().
@@ -143,25 +330,25 @@ void createMipmap(const TexSrcT& texSrc, const EqChannelType chanType,
 	switch(chanType)
 	{
 		case Channel_Float32:
-			createMipmapTyped<TexSrcT,TqFloat>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqFloat>(texSrc, outFile, filterInfo, wrapModes);
 			break;
 		case Channel_Unsigned32:
-			createMipmapTyped<TexSrcT,TqUint32>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqUint32>(texSrc, outFile, filterInfo, wrapModes);
 			break;
 		case Channel_Signed32:
-			createMipmapTyped<TexSrcT,TqInt32>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqInt32>(texSrc, outFile, filterInfo, wrapModes);
 			break;
 		case Channel_Unsigned16:
-			createMipmapTyped<TexSrcT,TqUint16>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqUint16>(texSrc, outFile, filterInfo, wrapModes);
 			break;
 		case Channel_Signed16:
-			createMipmapTyped<TexSrcT,TqInt16>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqInt16>(texSrc, outFile, filterInfo, wrapModes);
 			break;
 		case Channel_Unsigned8:
-			createMipmapTyped<TexSrcT,TqUint8>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqUint8>(texSrc, outFile, filterInfo, wrapModes);
 			break;
 		case Channel_Signed8:
-			createMipmapTyped<TexSrcT,TqInt8>(texSrc, outFile, filterInfo, wrapModes);
+			createMipmapTyped<TqInt8>(texSrc, outFile, filterInfo, wrapModes);
 			break;
 		case Channel_Float16:
 			createMipmapTypedHalf(texSrc, outFile, filterInfo, wrapModes);
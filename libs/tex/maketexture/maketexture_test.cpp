@@ -0,0 +1,164 @@
+// Aqsis
+// Copyright (C) 2001, Paul C. Gregory and the other authors and contributors
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// * Redistributions of source code must retain the above copyright notice,
+//   this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright notice,
+//   this list of conditions and the following disclaimer in the documentation
+//   and/or other materials provided with the distribution.
+// * Neither the name of the software's owners nor the names of its
+//   contributors may be used to endorse or promote products derived from this
+//   software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// (This is the New BSD license)
+
+/** \file
+ *
+ * \brief Unit tests for mipmap creation.
+ */
+
+#include <aqsis/tex/maketexture.h>
+
+#include <cmath>
+#include <sstream>
+
+#include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <aqsis/tex/buffers/texturebuffer.h>
+#include <aqsis/tex/io/itexinputfile.h>
+#include <aqsis/tex/io/itexoutputfile.h>
+#include "downsample.h"
+
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/auto_unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(maketexture_tests)
+
+using namespace Aqsis;
+
+namespace {
+
+RtFloat gaussianFilter(RtFloat x, RtFloat y, RtFloat xwidth, RtFloat ywidth)
+{
+	x *= 2.0f/xwidth;
+	y *= 2.0f/ywidth;
+	return std::exp(-2.0f*(x*x + y*y));
+}
+
+/// Create a plain (untiled) TIFF with some structured pixel data.
+boost::shared_ptr<CqTextureBuffer<TqFloat> > writeSourceImage(
+		const boostfs::path& fileName, TqInt width, TqInt height)
+{
+	boost::shared_ptr<CqTextureBuffer<TqFloat> > buf(
+			new CqTextureBuffer<TqFloat>(width, height, 2));
+	for(TqInt y = 0; y < height; ++y)
+	{
+		for(TqInt x = 0; x < width; ++x)
+		{
+			TqFloat pixel[2] = { TqFloat((x*7 + y*13) % 17),
+				TqFloat(y) + 0.01f*x };
+			buf->setPixel(x, y, pixel);
+		}
+	}
+	CqTexFileHeader header;
+	header.setWidth(width);
+	header.setHeight(height);
+	header.channelList() = buf->channelList();
+	IqTexOutputFile::open(fileName, ImageFile_Tiff, header)->writePixels(*buf);
+	return buf;
+}
+
+/** Check that makeTexture() gives the same mipmap levels as downsampling the
+ * whole source image in memory.
+ *
+ * The full resolution level is streamed through in bands, so the source
+ * image is several bands high and isn't a multiple of the tile height.
+ */
+void checkMipmapMatchesInMemory(TqFloat filterWidth, EqWrapMode wrapMode)
+{
+	const TqInt width = 45;
+	const TqInt height = 301;
+	boostfs::path inName = "maketexture_test_in.tif";
+	boostfs::path outName = "maketexture_test_out.tex";
+	boost::shared_ptr<CqTextureBuffer<TqFloat> > level
+		= writeSourceImage(inName, width, height);
+
+	SqFilterInfo filterInfo(gaussianFilter, filterWidth, filterWidth);
+	SqWrapModes wrapModes(wrapMode, wrapMode);
+	makeTexture(inName, outName, filterInfo, wrapModes,
+			CqRiParamList(Ri::ParamList()));
+
+	boost::shared_ptr<IqMultiTexInputFile> outFile
+		= IqMultiTexInputFile::open(outName);
+	typedef CqDownsampleIterator<CqTextureBuffer<TqFloat> > TqDownsampleIter;
+	TqInt levelNum = 0;
+	for(TqDownsampleIter i = TqDownsampleIter(level, filterInfo, wrapModes),
+			end = TqDownsampleIter(); i != end; ++i, ++levelNum)
+	{
+		level = *i;
+		BOOST_REQUIRE(levelNum < outFile->numSubImages());
+		outFile->setImageIndex(levelNum);
+		CqTextureBuffer<TqFloat> fileLevel;
+		outFile->readPixels(fileLevel);
+		BOOST_REQUIRE_EQUAL(fileLevel.width(), level->width());
+		BOOST_REQUIRE_EQUAL(fileLevel.height(), level->height());
+		TqInt numBad = 0;
+		for(TqInt y = 0; y < level->height(); ++y)
+		{
+			for(TqInt x = 0; x < level->width(); ++x)
+			{
+				for(TqInt c = 0; c < 2; ++c)
+				{
+					TqFloat expected = (*level)(x,y)[c];
+					TqFloat actual = fileLevel(x,y)[c];
+					// Summation order differs at the edges for wrapped rows.
+					if(!(std::fabs(actual - expected) <= 1e-4f*(1 + std::fabs(expected))))
+						++numBad;
+				}
+			}
+		}
+		std::ostringstream msg;
+		msg << "level " << levelNum << " with filter width " << filterWidth
+			<< " has " << numBad << " mismatched samples";
+		BOOST_CHECK_MESSAGE(numBad == 0, msg.str());
+	}
+	BOOST_CHECK_EQUAL(levelNum, outFile->numSubImages());
+
+	boost::filesystem::remove(inName);
+	boost::filesystem::remove(outName);
+}
+
+} // unnamed namespace
+
+BOOST_AUTO_TEST_CASE(makeTexture_narrow_filter_test)
+{
+	checkMipmapMatchesInMemory(2, WrapMode_Black);
+}
+
+BOOST_AUTO_TEST_CASE(makeTexture_wide_filter_test)
+{
+	// Filters at least this wide start the second band part way through a
+	// tile row of the output.
+	checkMipmapMatchesInMemory(3, WrapMode_Periodic);
+	checkMipmapMatchesInMemory(4, WrapMode_Clamp);
+	checkMipmapMatchesInMemory(8, WrapMode_Black);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,352 @@
+#!/usr/bin/env python
+######################################################################
+# Render the example scenes as a performance benchmark.
+#
+# Each scene is copied into a scratch directory and rendered at a set
+# of resolutions and thread counts.  The wall time, peak resident
+# memory and the renderer statistics counters of every case are
+# written to a JSON results file (and optionally a CSV file), and are
+# compared against a baseline from an earlier run.  The script exits
+# with a non-zero status if any case is slower or uses more memory
+# than the baseline by more than the given threshold.
+#
+# Requirements:
+#
+# - Python 2.7 or 3.x
+# - A built aqsis, aqsl and teqser, and the compiled standard shaders
+#
+# See aqsis_benchmark.py -h for usage information.
+######################################################################
+
+import sys, os, os.path, re, shutil, subprocess, tempfile, time, json, csv
+import argparse
+
+# The benchmark scenes, relative to the examples directory.
+#
+# "setup" lists commands which prepare a scene for rendering (compiling
+# shaders which live with the scene and making textures).  They aren't
+# timed.  "renders" lists the RIB files which are rendered, in order;
+# the times and counters of all of them are added together.
+SCENES = [
+	{ "name": "vase", "dir": "scenes/vase",
+	  "renders": ["vase.rib"] },
+	{ "name": "microbe", "dir": "scenes/microbe",
+	  "renders": ["microbe.rib"] },
+	{ "name": "cornellbox", "dir": "point_based_gi/cornellbox",
+	  "setup": [["aqsl", "ao.sl"], ["aqsl", "bake_points.sl"],
+	            ["aqsl", "indirect.sl"]],
+	  "renders": ["all_passes.rib"] },
+	{ "name": "archives", "dir": "features/archives",
+	  "renders": ["bike.rib"] },
+	{ "name": "bake", "dir": "features/bake",
+	  "renders": ["bakesphere.rib",
+	              ["teqser", "-wrap=periodic", "-filter=mitchell", "-width=2.0",
+	               "-bake=128", "sphere.bake.bake", "sphere.bake.tex"],
+	              "sphere.rib"] },
+	{ "name": "curves", "dir": "features/curves",
+	  "renders": ["bezier.rib"] },
+	{ "name": "layeredshaders", "dir": "features/layeredshaders",
+	  "setup": [["teqser", "grid.tif", "grid.tex"], ["aqsl", "texmap.sl"]],
+	  "renders": ["layered.rib"] },
+	{ "name": "levelofdetail", "dir": "features/levelofdetail",
+	  "renders": ["detail.rib"] },
+	{ "name": "motionblur_camera", "dir": "features/motionblur",
+	  "renders": ["camera.rib"] },
+	{ "name": "motionblur_deformation", "dir": "features/motionblur",
+	  "renders": ["deformation.rib"] },
+	{ "name": "multipass", "dir": "features/multipass",
+	  "setup": [["aqsl", "myval.sl"]],
+	  "renders": ["aov.rib"] },
+	{ "name": "objectinstance", "dir": "features/objectinstance",
+	  "renders": ["singlepolygon.rib"] },
+	{ "name": "occlusion", "dir": "features/occlusion",
+	  "setup": [["aqsl", "envlight.sl"]],
+	  "renders": ["occlmap.rib", "simple.rib"] },
+	{ "name": "pointcloud", "dir": "features/pointcloud",
+	  "setup": [["aqsl", "envlight.sl"]],
+	  "renders": ["occlmap.rib", "simple.rib", "simple_texture3d.rib"] },
+	{ "name": "autoshadow", "dir": "features/shadows",
+	  "renders": ["autoshadow.rib"] },
+	{ "name": "softshadow", "dir": "features/shadows",
+	  "renders": ["softshadow.rib"] },
+	{ "name": "solidmodeling", "dir": "features/solidmodeling",
+	  "renders": ["csg.rib"] },
+	{ "name": "subdivision", "dir": "features/subdivision",
+	  "renders": ["creases.rib"] },
+	{ "name": "textures", "dir": "features/textures",
+	  "setup": [["teqser", "-wrap=periodic", "grid.tif", "grid.tex"]],
+	  "renders": ["sticky.rib"] },
+]
+
+# Framebuffer displays are replaced by file displays so that the
+# benchmark can run without a display server.
+FRAMEBUFFER_RE = re.compile(r'Display(\s+)"(\+?)([^"]*)"(\s+)"(z?)framebuffer"')
+
+
+def parseResolution(res):
+	m = re.match(r'^(\d+)x(\d+)$', res)
+	if not m:
+		raise argparse.ArgumentTypeError("resolution must be WIDTHxHEIGHT: %s" % res)
+	return (int(m.group(1)), int(m.group(2)))
+
+
+def prepareScene(scene, examplesDir, workDir, rcFile):
+	"""Copy a scene into a fresh scratch directory ready for rendering."""
+	sceneDir = os.path.join(workDir, scene["name"])
+	if os.path.exists(sceneDir):
+		shutil.rmtree(sceneDir)
+	shutil.copytree(os.path.join(examplesDir, scene["dir"]), sceneDir)
+	for name in os.listdir(sceneDir):
+		if not name.endswith(".rib"):
+			continue
+		path = os.path.join(sceneDir, name)
+		with open(path) as f:
+			rib = f.read()
+		rib = FRAMEBUFFER_RE.sub(r'Display\1"\2\3.framebuffer.tif"\4"\5file"', rib)
+		with open(path, "w") as f:
+			f.write(rib)
+	# aqsis reads .aqsisrc from the current directory; this allows the
+	# benchmark to use a renderer which hasn't been installed yet.
+	if rcFile:
+		shutil.copyfile(rcFile, os.path.join(sceneDir, ".aqsisrc"))
+	return sceneDir
+
+
+def runTool(args, cwd, log):
+	"""Run a command, returning the wall time and peak memory in kB."""
+	start = time.time()
+	proc = subprocess.Popen(args, cwd=cwd, stdout=log, stderr=subprocess.STDOUT)
+	peakRss = None
+	if hasattr(os, "wait4"):
+		pid, status, usage = os.wait4(proc.pid, 0)
+		proc.returncode = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -1
+		peakRss = usage.ru_maxrss
+		# ru_maxrss is in bytes on OS X and kB elsewhere.
+		if sys.platform == "darwin":
+			peakRss //= 1024
+	else:
+		proc.wait()
+	wallTime = time.time() - start
+	if proc.returncode != 0:
+		raise RuntimeError("command failed with status %d: %s"
+				% (proc.returncode, " ".join(args)))
+	return wallTime, peakRss
+
+
+def toolCommand(command, tools):
+	return [tools.get(command[0], command[0])] + command[1:]
+
+
+def addCounters(total, stats):
+	for name, value in stats.get("counters", {}).items():
+		total[name] = total.get(name, 0) + value
+	for name, timer in stats.get("timers", {}).items():
+		total["time:" + name] = total.get("time:" + name, 0) + timer["time"]
+
+
+def runCase(scene, sceneDir, res, threads, tools, opts, log):
+	"""Render one scene at one resolution and thread count."""
+	statsFile = "benchmark_stats.json"
+	best = None
+	for repeat in range(opts.repeat):
+		wallTime = 0.0
+		peakRss = None
+		counters = {}
+		for step in scene["renders"]:
+			if not isinstance(step, str):
+				runTool(toolCommand(step, tools), sceneDir, log)
+				continue
+			statsPath = os.path.join(sceneDir, statsFile)
+			if os.path.exists(statsPath):
+				os.remove(statsPath)
+			args = [tools["aqsis"], "-res", str(res[0]), str(res[1]),
+					'-option=Option "statistics" "filename" ["%s"]' % statsFile,
+					'-option=Option "limits" "threads" [%d]' % threads]
+			# Shaders compiled by the setup steps live with the scene.
+			if opts.shaders:
+				args.append("-shaders=.:%s:@" % opts.shaders)
+			if opts.displays:
+				args.append("-displays=" + opts.displays)
+			if opts.procedurals:
+				args.append("-procedurals=" + opts.procedurals)
+			args.append(step)
+			stepTime, stepRss = runTool(args, sceneDir, log)
+			wallTime += stepTime
+			if stepRss is not None:
+				peakRss = max(peakRss or 0, stepRss)
+			# Each frame overwrites the report, so a RIB with several
+			# frames contributes the counters of its last one.
+			if os.path.exists(statsPath):
+				with open(statsPath) as f:
+					addCounters(counters, json.load(f))
+		# Keep the fastest of the repeats, which is the least disturbed
+		# by other activity on the machine.
+		if best is None or wallTime < best["wall_time"]:
+			best = { "wall_time": wallTime, "peak_rss_kb": peakRss,
+					"counters": counters }
+	return best
+
+
+def compareResults(results, baseline, opts):
+	"""Compare results against a baseline.
+
+	Returns a list of failures, and a list of the cases which aren't in the
+	baseline yet.
+	"""
+	failures = []
+	missing = []
+	for name in sorted(results):
+		if name not in baseline:
+			print("%-40s no baseline, recording" % name)
+			missing.append(name)
+			continue
+		new = results[name]
+		old = baseline[name]
+		timeRatio = new["wall_time"] / max(old["wall_time"], 1e-6)
+		line = "%-40s time %8.3fs (%+6.1f%%)" % (name, new["wall_time"],
+				100.0*(timeRatio - 1))
+		if timeRatio > 1 + opts.threshold:
+			failures.append("%s: wall time %.3fs exceeds baseline %.3fs"
+					% (name, new["wall_time"], old["wall_time"]))
+		if new.get("peak_rss_kb") and old.get("peak_rss_kb"):
+			rssRatio = float(new["peak_rss_kb"]) / old["peak_rss_kb"]
+			line += "  memory %8dkB (%+6.1f%%)" % (new["peak_rss_kb"],
+					100.0*(rssRatio - 1))
+			if rssRatio > 1 + opts.memory_threshold:
+				failures.append("%s: peak memory %dkB exceeds baseline %dkB"
+						% (name, new["peak_rss_kb"], old["peak_rss_kb"]))
+		print(line)
+	return failures, missing
+
+
+def saveBaseline(fileName, baseline):
+	with open(fileName, "w") as f:
+		json.dump(baseline, f, indent=1, sort_keys=True)
+
+
+def writeCsv(fileName, results):
+	counterNames = sorted(set(n for r in results.values() for n in r["counters"]))
+	with open(fileName, "w") as f:
+		out = csv.writer(f)
+		out.writerow(["case", "wall_time", "peak_rss_kb"] + counterNames)
+		for name in sorted(results):
+			r = results[name]
+			out.writerow([name, "%.6f" % r["wall_time"], r["peak_rss_kb"]]
+					+ [r["counters"].get(n, "") for n in counterNames])
+
+
+def main():
+	scriptDir = os.path.dirname(os.path.abspath(__file__))
+	parser = argparse.ArgumentParser(
+			description="Render the aqsis example scenes and check for "
+			"performance regressions against a baseline.")
+	parser.add_argument("--aqsis", default="aqsis", help="aqsis executable")
+	parser.add_argument("--aqsl", default="aqsl", help="aqsl executable")
+	parser.add_argument("--teqser", default="teqser", help="teqser executable")
+	parser.add_argument("--examples",
+			default=os.path.join(scriptDir, "..", "..", "examples"),
+			help="directory containing the example scenes")
+	parser.add_argument("--shaders", help="shader searchpath for the standard shaders")
+	parser.add_argument("--displays", help="display searchpath")
+	parser.add_argument("--procedurals", help="procedural searchpath")
+	parser.add_argument("--rc", help="aqsisrc file to use in place of the installed one")
+	parser.add_argument("--workdir", default=os.path.join(tempfile.gettempdir(),
+			"aqsis_benchmark"), help="scratch directory for rendering")
+	parser.add_argument("--scene", action="append", dest="scenes",
+			help="scene to render, can be given several times (default: all)")
+	parser.add_argument("--resolution", action="append", type=parseResolution,
+			dest="resolutions", help="resolution as WIDTHxHEIGHT, can be given "
+			"several times (default: 320x240 and 640x480)")
+	parser.add_argument("--threads", action="append", type=int,
+			help="number of bucket threads, can be given several times (default: 1)")
+	parser.add_argument("--threading", action="store_true",
+			help="aqsis was built with AQSIS_ENABLE_THREADING; thread counts "
+			"other than 1 are rejected without it, since they'd be ignored")
+	parser.add_argument("--repeat", type=int, default=3,
+			help="number of times to render each case, keeping the fastest")
+	parser.add_argument("--output", default="benchmark_results.json",
+			help="JSON file for the results")
+	parser.add_argument("--csv", help="also write the results to a CSV file")
+	parser.add_argument("--baseline", help="JSON results to compare against")
+	parser.add_argument("--update-baseline", action="store_true",
+			help="write the results to the baseline instead of comparing; "
+			"cases missing from the baseline are always recorded")
+	parser.add_argument("--threshold", type=float, default=0.1,
+			help="allowed fractional increase in wall time")
+	parser.add_argument("--memory-threshold", type=float, default=0.1,
+			help="allowed fractional increase in peak memory")
+	parser.add_argument("--list", action="store_true", help="list the scenes and exit")
+	opts = parser.parse_args()
+
+	if opts.list:
+		for scene in SCENES:
+			print(scene["name"])
+		return 0
+	scenes = SCENES
+	if opts.scenes:
+		known = set(s["name"] for s in SCENES)
+		for name in opts.scenes:
+			if name not in known:
+				parser.error("unknown scene: %s" % name)
+		scenes = [s for s in SCENES if s["name"] in opts.scenes]
+	resolutions = opts.resolutions or [(320, 240), (640, 480)]
+	threadCounts = opts.threads or [1]
+	for threads in threadCounts:
+		if threads < 1 or (threads > 1 and not opts.threading):
+			parser.error("can't render with %d threads%s" % (threads,
+				"" if threads < 1 else " unless aqsis was built with threading"
+				" (see --threading)"))
+	tools = { "aqsis": opts.aqsis, "aqsl": opts.aqsl, "teqser": opts.teqser }
+
+	if not os.path.isdir(opts.workdir):
+		os.makedirs(opts.workdir)
+	logName = os.path.join(opts.workdir, "benchmark.log")
+	results = {}
+	with open(logName, "w") as log:
+		for scene in scenes:
+			try:
+				sceneDir = prepareScene(scene, opts.examples, opts.workdir, opts.rc)
+				for command in scene.get("setup", []):
+					runTool(toolCommand(command, tools), sceneDir, log)
+				for res in resolutions:
+					for threads in threadCounts:
+						name = "%s-%dx%d-t%d" % (scene["name"], res[0], res[1], threads)
+						log.write("=== %s\n" % name)
+						log.flush()
+						results[name] = runCase(scene, sceneDir, res, threads,
+								tools, opts, log)
+			except (RuntimeError, OSError) as e:
+				sys.stderr.write("%s: %s (see %s)\n" % (scene["name"], e, logName))
+				return 2
+
+	with open(opts.output, "w") as f:
+		json.dump(results, f, indent=1, sort_keys=True)
+	if opts.csv:
+		writeCsv(opts.csv, results)
+
+	if not opts.baseline:
+		return 0
+	baseline = {}
+	if os.path.exists(opts.baseline):
+		with open(opts.baseline) as f:
+			baseline = json.load(f)
+	if opts.update_baseline:
+		baseline.update(results)
+		saveBaseline(opts.baseline, baseline)
+		print("Recorded baseline in %s" % opts.baseline)
+		return 0
+	# Cases which aren't in the baseline yet are added to it, so scenes which
+	# are run separately each get recorded the first time they run.
+	failures, missing = compareResults(results, baseline, opts)
+	if missing:
+		for name in missing:
+			baseline[name] = results[name]
+		saveBaseline(opts.baseline, baseline)
+		print("Recorded new baseline cases in %s" % opts.baseline)
+	for failure in failures:
+		sys.stderr.write("REGRESSION: %s\n" % failure)
+	return 1 if failures else 0
+
+
+if __name__ == "__main__":
+	sys.exit(main())
@@ -92,6 +92,18 @@
 //      See function DspyImageOpen(), below, for a list of valid
 //      "exrpixeltype" and "exrcompression" values.
 //
+//      Display commands with the same file name are gathered into a
+//      single multi-channel file, with the channels of each display in
+//      a separate layer.
+//
+//      Images are written as tiled files, with each tile written as
+//      soon as all of its pixels have arrived from every layer, so only
+//      the rows of tiles currently being rendered are held in memory.
+//      Tiles which complete together are compressed in parallel by the
+//      OpenEXR thread pool.  The tile size and the number of threads
+//      can be set with the "exrtilesize" and "exrthreads" arguments;
+//      by default tiles are 64x64 and a thread is used per processor.
+//
 //-----------------------------------------------------------------------------
 
 #include <aqsis/aqsis.h>
@@ -99,12 +111,14 @@
 #include <assert.h>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
 
 // Lower the warning level to eliminate unavoidable warnings from the OpenEXR headers.
 #if AQSIS_SYSTEM_WIN32 && (defined(AQSIS_COMPILER_MSVC6) || defined(AQSIS_COMPILER_MSVC7))
 #	pragma warning(push,1)
 #endif
-#include <OpenEXR/ImfOutputFile.h>
+#include <OpenEXR/ImfTiledOutputFile.h>
+#include <OpenEXR/ImfThreading.h>
 #include <OpenEXR/ImfChannelList.h>
 #include <OpenEXR/ImfIntAttribute.h>
 #include <OpenEXR/ImfFloatAttribute.h>
@@ -181,6 +195,7 @@ class Image
 
 		Image (const char filename[],
 		       const Header &header);
+		~Image ();
 
 			  Header &      header ();
 		const Header &      header () const;
@@ -194,19 +209,38 @@ class Image
 		                                 const unsigned char *data,
 										 std::string layerName);
 		void				addLayer(SqImageLayer& layer);
+		/// Close a layer, returning the number of layers still open.
+		int					closeLayer(const std::string& layerName);
 		void				open();
 	private:
-
-		boost::shared_ptr<OutputFile>          _file;
+		/// Pixels for a row of tiles, which are written out as they fill up.
+		struct SqTileRow
+		{
+			std::vector<char>	data;
+			/// Pixels still to arrive for each tile over all layers, or -1
+			/// once the tile has been written.
+			std::vector<int>	pixelsRemaining;
+			int					tilesWritten;
+		};
+
+		SqTileRow&			tileRow (int tileY);
+		/// Write out complete tiles of a row in batches, or all unwritten ones if flush is set.
+		void				writeReadyTiles (int tileY, bool flush = false);
+		void				writeTiles (int tileY, SqTileRow& row,
+		                                int tileX1, int tileX2);
+
+		boost::shared_ptr<TiledOutputFile>          _file;
 		std::string			_fileName;
 		Header				_header;
-		Array <char>        _buffer;
-		std::map<int, std::vector<char> >	_scanlines;
-		std::map<int, int >	_scanlinesReceived;
 		int                 _bufferPixelSize;
-		int                 _bufferXMin;
-		int                 _bufferNumPixels;
+		int                 _tileSize;
+		int                 _numXTiles;
+		int                 _numYTiles;
+		std::map<int, SqTileRow>	_tileRows;
+		/// Rows of tiles which have been completely written and freed.
+		std::vector<bool>	_tileRowsDone;
 		LayerList			_layers;
+		int					_openLayers;
 };
 
 
@@ -225,11 +259,35 @@ Image::Image (const char filename[],
 		_fileName (filename),
 		_header (header),
 		_bufferPixelSize (0),
-		_bufferXMin (header.dataWindow().min.x),
-		_bufferNumPixels (header.dataWindow().max.x - _bufferXMin + 1)
+		_tileSize (header.tileDescription().xSize),
+		_numXTiles ((header.dataWindow().size().x + _tileSize) / _tileSize),
+		_numYTiles ((header.dataWindow().size().y + _tileSize) / _tileSize),
+		_tileRowsDone (_numYTiles, false),
+		_openLayers (0)
 {}
 
 
+Image::~Image ()
+{
+	if(!_file)
+		return;
+	try
+	{
+		// Fill in any tiles which never received all their pixels, eg. if
+		// the render was aborted, so that the file is complete.
+		for(int tileY = 0; tileY < _numYTiles; ++tileY)
+		{
+			if(!_tileRowsDone[tileY])
+				writeReadyTiles(tileY, true);
+		}
+	}
+	catch (const exception &e)
+	{
+		DspyError ("OpenEXR display driver", "%s\n", e.what());
+	}
+}
+
+
 void Image::addLayer(SqImageLayer& layer)
 {
 	// Insert the channels into the header
@@ -258,6 +316,14 @@ void Image::addLayer(SqImageLayer& layer)
 		}
 	}
 	_layers[layer.layerName] = layer;
+	++_openLayers;
+}
+
+int Image::closeLayer(const std::string& /*layerName*/)
+{
+	// The layer stays in the frame buffer until the file is closed, in
+	// case any tiles are still to be written.
+	return --_openLayers;
 }
 
 const Header &Image::header () const
@@ -283,16 +349,72 @@ const LayerList& Image::layers() const
 
 void Image::open()
 {
-	V2i dwSize = _header.dataWindow().size();
+	_file = boost::shared_ptr<TiledOutputFile>(new TiledOutputFile(_fileName.c_str(), _header));
+}
 
-	_buffer.resizeErase (_bufferNumPixels * _bufferPixelSize);
+Image::SqTileRow& Image::tileRow (int tileY)
+{
+	std::map<int, SqTileRow>::iterator row = _tileRows.find(tileY);
+	if(row != _tileRows.end())
+		return row->second;
+
+	V2i dwSize = _header.dataWindow().size() + V2i(1, 1);
+	SqTileRow& newRow = _tileRows[tileY];
+	newRow.data.resize(dwSize.x * _tileSize * _bufferPixelSize);
+	int tileHeight = std::min(_tileSize, dwSize.y - tileY * _tileSize);
+	for(int tileX = 0; tileX < _numXTiles; ++tileX)
+	{
+		int tileWidth = std::min(_tileSize, dwSize.x - tileX * _tileSize);
+		newRow.pixelsRemaining.push_back(tileWidth * tileHeight
+				* static_cast<int>(layers().size()));
+	}
+	newRow.tilesWritten = 0;
+	return newRow;
+}
 
-	FrameBuffer  fb;
-	int          yStride = 0;
-	char        *base = &_buffer[0] -
-	                    _bufferXMin * _bufferPixelSize;
+void Image::writeReadyTiles (int tileY, bool flush)
+{
+	// Don't bring back a row which has already been written out.
+	if(_tileRowsDone[tileY])
+		return;
+	SqTileRow& row = tileRow(tileY);
+	// Buckets are usually much smaller than tiles, so tiles tend to complete
+	// one at a time.  Hold complete tiles back until there's a run of them
+	// long enough to give every thread in the pool a tile to compress, or
+	// until nothing else in the row is still waiting for pixels.
+	bool waiting = false;
+	for(int tileX = 0; tileX < _numXTiles; ++tileX)
+		waiting = waiting || row.pixelsRemaining[tileX] > 0;
+	int minRun = (flush || !waiting) ? 1 : std::max(1, globalThreadCount());
+	int runStart = -1;
+	for(int tileX = 0; tileX <= _numXTiles; ++tileX)
+	{
+		bool ready = tileX < _numXTiles && (flush ? row.pixelsRemaining[tileX] >= 0
+				: row.pixelsRemaining[tileX] == 0);
+		if(ready && runStart < 0)
+			runStart = tileX;
+		else if(!ready && runStart >= 0)
+		{
+			if(tileX - runStart >= minRun)
+				writeTiles(tileY, row, runStart, tileX - 1);
+			runStart = -1;
+		}
+	}
+	if(row.tilesWritten == _numXTiles)
+	{
+		_tileRows.erase(tileY);
+		_tileRowsDone[tileY] = true;
+	}
+}
 
+void Image::writeTiles (int tileY, SqTileRow& row, int tileX1, int tileX2)
+{
+	const Box2i &dw = _header.dataWindow();
+	int rowStride = (dw.max.x - dw.min.x + 1) * _bufferPixelSize;
+	char *base = &row.data[0] - dw.min.x * _bufferPixelSize
+		- (dw.min.y + tileY * _tileSize) * rowStride;
 
+	FrameBuffer  fb;
 	for(LayerList::iterator layer = _layers.begin(), layerEnd = _layers.end(); layer != layerEnd; ++layer)
 	{
 		for(LayerChannelList::iterator chan = layer->second.channelList.begin(), chanEnd = layer->second.channelList.end(); chan != chanEnd; ++chan)
@@ -301,14 +423,17 @@ void Image::open()
 				Slice(chan->channel.type,
 				base + chan->bufferOffset,
 				_bufferPixelSize,
-				yStride,
+				rowStride,
 				1,
 				1));
 		}
 	}
-
-	_file = boost::shared_ptr<OutputFile>(new OutputFile(_fileName.c_str(), _header));
 	_file->setFrameBuffer (fb);
+	_file->writeTiles (tileX1, tileX2, tileY, tileY);
+
+	for(int tileX = tileX1; tileX <= tileX2; ++tileX)
+		row.pixelsRemaining[tileX] = -1;
+	row.tilesWritten += tileX2 - tileX1 + 1;
 }
 
 void
@@ -324,94 +449,98 @@ Image::writePixels (int xMin, int xMaxPlusone,
 	if(!_file)
 		open();
 
-	//
-	// We can only deal with one scan line at a time.
-	//
-
-	assert (yMin == yMaxPlusone - 1);
-
+	// Buckets can overlap the edge of a cropped image.
+	const Box2i &dw = _header.dataWindow();
+	int x0 = std::max(xMin, dw.min.x);
+	int x1 = std::min(xMaxPlusone, dw.max.x + 1);
+	int y0 = std::max(yMin, dw.min.y);
+	int y1 = std::min(yMaxPlusone, dw.max.y + 1);
+	if(x0 >= x1 || y0 >= y1)
+		return;
 
-	int      numPixels = xMaxPlusone - xMin;
-	int      j = 0;
-
-	char    *toBase;
-	int      toInc;
+	int      numPixels = x1 - x0;
+	int      bucketLineLength = entrySize * (xMaxPlusone - xMin);
+	int      width = dw.max.x - dw.min.x + 1;
+	SqImageLayer& layer = layers()[layerName];
 
 	//
-	// Copy the pixels into our internal scanline array, collating multiple layers
-	// before copying to the fb and then to the file.
+	// Copy the pixels into the row of tiles they belong to, collating
+	// multiple layers before writing the tiles to the file.
 	//
 
-	// If there is no scanline for this y position, allocate one now.
-	if(_scanlines.find(yMin) == _scanlines.end())
+	for(int y = y0; y < y1; ++y)
 	{
-		_scanlines[yMin].resize (_bufferNumPixels * _bufferPixelSize);
-		_scanlinesReceived[yMin] = 0;
-	}
+		int tileY = (y - dw.min.y) / _tileSize;
+		if(_tileRowsDone[tileY])
+			continue;
+		SqTileRow& row = tileRow(tileY);
+
+		char    *toBase = &row.data[(((y - dw.min.y) % _tileSize) * width
+				+ x0 - dw.min.x) * _bufferPixelSize];
+		int      toInc = _bufferPixelSize;
+		const unsigned char *fromBase = data + (y - yMin) * bucketLineLength
+				+ (x0 - xMin) * entrySize;
+		int      j = 0;
+
+		for(LayerChannelList::iterator i = layer.channelList.begin(), e = layer.channelList.end(); i != e; ++i)
+		{
+			const unsigned char *from = fromBase + i->dataOffset;
+			const unsigned char *end  = from + numPixels * entrySize;
 
-	toBase = &(_scanlines[yMin][0]) + _bufferPixelSize * xMin;
-	toInc = _bufferPixelSize;
+			char *to = toBase + i->bufferOffset;
 
-	for(LayerChannelList::iterator i = layers()[layerName].channelList.begin(), e = layers()[layerName].channelList.end(); i != e; ++i)
-	{
-		const unsigned char *from = data + i->dataOffset;
-		const unsigned char *end  = from + numPixels * entrySize;
+			switch (i->channel.type)
+			{
+					case HALF:
+					{
+						halfFunction <half> &lut = *layer.channelLuts[j];
 
-		char *to = toBase + i->bufferOffset;
+						while (from < end)
+						{
+							*(half *) to = lut( ( half )( *(float *) from ) );
+							from += entrySize;
+							to += toInc;
+						}
 
-		switch (i->channel.type)
-		{
-				case HALF:
-				{
-					halfFunction <half> &lut = *layers()[layerName].channelLuts[j];
+						break;
+					}
+
+					case FLOAT:
 
 					while (from < end)
 					{
-						*(half *) to = lut( ( half )( *(float *) from ) );
+						*(float *) to = *(float *) from;
 						from += entrySize;
 						to += toInc;
 					}
 
 					break;
-				}
-
-				case FLOAT:
-
-				while (from < end)
-				{
-					*(float *) to = *(float *) from;
-					from += entrySize;
-					to += toInc;
-				}
 
-				break;
+					default:
 
-				default:
+					assert (false);  // channel type is not currently supported
+					break;
+			}
 
-				assert (false);  // channel type is not currently supported
-				break;
+			++j;
 		}
 
-		++j;
+		for(int x = x0; x < x1; )
+		{
+			int tileX = (x - dw.min.x) / _tileSize;
+			int tileEnd = std::min(x1, dw.min.x + (tileX + 1) * _tileSize);
+			row.pixelsRemaining[tileX] -= tileEnd - x;
+			x = tileEnd;
+		}
 	}
 
+	//
+	// Write out any tiles which are now complete.
+	//
 
-	_scanlinesReceived[yMin] += numPixels;
-
-	if(_scanlinesReceived[yMin] == _bufferNumPixels*static_cast<int>(layers().size()))
-	{
-		//
-		// If our one-line frame buffer is full, then write it to
-		// the output file.
-		//
-		for(int i = 0; i < (_bufferNumPixels * _bufferPixelSize); ++i)
-			_buffer[i] = _scanlines[yMin][i];
-
-		_file->writePixels();
-
-		_scanlines.erase(yMin);
-		_scanlinesReceived.erase(yMin);
-	}
+	for(int tileY = (y0 - dw.min.y) / _tileSize, tileYEnd = (y1 - 1 - dw.min.y) / _tileSize;
+			tileY <= tileYEnd; ++tileY)
+		writeReadyTiles(tileY);
 }
 
 
@@ -433,6 +562,7 @@ extern "C"
 	               PtDspyDevFormat *format,
 	               PtFlagStuff *flagstuff)
 	{
+		flagstuff->flags = 0;
 		try
 		{
 			//
@@ -456,7 +586,6 @@ extern "C"
 			if(gImages.find(filename) != gImages.end())
 			{
 				image = gImages.find(filename);
-				flagstuff->flags |= PkDspyFlagsWantsScanLineOrder;
 			}
 			else
 			{
@@ -556,11 +685,33 @@ extern "C"
 				}
 
 				//
-				// Line order
+				// Tiling and line order.  Tiles are written in the order
+				// that buckets finish.
 				//
 
-				header.lineOrder() = INCREASING_Y;
-				flagstuff->flags |= PkDspyFlagsWantsScanLineOrder;
+				{
+					int tileSize = 64;
+					DspyFindIntInParamList ("exrtilesize", &tileSize, paramCount, parameters);
+					if (tileSize <= 0)
+						THROW (Iex::ArgExc,
+							   "Invalid exrtilesize " << tileSize << " "
+							   "for image file " << filename << ".");
+					header.setTileDescription (TileDescription (tileSize, tileSize, ONE_LEVEL));
+				}
+				header.lineOrder() = RANDOM_Y;
+
+				//
+				// Compression threads.  The thread pool is shared by all
+				// files, so only change it when no others are open.
+				//
+
+				if (gImages.empty())
+				{
+					int threads = boost::thread::hardware_concurrency();
+					DspyFindIntInParamList ("exrthreads", &threads, paramCount, parameters);
+					if (threads >= 0 && threads != globalThreadCount())
+						setGlobalThreadCount (threads);
+				}
 
 				//
 				// Compression
@@ -776,8 +927,7 @@ extern "C"
 			if(gImages.find(imageName) != gImages.end())
 			{
 				boost::shared_ptr<Image> image = gImages[imageName];
-				image->layers().erase(gImageLayers[imageLayerIndex].second);
-				if(image->layers().size() == 0)
+				if(image->closeLayer(gImageLayers[imageLayerIndex].second) == 0)
 					gImages.erase(imageName);
 			}
 		}
@@ -33,6 +33,8 @@
 #include <string>
 #include <fstream>
 #include <algorithm>
+#include <map>
+#include <vector>
 #include <float.h>
 #include <time.h>
 #include <cstring>
@@ -60,6 +62,21 @@ enum EqDisplayTypes
     Type_Shadowmap,
 };
 
+/// A tile or strip of the output image which is waiting for data.
+struct SqPendingBlock
+{
+	std::vector<TqUchar> data;
+	/// Number of pixels in the block which haven't been received yet.
+	TqInt	pixelsRemaining;
+};
+
+/** Data for an open display.
+ *
+ * Rather than holding on to the whole image until the display is closed, the
+ * output file is opened straight away, and each TIFF strip or tile is written
+ * as soon as all of its pixels have arrived.  zfiles are written directly to
+ * their place in the file.
+ */
 struct SqDisplayInstance
 {
 	SqDisplayInstance() :
@@ -76,7 +93,16 @@ struct SqDisplayInstance
 			m_imageType(Type_File),
 			m_append(0),
 			m_pixelsReceived(0),
-			m_data(0)
+			m_tiff(0),
+			m_zfile(),
+			m_zHeaderSize(0),
+			m_tiled(false),
+			m_blockWidth(0),
+			m_blockHeight(0),
+			m_blocksPerRow(0),
+			m_pendingBlocks(),
+			m_blockWritten(),
+			m_minZ(FLT_MAX)
 	{}
 	std::string	m_filename;
 	TqInt		m_width;
@@ -96,7 +122,22 @@ struct SqDisplayInstance
 	TqFloat		m_matWorldToScreen[ 4 ][ 4 ];
 	// The number of pixels that have already been rendered (used for progress reporting)
 	TqInt		m_pixelsReceived;
-	void*		m_data;
+	/// Output file for TIFF and shadowmap images.
+	TIFF*		m_tiff;
+	/// Output file for zfile images.
+	std::ofstream	m_zfile;
+	std::streamoff	m_zHeaderSize;
+	/// Whether the TIFF is tiled or written in strips.
+	bool		m_tiled;
+	/// Size of the strips or tiles in pixels.
+	TqInt		m_blockWidth;
+	TqInt		m_blockHeight;
+	TqInt		m_blocksPerRow;
+	/// Strips or tiles which have been partially received, by index.
+	std::map<TqInt, SqPendingBlock> m_pendingBlocks;
+	std::vector<bool>	m_blockWritten;
+	/// Minimum depth seen so far for shadowmaps.
+	TqDouble	m_minZ;
 };
 //------------------------------------------------------------------------------
 
@@ -106,310 +147,381 @@ static time_t start;
 static std::string description;
 
 //----------------------------------------------------------------------
-/** SaveAsShadowMap() Save as a tiff an shadowmap
+/** SetDateTime() Fill in the datetime string with the current time.
 *
 */
 
-void SaveAsShadowMap(const std::string& filename, SqDisplayInstance* image, char *mydescription)
+time_t SetDateTime()
 {
-	TqChar version[ 80 ];
-	TqUint twidth = 32;
-	TqUint tlength = 32;
-
-	struct tm *ct;
-	int year;
-
 	time_t long_time;
 
 	time( &long_time );           /* Get time as long integer. */
-	ct = localtime( &long_time ); /* Convert to local time. */
+	struct tm *ct = localtime( &long_time ); /* Convert to local time. */
 
-
-	year=1900 + ct->tm_year;
+	int year=1900 + ct->tm_year;
 	sprintf(datetime, "%04d:%02d:%02d %02d:%02d:%02d", year, ct->tm_mon + 1,
 	        ct->tm_mday, ct->tm_hour, ct->tm_min, ct->tm_sec);
+	return long_time;
+}
 
+//----------------------------------------------------------------------
+/** OpenShadowMap() Open a tiff shadowmap ready to receive tiles.
+*
+*/
+
+bool OpenShadowMap(const std::string& filename, SqDisplayInstance* image)
+{
+	TqChar version[ 80 ];
+	TqUint twidth = 32;
+	TqUint tlength = 32;
 
 	const char* mode = (image->m_append)? "a" : "w";
 
-	// Save the shadowmap to a binary file.
-	if ( filename.compare( "" ) != 0 )
-	{
-		TIFF * pshadow = TIFFOpen( filename.c_str(), mode );
-		if( pshadow != NULL )
-		{
-			// Set common tags
-			TIFFCreateDirectory( pshadow );
-
-			sprintf( version, "Aqsis %s (%s %s)", AQSIS_VERSION_STR, __DATE__, __TIME__);
-
-			TIFFSetField( pshadow, TIFFTAG_SOFTWARE, ( char* ) version );
-			TIFFSetField( pshadow, TIFFTAG_PIXAR_MATRIX_WORLDTOCAMERA, image->m_matWorldToCamera );
-			TIFFSetField( pshadow, TIFFTAG_PIXAR_MATRIX_WORLDTOSCREEN, image->m_matWorldToScreen );
-			TIFFSetField( pshadow, TIFFTAG_PIXAR_TEXTUREFORMAT, SHADOWMAP_HEADER );
-			TIFFSetField( pshadow, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK );
-
-			if (!image->m_hostname.empty())
-				TIFFSetField( pshadow, TIFFTAG_HOSTCOMPUTER, image->m_hostname.c_str() );
-			TIFFSetField( pshadow, TIFFTAG_IMAGEDESCRIPTION, mydescription);
-			// Write the floating point image to the directory.
-			TIFFSetField( pshadow, TIFFTAG_IMAGEWIDTH, image->m_width );
-			TIFFSetField( pshadow, TIFFTAG_IMAGELENGTH, image->m_height );
-			TIFFSetField( pshadow, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG );
-			TIFFSetField( pshadow, TIFFTAG_BITSPERSAMPLE, 32 );
-			TIFFSetField( pshadow, TIFFTAG_SAMPLESPERPIXEL, image->m_iFormatCount );
-			TIFFSetField( pshadow, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT );
-			TIFFSetField( pshadow, TIFFTAG_TILEWIDTH, twidth );
-			TIFFSetField( pshadow, TIFFTAG_TILELENGTH, tlength );
-			TIFFSetField( pshadow, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP );
-			TIFFSetField( pshadow, TIFFTAG_COMPRESSION, image->m_compression );
-			TIFFSetField( pshadow, TIFFTAG_DATETIME, datetime);
-
-			TqDouble minz = FLT_MAX;
-			TqFloat* ptdata = reinterpret_cast<TqFloat*>(image->m_data) ;
-			for (TqInt y = 0; y < image->m_height; y++)
-				for (TqInt x = 0; x < image->m_width; x++)
-				{
-					TqDouble value = (TqDouble) ptdata[y*image->m_width + x];
-					if (value < minz) minz = value;	
-				}
-			TIFFSetField( pshadow, TIFFTAG_SMINSAMPLEVALUE, minz );
+	if ( filename.compare( "" ) == 0 )
+		return false;
+	TIFF * pshadow = TIFFOpen( filename.c_str(), mode );
+	if( pshadow == NULL )
+		return false;
 
-			TqUint tsize = twidth * tlength;
-			TqUint tperrow = ( image->m_width + twidth - 1 ) / twidth;
-			TqFloat* ptile = static_cast<TqFloat*>( _TIFFmalloc( tsize * sizeof( TqFloat ) ) );
+	// Set common tags
+	TIFFCreateDirectory( pshadow );
+
+	sprintf( version, "Aqsis %s (%s %s)", AQSIS_VERSION_STR, __DATE__, __TIME__);
+
+	TIFFSetField( pshadow, TIFFTAG_SOFTWARE, ( char* ) version );
+	TIFFSetField( pshadow, TIFFTAG_PIXAR_MATRIX_WORLDTOCAMERA, image->m_matWorldToCamera );
+	TIFFSetField( pshadow, TIFFTAG_PIXAR_MATRIX_WORLDTOSCREEN, image->m_matWorldToScreen );
+	TIFFSetField( pshadow, TIFFTAG_PIXAR_TEXTUREFORMAT, SHADOWMAP_HEADER );
+	TIFFSetField( pshadow, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK );
+
+	if (!image->m_hostname.empty())
+		TIFFSetField( pshadow, TIFFTAG_HOSTCOMPUTER, image->m_hostname.c_str() );
+	// Write the floating point image to the directory.
+	TIFFSetField( pshadow, TIFFTAG_IMAGEWIDTH, image->m_width );
+	TIFFSetField( pshadow, TIFFTAG_IMAGELENGTH, image->m_height );
+	TIFFSetField( pshadow, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG );
+	TIFFSetField( pshadow, TIFFTAG_BITSPERSAMPLE, 32 );
+	TIFFSetField( pshadow, TIFFTAG_SAMPLESPERPIXEL, image->m_iFormatCount );
+	TIFFSetField( pshadow, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT );
+	TIFFSetField( pshadow, TIFFTAG_TILEWIDTH, twidth );
+	TIFFSetField( pshadow, TIFFTAG_TILELENGTH, tlength );
+	TIFFSetField( pshadow, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP );
+	TIFFSetField( pshadow, TIFFTAG_COMPRESSION, image->m_compression );
+
+	image->m_tiff = pshadow;
+	image->m_tiled = true;
+	image->m_blockWidth = twidth;
+	image->m_blockHeight = tlength;
+	return true;
+}
 
+//----------------------------------------------------------------------
+/** OpenTIFF() Open a tiff ready to receive the output of the renderer in strips.
+*
+*/
 
-			if ( ptile != NULL )
-			{
-				TqUint ctiles = tperrow * ( ( image->m_width + tlength - 1 ) / tlength );
-				TqUint itile;
-				for ( itile = 0; itile < ctiles; itile++ )
-				{
-					TqUint x = ( itile % tperrow ) * twidth;
-					TqUint y = ( itile / tperrow ) * tlength;
-					ptdata = reinterpret_cast<TqFloat*>(image->m_data) + ( ( y * image->m_width ) + x ) * image->m_iFormatCount;
-					// Clear the tile to black.
-					memset( ptile, 0, tsize * sizeof( TqFloat ) );
-					for ( TqUlong i = 0; i < tlength; i++ )
-					{
-						for ( TqUlong j = 0; j < twidth; j++ )
-						{
-							if ( ( x + j ) < (TqUlong) image->m_width && ( y + i ) < (TqUlong) image->m_height )
-							{
-								TqInt ii;
-								for ( ii = 0; ii < image->m_iFormatCount; ii++ ) 
-								{
-									TqFloat value = ptdata[ ( ( j * image->m_iFormatCount ) + ii ) ];
-									ptile[ ( i * twidth * image->m_iFormatCount ) + ( ( ( j * image->m_iFormatCount ) + ii ) ) ] = value;
-								}
-							}
-						}
-						ptdata += ( image->m_width * image->m_iFormatCount );
-					}
-					TIFFWriteTile( pshadow, ptile, x, y, 0, 0 );
-				}
-				TIFFWriteDirectory( pshadow );
+bool OpenTIFF(const std::string& filename, SqDisplayInstance* image)
+{
+	uint16_t photometric = PHOTOMETRIC_RGB;
+	uint16_t config = PLANARCONFIG_CONTIG;
 
-			}
+	TIFF* pOut = TIFFOpen( filename.c_str(), "w" );
+	if ( !pOut )
+		return false;
+
+	char version[ 80 ];
+
+	short ExtraSamplesTypes[ 1 ] = {EXTRASAMPLE_ASSOCALPHA};
+
+	sprintf( version, "Aqsis %s (%s %s)", AQSIS_VERSION_STR, __DATE__, __TIME__);
+	bool use_logluv = false;
+
+	TIFFSetField( pOut, TIFFTAG_SOFTWARE, ( char* ) version );
+	TIFFSetField( pOut, TIFFTAG_IMAGEWIDTH, ( uint32_t ) image->m_width );
+	TIFFSetField( pOut, TIFFTAG_IMAGELENGTH, ( uint32_t ) image->m_height );
+	TIFFSetField( pOut, TIFFTAG_RESOLUTIONUNIT, RESUNIT_NONE );
+	TIFFSetField( pOut, TIFFTAG_XRESOLUTION, (float) 1.0 );
+	TIFFSetField( pOut, TIFFTAG_YRESOLUTION, (float) 1.0 );
+	TIFFSetField( pOut, TIFFTAG_BITSPERSAMPLE, (short) 8 );
+	TIFFSetField( pOut, TIFFTAG_PIXAR_MATRIX_WORLDTOCAMERA, image->m_matWorldToCamera );
+	TIFFSetField( pOut, TIFFTAG_PIXAR_MATRIX_WORLDTOSCREEN, image->m_matWorldToScreen );
+	TIFFSetField( pOut, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT );
+	TIFFSetField( pOut, TIFFTAG_SAMPLESPERPIXEL, image->m_iFormatCount );
+	if (!image->m_hostname.empty())
+		TIFFSetField( pOut, TIFFTAG_HOSTCOMPUTER, image->m_hostname.c_str() );
+
+	// Set the position tages in case we aer dealing with a cropped image.
+	TIFFSetField( pOut, TIFFTAG_XPOSITION, ( float ) image->m_origin[0] );
+	TIFFSetField( pOut, TIFFTAG_YPOSITION, ( float ) image->m_origin[1] );
+	TIFFSetField( pOut, TIFFTAG_PIXAR_IMAGEFULLWIDTH, ( uint32_t ) image->m_OriginalSize[0] );
+	TIFFSetField( pOut, TIFFTAG_PIXAR_IMAGEFULLLENGTH, ( uint32_t ) image->m_OriginalSize[1] );
+
+	// Write out an 8 bits per pixel integer image.
+	if ( image->m_format == PkDspyUnsigned8 )
+	{
+		TIFFSetField( pOut, TIFFTAG_BITSPERSAMPLE, 8 );
+		TIFFSetField( pOut, TIFFTAG_PLANARCONFIG, config );
+		TIFFSetField( pOut, TIFFTAG_COMPRESSION, image->m_compression );
+		if ( image->m_compression == COMPRESSION_JPEG )
+			TIFFSetField( pOut, TIFFTAG_JPEGQUALITY, image->m_quality );
+		TIFFSetField( pOut, TIFFTAG_PHOTOMETRIC, photometric );
+
+		if ( image->m_iFormatCount == 4 )
+			TIFFSetField( pOut, TIFFTAG_EXTRASAMPLES, 1, ExtraSamplesTypes );
+	}
+	else
+	{
+		// Write out a floating point image.
+		TIFFSetField( pOut, TIFFTAG_STONITS, ( double ) 1.0 );
+
+		//			if(/* user wants logluv compression*/)
+		//			{
+		//				if(/* user wants to save the alpha channel */)
+		//				{
+		//					warn("SGI LogLuv encoding does not allow an alpha channel"
+		//							" - using uncompressed IEEEFP instead");
+		//				}
+		//				else
+		//				{
+		//					use_logluv = true;
+		//				}
+		//
+		//				if(/* user wants LZW compression*/)
+		//				{
+		//					warn("LZW compression is not available with SGI LogLuv encoding\n");
+		//				}
+		//			}
+
+		if ( use_logluv )
+		{
+			/* use SGI LogLuv compression */
+			TIFFSetField( pOut, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT );
+			TIFFSetField( pOut, TIFFTAG_BITSPERSAMPLE, 16 );
+			TIFFSetField( pOut, TIFFTAG_COMPRESSION, COMPRESSION_SGILOG );
+			TIFFSetField( pOut, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_LOGLUV );
+			TIFFSetField( pOut, TIFFTAG_SGILOGDATAFMT, SGILOGDATAFMT_FLOAT );
+		}
+		else
+		{
+			/* use uncompressed IEEEFP pixels */
+			TIFFSetField( pOut, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP );
+			TIFFSetField( pOut, TIFFTAG_BITSPERSAMPLE, 32 );
+			TIFFSetField( pOut, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB );
+			TIFFSetField( pOut, TIFFTAG_COMPRESSION, image->m_compression );
+		}
+		if (image->m_format == PkDspyUnsigned16)
+		{
+			TIFFSetField( pOut, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT );
+			TIFFSetField( pOut, TIFFTAG_BITSPERSAMPLE, 16 );
+		}
 
+		TIFFSetField( pOut, TIFFTAG_SAMPLESPERPIXEL, image->m_iFormatCount );
 
-			TIFFClose( pshadow );
-		}
+		if ( image->m_iFormatCount == 4 )
+			TIFFSetField( pOut, TIFFTAG_EXTRASAMPLES, 1, ExtraSamplesTypes );
+		TIFFSetField( pOut, TIFFTAG_PLANARCONFIG, config );
 	}
+
+	uint32_t rowsPerStrip = TIFFDefaultStripSize( pOut, 0 );
+	TIFFSetField( pOut, TIFFTAG_ROWSPERSTRIP, rowsPerStrip );
+
+	image->m_tiff = pOut;
+	image->m_tiled = false;
+	image->m_blockWidth = image->m_width;
+	image->m_blockHeight = rowsPerStrip;
+	return true;
 }
 
 //----------------------------------------------------------------------
-/** WriteTIFF() Save as a tiff the output of the renderer
+/** OpenZFile() Open a zfile and write its header.
 *
 */
 
-void WriteTIFF(const std::string& filename, SqDisplayInstance* image)
+bool OpenZFile(const std::string& filename, SqDisplayInstance* image)
 {
-	uint16_t photometric = PHOTOMETRIC_RGB;
-	uint16_t config = PLANARCONFIG_CONTIG;
-	struct tm *ct;
-	char mydescription[80];
-	int year;
-
-	time_t long_time;
-
-	time( &long_time );           /* Get time as long integer. */
-	ct = localtime( &long_time ); /* Convert to local time. */
+	std::ofstream& ofile = image->m_zfile;
+	ofile.open( filename.c_str(), std::ios::out | std::ios::binary );
+	if ( !ofile.is_open() )
+		return false;
+
+	// Save a file type and version marker
+	ofile << ZFILE_HEADER;
+
+	// Save the xres and yres.
+	ofile.write( reinterpret_cast<char* >( &image->m_width ), sizeof( image->m_width ) );
+	ofile.write( reinterpret_cast<char* >( &image->m_height ), sizeof( image->m_height ) );
+
+	// Save the transformation matrices.
+	ofile.write( reinterpret_cast<char*>( image->m_matWorldToCamera[ 0 ] ), sizeof( image->m_matWorldToCamera[ 0 ][ 0 ] ) * 4 );
+	ofile.write( reinterpret_cast<char*>( image->m_matWorldToCamera[ 1 ] ), sizeof( image->m_matWorldToCamera[ 0 ][ 0 ] ) * 4 );
+	ofile.write( reinterpret_cast<char*>( image->m_matWorldToCamera[ 2 ] ), sizeof( image->m_matWorldToCamera[ 0 ][ 0 ] ) * 4 );
+	ofile.write( reinterpret_cast<char*>( image->m_matWorldToCamera[ 3 ] ), sizeof( image->m_matWorldToCamera[ 0 ][ 0 ] ) * 4 );
+
+	ofile.write( reinterpret_cast<char*>( image->m_matWorldToScreen[ 0 ] ), sizeof( image->m_matWorldToScreen[ 0 ][ 0 ] ) * 4 );
+	ofile.write( reinterpret_cast<char*>( image->m_matWorldToScreen[ 1 ] ), sizeof( image->m_matWorldToScreen[ 0 ][ 0 ] ) * 4 );
+	ofile.write( reinterpret_cast<char*>( image->m_matWorldToScreen[ 2 ] ), sizeof( image->m_matWorldToScreen[ 0 ][ 0 ] ) * 4 );
+	ofile.write( reinterpret_cast<char*>( image->m_matWorldToScreen[ 3 ] ), sizeof( image->m_matWorldToScreen[ 0 ][ 0 ] ) * 4 );
+
+	// The depth values follow, and are written as they arrive.
+	image->m_zHeaderSize = ofile.tellp();
+	return true;
+}
 
+//----------------------------------------------------------------------
+/** OpenOutput() Open the output file for the display type.
+*
+*/
 
-	year=1900 + ct->tm_year;
-	sprintf(datetime, "%04d:%02d:%02d %02d:%02d:%02d", year, ct->tm_mon + 1,
-	        ct->tm_mday, ct->tm_hour, ct->tm_min, ct->tm_sec);
+bool OpenOutput(SqDisplayInstance* image)
+{
+	if( image->m_imageType == Type_ZFile )
+		return OpenZFile(image->m_filename, image);
 
-	if (description.empty())
+	bool opened = false;
+	if( image->m_imageType == Type_Shadowmap )
+		opened = OpenShadowMap(image->m_filename, image);
+	else
+		opened = OpenTIFF(image->m_filename, image);
+	if( opened )
 	{
-		double nSecs = difftime(long_time, start);
-		sprintf(mydescription,"Aqsis Renderer, %d secs rendertime", static_cast<TqInt>(nSecs));
-		start = long_time;
+		image->m_blocksPerRow = ( image->m_width + image->m_blockWidth - 1 ) / image->m_blockWidth;
+		TqInt blockRows = ( image->m_height + image->m_blockHeight - 1 ) / image->m_blockHeight;
+		image->m_blockWritten.assign( image->m_blocksPerRow * blockRows, false );
 	}
+	return opened;
+}
+
+//----------------------------------------------------------------------
+/** WriteBlock() Write a complete strip or tile to the tiff.
+*
+*/
+
+void WriteBlock(SqDisplayInstance* image, TqInt index, SqPendingBlock& block)
+{
+	if ( image->m_tiled )
+		TIFFWriteEncodedTile( image->m_tiff, index, &block.data[0], block.data.size() );
 	else
 	{
-		strcpy(mydescription, description.c_str());
+		TqInt rows = min( image->m_blockHeight, image->m_height - index * image->m_blockHeight );
+		TIFFWriteEncodedStrip( image->m_tiff, index, &block.data[0], rows * image->m_lineLength );
 	}
+	image->m_blockWritten[index] = true;
+}
 
+//----------------------------------------------------------------------
+/** StoreRow() Store a run of pixels from one row of the image.
+*
+* Any strips or tiles completed by the pixels are written out straight away.
+*/
 
-	// Set common tags
-	// If in "shadowmap" mode, write as a shadowmap.
-	if( image->m_imageType == Type_Shadowmap )
+void StoreRow(SqDisplayInstance* image, TqInt x, TqInt y, TqInt count, const TqUchar* data)
+{
+	if( image->m_imageType == Type_ZFile )
 	{
-		SaveAsShadowMap(filename, image, mydescription);
+		image->m_zfile.seekp( image->m_zHeaderSize + ( y * image->m_width + x ) * image->m_entrySize );
+		image->m_zfile.write( reinterpret_cast<const char*>( data ), count * image->m_entrySize );
 		return;
 	}
-	else if( image->m_imageType == Type_ZFile )
+	if( image->m_imageType == Type_Shadowmap )
 	{
-		std::ofstream ofile( filename.c_str(), std::ios::out | std::ios::binary );
-		if ( ofile.is_open() )
+		const TqFloat* depths = reinterpret_cast<const TqFloat*>( data );
+		for ( TqInt i = 0; i < count; i++ )
 		{
-			// Save a file type and version marker
-			ofile << ZFILE_HEADER;
-
-			// Save the xres and yres.
-			ofile.write( reinterpret_cast<char* >( &image->m_width ), sizeof( image->m_width ) );
-			ofile.write( reinterpret_cast<char* >( &image->m_height ), sizeof( image->m_height ) );
-
-			// Save the transformation matrices.
-			ofile.write( reinterpret_cast<char*>( image->m_matWorldToCamera[ 0 ] ), sizeof( image->m_matWorldToCamera[ 0 ][ 0 ] ) * 4 );
-			ofile.write( reinterpret_cast<char*>( image->m_matWorldToCamera[ 1 ] ), sizeof( image->m_matWorldToCamera[ 0 ][ 0 ] ) * 4 );
-			ofile.write( reinterpret_cast<char*>( image->m_matWorldToCamera[ 2 ] ), sizeof( image->m_matWorldToCamera[ 0 ][ 0 ] ) * 4 );
-			ofile.write( reinterpret_cast<char*>( image->m_matWorldToCamera[ 3 ] ), sizeof( image->m_matWorldToCamera[ 0 ][ 0 ] ) * 4 );
-
-			ofile.write( reinterpret_cast<char*>( image->m_matWorldToScreen[ 0 ] ), sizeof( image->m_matWorldToScreen[ 0 ][ 0 ] ) * 4 );
-			ofile.write( reinterpret_cast<char*>( image->m_matWorldToScreen[ 1 ] ), sizeof( image->m_matWorldToScreen[ 0 ][ 0 ] ) * 4 );
-			ofile.write( reinterpret_cast<char*>( image->m_matWorldToScreen[ 2 ] ), sizeof( image->m_matWorldToScreen[ 0 ][ 0 ] ) * 4 );
-			ofile.write( reinterpret_cast<char*>( image->m_matWorldToScreen[ 3 ] ), sizeof( image->m_matWorldToScreen[ 0 ][ 0 ] ) * 4 );
-
-			// Now output the depth values
-			ofile.write( reinterpret_cast<char*>( image->m_data ), sizeof( TqFloat ) * ( image->m_width * image->m_height ) );
-			ofile.close();
+			TqDouble value = depths[ i * image->m_iFormatCount ];
+			if ( value < image->m_minZ ) image->m_minZ = value;
 		}
-		return;
 	}
 
-	TIFF* pOut = TIFFOpen( filename.c_str(), "w" );
-
-	if ( pOut )
+	TqInt blockY = y / image->m_blockHeight;
+	TqInt y0 = blockY * image->m_blockHeight;
+	while ( count > 0 )
 	{
-		// Write the image to a tiff file.
-		char version[ 80 ];
-
-		short ExtraSamplesTypes[ 1 ] = {EXTRASAMPLE_ASSOCALPHA};
-
-		sprintf( version, "Aqsis %s (%s %s)", AQSIS_VERSION_STR, __DATE__, __TIME__);
-		bool use_logluv = false;
-
-		TIFFSetField( pOut, TIFFTAG_SOFTWARE, ( char* ) version );
-		TIFFSetField( pOut, TIFFTAG_IMAGEWIDTH, ( uint32_t ) image->m_width );
-		TIFFSetField( pOut, TIFFTAG_IMAGELENGTH, ( uint32_t ) image->m_height );
-		TIFFSetField( pOut, TIFFTAG_RESOLUTIONUNIT, RESUNIT_NONE );
-		TIFFSetField( pOut, TIFFTAG_XRESOLUTION, (float) 1.0 );
-		TIFFSetField( pOut, TIFFTAG_YRESOLUTION, (float) 1.0 );
-		TIFFSetField( pOut, TIFFTAG_BITSPERSAMPLE, (short) 8 );
-		TIFFSetField( pOut, TIFFTAG_PIXAR_MATRIX_WORLDTOCAMERA, image->m_matWorldToCamera );
-		TIFFSetField( pOut, TIFFTAG_PIXAR_MATRIX_WORLDTOSCREEN, image->m_matWorldToScreen );
-		TIFFSetField( pOut, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT );
-		TIFFSetField( pOut, TIFFTAG_SAMPLESPERPIXEL, image->m_iFormatCount );
-		TIFFSetField( pOut, TIFFTAG_DATETIME, datetime);
-		if (!image->m_hostname.empty())
-			TIFFSetField( pOut, TIFFTAG_HOSTCOMPUTER, image->m_hostname.c_str() );
-		TIFFSetField( pOut, TIFFTAG_IMAGEDESCRIPTION, mydescription);
-
-		// Set the position tages in case we aer dealing with a cropped image.
-		TIFFSetField( pOut, TIFFTAG_XPOSITION, ( float ) image->m_origin[0] );
-		TIFFSetField( pOut, TIFFTAG_YPOSITION, ( float ) image->m_origin[1] );
-		TIFFSetField( pOut, TIFFTAG_PIXAR_IMAGEFULLWIDTH, ( uint32_t ) image->m_OriginalSize[0] );
-		TIFFSetField( pOut, TIFFTAG_PIXAR_IMAGEFULLLENGTH, ( uint32_t ) image->m_OriginalSize[1] );
-
-		// Write out an 8 bits per pixel integer image.
-		if ( image->m_format == PkDspyUnsigned8 )
-		{
-			TIFFSetField( pOut, TIFFTAG_BITSPERSAMPLE, 8 );
-			TIFFSetField( pOut, TIFFTAG_PLANARCONFIG, config );
-			TIFFSetField( pOut, TIFFTAG_COMPRESSION, image->m_compression );
-			if ( image->m_compression == COMPRESSION_JPEG )
-				TIFFSetField( pOut, TIFFTAG_JPEGQUALITY, image->m_quality );
-			TIFFSetField( pOut, TIFFTAG_PHOTOMETRIC, photometric );
-			TIFFSetField( pOut, TIFFTAG_ROWSPERSTRIP, TIFFDefaultStripSize( pOut, 0 ) );
-
-			if ( image->m_iFormatCount == 4 )
-				TIFFSetField( pOut, TIFFTAG_EXTRASAMPLES, 1, ExtraSamplesTypes );
+		TqInt blockX = x / image->m_blockWidth;
+		TqInt x0 = blockX * image->m_blockWidth;
+		TqInt n = min( count, x0 + image->m_blockWidth - x );
+		TqInt index = blockY * image->m_blocksPerRow + blockX;
 
-			TqInt row;
-			for ( row = 0; row < image->m_height; row++ )
-			{
-				if ( TIFFWriteScanline( pOut, reinterpret_cast<void*>(reinterpret_cast<char*>(image->m_data) + ( row * image->m_lineLength ))
-				                        , row, 0 ) < 0 )
-					break;
-			}
-			TIFFClose( pOut );
+		std::map<TqInt, SqPendingBlock>::iterator pending = image->m_pendingBlocks.find( index );
+		if ( pending == image->m_pendingBlocks.end() )
+		{
+			// Tiles hanging off the edge of the image are padded with black.
+			pending = image->m_pendingBlocks.insert( std::make_pair( index, SqPendingBlock() ) ).first;
+			pending->second.data.assign( image->m_blockWidth * image->m_blockHeight * image->m_entrySize, 0 );
+			pending->second.pixelsRemaining = min( image->m_blockWidth, image->m_width - x0 )
+				* min( image->m_blockHeight, image->m_height - y0 );
 		}
-		else
+		SqPendingBlock& block = pending->second;
+		memcpy( &block.data[ ( ( y - y0 ) * image->m_blockWidth + x - x0 ) * image->m_entrySize ],
+		        data, n * image->m_entrySize );
+		block.pixelsRemaining -= n;
+		if ( block.pixelsRemaining <= 0 )
 		{
-			// Write out a floating point image.
-			TIFFSetField( pOut, TIFFTAG_STONITS, ( double ) 1.0 );
-
-			//			if(/* user wants logluv compression*/)
-			//			{
-			//				if(/* user wants to save the alpha channel */)
-			//				{
-			//					warn("SGI LogLuv encoding does not allow an alpha channel"
-			//							" - using uncompressed IEEEFP instead");
-			//				}
-			//				else
-			//				{
-			//					use_logluv = true;
-			//				}
-			//
-			//				if(/* user wants LZW compression*/)
-			//				{
-			//					warn("LZW compression is not available with SGI LogLuv encoding\n");
-			//				}
-			//			}
-
-			if ( use_logluv )
-			{
-				/* use SGI LogLuv compression */
-				TIFFSetField( pOut, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT );
-				TIFFSetField( pOut, TIFFTAG_BITSPERSAMPLE, 16 );
-				TIFFSetField( pOut, TIFFTAG_COMPRESSION, COMPRESSION_SGILOG );
-				TIFFSetField( pOut, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_LOGLUV );
-				TIFFSetField( pOut, TIFFTAG_SGILOGDATAFMT, SGILOGDATAFMT_FLOAT );
-			}
-			else
-			{
-				/* use uncompressed IEEEFP pixels */
-				TIFFSetField( pOut, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP );
-				TIFFSetField( pOut, TIFFTAG_BITSPERSAMPLE, 32 );
-				TIFFSetField( pOut, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB );
-				TIFFSetField( pOut, TIFFTAG_COMPRESSION, image->m_compression );
-			}
-			if (image->m_format == PkDspyUnsigned16)
-			{
-				TIFFSetField( pOut, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_UINT );
-				TIFFSetField( pOut, TIFFTAG_BITSPERSAMPLE, 16 );
-			}
+			WriteBlock( image, index, block );
+			image->m_pendingBlocks.erase( pending );
+		}
 
-			TIFFSetField( pOut, TIFFTAG_SAMPLESPERPIXEL, image->m_iFormatCount );
+		x += n;
+		data += n * image->m_entrySize;
+		count -= n;
+	}
+}
 
-			if ( image->m_iFormatCount == 4 )
-				TIFFSetField( pOut, TIFFTAG_EXTRASAMPLES, 1, ExtraSamplesTypes );
-			TIFFSetField( pOut, TIFFTAG_PLANARCONFIG, config );
+//----------------------------------------------------------------------
+/** CloseOutput() Finish off and close the output file.
+*
+*/
 
-			TqInt row = 0;
-			for ( row = 0; row < image->m_height; row++ )
-			{
-				if ( TIFFWriteScanline( pOut, reinterpret_cast<void*>(reinterpret_cast<TqUchar*>(image->m_data) + ( row * image->m_lineLength )), row, 0 )
-				        < 0 )
-					break;
-			}
-			TIFFClose( pOut );
+void CloseOutput(SqDisplayInstance* image)
+{
+	if( image->m_imageType == Type_ZFile )
+	{
+		if ( image->m_zfile.is_open() )
+			image->m_zfile.close();
+		return;
+	}
+	if ( !image->m_tiff )
+		return;
+
+	char mydescription[80];
+	time_t long_time = SetDateTime();
+	if (description.empty())
+	{
+		double nSecs = difftime(long_time, start);
+		sprintf(mydescription,"Aqsis Renderer, %d secs rendertime", static_cast<TqInt>(nSecs));
+		start = long_time;
+	}
+	else
+	{
+		strcpy(mydescription, description.c_str());
+	}
+
+	// Write out anything which never received all its pixels, eg. if the
+	// render was aborted, so that the file is complete.
+	for ( TqInt index = 0, end = image->m_blockWritten.size(); index < end; index++ )
+	{
+		if ( image->m_blockWritten[ index ] )
+			continue;
+		std::map<TqInt, SqPendingBlock>::iterator pending = image->m_pendingBlocks.find( index );
+		if ( pending != image->m_pendingBlocks.end() )
+			WriteBlock( image, index, pending->second );
+		else
+		{
+			SqPendingBlock block;
+			block.data.assign( image->m_blockWidth * image->m_blockHeight * image->m_entrySize, 0 );
+			WriteBlock( image, index, block );
 		}
 	}
+	image->m_pendingBlocks.clear();
+
+	TIFFSetField( image->m_tiff, TIFFTAG_IMAGEDESCRIPTION, mydescription);
+	TIFFSetField( image->m_tiff, TIFFTAG_DATETIME, datetime);
+	if( image->m_imageType == Type_Shadowmap )
+	{
+		TIFFSetField( image->m_tiff, TIFFTAG_SMINSAMPLEVALUE, image->m_minZ );
+		TIFFWriteDirectory( image->m_tiff );
+	}
+	TIFFClose( image->m_tiff );
+	image->m_tiff = 0;
 }
 
 } // unnamed namespace
@@ -491,25 +603,13 @@ extern "C" PtDspyError DspyImageOpen(PtDspyImageHandle * image,
 
 		// Determine the appropriate format to save into.
 		if(widestFormat == PkDspyUnsigned8)
-		{
-			pImage->m_data = malloc( pImage->m_width * pImage->m_height * pImage->m_iFormatCount * sizeof(PtDspyUnsigned8));
 			pImage->m_entrySize = pImage->m_iFormatCount * sizeof(PtDspyUnsigned8);
-		}
 		else if(widestFormat == PkDspyUnsigned16)
-		{
-			pImage->m_data = malloc( pImage->m_width * pImage->m_height * pImage->m_iFormatCount * sizeof(PtDspyUnsigned16));
 			pImage->m_entrySize = pImage->m_iFormatCount * sizeof(PtDspyUnsigned16);
-		}
 		else if(widestFormat == PkDspyUnsigned32)
-		{
-			pImage->m_data = malloc( pImage->m_width * pImage->m_height * pImage->m_iFormatCount * sizeof(PtDspyUnsigned32));
 			pImage->m_entrySize = pImage->m_iFormatCount * sizeof(PtDspyUnsigned32);
-		}
 		else if(widestFormat == PkDspyFloat32)
-		{
-			pImage->m_data = malloc( pImage->m_width * pImage->m_height * pImage->m_iFormatCount * sizeof(PtDspyFloat32));
 			pImage->m_entrySize = pImage->m_iFormatCount * sizeof(PtDspyFloat32);
-		}
 		pImage->m_lineLength = pImage->m_entrySize * pImage->m_width;
 		pImage->m_format = widestFormat;
 
@@ -567,6 +667,15 @@ extern "C" PtDspyError DspyImageOpen(PtDspyImageHandle * image,
 			if (ydesc && *ydesc)
 				description = ydesc;
 		}
+
+		// Now we know everything about the image, open the file so the data
+		// can be written as it arrives.
+		if(!OpenOutput(pImage))
+		{
+			*image = 0;
+			delete pImage;
+			return(PkDspyErrorNoResource);
+		}
 	}
 	else
 		return(PkDspyErrorNoMemory);
@@ -599,7 +708,6 @@ extern "C" PtDspyError DspyImageData(PtDspyImageHandle image,
 	TqInt xmaxplus1__ = min((xmaxplus1-pImage->m_origin[0]), pImage->m_width);
 	TqInt ymaxplus1__ = min((ymaxplus1-pImage->m_origin[1]), pImage->m_height);
 	TqInt bucketlinelen = entrysize * (xmaxplus1 - xmin);
-	TqInt copylinelen = entrysize * (xmaxplus1__ - xmin__);
 
 	pImage->m_pixelsReceived += (xmaxplus1__-xmin__)*(ymaxplus1__-ymin__);
 
@@ -613,9 +721,8 @@ extern "C" PtDspyError DspyImageData(PtDspyImageHandle image,
 	{
 		for (TqInt y = ymin__; y < ymaxplus1__; y++ )
 		{
-			// Copy a whole row at a time, as we know it is being sent in the proper format and order.
-			TqInt so = ( y * pImage->m_lineLength ) + ( xmin__ * pImage->m_entrySize );
-			memcpy(reinterpret_cast<char*>(pImage->m_data)+so, reinterpret_cast<const void*>(pdatarow), copylinelen);
+			// Store a whole row at a time, as we know it is being sent in the proper format and order.
+			StoreRow(pImage, xmin__, y, xmaxplus1__ - xmin__, pdatarow);
 			pdatarow += bucketlinelen;
 		}
 	}
@@ -628,15 +735,10 @@ extern "C" PtDspyError DspyImageClose(PtDspyImageHandle image)
 	SqDisplayInstance* pImage;
 	pImage = reinterpret_cast<SqDisplayInstance*>(image);
 
-	// Write the image to disk
-	if( pImage->m_imageType == Type_File ||
-	        pImage->m_imageType == Type_ZFile ||
-	        pImage->m_imageType == Type_Shadowmap )
-		WriteTIFF( pImage->m_filename, pImage);
+	// Finish writing the image to disk
+	CloseOutput(pImage);
 
 	// Delete the image structure.
-	if (pImage->m_data)
-		free(pImage->m_data);
 	description = "";
 	delete(pImage);
 
@@ -650,7 +752,7 @@ extern "C" PtDspyError DspyImageDelayClose(PtDspyImageHandle image)
 	SqDisplayInstance* pImage;
 	pImage = reinterpret_cast<SqDisplayInstance*>(image);
 
-	if(pImage && pImage->m_data)
+	if(pImage)
 		return DspyImageClose(image);
 	return(PkDspyErrorNone);
 }